@@ -0,0 +1,318 @@
+
+#include "Array.h"
+
+#include <algorithm>
+#include <climits>
+#include <iterator>
+
+namespace {
+
+// indexes below this always go into the vector, no matter how sparse it is
+constexpr int MinDenseSize = 16;
+
+}
+
+/**
+ * @brief Array::isIndex
+ * @param key
+ * @param index
+ * @return true if key is the canonical decimal spelling of a non-negative int,
+ * such as "0" or "42" (but not "042", "+42" or "-42")
+ */
+bool Array::isIndex(const std::string &key, int *index) {
+
+	if (key.empty() || key.size() > 10 || (key[0] == '0' && key.size() != 1)) {
+		return false;
+	}
+
+	int64_t n = 0;
+	for (char ch : key) {
+		if (ch < '0' || ch > '9') {
+			return false;
+		}
+		n = (n * 10) + (ch - '0');
+	}
+
+	if (n > INT_MAX) {
+		return false;
+	}
+
+	*index = static_cast<int>(n);
+	return true;
+}
+
+/**
+ * @brief Array::denseAccepts
+ * @param index
+ * @return true if growing the vector to hold index would keep it at least
+ * half full. Sparse keys such as a[1000000] go into the hash table instead.
+ */
+bool Array::denseAccepts(int index) const {
+	return index < MinDenseSize || (denseCount_ + 1) * 2 > static_cast<size_t>(index);
+}
+
+/**
+ * @brief Array::find
+ * @param key
+ * @return a pointer to the value stored under key, nullptr if there is none
+ */
+DataValue *Array::find(const std::string &key) {
+
+	int index;
+	if (isIndex(key, &index)) {
+		return find(index);
+	}
+
+	auto it = hashed_.find(key);
+	if (it != hashed_.end()) {
+		return &it->second;
+	}
+
+	return nullptr;
+}
+
+/**
+ * @brief Array::find
+ * @param index
+ * @return a pointer to the value stored under the key std::to_string(index),
+ * nullptr if there is none
+ */
+DataValue *Array::find(int index) {
+
+	if (index >= 0) {
+		const auto slot = static_cast<size_t>(index);
+		if (slot < dense_.size() && !is_unset(dense_[slot])) {
+			return &dense_[slot];
+		}
+
+		if (hashedIndexes_ == 0) {
+			return nullptr;
+		}
+	}
+
+	auto it = hashed_.find(std::to_string(index));
+	if (it != hashed_.end()) {
+		return &it->second;
+	}
+
+	return nullptr;
+}
+
+/**
+ * @brief Array::insert
+ * @param key
+ * @param value
+ *
+ * inserts value under key, replacing any existing value
+ */
+void Array::insert(const std::string &key, const DataValue &value) {
+
+	int index;
+	if (isIndex(key, &index)) {
+		insert(index, value);
+		return;
+	}
+
+	insertHashed(key, value, false);
+}
+
+/**
+ * @brief Array::insert
+ * @param index
+ * @param value
+ *
+ * inserts value under the key std::to_string(index), replacing any existing
+ * value
+ */
+void Array::insert(int index, const DataValue &value) {
+
+	if (index < 0) {
+		insertHashed(std::to_string(index), value, false);
+		return;
+	}
+
+	const auto slot = static_cast<size_t>(index);
+
+	// an unset value can't be told apart from an empty slot, so it has to
+	// live in the hash table
+	if (is_unset(value)) {
+		if (slot < dense_.size() && !is_unset(dense_[slot])) {
+			dense_[slot] = DataValue();
+			--denseCount_;
+		}
+
+		insertHashed(std::to_string(index), value, true);
+		return;
+	}
+
+	if (slot >= dense_.size()) {
+		if (!denseAccepts(index)) {
+			insertHashed(std::to_string(index), value, true);
+			return;
+		}
+
+		dense_.resize(slot + 1);
+	}
+
+	DataValue &element = dense_[slot];
+	if (is_unset(element)) {
+		// the key may already be in the hash table, from before the vector
+		// was long enough to hold it
+		if (hashedIndexes_ != 0 && hashed_.erase(std::to_string(index)) != 0) {
+			--hashedIndexes_;
+		} else {
+			sortedKeys_ = nullptr;
+		}
+
+		++denseCount_;
+	}
+
+	element = value;
+}
+
+/**
+ * @brief Array::insertHashed
+ * @param key
+ * @param value
+ * @param indexKey
+ */
+void Array::insertHashed(std::string key, const DataValue &value, bool indexKey) {
+
+	auto it = hashed_.find(key);
+	if (it != hashed_.end()) {
+		it->second = value;
+		return;
+	}
+
+	hashed_.emplace(std::move(key), value);
+	if (indexKey) {
+		++hashedIndexes_;
+	}
+
+	sortedKeys_ = nullptr;
+}
+
+/**
+ * @brief Array::erase
+ * @param key
+ */
+void Array::erase(const std::string &key) {
+
+	int index;
+	if (isIndex(key, &index)) {
+		erase(index);
+		return;
+	}
+
+	if (hashed_.erase(key) != 0) {
+		sortedKeys_ = nullptr;
+	}
+}
+
+/**
+ * @brief Array::erase
+ * @param index
+ */
+void Array::erase(int index) {
+
+	if (index >= 0) {
+		const auto slot = static_cast<size_t>(index);
+		if (slot < dense_.size() && !is_unset(dense_[slot])) {
+			dense_[slot] = DataValue();
+			--denseCount_;
+			sortedKeys_ = nullptr;
+			return;
+		}
+
+		if (hashedIndexes_ != 0 && hashed_.erase(std::to_string(index)) != 0) {
+			--hashedIndexes_;
+			sortedKeys_ = nullptr;
+		}
+		return;
+	}
+
+	if (hashed_.erase(std::to_string(index)) != 0) {
+		sortedKeys_ = nullptr;
+	}
+}
+
+/**
+ * @brief Array::clear
+ */
+void Array::clear() {
+	dense_.clear();
+	hashed_.clear();
+	denseCount_    = 0;
+	hashedIndexes_ = 0;
+	sortedKeys_    = nullptr;
+}
+
+/**
+ * @brief Array::size
+ * @return
+ */
+size_t Array::size() const {
+	return denseCount_ + hashed_.size();
+}
+
+/**
+ * @brief Array::sortedKeys
+ * @return all keys of the array, in the order which macros iterate them
+ *
+ * The list is built on first use and shared with every iteration which
+ * starts before the set of keys changes again.
+ */
+std::shared_ptr<const Array::KeyList> Array::sortedKeys() {
+
+	if (!sortedKeys_) {
+		KeyList hashed;
+		hashed.reserve(hashed_.size());
+
+		for (const auto &entry : hashed_) {
+			hashed.push_back(entry.first);
+		}
+
+		std::sort(hashed.begin(), hashed.end());
+
+		/* the indexes are visited in string order ("0", "1", "10", "100",
+		 * "11", ... "2", ...) to begin with, so only the hashed keys need
+		 * sorting, which is where most of the time went for large arrays */
+		KeyList dense;
+		dense.reserve(denseCount_);
+
+		if (!dense_.empty()) {
+			const size_t last = dense_.size() - 1;
+
+			if (!is_unset(dense_[0])) {
+				dense.push_back("0");
+			}
+
+			size_t index = 1;
+			for (size_t i = 0; i < last; ++i) {
+				if (!is_unset(dense_[index])) {
+					dense.push_back(std::to_string(index));
+				}
+
+				if (index * 10 <= last) {
+					index *= 10;
+				} else {
+					if (index >= last) {
+						index /= 10;
+					}
+
+					++index;
+					while (index % 10 == 0) {
+						index /= 10;
+					}
+				}
+			}
+		}
+
+		auto keys = std::make_shared<KeyList>();
+		keys->reserve(dense.size() + hashed.size());
+		std::merge(std::make_move_iterator(dense.begin()), std::make_move_iterator(dense.end()), std::make_move_iterator(hashed.begin()), std::make_move_iterator(hashed.end()), std::back_inserter(*keys));
+		sortedKeys_ = std::move(keys);
+	}
+
+	return sortedKeys_;
+}
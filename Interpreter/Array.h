@@ -0,0 +1,73 @@
+
+#ifndef ARRAY_H_
+#define ARRAY_H_
+
+#include "DataValue.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The storage behind a macro language array.
+ *
+ * Keys are always strings as far as macros are concerned, but the keys
+ * "0", "1", "2", ... which most macros use (split() results, $args, counting
+ * loops) are stored in a vector indexed directly by their integer value.
+ * Every other key lives in a hash table. Iteration still visits the keys in
+ * sorted (string) order, that order is only produced when an iteration starts
+ * and is cached until the set of keys changes.
+ */
+class Array {
+public:
+	using KeyList = std::vector<std::string>;
+
+public:
+	DataValue *find(const std::string &key);
+	DataValue *find(int index);
+	void insert(const std::string &key, const DataValue &value);
+	void insert(int index, const DataValue &value);
+	void erase(const std::string &key);
+	void erase(int index);
+	void clear();
+	size_t size() const;
+	std::shared_ptr<const KeyList> sortedKeys();
+
+public:
+	/**
+	 * @brief calls func(key, value) for every element, in no particular order
+	 */
+	template <class Func>
+	void forEach(Func func) const {
+		for (size_t i = 0; i < dense_.size(); ++i) {
+			if (!is_unset(dense_[i])) {
+				func(std::to_string(i), dense_[i]);
+			}
+		}
+
+		for (const auto &entry : hashed_) {
+			func(entry.first, entry.second);
+		}
+	}
+
+private:
+	static bool isIndex(const std::string &key, int *index);
+	bool denseAccepts(int index) const;
+	void insertHashed(std::string key, const DataValue &value, bool indexKey);
+
+private:
+	// slots for the keys "0" .. "N", empty slots hold an unset value
+	std::vector<DataValue> dense_;
+	size_t denseCount_ = 0;
+
+	std::unordered_map<std::string, DataValue> hashed_;
+
+	// number of keys in hashed_ which look like an index, but were too sparse
+	// to go into dense_ when they were inserted
+	size_t hashedIndexes_ = 0;
+
+	std::shared_ptr<const KeyList> sortedKeys_;
+};
+
+#endif
@@ -6,15 +6,16 @@
 
 #include <gsl/span>
 
-#include <map>
 #include <memory>
 #include <string>
 #include <system_error>
+#include <vector>
 
 #include <boost/variant.hpp>
 
 #include <QString>
 
+class Array;
 class DocumentWidget;
 struct DataValue;
 struct Program;
@@ -22,15 +23,16 @@ union Inst;
 
 using Arguments      = gsl::span<DataValue>;
 using LibraryRoutine = std::error_code (*)(DocumentWidget *document, Arguments arguments, DataValue *result);
-using Array          = std::map<std::string, DataValue>;
 using ArrayPtr       = std::shared_ptr<Array>;
 
 // we use a kind of "fat iterator", because the arrayIter function
-// needs to know if the iterator is at the end of the map. This requirement
-// means that we need a reference to the map to compare against
+// needs to check that a key is still in the array before handing it out.
+// The keys are a snapshot of the sorted key list taken when the iteration
+// started, so modifying the array inside the loop can't invalidate it
 struct ArrayIterator {
 	ArrayPtr m;
-	Array::iterator it;
+	std::shared_ptr<const std::vector<std::string>> keys;
+	size_t index;
 };
 
 using Data = boost::variant<
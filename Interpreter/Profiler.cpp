@@ -0,0 +1,355 @@
+
+#include "Profiler.h"
+#include "interpret.h"
+
+#include <QString>
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace Profiler {
+
+bool Active = false;
+
+namespace {
+
+// the most lines listed in a report
+constexpr size_t MaxReportedLines = 50;
+
+struct Frame {
+	std::string name;
+	const Program *prog;
+	const DataValue *frame; // the frame pointer of the call, to match it with its return
+	Clock::time_point start;
+	Clock::duration children;
+};
+
+struct FunctionStats {
+	uint64_t calls = 0;
+	Clock::duration inclusive{0};
+	Clock::duration exclusive{0};
+	bool builtin = false;
+};
+
+struct LineStats {
+	uint64_t samples = 0;
+	Clock::duration builtinTime{0}; // spent in built-in subroutines called from the line
+};
+
+using LineKey = std::pair<std::string, int>;
+
+// only ever used from the GUI thread
+std::map<std::string, FunctionStats> Functions;
+std::map<LineKey, LineStats> Lines;
+uint64_t Samples = 0;
+
+// bumped on every start, call stacks from before then are thrown away
+uint64_t Generation = 0;
+
+/**
+ * @brief lineOf
+ * @param prog
+ * @param pc
+ * @return the line "pc" was compiled from, or 0 if it isn't known
+ */
+int lineOf(const Program *prog, const Inst *pc) {
+	if (!prog || !pc || pc < prog->code.data()) {
+		return 0;
+	}
+
+	const auto index = static_cast<size_t>(pc - prog->code.data());
+	if (index >= prog->lines.size()) {
+		return 0;
+	}
+
+	return prog->lines[index];
+}
+
+/**
+ * @brief milliseconds
+ * @param d
+ * @return
+ */
+double milliseconds(Clock::duration d) {
+	return std::chrono::duration<double, std::milli>(d).count();
+}
+
+}
+
+struct CallStack {
+	std::vector<Frame> frames;
+	uint64_t generation = Generation;
+	Clock::time_point suspendedAt;
+	bool suspended = false;
+};
+
+namespace {
+
+/**
+ * @brief callStack
+ * @param context
+ * @return the call stack of the macro running in "context", made empty if
+ * it is left over from an earlier profile
+ */
+CallStack *callStack(MacroContext *context) {
+
+	if (!context->Profile) {
+		context->Profile = std::make_shared<CallStack>();
+	} else if (context->Profile->generation != Generation) {
+		context->Profile->frames.clear();
+		context->Profile->generation = Generation;
+		context->Profile->suspended  = false;
+	}
+
+	return context->Profile.get();
+}
+
+}
+
+/**
+ * @brief start
+ *
+ * Throws away what was gathered so far and starts profiling every macro
+ */
+void start() {
+	reset();
+	Active = true;
+}
+
+/**
+ * @brief stop
+ *
+ * Stops profiling, what was gathered is kept for the report
+ */
+void stop() {
+	Active = false;
+}
+
+/**
+ * @brief reset
+ */
+void reset() {
+	Functions.clear();
+	Lines.clear();
+	Samples = 0;
+	++Generation;
+}
+
+/**
+ * @brief enter
+ * @param context
+ * @param name
+ * @param prog
+ * @param frame
+ *
+ * A macro function, or a macro run as one, is being called
+ */
+void enter(MacroContext *context, const std::string &name, const Program *prog, const DataValue *frame) {
+	CallStack *stack = callStack(context);
+	stack->frames.push_back(Frame{name, prog, frame, Clock::now(), Clock::duration::zero()});
+}
+
+/**
+ * @brief leave
+ * @param context
+ * @param frame
+ *
+ * The macro function called with "frame" returns. Functions which were
+ * called before profiling started aren't on the call stack and are ignored
+ */
+void leave(MacroContext *context, const DataValue *frame) {
+
+	CallStack *stack = callStack(context);
+	if (stack->frames.empty() || stack->frames.back().frame != frame) {
+		return;
+	}
+
+	const Frame f = std::move(stack->frames.back());
+	stack->frames.pop_back();
+
+	const Clock::duration elapsed = Clock::now() - f.start;
+
+	FunctionStats &stats = Functions[f.name];
+	++stats.calls;
+	stats.exclusive += elapsed - f.children;
+
+	// the time of a recursive call is already part of the outer call
+	const bool recursive = std::any_of(stack->frames.begin(), stack->frames.end(), [&f](const Frame &caller) {
+		return caller.name == f.name;
+	});
+
+	if (!recursive) {
+		stats.inclusive += elapsed;
+	}
+
+	if (!stack->frames.empty()) {
+		stack->frames.back().children += elapsed;
+	}
+}
+
+/**
+ * @brief builtin
+ * @param context
+ * @param name
+ * @param pc where it was called from
+ * @param elapsed
+ *
+ * A built-in subroutine was called and has returned
+ */
+void builtin(MacroContext *context, const std::string &name, const Inst *pc, Clock::duration elapsed) {
+
+	FunctionStats &stats = Functions[name];
+	++stats.calls;
+	stats.inclusive += elapsed;
+	stats.exclusive += elapsed;
+	stats.builtin = true;
+
+	CallStack *stack = callStack(context);
+	if (!stack->frames.empty()) {
+		Frame &caller = stack->frames.back();
+		caller.children += elapsed;
+		Lines[LineKey(caller.name, lineOf(caller.prog, pc))].builtinTime += elapsed;
+	}
+}
+
+/**
+ * @brief sample
+ * @param context
+ * @param pc
+ *
+ * Notes which line the macro running in "context" is at
+ */
+void sample(const MacroContext *context, const Inst *pc) {
+
+	const CallStack *stack = context->Profile.get();
+	if (!stack || stack->generation != Generation || stack->frames.empty()) {
+		return;
+	}
+
+	const Frame &current = stack->frames.back();
+	++Lines[LineKey(current.name, lineOf(current.prog, pc))].samples;
+	++Samples;
+}
+
+/**
+ * @brief suspend
+ * @param context
+ *
+ * The macro running in "context" was preempted
+ */
+void suspend(MacroContext *context) {
+	CallStack *stack   = callStack(context);
+	stack->suspendedAt = Clock::now();
+	stack->suspended   = true;
+}
+
+/**
+ * @brief resume
+ * @param context
+ *
+ * The macro running in "context" continues, the time it was waiting is left
+ * out by moving the start of the calls in progress forward by as much
+ */
+void resume(MacroContext *context) {
+
+	CallStack *stack = callStack(context);
+	if (!stack->suspended) {
+		return;
+	}
+
+	const Clock::duration waited = Clock::now() - stack->suspendedAt;
+	for (Frame &f : stack->frames) {
+		f.start += waited;
+	}
+
+	stack->suspended = false;
+}
+
+/**
+ * @brief finish
+ * @param context
+ *
+ * The macro running in "context" has ended, possibly with an error, in
+ * which case the calls in progress end with it
+ */
+void finish(MacroContext *context) {
+
+	CallStack *stack = callStack(context);
+	while (!stack->frames.empty()) {
+		leave(context, stack->frames.back().frame);
+	}
+}
+
+/**
+ * @brief report
+ * @return a table of the time spent in each function and the lines most of
+ * it was spent on, as plain text
+ */
+QString report() {
+
+	std::vector<std::pair<std::string, FunctionStats>> functions(Functions.begin(), Functions.end());
+	std::sort(functions.begin(), functions.end(), [](const std::pair<std::string, FunctionStats> &lhs, const std::pair<std::string, FunctionStats> &rhs) {
+		return lhs.second.exclusive > rhs.second.exclusive;
+	});
+
+	std::vector<std::pair<LineKey, LineStats>> lines(Lines.begin(), Lines.end());
+	std::sort(lines.begin(), lines.end(), [](const std::pair<LineKey, LineStats> &lhs, const std::pair<LineKey, LineStats> &rhs) {
+		if (lhs.second.samples != rhs.second.samples) {
+			return lhs.second.samples > rhs.second.samples;
+		}
+		return lhs.second.builtinTime > rhs.second.builtinTime;
+	});
+
+	// every moment is spent in exactly one function
+	Clock::duration total{0};
+	for (const std::pair<std::string, FunctionStats> &function : functions) {
+		total += function.second.exclusive;
+	}
+
+	QString text;
+	text += QStringLiteral("Macro profile: %1 ms in %2 functions, %3 samples\n\n")
+				.arg(milliseconds(total), 0, 'f', 3)
+				.arg(functions.size())
+				.arg(Samples);
+
+	text += QStringLiteral("%1 %2 %3 %4 %5\n")
+				.arg(QStringLiteral("Function"), -40)
+				.arg(QStringLiteral("Calls"), 10)
+				.arg(QStringLiteral("Total ms"), 12)
+				.arg(QStringLiteral("Self ms"), 12)
+				.arg(QStringLiteral("Self %"), 7);
+
+	for (const std::pair<std::string, FunctionStats> &function : functions) {
+		const FunctionStats &stats = function.second;
+		const QString name         = QString::fromStdString(function.first) + (stats.builtin ? QStringLiteral(" (built-in)") : QString());
+		const double share         = (total.count() != 0) ? 100.0 * static_cast<double>(stats.exclusive.count()) / static_cast<double>(total.count()) : 0.0;
+
+		text += QStringLiteral("%1 %2 %3 %4 %5\n")
+					.arg(name, -40)
+					.arg(stats.calls, 10)
+					.arg(milliseconds(stats.inclusive), 12, 'f', 3)
+					.arg(milliseconds(stats.exclusive), 12, 'f', 3)
+					.arg(share, 7, 'f', 1);
+	}
+
+	text += QStringLiteral("\n%1 %2 %3\n")
+				.arg(QStringLiteral("Line"), -40)
+				.arg(QStringLiteral("Samples"), 10)
+				.arg(QStringLiteral("Built-in ms"), 12);
+
+	lines.resize(std::min(lines.size(), MaxReportedLines));
+	for (const std::pair<LineKey, LineStats> &line : lines) {
+		const QString where = QStringLiteral("%1:%2").arg(QString::fromStdString(line.first.first)).arg(line.first.second);
+
+		text += QStringLiteral("%1 %2 %3\n")
+					.arg(where, -40)
+					.arg(line.second.samples, 10)
+					.arg(milliseconds(line.second.builtinTime), 12, 'f', 3);
+	}
+
+	return text;
+}
+
+}
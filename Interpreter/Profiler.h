@@ -0,0 +1,57 @@
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+class QString;
+struct DataValue;
+union Inst;
+struct MacroContext;
+struct Program;
+
+/*
+ * An opt-in profiler for the macro interpreter.
+ *
+ * While it is running, the interpreter reports every call of a macro
+ * function and of a built-in subroutine, from which the number of calls and
+ * the inclusive and exclusive time of each are gathered. Every few hundred
+ * instructions it also samples where it is, which together with the line
+ * each instruction was compiled from tells which lines the time goes to.
+ *
+ * Each macro keeps its own call stack (see MacroContext::Profile), so macros
+ * which take turns running in different documents don't get mixed up, and
+ * the time a macro spends preempted, waiting for its next time slice, isn't
+ * counted.
+ */
+namespace Profiler {
+
+using Clock = std::chrono::steady_clock;
+
+struct CallStack;
+
+extern bool Active;
+
+inline bool active() noexcept {
+	return Active;
+}
+
+void start();
+void stop();
+void reset();
+QString report();
+
+// called by the interpreter
+void enter(MacroContext *context, const std::string &name, const Program *prog, const DataValue *frame);
+void leave(MacroContext *context, const DataValue *frame);
+void builtin(MacroContext *context, const std::string &name, const Inst *pc, Clock::duration elapsed);
+void sample(const MacroContext *context, const Inst *pc);
+void suspend(MacroContext *context);
+void resume(MacroContext *context);
+void finish(MacroContext *context);
+
+}
+
+#endif
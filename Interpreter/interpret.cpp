@@ -1,13 +1,22 @@
 
 #include "interpret.h"
+#include "Profiler.h"
+#include "Util/Instrumentation.h"
 #include "Util/utils.h"
 #include <cassert>
+#include <chrono>
+#include <climits>
 #include <cmath>
 #include <gsl/gsl_util>
 
 // This enables preemption, useful to disable it for debugging things
 #define ENABLE_PREEMPTION
 
+// Use GCC's "labels as values" extension for threaded dispatch when available
+#if defined(__GNUC__)
+#define USE_COMPUTED_GOTO
+#endif
+
 // #define DEBUG_ASSEMBLY
 // #define DEBUG_STACK
 
@@ -16,10 +25,12 @@ namespace {
 // Maximum stack size
 constexpr int STACK_SIZE = 1024;
 
-constexpr int PROGRAM_SIZE      = 4096; // Maximum program size
-constexpr int MAX_ERR_MSG_LEN   = 256;  // Max. length for error messages
-constexpr int LOOP_STACK_SIZE   = 200;  // (Approx.) Number of break/continue stmts allowed per program
-constexpr int INSTRUCTION_LIMIT = 100;  // Number of instructions the interpreter is allowed to execute before preempting and returning to allow other things to run
+constexpr int PROGRAM_SIZE         = 4096; // Maximum program size
+constexpr int MAX_ERR_MSG_LEN      = 256;  // Max. length for error messages
+constexpr int LOOP_STACK_SIZE      = 200;  // (Approx.) Number of break/continue stmts allowed per program
+constexpr int CLOCK_CHECK_INTERVAL = 256;  // Number of instructions executed between checks of the time slice
+
+constexpr auto TIME_SLICE = std::chrono::milliseconds(10); // Time the interpreter is allowed to run before preempting and returning to allow other things to run
 
 /* Temporary markers placed in a branch address location to designate
    which loop address (break or continue) the location needs */
@@ -46,12 +57,27 @@ constexpr const char CantConvertArrayToString[]  = "can't convert array to strin
 
 const auto MacroTooLarge = QLatin1String("macro too large");
 
+// the key addressing an array element, as built from the sub-scripts on the
+// stack. A single integer sub-script is kept as an integer so that the array
+// can look it up without converting it to a string first
+struct ArrayKey {
+	std::string string;
+	int index    = 0;
+	bool isIndex = false;
+
+	std::string toString() const {
+		return isIndex ? std::to_string(index) : string;
+	}
+};
+
 // Global symbols and function definitions
 std::deque<Symbol *> GlobalSymList;
 
 // Temporary global data for use while accumulating programs
 std::deque<Symbol *> LocalSymList; // symbols local to the program
 Inst Prog[PROGRAM_SIZE];           // the program
+int ProgLines[PROGRAM_SIZE];       // the source line of each element of the program
+int SourceLine;                    // the source line being compiled
 Inst *ProgP;                       // next free spot for code gen.
 Inst *LoopStack[LOOP_STACK_SIZE];  // addresses of break, cont stmts
 Inst **LoopStackPtr = LoopStack;   //  to fill at the end of a loop
@@ -110,8 +136,10 @@ void saveContext(Pointer context) {
 	context->StackP        = Context.StackP;
 	context->FrameP        = Context.FrameP;
 	context->PC            = Context.PC;
+	context->RetValFetched = Context.RetValFetched;
 	context->RunDocument   = Context.RunDocument;
 	context->FocusDocument = Context.FocusDocument;
+	context->Profile       = Context.Profile;
 }
 
 template <class Pointer>
@@ -120,8 +148,10 @@ void restoreContext(Pointer context) {
 	Context.StackP        = context->StackP;
 	Context.FrameP        = context->FrameP;
 	Context.PC            = context->PC;
+	Context.RetValFetched = context->RetValFetched;
 	Context.RunDocument   = context->RunDocument;
 	Context.FocusDocument = context->FocusDocument;
+	Context.Profile       = context->Profile;
 }
 
 /*
@@ -211,9 +241,18 @@ static int beginArrayIter();
 static int arrayIter();
 static int inArray();
 static int deleteArrayElement();
-
+static int gtBranchFalse();
+static int ltBranchFalse();
+static int geBranchFalse();
+static int leBranchFalse();
+static int eqBranchFalse();
+static int neBranchFalse();
+static void optimizeProgram(std::vector<Inst> &code, std::vector<int> &lines);
+
+static int makeArrayKeyFromArgs(int64_t nArgs, ArrayKey *key, bool leaveParams);
+static DataValue *arrayFind(const DataValue &theArray, const ArrayKey &key);
 static ArrayIterator arrayIterateFirst(DataValue *theArray);
-static ArrayIterator arrayIterateNext(ArrayIterator iterator);
+static bool arrayIterateNext(ArrayIterator *iterator, std::string *key);
 
 #if defined(DEBUG_ASSEMBLY) || defined(DEBUG_STACK)
 #define DEBUG_DISASSEMBLER
@@ -284,6 +323,12 @@ static const operation_type OpFns[N_OPS] = {
 	pushArgVal,
 	pushArgCount,
 	pushArgArray,
+	gtBranchFalse,
+	ltBranchFalse,
+	geBranchFalse,
+	leBranchFalse,
+	eqBranchFalse,
+	neBranchFalse,
 };
 
 /*
@@ -329,6 +374,15 @@ void BeginCreatingProgram() {
 	LocalSymList.clear();
 	ProgP        = Prog;
 	LoopStackPtr = LoopStack;
+	SourceLine   = 0;
+}
+
+/*
+** Set the line of the macro source which the instructions added from now on
+** are compiled from, for the profiler to map them back to
+*/
+void SetSourceLine(int line) {
+	SourceLine = line;
 }
 
 /*
@@ -340,6 +394,7 @@ Program *FinishCreatingProgram() {
 
 	auto newProg = std::make_unique<Program>();
 	std::copy(Prog, ProgP, std::back_inserter(newProg->code));
+	std::copy(ProgLines, ProgLines + (ProgP - Prog), std::back_inserter(newProg->lines));
 
 	newProg->localSymList = LocalSymList;
 	LocalSymList.clear();
@@ -352,6 +407,8 @@ Program *FinishCreatingProgram() {
 		s->value = make_value(fpOffset++);
 	}
 
+	optimizeProgram(newProg->code, newProg->lines);
+
 	DISASM(newProg->code.data(), newProg->code.size());
 	return newProg.release();
 }
@@ -365,7 +422,8 @@ bool AddOp(int op, QString *msg) {
 		return false;
 	}
 
-	ProgP++->func = OpFns[op];
+	ProgLines[ProgP - Prog] = SourceLine;
+	ProgP++->op             = static_cast<Operations>(op);
 	return true;
 }
 
@@ -378,7 +436,8 @@ bool AddSym(Symbol *sym, QString *msg) {
 		return false;
 	}
 
-	ProgP++->sym = sym;
+	ProgLines[ProgP - Prog] = SourceLine;
+	ProgP++->sym            = sym;
 	return true;
 }
 
@@ -391,7 +450,8 @@ bool AddImmediate(int value, QString *msg) {
 		return false;
 	}
 
-	ProgP++->value = value;
+	ProgLines[ProgP - Prog] = SourceLine;
+	ProgP++->value          = value;
 	return true;
 }
 
@@ -407,7 +467,8 @@ bool AddBranchOffset(const Inst *to, QString *msg) {
 	/* we don't use gsl::narrow here because when to is nullptr (to indicate
 	 * end of program) it produces values that won't fit into an int on
 	 * 64-bit systems */
-	ProgP->value = static_cast<int>(to - ProgP);
+	ProgLines[ProgP - Prog] = SourceLine;
+	ProgP->value            = static_cast<int>(to - ProgP);
 	ProgP++;
 	return true;
 }
@@ -431,6 +492,11 @@ void SwapCode(Inst *start, Inst *boundary, Inst *end) {
 	std::reverse(start, boundary); // 1
 	std::reverse(boundary, end);   // 2
 	std::reverse(start, end);      // 3
+
+	// and the same for the lines they came from
+	std::reverse(ProgLines + (start - Prog), ProgLines + (boundary - Prog));
+	std::reverse(ProgLines + (boundary - Prog), ProgLines + (end - Prog));
+	std::reverse(ProgLines + (start - Prog), ProgLines + (end - Prog));
 }
 
 /*
@@ -497,14 +563,399 @@ void FillLoopAddrs(const Inst *breakAddr, const Inst *continueAddr) {
 	}
 }
 
+/*
+** Number of operands following each operation in the program
+** Must correspond to the enum called "operations" in interpret.h
+*/
+static const int OpOperands[N_OPS] = {
+	0, // OP_RETURN_NO_VAL
+	0, // OP_RETURN
+	1, // OP_PUSH_SYM
+	0, // OP_DUP
+	0, // OP_ADD
+	0, // OP_SUB
+	0, // OP_MUL
+	0, // OP_DIV
+	0, // OP_MOD
+	0, // OP_NEGATE
+	0, // OP_INCR
+	0, // OP_DECR
+	0, // OP_GT
+	0, // OP_LT
+	0, // OP_GE
+	0, // OP_LE
+	0, // OP_EQ
+	0, // OP_NE
+	0, // OP_BIT_AND
+	0, // OP_BIT_OR
+	0, // OP_AND
+	0, // OP_OR
+	0, // OP_NOT
+	0, // OP_POWER
+	0, // OP_CONCAT
+	1, // OP_ASSIGN
+	2, // OP_SUBR_CALL
+	0, // OP_FETCH_RET_VAL
+	1, // OP_BRANCH
+	1, // OP_BRANCH_TRUE
+	1, // OP_BRANCH_FALSE
+	1, // OP_BRANCH_NEVER
+	1, // OP_ARRAY_REF
+	1, // OP_ARRAY_ASSIGN
+	1, // OP_BEGIN_ARRAY_ITER
+	3, // OP_ARRAY_ITER
+	0, // OP_IN_ARRAY
+	1, // OP_ARRAY_DELETE
+	2, // OP_PUSH_ARRAY_SYM
+	2, // OP_ARRAY_REF_ASSIGN_SETUP
+	0, // OP_PUSH_ARG
+	0, // OP_PUSH_ARG_COUNT
+	0, // OP_PUSH_ARG_ARRAY
+	1, // OP_GT_BRANCH_FALSE
+	1, // OP_LT_BRANCH_FALSE
+	1, // OP_GE_BRANCH_FALSE
+	1, // OP_LE_BRANCH_FALSE
+	1, // OP_EQ_BRANCH_FALSE
+	1, // OP_NE_BRANCH_FALSE
+};
+
+/*
+** Returns the index (relative to the operation) of the operand holding a
+** branch offset, or 0 if the operation doesn't branch
+*/
+static int branchOperand(Operations op) {
+	switch (op) {
+	case OP_BRANCH:
+	case OP_BRANCH_TRUE:
+	case OP_BRANCH_FALSE:
+	case OP_BRANCH_NEVER:
+	case OP_GT_BRANCH_FALSE:
+	case OP_LT_BRANCH_FALSE:
+	case OP_GE_BRANCH_FALSE:
+	case OP_LE_BRANCH_FALSE:
+	case OP_EQ_BRANCH_FALSE:
+	case OP_NE_BRANCH_FALSE:
+		return 1;
+	case OP_ARRAY_ITER:
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+/*
+** Returns the compare and branch superinstruction replacing "op" followed by
+** OP_BRANCH_FALSE, or OP_BRANCH_FALSE itself if there is none
+*/
+static Operations fusedBranchFalse(Operations op) {
+	switch (op) {
+	case OP_GT:
+		return OP_GT_BRANCH_FALSE;
+	case OP_LT:
+		return OP_LT_BRANCH_FALSE;
+	case OP_GE:
+		return OP_GE_BRANCH_FALSE;
+	case OP_LE:
+		return OP_LE_BRANCH_FALSE;
+	case OP_EQ:
+		return OP_EQ_BRANCH_FALSE;
+	case OP_NE:
+		return OP_NE_BRANCH_FALSE;
+	default:
+		return OP_BRANCH_FALSE;
+	}
+}
+
+/*
+** find or install the constant symbol for an integer, named the same way as
+** the ones the parser creates for number literals
+*/
+static Symbol *installIntegerConstSymbol(int value) {
+
+	const std::string name = "const " + std::to_string(value);
+
+	if (Symbol *sym = LookupSymbol(name)) {
+		return sym;
+	}
+
+	return InstallSymbol(name, CONST_SYM, make_value(value));
+}
+
+/*
+** Evaluate "op" applied to two constants at compile time. Returns nullptr
+** if the operation can't be folded, either because it depends on run-time
+** state or because it would fail (eg. division by zero), in which case the
+** error is left to be reported when the macro runs.
+*/
+static Symbol *foldBinaryOperation(Operations op, const Symbol *left, const Symbol *right) {
+
+	if (op == OP_CONCAT) {
+		if ((is_string(left->value) || is_integer(left->value)) && (is_string(right->value) || is_integer(right->value))) {
+			return InstallStringConstSymbol(to_string(left->value) + to_string(right->value));
+		}
+		return nullptr;
+	}
+
+	if ((op == OP_EQ || op == OP_NE) && is_string(left->value) && is_string(right->value)) {
+		const bool equal = (to_string(left->value) == to_string(right->value));
+		return installIntegerConstSymbol((op == OP_EQ) ? equal : !equal);
+	}
+
+	if (!is_integer(left->value) || !is_integer(right->value)) {
+		return nullptr;
+	}
+
+	const int64_t n1 = to_integer(left->value);
+	const int64_t n2 = to_integer(right->value);
+	int64_t r;
+
+	switch (op) {
+	case OP_ADD:
+		r = n1 + n2;
+		break;
+	case OP_SUB:
+		r = n1 - n2;
+		break;
+	case OP_MUL:
+		r = n1 * n2;
+		break;
+	case OP_DIV:
+		if (n2 == 0) {
+			return nullptr;
+		}
+		r = n1 / n2;
+		break;
+	case OP_MOD:
+		if (n2 == 0) {
+			return nullptr;
+		}
+		r = n1 % n2;
+		break;
+	case OP_GT:
+		r = n1 > n2;
+		break;
+	case OP_LT:
+		r = n1 < n2;
+		break;
+	case OP_GE:
+		r = n1 >= n2;
+		break;
+	case OP_LE:
+		r = n1 <= n2;
+		break;
+	case OP_EQ:
+		r = n1 == n2;
+		break;
+	case OP_NE:
+		r = n1 != n2;
+		break;
+	case OP_BIT_AND:
+		r = n1 & n2;
+		break;
+	case OP_BIT_OR:
+		r = n1 | n2;
+		break;
+	default:
+		return nullptr;
+	}
+
+	// leave overflow to happen at run-time, the same way it always has
+	if (r > INT_MAX || r < INT_MIN) {
+		return nullptr;
+	}
+
+	return installIntegerConstSymbol(static_cast<int>(r));
+}
+
+static Symbol *foldUnaryOperation(Operations op, const Symbol *operand) {
+
+	if (!is_integer(operand->value)) {
+		return nullptr;
+	}
+
+	const int n = to_integer(operand->value);
+
+	switch (op) {
+	case OP_NEGATE:
+		return (n == INT_MIN) ? nullptr : installIntegerConstSymbol(-n);
+	case OP_NOT:
+		return installIntegerConstSymbol(!n);
+	default:
+		return nullptr;
+	}
+}
+
+/*
+** Peephole optimizer, run on a program once the parser has finished with it
+** (and all branch offsets are resolved).
+**
+** Expressions on constants are folded into a single OP_PUSH_SYM of the result,
+** and a comparison followed by OP_BRANCH_FALSE (which is what every "if",
+** "while" and "for" condition compiles to) is fused into a single compare
+** and branch instruction. Instructions which are the target of a branch are
+** never merged into the instruction before them. Branch offsets are relocated
+** to account for the removed instructions.
+**
+** Programs which failed to parse may have unresolved branches, so if any
+** branch doesn't land on an instruction, the program is left untouched.
+**
+** "lines" holds the source line of each element of "code" and is kept in
+** step with it, an instruction made from several takes the line of the first.
+**
+** The result is still code for the stack machine the parser generates for,
+** it isn't translated into register based code. The time left in a loop after
+** this goes mostly into copying DataValues on and off the stack rather than
+** into dispatch.
+*/
+static void optimizeProgram(std::vector<Inst> &code, std::vector<int> &lines) {
+
+	const size_t size = code.size();
+
+	// find where instructions begin and which ones are branched to
+	std::vector<bool> isStart(size + 1, false);
+	std::vector<bool> isTarget(size + 1, false);
+
+	for (size_t i = 0; i < size;) {
+		const int op = code[i].op;
+		if (op < 0 || op >= N_OPS || i + OpOperands[op] >= size) {
+			return;
+		}
+
+		if (const int operand = branchOperand(code[i].op)) {
+			const int64_t target = static_cast<int64_t>(i + operand) + code[i + operand].value;
+			if (target < 0 || target > static_cast<int64_t>(size)) {
+				return;
+			}
+			isTarget[static_cast<size_t>(target)] = true;
+		}
+
+		isStart[i] = true;
+		i += 1 + OpOperands[op];
+	}
+
+	isStart[size] = true;
+
+	for (size_t i = 0; i <= size; ++i) {
+		if (isTarget[i] && !isStart[i]) {
+			return;
+		}
+	}
+
+	struct Emitted {
+		size_t start;  // position in the optimized code
+		size_t origin; // position in the original code
+	};
+
+	struct Relocation {
+		size_t operand; // position of the branch offset in the optimized code
+		size_t target;  // branch destination in the original code
+	};
+
+	std::vector<Inst> out;
+	std::vector<Emitted> emitted;
+	std::vector<Relocation> relocations;
+	std::vector<size_t> newIndex(size + 1);
+
+	out.reserve(size);
+
+	// is the n'th most recently emitted instruction a push of a constant?
+	auto constantPushed = [&](size_t n) -> Symbol * {
+		if (emitted.size() < n) {
+			return nullptr;
+		}
+
+		const Emitted &e = emitted[emitted.size() - n];
+		if (out[e.start].op != OP_PUSH_SYM || out[e.start + 1].sym->type != CONST_SYM) {
+			return nullptr;
+		}
+
+		return out[e.start + 1].sym;
+	};
+
+	// replace the last "count" instructions with a push of "sym"
+	auto replaceWithPush = [&](size_t count, Symbol *sym) {
+		const Emitted first = emitted[emitted.size() - count];
+		emitted.resize(emitted.size() - count);
+		out.resize(first.start);
+
+		emitted.push_back(Emitted{out.size(), first.origin});
+		out.push_back(Inst{OP_PUSH_SYM});
+		out.emplace_back();
+		out.back().sym = sym;
+	};
+
+	for (size_t i = 0; i < size; i += 1 + OpOperands[code[i].op]) {
+
+		const Operations op = code[i].op;
+		newIndex[i]         = out.size();
+
+		// an instruction can only be merged with the ones before it if nothing branches to it
+		if (!isTarget[i]) {
+			if (op == OP_NEGATE || op == OP_NOT) {
+				if (Symbol *operand = constantPushed(1)) {
+					if (Symbol *folded = foldUnaryOperation(op, operand)) {
+						replaceWithPush(1, folded);
+						continue;
+					}
+				}
+			} else if (op == OP_BRANCH_FALSE && !emitted.empty()) {
+				const size_t last = emitted.back().start;
+				const Operations fused = fusedBranchFalse(out[last].op);
+				if (fused != OP_BRANCH_FALSE) {
+					out[last].op = fused;
+					relocations.push_back(Relocation{out.size(), i + 1 + static_cast<size_t>(code[i + 1].value)});
+					out.push_back(code[i + 1]);
+					continue;
+				}
+			} else {
+				Symbol *right = constantPushed(1);
+				Symbol *left  = constantPushed(2);
+
+				// the second operand must not be a branch target either
+				if (left && right && !isTarget[emitted.back().origin]) {
+					if (Symbol *folded = foldBinaryOperation(op, left, right)) {
+						replaceWithPush(2, folded);
+						continue;
+					}
+				}
+			}
+		}
+
+		emitted.push_back(Emitted{out.size(), i});
+
+		if (const int operand = branchOperand(op)) {
+			relocations.push_back(Relocation{out.size() + operand, i + operand + static_cast<size_t>(code[i + operand].value)});
+		}
+
+		out.insert(out.end(), code.begin() + static_cast<ptrdiff_t>(i), code.begin() + static_cast<ptrdiff_t>(i + 1 + OpOperands[op]));
+	}
+
+	newIndex[size] = out.size();
+
+	for (const Relocation &r : relocations) {
+		out[r.operand].value = static_cast<int64_t>(newIndex[r.target]) - static_cast<int64_t>(r.operand);
+	}
+
+	std::vector<int> outLines(out.size());
+	for (size_t i = 0; i < emitted.size(); ++i) {
+		const size_t end = (i + 1 < emitted.size()) ? emitted[i + 1].start : out.size();
+		std::fill(outLines.begin() + static_cast<ptrdiff_t>(emitted[i].start), outLines.begin() + static_cast<ptrdiff_t>(end), lines[emitted[i].origin]);
+	}
+
+	code  = std::move(out);
+	lines = std::move(outLines);
+}
+
 /*
 ** Execute a compiled macro, "prog", using the arguments in the array
-** "args".  Returns one of MACRO_DONE, MACRO_PREEMPT, or MACRO_ERROR.
+** "args". "name" is what the macro is called in profiles.  Returns one of MACRO_DONE, MACRO_PREEMPT, or MACRO_ERROR.
 ** if MACRO_DONE is returned, the macro completed, and the returned value
 ** (if any) can be read from "result".  If MACRO_PREEMPT is returned, the
 ** macro exceeded its alotted time-slice and scheduled...
 */
-int executeMacro(DocumentWidget *document, Program *prog, gsl::span<DataValue> arguments, DataValue *result, std::shared_ptr<MacroContext> &continuation, QString *msg) {
+int executeMacro(DocumentWidget *document, Program *prog, const QString &name, gsl::span<DataValue> arguments, DataValue *result, std::shared_ptr<MacroContext> &continuation, QString *msg) {
+
+	INSTRUMENT_SCOPE("executeMacro");
 
 	/* Create an execution context (a stack, a stack pointer, a frame pointer,
 	   and a program counter) which will retain the program state across
@@ -537,6 +988,10 @@ int executeMacro(DocumentWidget *document, Program *prog, gsl::span<DataValue> a
 		context->StackP++;
 	}
 
+	if (Profiler::active()) {
+		Profiler::enter(context.get(), name.toStdString(), prog, context->FrameP);
+	}
+
 	// Begin execution, return on error or preemption
 	return continueMacro(context, result, msg);
 }
@@ -547,7 +1002,7 @@ int executeMacro(DocumentWidget *document, Program *prog, gsl::span<DataValue> a
 */
 ExecReturnCodes continueMacro(const std::shared_ptr<MacroContext> &continuation, DataValue *result, QString *msg) {
 
-	int instCount = 0;
+	INSTRUMENT_SCOPE("continueMacro");
 
 	/* To allow macros to be invoked arbitrarily (such as those automatically
 	   triggered within smart-indent) within executing macros, this call is
@@ -557,50 +1012,224 @@ ExecReturnCodes continueMacro(const std::shared_ptr<MacroContext> &continuation,
 
 	Q_ASSERT(continuation);
 
+	/* The time slice is only checked every CLOCK_CHECK_INTERVAL instructions
+	   so that reading the clock doesn't dominate cheap instructions */
+	const auto sliceStart = std::chrono::steady_clock::now();
+	int clockCheckCountdown  = CLOCK_CHECK_INTERVAL;
+
+	auto sliceExpired = [&sliceStart, &clockCheckCountdown]() {
+#if defined(ENABLE_PREEMPTION)
+		if (--clockCheckCountdown == 0) {
+			clockCheckCountdown = CLOCK_CHECK_INTERVAL;
+			if (Profiler::active()) {
+				Profiler::sample(&Context, Context.PC);
+			}
+			return std::chrono::steady_clock::now() - sliceStart >= TIME_SLICE;
+		}
+#endif
+		return false;
+	};
+
+	OpStatusCodes status;
+
 	/*
 	** Execution Loop:  Call the succesive routine addresses in the program
 	** until one returns something other than STAT_OK, then take action
 	*/
 	restoreContext(continuation);
 	ErrorMessage = nullptr;
+
+	if (Profiler::active()) {
+		Profiler::resume(&Context);
+	}
+
+#if defined(USE_COMPUTED_GOTO)
+	/* Each instruction jumps directly to the handler of the next one, which
+	   gives the branch predictor one indirect jump per handler to learn
+	   from instead of a single shared one. Must correspond to the enum called
+	   "operations" in interpret.h */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+	static void *const DispatchTable[N_OPS] = {
+		&&do_returnNoVal,
+		&&do_returnVal,
+		&&do_pushSymVal,
+		&&do_dupStack,
+		&&do_add,
+		&&do_subtract,
+		&&do_multiply,
+		&&do_divide,
+		&&do_modulo,
+		&&do_negate,
+		&&do_increment,
+		&&do_decrement,
+		&&do_gt,
+		&&do_lt,
+		&&do_ge,
+		&&do_le,
+		&&do_eq,
+		&&do_ne,
+		&&do_bitAnd,
+		&&do_bitOr,
+		&&do_logicalAnd,
+		&&do_logicalOr,
+		&&do_logicalNot,
+		&&do_power,
+		&&do_concat,
+		&&do_assign,
+		&&do_callSubroutine,
+		&&do_fetchRetVal,
+		&&do_branch,
+		&&do_branchTrue,
+		&&do_branchFalse,
+		&&do_branchNever,
+		&&do_arrayRef,
+		&&do_arrayAssign,
+		&&do_beginArrayIter,
+		&&do_arrayIter,
+		&&do_inArray,
+		&&do_deleteArrayElement,
+		&&do_pushArraySymVal,
+		&&do_arrayRefAndAssignSetup,
+		&&do_pushArgVal,
+		&&do_pushArgCount,
+		&&do_pushArgArray,
+		&&do_gtBranchFalse,
+		&&do_ltBranchFalse,
+		&&do_geBranchFalse,
+		&&do_leBranchFalse,
+		&&do_eqBranchFalse,
+		&&do_neBranchFalse,
+	};
+
+#define DISPATCH() goto *DispatchTable[Context.PC++->op]
+
+#define EXECUTE(function)                            \
+	do_##function:                                   \
+	status = static_cast<OpStatusCodes>(function()); \
+	if (status != STAT_OK) {                         \
+		goto finished;                               \
+	}                                                \
+	if (sliceExpired()) {                            \
+		goto time_limit;                             \
+	}                                                \
+	DISPATCH()
+
+	DISPATCH();
+
+	EXECUTE(returnNoVal);
+	EXECUTE(returnVal);
+	EXECUTE(pushSymVal);
+	EXECUTE(dupStack);
+	EXECUTE(add);
+	EXECUTE(subtract);
+	EXECUTE(multiply);
+	EXECUTE(divide);
+	EXECUTE(modulo);
+	EXECUTE(negate);
+	EXECUTE(increment);
+	EXECUTE(decrement);
+	EXECUTE(gt);
+	EXECUTE(lt);
+	EXECUTE(ge);
+	EXECUTE(le);
+	EXECUTE(eq);
+	EXECUTE(ne);
+	EXECUTE(bitAnd);
+	EXECUTE(bitOr);
+	EXECUTE(logicalAnd);
+	EXECUTE(logicalOr);
+	EXECUTE(logicalNot);
+	EXECUTE(power);
+	EXECUTE(concat);
+	EXECUTE(assign);
+	EXECUTE(callSubroutine);
+	EXECUTE(fetchRetVal);
+	EXECUTE(branch);
+	EXECUTE(branchTrue);
+	EXECUTE(branchFalse);
+	EXECUTE(branchNever);
+	EXECUTE(arrayRef);
+	EXECUTE(arrayAssign);
+	EXECUTE(beginArrayIter);
+	EXECUTE(arrayIter);
+	EXECUTE(inArray);
+	EXECUTE(deleteArrayElement);
+	EXECUTE(pushArraySymVal);
+	EXECUTE(arrayRefAndAssignSetup);
+	EXECUTE(pushArgVal);
+	EXECUTE(pushArgCount);
+	EXECUTE(pushArgArray);
+	EXECUTE(gtBranchFalse);
+	EXECUTE(ltBranchFalse);
+	EXECUTE(geBranchFalse);
+	EXECUTE(leBranchFalse);
+	EXECUTE(eqBranchFalse);
+	EXECUTE(neBranchFalse);
+
+#undef EXECUTE
+#undef DISPATCH
+#pragma GCC diagnostic pop
+#else
 	Q_FOREVER {
 
 		// Execute an instruction
-		Inst *inst = Context.PC++;
-
-		auto status = static_cast<OpStatusCodes>(inst->func());
-
-		// If error return was not STAT_OK, return to caller
-		switch (status) {
-		case STAT_PREEMPT:
-			saveContext(continuation);
-			restoreContext(&oldContext);
-			return MACRO_PREEMPT;
-		case STAT_ERROR:
-			*msg = QString::fromLatin1(ErrorMessage);
-			restoreContext(&oldContext);
-			return MACRO_ERROR;
-		case STAT_DONE:
-			*msg    = QString();
-			*result = *--Context.StackP;
-			restoreContext(&oldContext);
-			return MACRO_DONE;
-		case STAT_OK:
-			break;
+		status = static_cast<OpStatusCodes>(OpFns[Context.PC++->op]());
+		if (status != STAT_OK) {
+			goto finished;
 		}
 
-		/* Count instructions executed.  If the instruction limit is hit,
-		   preempt, store re-start information in continuation and give
-		   X, other macros, and other shell scripts a chance to execute */
-		++instCount;
-#if defined(ENABLE_PREEMPTION)
-		if (instCount >= INSTRUCTION_LIMIT) {
-			saveContext(continuation);
-			restoreContext(&oldContext);
-			return MACRO_TIME_LIMIT;
+		if (sliceExpired()) {
+			goto time_limit;
 		}
+	}
 #endif
+
+time_limit:
+	/* If the time slice is used up, preempt, store re-start information in
+	   continuation and give X, other macros, and other shell scripts a chance
+	   to execute */
+	if (Profiler::active()) {
+		Profiler::suspend(&Context);
 	}
+
+	saveContext(continuation);
+	restoreContext(&oldContext);
+	return MACRO_TIME_LIMIT;
+
+finished:
+	// If error return was not STAT_OK, return to caller
+	switch (status) {
+	case STAT_PREEMPT:
+		if (Profiler::active()) {
+			Profiler::suspend(&Context);
+		}
+
+		saveContext(continuation);
+		restoreContext(&oldContext);
+		return MACRO_PREEMPT;
+	case STAT_ERROR:
+		if (Profiler::active()) {
+			Profiler::finish(&Context);
+		}
+
+		*msg = QString::fromLatin1(ErrorMessage);
+		restoreContext(&oldContext);
+		return MACRO_ERROR;
+	case STAT_DONE:
+		if (Profiler::active()) {
+			Profiler::finish(&Context);
+		}
+
+		*msg    = QString();
+		*result = *--Context.StackP;
+		restoreContext(&oldContext);
+		return MACRO_DONE;
+	case STAT_OK:
+		break;
+	}
+
+	Q_UNREACHABLE();
 }
 
 /*
@@ -608,9 +1237,9 @@ ExecReturnCodes continueMacro(const std::shared_ptr<MacroContext> &continuation,
 ** this can be called instead of ExecuteMacro to run it in the same context
 ** as if it were a subroutine.  This saves the caller from maintaining
 ** separate contexts, and serializes processing of the two macros without
-** additional work.
+** additional work. "name" is what the macro is called in profiles.
 */
-void RunMacroAsSubrCall(Program *prog) {
+void RunMacroAsSubrCall(Program *prog, const QString &name) {
 
 	/* See "callSubroutine" for a description of the stack frame
 	   for a subroutine call */
@@ -626,6 +1255,10 @@ void RunMacroAsSubrCall(Program *prog) {
 		FP_GET_SYM_VAL(Context.FrameP, s) = make_value();
 		Context.StackP++;
 	}
+
+	if (Profiler::active()) {
+		Profiler::enter(&Context, name.toStdString(), prog, Context.FrameP);
+	}
 }
 
 /*
@@ -643,7 +1276,7 @@ void preemptMacro() {
 ** a value directly).
 */
 void modifyReturnedValue(const std::shared_ptr<MacroContext> &context, const DataValue &dv) {
-	if ((context->PC - 1)->func == fetchRetVal) {
+	if (context->RetValFetched) {
 		*(context->StackP - 1) = dv;
 	}
 }
@@ -823,7 +1456,7 @@ Symbol *PromoteToGlobal(Symbol *sym) {
 	do {                                           \
 		if (Context.StackP == Context.Stack.get()) \
 			return execError(StackUnderflowMsg);   \
-		dataVal = *--Context.StackP;               \
+		dataVal = std::move(*--Context.StackP);    \
 	} while (0)
 
 #define PUSH(dataVal)                                           \
@@ -912,16 +1545,18 @@ Symbol *PromoteToGlobal(Symbol *sym) {
 static int pushSymVal() {
 
 	DataValue symVal;
+	const DataValue *symValPtr = &symVal;
 
 	DISASM_RT(PC - 1, 2);
 	STACKDUMP(0, 3);
 
 	Symbol *s = Context.PC++->sym;
 
+	// variables are pushed straight from where they live, to save a copy
 	if (s->type == LOCAL_SYM) {
-		symVal = FP_GET_SYM_VAL(Context.FrameP, s);
+		symValPtr = &FP_GET_SYM_VAL(Context.FrameP, s);
 	} else if (s->type == GLOBAL_SYM || s->type == CONST_SYM) {
-		symVal = s->value;
+		symValPtr = &s->value;
 	} else if (s->type == ARG_SYM) {
 		int nArgs  = FP_GET_ARG_COUNT(Context.FrameP);
 		int argNum = to_integer(s->value);
@@ -931,7 +1566,7 @@ static int pushSymVal() {
 		if (argNum == N_ARGS_ARG_SYM) {
 			symVal = make_value(nArgs);
 		} else {
-			symVal = FP_GET_ARG_N(Context.FrameP, argNum);
+			symValPtr = &FP_GET_ARG_N(Context.FrameP, argNum);
 		}
 	} else if (s->type == PROC_VALUE_SYM) {
 
@@ -942,11 +1577,11 @@ static int pushSymVal() {
 		return execError("reading non-variable: %s", s->name.c_str());
 	}
 
-	if (is_unset(symVal)) {
+	if (is_unset(*symValPtr)) {
 		return execError("variable not set: %s", s->name.c_str());
 	}
 
-	PUSH(symVal);
+	PUSH(*symValPtr);
 
 	return STAT_OK;
 }
@@ -979,8 +1614,6 @@ static int pushArgCount() {
 
 static int pushArgArray() {
 
-	DataValue argVal;
-
 	DISASM_RT(PC - 1, 1);
 	STACKDUMP(0, 3);
 
@@ -991,14 +1624,10 @@ static int pushArgArray() {
 
 		*resultArray = make_value(std::make_shared<Array>());
 
-		for (int argNum = 0; argNum < nArgs; ++argNum) {
-
-			auto intStr = std::to_string(argNum);
+		const ArrayPtr &m = to_array(*resultArray);
 
-			argVal = FP_GET_ARG_N(Context.FrameP, argNum);
-			if (!ArrayInsert(resultArray, intStr, &argVal)) {
-				return execError("array insertion failure");
-			}
+		for (int argNum = 0; argNum < nArgs; ++argNum) {
+			m->insert(argNum, FP_GET_ARG_N(Context.FrameP, argNum));
 		}
 	}
 
@@ -1085,7 +1714,7 @@ static int assign() {
 		return ArrayCopy(dataPtr, &value);
 	}
 
-	*dataPtr = value;
+	*dataPtr = std::move(value);
 	return STAT_OK;
 }
 
@@ -1135,37 +1764,13 @@ static int add() {
 			const ArrayPtr &leftMap  = to_array(leftVal);
 			const ArrayPtr &rightMap = to_array(rightVal);
 
-			auto leftIter  = leftMap->begin();
-			auto rightIter = rightMap->begin();
-
-			while (leftIter != leftMap->end() || rightIter != rightMap->end()) {
-
-				bool insertResult = true;
-
-				if (leftIter != leftMap->end() && rightIter != rightMap->end()) {
-					int compareResult = leftIter->first.compare(rightIter->first);
-					if (compareResult < 0) {
-						insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-						++leftIter;
-					} else if (compareResult > 0) {
-						insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-						++rightIter;
-					} else {
-						insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-						++leftIter;
-						++rightIter;
-					}
-				} else if (leftIter != leftMap->end()) {
-					insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-					++leftIter;
-				} else {
-					insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-					++rightIter;
-				}
-				if (!insertResult) {
-					return execError("array insertion failure");
-				}
-			}
+			const ArrayPtr &resultMap = to_array(resultArray);
+
+			*resultMap = *leftMap;
+			rightMap->forEach([&resultMap](const std::string &key, const DataValue &value) {
+				resultMap->insert(key, value);
+			});
+
 			PUSH(resultArray);
 		} else {
 			return execError("can't mix math with arrays and non-arrays");
@@ -1209,31 +1814,14 @@ static int subtract() {
 			const ArrayPtr &leftMap  = to_array(leftVal);
 			const ArrayPtr &rightMap = to_array(rightVal);
 
-			auto leftIter  = leftMap->begin();
-			auto rightIter = rightMap->begin();
-
-			while (leftIter != leftMap->end()) {
-				bool insertResult = true;
-
-				if (leftIter != leftMap->end() && rightIter != rightMap->end()) {
-					int compareResult = leftIter->first.compare(rightIter->first);
-					if (compareResult < 0) {
-						insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-						++leftIter;
-					} else if (compareResult > 0) {
-						++rightIter;
-					} else {
-						++leftIter;
-						++rightIter;
-					}
-				} else if (leftIter != leftMap->end()) {
-					insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-					++leftIter;
-				}
-				if (!insertResult) {
-					return execError("array insertion failure");
+			const ArrayPtr &resultMap = to_array(resultArray);
+
+			leftMap->forEach([&resultMap, &rightMap](const std::string &key, const DataValue &value) {
+				if (!rightMap->find(key)) {
+					resultMap->insert(key, value);
 				}
-			}
+			});
+
 			PUSH(resultArray);
 		} else {
 			return execError("can't mix math with arrays and non-arrays");
@@ -1341,9 +1929,8 @@ static int eq() {
 		auto n2 = to_integer(v2);
 		v1      = make_value(n1 == n2);
 	} else if (is_string(v1) && is_string(v2)) {
-		auto s1 = to_string(v1);
-		auto s2 = to_string(v2);
-		v1      = make_value(s1 == s2);
+		const bool equal = (boost::get<std::string>(v1.value) == boost::get<std::string>(v2.value));
+		v1               = make_value(equal);
 	} else if (is_string(v1) && is_integer(v2)) {
 		int number;
 		if (!StringToNum(to_string(v1), &number)) {
@@ -1400,26 +1987,14 @@ static int bitAnd() {
 			const ArrayPtr &leftMap  = to_array(leftVal);
 			const ArrayPtr &rightMap = to_array(rightVal);
 
-			auto leftIter  = leftMap->begin();
-			auto rightIter = rightMap->begin();
-
-			while (leftIter != leftMap->end() && rightIter != rightMap->end()) {
-				bool insertResult = true;
-				int compareResult = leftIter->first.compare(rightIter->first);
-
-				if (compareResult < 0) {
-					++leftIter;
-				} else if (compareResult > 0) {
-					++rightIter;
-				} else {
-					insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-					++leftIter;
-					++rightIter;
-				}
-				if (!insertResult) {
-					return execError("array insertion failure");
+			const ArrayPtr &resultMap = to_array(resultArray);
+
+			rightMap->forEach([&resultMap, &leftMap](const std::string &key, const DataValue &value) {
+				if (leftMap->find(key)) {
+					resultMap->insert(key, value);
 				}
-			}
+			});
+
 			PUSH(resultArray);
 		} else {
 			return execError("can't mix math with arrays and non-arrays");
@@ -1463,35 +2038,20 @@ static int bitOr() {
 			const ArrayPtr &leftMap  = to_array(leftVal);
 			const ArrayPtr &rightMap = to_array(rightVal);
 
-			auto leftIter  = leftMap->begin();
-			auto rightIter = rightMap->begin();
-
-			while (leftIter != leftMap->end() || rightIter != rightMap->end()) {
-				bool insertResult = true;
-
-				if (leftIter != leftMap->end() && rightIter != rightMap->end()) {
-					int compareResult = leftIter->first.compare(rightIter->first);
-					if (compareResult < 0) {
-						insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-						++leftIter;
-					} else if (compareResult > 0) {
-						insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-						++rightIter;
-					} else {
-						++leftIter;
-						++rightIter;
-					}
-				} else if (leftIter != leftMap->end()) {
-					insertResult = ArrayInsert(&resultArray, leftIter->first, &leftIter->second);
-					++leftIter;
-				} else {
-					insertResult = ArrayInsert(&resultArray, rightIter->first, &rightIter->second);
-					++rightIter;
+			const ArrayPtr &resultMap = to_array(resultArray);
+
+			leftMap->forEach([&resultMap, &rightMap](const std::string &key, const DataValue &value) {
+				if (!rightMap->find(key)) {
+					resultMap->insert(key, value);
 				}
-				if (!insertResult) {
-					return execError("array insertion failure");
+			});
+
+			rightMap->forEach([&resultMap, &leftMap](const std::string &key, const DataValue &value) {
+				if (!leftMap->find(key)) {
+					resultMap->insert(key, value);
 				}
-			}
+			});
+
 			PUSH(resultArray);
 		} else {
 			return execError("can't mix math with arrays and non-arrays");
@@ -1619,11 +2179,19 @@ static int callSubroutine() {
 		// Call the function and check for preemption
 		PreemptRequest = false;
 
+		const bool profiling                    = Profiler::active();
+		const Profiler::Clock::time_point start = profiling ? Profiler::Clock::now() : Profiler::Clock::time_point();
+
 		if (std::error_code ec = to_subroutine(sym->value)(Context.FocusDocument, Arguments(Context.StackP, nArgs), &result)) {
 			return execError(ec, sym->name.c_str());
 		}
 
-		if (Context.PC->func == fetchRetVal) {
+		if (profiling) {
+			Profiler::builtin(&Context, sym->name, Context.PC, Profiler::Clock::now() - start);
+		}
+
+		Context.RetValFetched = (Context.PC->op == OP_FETCH_RET_VAL);
+		if (Context.RetValFetched) {
 
 			if (is_unset(result)) {
 				return execError("%s does not return a value", sym->name.c_str());
@@ -1658,6 +2226,10 @@ static int callSubroutine() {
 			FP_GET_SYM_VAL(Context.FrameP, s) = make_value();
 			Context.StackP++;
 		}
+
+		if (Profiler::active()) {
+			Profiler::enter(&Context, sym->name, prog, Context.FrameP);
+		}
 		return STAT_OK;
 	}
 
@@ -1701,6 +2273,10 @@ static int returnValOrNone(bool valOnStack) {
 		POP(retVal);
 	}
 
+	if (Profiler::active()) {
+		Profiler::leave(&Context, Context.FrameP);
+	}
+
 	// get stored return information
 	int nArgs            = FP_GET_ARG_COUNT(Context.FrameP);
 	DataValue *newFrameP = FP_GET_OLD_FP(Context.FrameP);
@@ -1719,7 +2295,7 @@ static int returnValOrNone(bool valOnStack) {
 		} else {
 			PUSH(make_value());
 		}
-	} else if (Context.PC->func == fetchRetVal) {
+	} else if (Context.PC->op == OP_FETCH_RET_VAL) {
 		if (valOnStack) {
 			PUSH(retVal);
 			Context.PC++;
@@ -1804,6 +2380,68 @@ static int branchNever() {
 	return STAT_OK;
 }
 
+/*
+** Compare and branch superinstructions, generated by the optimizer for a
+** comparison immediately followed by OP_BRANCH_FALSE. Branches to the address
+** of the immediate operand if the comparison is false (pops stack)
+**
+** Before: Prog->  [branchDest], next, ..., (branchdest)next
+**         TheStack-> value2, value1, next, ...
+** After:  either: Prog->  branchDest, [next], ...
+** After:  or:     Prog->  branchDest, next, ..., (branchdest)[next]
+**         TheStack-> next, ...
+*/
+#define COMPARE_AND_BRANCH_FALSE(op)                 \
+	do {                                             \
+		int n1;                                      \
+		int n2;                                      \
+		DISASM_RT(PC - 1, 2);                        \
+		STACKDUMP(2, 3);                             \
+		POP_INT(n2);                                 \
+		POP_INT(n1);                                 \
+		Inst *addr = Context.PC + Context.PC->value; \
+		Context.PC++;                                \
+		if (!(n1 op n2)) {                           \
+			Context.PC = addr;                       \
+		}                                            \
+		return STAT_OK;                              \
+	} while (0)
+
+static int gtBranchFalse() {
+	COMPARE_AND_BRANCH_FALSE(>);
+}
+
+static int ltBranchFalse() {
+	COMPARE_AND_BRANCH_FALSE(<);
+}
+
+static int geBranchFalse() {
+	COMPARE_AND_BRANCH_FALSE(>=);
+}
+
+static int leBranchFalse() {
+	COMPARE_AND_BRANCH_FALSE(<=);
+}
+
+// eq() handles the string/number conversions, so these just chain to it
+static int eqBranchFalse() {
+	const int status = eq();
+	if (status != STAT_OK) {
+		return status;
+	}
+
+	return branchFalse();
+}
+
+static int neBranchFalse() {
+	const int status = eq();
+	if (status != STAT_OK) {
+		return status;
+	}
+
+	return branchTrue();
+}
+
 /*
 ** recursively copy(duplicate) the sparse array nodes of an array
 ** this does not duplicate the key/node data since they are never
@@ -1817,52 +2455,83 @@ int ArrayCopy(DataValue *dstArray, const DataValue *srcArray) {
 /*
 ** creates a string of a single key for all the sub-scripts
 ** using ARRAY_DIM_SEP as a separator
-** this function uses the PEEK macros in order to remove most limits on
-** the number of arguments to an array
+** this function reads the arguments in place on the stack in order to remove
+** most limits on the number of arguments to an array, and to avoid copying
+** them before they are appended to the key
+** a single integer sub-script doesn't build a string at all, the array can
+** look those up directly
 */
-static int makeArrayKeyFromArgs(int64_t nArgs, std::string *keyString, bool leaveParams) {
-	DataValue tmpVal;
+static int makeArrayKeyFromArgs(int64_t nArgs, ArrayKey *key, bool leaveParams) {
+
+	if (Context.StackP - Context.Stack.get() < nArgs) {
+		return execError(StackUnderflowMsg);
+	}
+
+	DataValue *const args = Context.StackP - nArgs;
+
+	if (nArgs == 1) {
+		if (auto n = boost::get<int>(&args[0].value)) {
+			key->isIndex = true;
+			key->index   = *n;
+			if (!leaveParams) {
+				Context.StackP = args;
+			}
+			return STAT_OK;
+		}
 
-	std::string str;
+		// the common case of a single string subscript can just take the string
+		if (!leaveParams) {
+			if (auto str = boost::get<std::string>(&args[0].value)) {
+				key->isIndex   = false;
+				key->string    = std::move(*str);
+				Context.StackP = args;
+				return STAT_OK;
+			}
+		}
+	}
+
+	key->isIndex           = false;
+	std::string *keyString = &key->string;
+	keyString->clear();
 
-	for (int64_t i = nArgs - 1; i >= 0; --i) {
-		if (i != nArgs - 1) {
-			str.append(ARRAY_DIM_SEP);
+	for (int64_t i = 0; i < nArgs; ++i) {
+		if (i != 0) {
+			keyString->append(ARRAY_DIM_SEP);
 		}
-		PEEK(tmpVal, i);
-		if (is_integer(tmpVal)) {
-			str.append(std::to_string(to_integer(tmpVal)));
-		} else if (is_string(tmpVal)) {
-			auto s = to_string(tmpVal);
-			str.append(s.begin(), s.end());
+
+		if (auto n = boost::get<int>(&args[i].value)) {
+			keyString->append(std::to_string(*n));
+		} else if (auto str = boost::get<std::string>(&args[i].value)) {
+			keyString->append(*str);
 		} else {
 			return execError("can only index array with string or int.");
 		}
 	}
 
 	if (!leaveParams) {
-		for (int64_t i = nArgs - 1; i >= 0; --i) {
-			POP(tmpVal);
-		}
+		Context.StackP = args;
 	}
 
-	*keyString = str;
-
 	return STAT_OK;
 }
 
+/*
+** look up the element of an array addressed by key, returns nullptr if the
+** array has no such element
+*/
+DataValue *arrayFind(const DataValue &theArray, const ArrayKey &key) {
+
+	const ArrayPtr &m = boost::get<ArrayPtr>(theArray.value);
+	return key.isIndex ? m->find(key.index) : m->find(key.string);
+}
+
 /*
 ** insert a DataValue into an array
 */
 bool ArrayInsert(DataValue *theArray, const std::string &keyStr, DataValue *theValue) {
 
 	const ArrayPtr &m = to_array(*theArray);
-	auto p            = m->insert(std::make_pair(keyStr, *theValue));
-	if (p.second) {
-		return true;
-	}
-
-	p.first->second = *theValue;
+	m->insert(keyStr, *theValue);
 	return true;
 }
 
@@ -1872,11 +2541,7 @@ bool ArrayInsert(DataValue *theArray, const std::string &keyStr, DataValue *theV
 void ArrayDelete(DataValue *theArray, const std::string &keyStr) {
 
 	const ArrayPtr &m = to_array(*theArray);
-
-	auto it = m->find(keyStr);
-	if (it != m->end()) {
-		m->erase(it);
-	}
+	m->erase(keyStr);
 }
 
 /*
@@ -1903,9 +2568,8 @@ int ArraySize(DataValue *theArray) {
 bool ArrayGet(DataValue *theArray, const std::string &keyStr, DataValue *theValue) {
 
 	const ArrayPtr &m = to_array(*theArray);
-	auto it           = m->find(keyStr);
-	if (it != m->end()) {
-		*theValue = it->second;
+	if (DataValue *value = m->find(keyStr)) {
+		*theValue = *value;
 		return true;
 	}
 
@@ -1918,19 +2582,26 @@ bool ArrayGet(DataValue *theArray, const std::string &keyStr, DataValue *theValu
 ArrayIterator arrayIterateFirst(DataValue *theArray) {
 
 	const ArrayPtr &m = to_array(*theArray);
-	ArrayIterator it{m, m->begin()};
+	ArrayIterator it{m, m->sortedKeys(), 0};
 
 	return it;
 }
 
 /*
-** move iterator to next entry in array
+** move iterator to the next key which is still in the array, keys deleted
+** since the iteration started are skipped. Returns false at the end
 */
-ArrayIterator arrayIterateNext(ArrayIterator iterator) {
+bool arrayIterateNext(ArrayIterator *iterator, std::string *key) {
+
+	while (iterator->index < iterator->keys->size()) {
+		const std::string &k = (*iterator->keys)[iterator->index++];
+		if (iterator->m->find(k)) {
+			*key = k;
+			return true;
+		}
+	}
 
-	Q_ASSERT(iterator.it != iterator.m->end());
-	++(iterator.it);
-	return iterator;
+	return false;
 }
 
 /*
@@ -1944,8 +2615,7 @@ ArrayIterator arrayIterateNext(ArrayIterator iterator) {
 static int arrayRef() {
 
 	DataValue srcArray;
-	DataValue valueItem;
-	std::string keyString;
+	ArrayKey key;
 
 	int64_t nDim = Context.PC++->value;
 
@@ -1953,17 +2623,18 @@ static int arrayRef() {
 	STACKDUMP(nDim, 3);
 
 	if (nDim > 0) {
-		int errNum = makeArrayKeyFromArgs(nDim, &keyString, false);
+		int errNum = makeArrayKeyFromArgs(nDim, &key, false);
 		if (errNum != STAT_OK) {
 			return errNum;
 		}
 
 		POP(srcArray);
 		if (is_array(srcArray)) {
-			if (!ArrayGet(&srcArray, keyString, &valueItem)) {
-				return execError("referenced array value not in array: %s", keyString.c_str());
+			DataValue *valueItem = arrayFind(srcArray, key);
+			if (!valueItem) {
+				return execError("referenced array value not in array: %s", key.toString().c_str());
 			}
-			PUSH(valueItem);
+			PUSH(*valueItem);
 			return STAT_OK;
 		} else {
 			return execError("operator [] on non-array");
@@ -1988,7 +2659,7 @@ static int arrayRef() {
 **         TheStack-> next, ...
 */
 static int arrayAssign() {
-	std::string keyString;
+	ArrayKey key;
 	DataValue srcValue;
 	DataValue dstArray;
 
@@ -2000,7 +2671,7 @@ static int arrayAssign() {
 	if (nDim > 0) {
 		POP(srcValue);
 
-		int errNum = makeArrayKeyFromArgs(nDim, &keyString, false);
+		int errNum = makeArrayKeyFromArgs(nDim, &key, false);
 		if (errNum != STAT_OK) {
 			return errNum;
 		}
@@ -2020,11 +2691,13 @@ static int arrayAssign() {
 				return errNum;
 			}
 		}
-		if (ArrayInsert(&dstArray, keyString, &srcValue)) {
-			return STAT_OK;
+		const ArrayPtr &m = to_array(dstArray);
+		if (key.isIndex) {
+			m->insert(key.index, srcValue);
 		} else {
-			return execError("array member allocation failure");
+			m->insert(key.string, srcValue);
 		}
+		return STAT_OK;
 	}
 	return execError("empty operator []");
 }
@@ -2040,9 +2713,8 @@ static int arrayAssign() {
 static int arrayRefAndAssignSetup() {
 
 	DataValue srcArray;
-	DataValue valueItem;
 	DataValue moveExpr;
-	std::string keyString;
+	ArrayKey key;
 
 	int64_t binaryOp = Context.PC++->value;
 	int64_t nDim     = Context.PC++->value;
@@ -2055,17 +2727,18 @@ static int arrayRefAndAssignSetup() {
 	}
 
 	if (nDim > 0) {
-		int errNum = makeArrayKeyFromArgs(nDim, &keyString, true);
+		int errNum = makeArrayKeyFromArgs(nDim, &key, true);
 		if (errNum != STAT_OK) {
 			return errNum;
 		}
 
 		PEEK(srcArray, nDim);
 		if (is_array(srcArray)) {
-			if (!ArrayGet(&srcArray, keyString, &valueItem)) {
-				return execError("referenced array value not in array: %s", keyString.c_str());
+			DataValue *valueItem = arrayFind(srcArray, key);
+			if (!valueItem) {
+				return execError("referenced array value not in array: %s", key.toString().c_str());
 			}
-			PUSH(valueItem);
+			PUSH(*valueItem);
 			if (binaryOp) {
 				PUSH(moveExpr);
 			}
@@ -2116,10 +2789,10 @@ static int beginArrayIter() {
 }
 
 /*
-** copy key to symbol if node is still valid, marked bad by a color of -1
-** then move iterator to next node
-** this allows iterators to progress even if you delete any node in the array
-** except the item just after the current key
+** copy the next key which is still in the array to the symbol, then move
+** the iterator past it
+** this allows iterators to progress even if you delete any node in the
+** array. Keys added during the loop are not visited
 **
 ** Before: Prog->  iter, ARRAY_ITER, [iterVar], iter, endLoopBranch, next, ...
 **         TheStack-> [next], ...
@@ -2168,11 +2841,11 @@ static int arrayIter() {
 
 	DataValue *iteratorValPtr = &FP_GET_SYM_VAL(Context.FrameP, iterator);
 
-	ArrayIterator thisEntry = to_iterator(*iteratorValPtr);
+	auto &thisEntry = boost::get<ArrayIterator>(iteratorValPtr->value);
 
-	if (thisEntry.it != thisEntry.m->end()) {
-		*itemValPtr     = make_value(thisEntry.it->first);
-		*iteratorValPtr = make_value(arrayIterateNext(thisEntry));
+	std::string key;
+	if (arrayIterateNext(&thisEntry, &key)) {
+		*itemValPtr = make_value(key);
 	} else {
 		Context.PC = branchAddr;
 	}
@@ -2212,13 +2885,14 @@ static int inArray() {
 
 		POP(leftArray);
 
-		const ArrayPtr &m = to_array(leftArray);
+		const ArrayPtr &m     = to_array(leftArray);
+		const ArrayPtr &right = to_array(theArray);
 
-		inResult  = 1;
-		auto iter = m->begin();
-		while (inResult && iter != m->end()) {
-			inResult = inResult && ArrayGet(&theArray, iter->first, &theValue);
-			++iter;
+		inResult = m->size() <= right->size();
+		if (inResult) {
+			m->forEach([&inResult, &right](const std::string &key, const DataValue &) {
+				inResult = inResult && right->find(key);
+			});
 		}
 	} else {
 		std::string keyStr;
@@ -2243,7 +2917,7 @@ static int inArray() {
 */
 static int deleteArrayElement() {
 	DataValue theArray;
-	std::string keyString;
+	ArrayKey key;
 
 	int64_t nDim = Context.PC++->value;
 
@@ -2251,7 +2925,7 @@ static int deleteArrayElement() {
 	STACKDUMP(nDim + 1, 3);
 
 	if (nDim > 0) {
-		int errNum = makeArrayKeyFromArgs(nDim, &keyString, false);
+		int errNum = makeArrayKeyFromArgs(nDim, &key, false);
 		if (errNum != STAT_OK) {
 			return errNum;
 		}
@@ -2260,7 +2934,12 @@ static int deleteArrayElement() {
 	POP(theArray);
 	if (is_array(theArray)) {
 		if (nDim > 0) {
-			ArrayDelete(&theArray, keyString);
+			const ArrayPtr &m = to_array(theArray);
+			if (key.isIndex) {
+				m->erase(key.index);
+			} else {
+				m->erase(key.string);
+			}
 		} else {
 			ArrayDeleteAll(&theArray);
 		}
@@ -2393,7 +3072,13 @@ static void disasm(Inst *inst, size_t nInstr) {
 		"ARRAY_REF_ASSIGN_SETUP", // arrayRefAndAssignSetup
 		"PUSH_ARG",               // $arg[expr]
 		"PUSH_ARG_COUNT",         // $arg[]
-		"PUSH_ARG_ARRAY"          // $arg
+		"PUSH_ARG_ARRAY",         // $arg
+		"GT_BRANCH_FALSE",        // gtBranchFalse
+		"LT_BRANCH_FALSE",        // ltBranchFalse
+		"GE_BRANCH_FALSE",        // geBranchFalse
+		"LE_BRANCH_FALSE",        // leBranchFalse
+		"EQ_BRANCH_FALSE",        // eqBranchFalse
+		"NE_BRANCH_FALSE"         // neBranchFalse
 	};
 	int j;
 
@@ -2401,7 +3086,7 @@ static void disasm(Inst *inst, size_t nInstr) {
 	for (size_t i = 0; i < nInstr; ++i) {
 		printf("Prog %8p ", static_cast<void *>(&inst[i]));
 		for (j = 0; j < N_OPS; ++j) {
-			if (inst[i].func == OpFns[j]) {
+			if (inst[i].op == j) {
 				printf("%22s ", opNames[j]);
 				if (j == OP_PUSH_SYM || j == OP_ASSIGN) {
 					Symbol *sym = inst[i + 1].sym;
@@ -2410,7 +3095,7 @@ static void disasm(Inst *inst, size_t nInstr) {
 						dumpVal(sym->value);
 					}
 					++i;
-				} else if (j == OP_BRANCH || j == OP_BRANCH_FALSE || j == OP_BRANCH_NEVER || j == OP_BRANCH_TRUE) {
+				} else if (branchOperand(static_cast<Operations>(j)) == 1) {
 					printf("to=(%+ld) %p", inst[i + 1].value, static_cast<void *>(&inst[i + 1] + inst[i + 1].value));
 					++i;
 				} else if (j == OP_SUBR_CALL) {
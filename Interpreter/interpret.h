@@ -2,6 +2,7 @@
 #ifndef INTERPRET_H_
 #define INTERPRET_H_
 
+#include "Array.h"
 #include "DataValue.h"
 #include "Util/string_view.h"
 
@@ -19,6 +20,10 @@ struct DataValue;
 struct Program;
 struct Symbol;
 
+namespace Profiler {
+struct CallStack;
+}
+
 constexpr const char ARRAY_DIM_SEP[] = "\034";
 
 enum SymTypes {
@@ -31,7 +36,7 @@ enum SymTypes {
 	MACRO_FUNCTION_SYM
 };
 
-#define N_OPS 43
+#define N_OPS 49
 enum Operations {
 	OP_RETURN_NO_VAL,
 	OP_RETURN,
@@ -75,7 +80,15 @@ enum Operations {
 	OP_ARRAY_REF_ASSIGN_SETUP,
 	OP_PUSH_ARG,
 	OP_PUSH_ARG_COUNT,
-	OP_PUSH_ARG_ARRAY
+	OP_PUSH_ARG_ARRAY,
+
+	// superinstructions, only generated by the optimizer
+	OP_GT_BRANCH_FALSE,
+	OP_LT_BRANCH_FALSE,
+	OP_GE_BRANCH_FALSE,
+	OP_LE_BRANCH_FALSE,
+	OP_EQ_BRANCH_FALSE,
+	OP_NE_BRANCH_FALSE
 };
 
 enum ExecReturnCodes {
@@ -86,7 +99,7 @@ enum ExecReturnCodes {
 };
 
 union Inst {
-	int (*func)();
+	Operations op;
 	int64_t value;
 	Symbol *sym;
 };
@@ -108,6 +121,7 @@ struct Program {
 
 	std::deque<Symbol *> localSymList;
 	std::vector<Inst> code;
+	std::vector<int> lines; // the line of the macro each element of "code" was compiled from
 };
 
 /* Information needed to re-start a preempted macro */
@@ -119,8 +133,11 @@ struct MacroContext {
 	DataValue *StackP             = nullptr; // next free spot on stack
 	DataValue *FrameP             = nullptr; // frame pointer (start of local variables for the current subroutine invocation)
 	Inst *PC                      = nullptr; // program counter during execution
+	bool RetValFetched            = false;   // last built-in call pushed a value for OP_FETCH_RET_VAL
 	DocumentWidget *RunDocument   = nullptr; // document from which macro was run
 	DocumentWidget *FocusDocument = nullptr; // document on which macro commands operate
+
+	std::shared_ptr<Profiler::CallStack> Profile; // calls in progress, while profiling
 };
 
 void InitMacroGlobals();
@@ -153,13 +170,14 @@ Symbol *LookupSymbolEx(const QString &name);
 Symbol *LookupSymbol(view::string_view name);
 void BeginCreatingProgram();
 void FillLoopAddrs(const Inst *breakAddr, const Inst *continueAddr);
+void SetSourceLine(int line);
 void StartLoopAddrList();
 void SwapCode(Inst *start, Inst *boundary, Inst *end);
 
 // Routines for executing programs
-int executeMacro(DocumentWidget *document, Program *prog, gsl::span<DataValue> arguments, DataValue *result, std::shared_ptr<MacroContext> &continuation, QString *msg);
+int executeMacro(DocumentWidget *document, Program *prog, const QString &name, gsl::span<DataValue> arguments, DataValue *result, std::shared_ptr<MacroContext> &continuation, QString *msg);
 ExecReturnCodes continueMacro(const std::shared_ptr<MacroContext> &continuation, DataValue *result, QString *msg);
-void RunMacroAsSubrCall(Program *prog);
+void RunMacroAsSubrCall(Program *prog, const QString &name);
 void preemptMacro();
 
 Symbol *PromoteToGlobal(Symbol *sym);
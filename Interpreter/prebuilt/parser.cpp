@@ -2339,6 +2339,11 @@ yyreturn:
  /* User Subroutines Section */
 
 
+/* How far the lines of the macro have been counted, so that each instruction
+   can be given the line it was compiled from */
+static QString::const_iterator LineCountedTo;
+static int LineNumber;
+
 /*
 ** Parse a string and create a program from it (this is the parser entry point).
 ** The program created by this routine can be executed using ExecuteProgram.
@@ -2356,6 +2361,10 @@ Program *compileMacro(const QString &expr, QString *msg, int *stoppedAt) {
     InPtr  = start;
     EndPtr = start + expr.size();
 
+    LineCountedTo = start;
+    LineNumber    = 1;
+    SetSourceLine(LineNumber);
+
     if (yyparse()) {
 		*msg       = ErrMsg;
         *stoppedAt = gsl::narrow<int>(InPtr - start);
@@ -2402,6 +2411,15 @@ static int yylex(void) {
         }
     }
 
+    /* instructions are added when the parser has read one token past them,
+       so they belong to the line of the token before the one read now */
+    SetSourceLine(LineNumber);
+    for (; LineCountedTo < InPtr; ++LineCountedTo) {
+        if (*LineCountedTo == QLatin1Char('\n')) {
+            ++LineNumber;
+        }
+    }
+
     /* return end of input at the end of the string */
     if (InPtr == EndPtr) {
         return 0;
@@ -15,6 +15,9 @@
 #include <cctype>
 #include <cstring>
 #include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -113,60 +116,66 @@ bool isQuantifier(char ch) noexcept {
 }
 
 /*--------------------------------------------------------------------*
- * init_ansi_classes
+ * generate_ansi_classes
  *
  * Generate character class sets using locale aware ANSI C functions.
  *
  *--------------------------------------------------------------------*/
-bool init_ansi_classes() noexcept {
-
-	static bool initialized = false;
+bool generate_ansi_classes() noexcept {
 
-	if (!initialized) {
-		initialized = true; // Only need to generate character sets once.
+	constexpr char Underscore = '_';
+	constexpr char Newline    = '\n';
 
-		constexpr char Underscore = '_';
-		constexpr char Newline    = '\n';
+	int word_count   = 0;
+	int letter_count = 0;
+	int space_count  = 0;
 
-		int word_count   = 0;
-		int letter_count = 0;
-		int space_count  = 0;
+	for (int i = 1; i < UINT8_MAX; i++) {
 
-		for (int i = 1; i < UINT8_MAX; i++) {
-
-			const auto ch = static_cast<char>(i);
-
-			if (safe_isalnum(ch) || ch == Underscore) {
-				Word_Char[word_count++] = ch;
-			}
+		const auto ch = static_cast<char>(i);
 
-			if (safe_isalpha(ch)) {
-				Letter_Char[letter_count++] = ch;
-			}
+		if (safe_isalnum(ch) || ch == Underscore) {
+			Word_Char[word_count++] = ch;
+		}
 
-			/* Note: Whether or not newline is considered to be whitespace is
-			   handled by switches within the original regex and is thus omitted
-			   here. */
-			if (safe_isspace(ch) && (ch != Newline)) {
-				White_Space[space_count++] = ch;
-			}
+		if (safe_isalpha(ch)) {
+			Letter_Char[letter_count++] = ch;
+		}
 
-			/* Make sure arrays are big enough.  ("- 2" because of zero array
-			   origin and we need to leave room for the '\0' terminator.) */
-			if (word_count > (ALNUM_CHAR_SIZE - 2) || space_count > (WHITE_SPACE_SIZE - 2) || letter_count > (ALNUM_CHAR_SIZE - 2)) {
-				reg_error("internal error #9 'init_ansi_classes'");
-				return false;
-			}
+		/* Note: Whether or not newline is considered to be whitespace is
+		   handled by switches within the original regex and is thus omitted
+		   here. */
+		if (safe_isspace(ch) && (ch != Newline)) {
+			White_Space[space_count++] = ch;
 		}
 
-		Word_Char[word_count]     = '\0';
-		Letter_Char[letter_count] = '\0';
-		White_Space[space_count]  = '\0';
+		/* Make sure arrays are big enough.  ("- 2" because of zero array
+		   origin and we need to leave room for the '\0' terminator.) */
+		if (word_count > (ALNUM_CHAR_SIZE - 2) || space_count > (WHITE_SPACE_SIZE - 2) || letter_count > (ALNUM_CHAR_SIZE - 2)) {
+			reg_error("internal error #9 'init_ansi_classes'");
+			return false;
+		}
 	}
 
+	Word_Char[word_count]     = '\0';
+	Letter_Char[letter_count] = '\0';
+	White_Space[space_count]  = '\0';
+
 	return true;
 }
 
+/*--------------------------------------------------------------------*
+ * init_ansi_classes
+ *
+ * Generate the character class sets, only once even if several threads
+ * compile regular expressions at the same time.
+ *
+ *--------------------------------------------------------------------*/
+bool init_ansi_classes() noexcept {
+	static const bool initialized = generate_ansi_classes();
+	return initialized;
+}
+
 /*----------------------------------------------------------------------*
  * emit_node
  *
@@ -1858,6 +1867,402 @@ uint8_t *chunk(int paren, int *flag_param, len_range &range_param) {
 	return ret_val;
 }
 
+/*----------------------------------------------------------------------*
+ * node_size
+ *
+ * Returns the size of a compiled node, including its operand.
+ *----------------------------------------------------------------------*/
+size_t node_size(uint8_t *node) {
+
+	switch (GET_OP_CODE(node)) {
+	case EXACTLY:
+	case SIMILAR:
+	case ANY_OF:
+	case ANY_BUT:
+		return NODE_SIZE + ::strlen(reinterpret_cast<char *>(OPERAND(node))) + 1;
+	case BRACE:
+	case LAZY_BRACE:
+		return NODE_SIZE + (2 * NEXT_PTR_SIZE);
+	case POS_BEHIND_OPEN:
+	case NEG_BEHIND_OPEN:
+		return NODE_SIZE + LENGTH_SIZE;
+	case TEST_COUNT:
+		return NODE_SIZE + INDEX_SIZE + NEXT_PTR_SIZE;
+	case INIT_COUNT:
+	case INC_COUNT:
+	case BACK_REF:
+	case BACK_REF_CI:
+	case X_REGEX_BR:
+	case X_REGEX_BR_CI:
+		return NODE_SIZE + INDEX_SIZE;
+	default:
+		return NODE_SIZE;
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * add_trie_node
+ *
+ * Adds the trie node for the strings in [first, last), which all share
+ * their first 'depth' characters, and returns its index.  The strings
+ * are sorted, and each comes with the index of its alternative.
+ *----------------------------------------------------------------------*/
+using Keyword = std::pair<std::string, uint16_t>;
+
+uint32_t add_trie_node(KeywordSet &set, std::vector<Keyword>::const_iterator first, std::vector<Keyword>::const_iterator last, size_t depth) {
+
+	const auto index = static_cast<uint32_t>(set.nodes.size());
+	set.nodes.push_back(KeywordSet::Node{0, 0, KeywordSet::NoBranch});
+
+	// Being sorted, a string which ends here comes first.
+	if (first->first.size() == depth) {
+		set.nodes[index].branch = first->second;
+		++first;
+	}
+
+	// The edges of a node have to be next to each other, so add them all
+	// before adding the nodes they lead to.
+	std::vector<std::pair<std::vector<Keyword>::const_iterator, std::vector<Keyword>::const_iterator>> children;
+
+	for (auto it = first; it != last;) {
+		const char ch = it->first[depth];
+
+		auto end = std::find_if(it, last, [ch, depth](const Keyword &keyword) {
+			return keyword.first[depth] != ch;
+		});
+
+		children.emplace_back(it, end);
+		it = end;
+	}
+
+	const auto first_edge       = static_cast<uint32_t>(set.edges.size());
+	set.nodes[index].first_edge = first_edge;
+	set.nodes[index].edge_count = static_cast<uint16_t>(children.size());
+
+	for (const auto &child : children) {
+		set.edges.push_back(KeywordSet::Edge{static_cast<uint8_t>(child.first->first[depth]), 0});
+	}
+
+	for (size_t i = 0; i < children.size(); ++i) {
+		const uint32_t node            = add_trie_node(set, children[i].first, children[i].second, depth + 1);
+		set.edges[first_edge + i].node = node;
+	}
+
+	return index;
+}
+
+/*----------------------------------------------------------------------*
+ * keyword_set
+ *
+ * Checks whether the choice starting at 'branch' is one between plain
+ * strings, i.e. whether every alternative is a single EXACTLY (or every
+ * one a single SIMILAR) node followed by whatever follows the choice.
+ * If so, puts the strings in a trie.
+ *----------------------------------------------------------------------*/
+bool keyword_set(uint8_t *program, uint8_t *branch, KeywordSet *set) {
+
+	// Too few alternatives aren't worth it.
+	constexpr size_t MinKeywords = 4;
+
+	std::vector<Keyword> keywords;
+	uint8_t *last_branch = branch;
+	uint8_t op_code      = GET_OP_CODE(OPERAND(branch));
+
+	if (op_code != EXACTLY && op_code != SIMILAR) {
+		return false;
+	}
+
+	for (uint8_t *scan = branch; scan != nullptr && GET_OP_CODE(scan) == BRANCH; scan = next_ptr(scan)) {
+		uint8_t *operand = OPERAND(scan);
+
+		if (GET_OP_CODE(operand) != op_code || keywords.size() >= KeywordSet::NoBranch) {
+			return false;
+		}
+
+		keywords.emplace_back(reinterpret_cast<char *>(OPERAND(operand)), static_cast<uint16_t>(keywords.size()));
+		last_branch = scan;
+	}
+
+	uint8_t *next = next_ptr(last_branch);
+
+	if (keywords.size() < MinKeywords || next == nullptr) {
+		return false;
+	}
+
+	for (uint8_t *scan = branch; scan != next; scan = next_ptr(scan)) {
+		if (next_ptr(OPERAND(scan)) != next) {
+			return false;
+		}
+	}
+
+	/* Sorting by index as well puts the first of several equal strings
+	   first, which is the only one of them that can ever match. */
+	std::sort(keywords.begin(), keywords.end());
+	keywords.erase(std::unique(keywords.begin(), keywords.end(), [](const Keyword &lhs, const Keyword &rhs) {
+					   return lhs.first == rhs.first;
+				   }),
+				   keywords.end());
+
+	set->offset           = static_cast<size_t>(branch - program);
+	set->next             = static_cast<size_t>(next - program);
+	set->case_insensitive = (op_code == SIMILAR);
+	add_trie_node(*set, keywords.cbegin(), keywords.cend(), 0);
+	return true;
+}
+
+/*----------------------------------------------------------------------*
+ * find_keyword_sets
+ *
+ * Finds the choices between plain strings in a compiled regex.  They are
+ * matched by 'ExecRE' with a trie instead of trying each alternative in
+ * turn, the program itself stays as it is.
+ *----------------------------------------------------------------------*/
+void find_keyword_sets(Regex *re) {
+
+	uint8_t *const program = &re->program[0];
+	uint8_t *const end     = program + re->program.size();
+
+	// Only the first BRANCH of a choice is of interest, so find the others.
+	std::vector<bool> chained(re->program.size());
+
+	for (uint8_t *scan = program + REGEX_START_OFFSET; scan < end; scan += node_size(scan)) {
+		if (GET_OP_CODE(scan) == BRANCH) {
+			uint8_t *next = next_ptr(scan);
+			if (next && GET_OP_CODE(next) == BRANCH) {
+				chained[static_cast<size_t>(next - program)] = true;
+			}
+		}
+	}
+
+	for (uint8_t *scan = program + REGEX_START_OFFSET; scan < end; scan += node_size(scan)) {
+		if (GET_OP_CODE(scan) == BRANCH && !chained[static_cast<size_t>(scan - program)]) {
+			KeywordSet set;
+			if (keyword_set(program, scan, &set)) {
+				re->keyword_sets.push_back(std::move(set));
+			}
+		}
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * add_chars_if
+ *
+ * Adds the characters for which 'pred' is true to 'chars'.
+ *----------------------------------------------------------------------*/
+template <class Pred>
+void add_chars_if(std::bitset<256> *chars, Pred pred) {
+	for (int ch = 0; ch < 256; ++ch) {
+		if (pred(static_cast<uint8_t>(ch))) {
+			chars->set(static_cast<size_t>(ch));
+		}
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * add_simple_chars
+ *
+ * Adds the characters matched by the SIMPLE node 'node' to 'chars'.
+ * Returns false if they depend on how the regex is run.
+ *----------------------------------------------------------------------*/
+bool add_simple_chars(uint8_t *node, std::bitset<256> *chars) {
+
+	const auto opnd = reinterpret_cast<const char *>(OPERAND(node));
+
+	switch (GET_OP_CODE(node)) {
+	case EXACTLY:
+		chars->set(static_cast<uint8_t>(opnd[0]));
+		return true;
+	case SIMILAR:
+		// The operand was converted to lower case during compile.
+		add_chars_if(chars, [opnd](uint8_t ch) { return safe_tolower(ch) == static_cast<uint8_t>(opnd[0]); });
+		return true;
+	case ANY_OF:
+		add_chars_if(chars, [opnd](uint8_t ch) { return ::strchr(opnd, ch) != nullptr; });
+		return true;
+	case ANY_BUT:
+		add_chars_if(chars, [opnd](uint8_t ch) { return ::strchr(opnd, ch) == nullptr; });
+		return true;
+	case ANY:
+		add_chars_if(chars, [](uint8_t ch) { return ch != '\n'; });
+		return true;
+	case EVERY:
+		chars->set();
+		return true;
+	case DIGIT:
+		add_chars_if(chars, [](uint8_t ch) { return safe_isdigit(ch); });
+		return true;
+	case NOT_DIGIT:
+		add_chars_if(chars, [](uint8_t ch) { return !safe_isdigit(ch) && ch != '\n'; });
+		return true;
+	case LETTER:
+		add_chars_if(chars, [](uint8_t ch) { return safe_isalpha(ch); });
+		return true;
+	case NOT_LETTER:
+		add_chars_if(chars, [](uint8_t ch) { return !safe_isalpha(ch) && ch != '\n'; });
+		return true;
+	case SPACE:
+		add_chars_if(chars, [](uint8_t ch) { return safe_isspace(ch) && ch != '\n'; });
+		return true;
+	case SPACE_NL:
+		add_chars_if(chars, [](uint8_t ch) { return safe_isspace(ch); });
+		return true;
+	case NOT_SPACE:
+		add_chars_if(chars, [](uint8_t ch) { return !safe_isspace(ch); });
+		return true;
+	case NOT_SPACE_NL:
+		add_chars_if(chars, [](uint8_t ch) { return !safe_isspace(ch) || ch == '\n'; });
+		return true;
+	case WORD_CHAR:
+		add_chars_if(chars, [](uint8_t ch) { return safe_isalnum(ch) || ch == '_'; });
+		return true;
+	case NOT_WORD_CHAR:
+		add_chars_if(chars, [](uint8_t ch) { return !safe_isalnum(ch) && ch != '_' && ch != '\n'; });
+		return true;
+	default:
+		// IS_DELIM and NOT_DELIM depend on the delimiters passed to 'ExecRE'.
+		return false;
+	}
+}
+
+/*----------------------------------------------------------------------*
+ * add_first_chars
+ *
+ * Adds the characters a match of the program at 'node' can start with
+ * to 'chars'.  Returns false if that can't be told, for instance because
+ * the program may match the empty string.  'budget' limits the number of
+ * nodes looked at, since every alternative of a choice which may be
+ * skipped leads to the nodes after it again.
+ *----------------------------------------------------------------------*/
+bool add_first_chars(uint8_t *node, std::bitset<256> *chars, int *budget) {
+
+	uint8_t *scan = node;
+
+	while (scan) {
+
+		if (--*budget < 0) {
+			return false;
+		}
+
+		const uint8_t op_code = GET_OP_CODE(scan);
+
+		switch (op_code) {
+		case BRANCH: {
+			uint8_t *next = next_ptr(scan);
+			if (!next || GET_OP_CODE(next) != BRANCH) { // No choice.
+				scan = OPERAND(scan);
+				continue;
+			}
+
+			for (; scan && GET_OP_CODE(scan) == BRANCH; scan = next_ptr(scan)) {
+				if (!add_first_chars(OPERAND(scan), chars, budget)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		case STAR:
+		case LAZY_STAR:
+		case QUESTION:
+		case LAZY_QUESTION:
+			// The operand may be skipped, so the rest may come first.
+			if (!add_simple_chars(OPERAND(scan), chars)) {
+				return false;
+			}
+			break;
+
+		case PLUS:
+		case LAZY_PLUS:
+			return add_simple_chars(OPERAND(scan), chars);
+
+		case BRACE:
+		case LAZY_BRACE:
+			if (!add_simple_chars(OPERAND(scan + (2 * NEXT_PTR_SIZE)), chars)) {
+				return false;
+			}
+
+			if (GET_OFFSET(scan + NEXT_PTR_SIZE) > 0) { // min > 0
+				return true;
+			}
+			break;
+
+		case BOL:
+		case EOL:
+		case BOWORD:
+		case EOWORD:
+		case NOT_BOUNDARY:
+		case NOTHING:
+			// Zero width, whatever follows comes first.
+			break;
+
+		case POS_AHEAD_OPEN:
+		case NEG_AHEAD_OPEN:
+		case POS_BEHIND_OPEN:
+		case NEG_BEHIND_OPEN: {
+			/* Zero width too.  Skip to the node after the construct the way
+			   'match' does, the characters it allows are not narrowed down
+			   any further. */
+			uint8_t *next;
+			if (op_code == POS_AHEAD_OPEN || op_code == NEG_AHEAD_OPEN) {
+				next = next_ptr(OPERAND(scan));
+			} else {
+				next = next_ptr(OPERAND(scan) + LENGTH_SIZE);
+			}
+
+			while (next && GET_OP_CODE(next) == BRANCH) {
+				next = next_ptr(next);
+			}
+
+			if (!next) {
+				return false;
+			}
+
+			scan = next_ptr(next);
+			continue;
+		}
+
+		default:
+			if (add_simple_chars(scan, chars)) {
+				return true;
+			}
+
+			if (op_code >= OPEN && op_code < LAST_PAREN) {
+				break; // Capturing parentheses are zero width as well.
+			}
+
+			// END, back references, counted constructs, ...
+			return false;
+		}
+
+		scan = next_ptr(scan);
+	}
+
+	return false;
+}
+
+/*----------------------------------------------------------------------*
+ * find_first_chars
+ *
+ * Finds the characters a match of a compiled regex can start with, so
+ * that 'ExecRE' doesn't have to try it anywhere else.  If they can't be
+ * told, all characters are assumed.
+ *----------------------------------------------------------------------*/
+void find_first_chars(Regex *re) {
+
+	std::bitset<256> chars;
+	int budget = 4096;
+
+	if (add_first_chars(&re->program[0] + REGEX_START_OFFSET, &chars, &budget)) {
+		/* A '\0' in the text is matched by every character class, because
+		   strchr() considers it part of every string. */
+		chars.set(0);
+		re->first_chars = chars;
+	} else {
+		re->first_chars.set();
+	}
+}
+
 }
 
 /*----------------------------------------------------------------------*
@@ -1990,4 +2395,7 @@ Regex::Regex(view::string_view exp, int defaultFlags) {
 			re->anchor++;
 		}
 	}
+
+	find_keyword_sets(re);
+	find_first_chars(re);
 }
@@ -8,7 +8,7 @@
 
 class Regex;
 
-// Global work variables for 'CompileRE'.
+// Per-thread work variables for 'CompileRE'.
 struct ParseContext {
 	view::string_view::iterator Reg_Parse; // Input scan ptr (scans user's regex)
 	view::string_view InputString;
@@ -26,6 +26,6 @@ struct ParseContext {
 	char Brace_Char;
 };
 
-extern ParseContext pContext;
+extern thread_local ParseContext pContext;
 
 #endif
@@ -6,6 +6,7 @@
 #include "Opcodes.h"
 #include "Regex.h"
 #include "RegexError.h"
+#include "RegexSet.h"
 #include "Util/Compiler.h"
 #include "Util/utils.h"
 
@@ -226,6 +227,116 @@ uint32_t greedy(uint8_t *p, uint32_t max) {
 	return count;
 }
 
+/*----------------------------------------------------------------------*
+ * keyword_set_at
+ *
+ * Returns the keyword set standing in for the choice starting at the
+ * BRANCH node 'node', if there is one.
+ *----------------------------------------------------------------------*/
+const KeywordSet *keyword_set_at(const uint8_t *node) {
+
+	const std::vector<KeywordSet> &sets = *eContext.Keyword_Sets;
+	if (sets.empty()) {
+		return nullptr;
+	}
+
+	const auto offset = static_cast<size_t>(node - eContext.Program_Start);
+
+	auto it = std::lower_bound(sets.begin(), sets.end(), offset, [](const KeywordSet &set, size_t value) {
+		return set.offset < value;
+	});
+
+	if (it == sets.end() || it->offset != offset) {
+		return nullptr;
+	}
+
+	return &*it;
+}
+
+/*----------------------------------------------------------------------*
+ * next_keyword
+ *
+ * Looks up the string at 'input' in a keyword set and returns the lowest
+ * numbered alternative above 'after' which matches there (or NoBranch),
+ * along with its length.
+ *----------------------------------------------------------------------*/
+uint16_t next_keyword(const KeywordSet &set, const char *input, int after, size_t *length) {
+
+	uint16_t branch  = KeywordSet::NoBranch;
+	const char *scan = input;
+	uint32_t index   = 0;
+
+	while (true) {
+		const KeywordSet::Node &node = set.nodes[index];
+
+		if (node.branch < branch && static_cast<int>(node.branch) > after) {
+			branch  = node.branch;
+			*length = static_cast<size_t>(scan - input);
+		}
+
+		if (node.edge_count == 0 || end_of_string(scan)) {
+			break;
+		}
+
+		const auto ch = static_cast<uint8_t>(set.case_insensitive ? safe_tolower(*scan) : *scan);
+
+		const KeywordSet::Edge *edge = &set.edges[node.first_edge];
+		const KeywordSet::Edge *last = edge + node.edge_count;
+
+		// The edges are sorted by character.
+		while (edge != last && edge->ch < ch) {
+			++edge;
+		}
+
+		if (edge == last || edge->ch != ch) {
+			break;
+		}
+
+		index = edge->node;
+		++scan;
+	}
+
+	return branch;
+}
+
+/*----------------------------------------------------------------------*
+ * match_keywords
+ *
+ * Matches a choice between plain strings the way the BRANCH nodes it
+ * stands in for would, i.e. tries the alternatives which match at the
+ * current position in their original order, until the rest of the regex
+ * matches too.
+ *----------------------------------------------------------------------*/
+bool match_keywords(const KeywordSet &set, size_t *branch_index_param) {
+
+	const char *save = eContext.Reg_Input;
+	uint8_t *next    = eContext.Program_Start + set.next;
+	int after        = -1;
+	size_t length    = 0;
+
+	uint16_t branch;
+	while ((branch = next_keyword(set, save, after, &length)) != KeywordSet::NoBranch) {
+
+		eContext.Reg_Input = save + length;
+
+		if (match(next, nullptr)) {
+			if (branch_index_param) {
+				*branch_index_param = branch;
+			}
+			return true;
+		}
+
+		if (eContext.Recursion_Limit_Exceeded) {
+			break;
+		}
+
+		after = branch;
+	}
+
+	eContext.Reg_Input = save; // Backtrack.
+	return false;
+}
+
 /*----------------------------------------------------------------------*
  * match - main matching routine
  *
@@ -271,6 +382,8 @@ bool match(uint8_t *prog, size_t *branch_index_param) {
 		case BRANCH:
 			if (GET_OP_CODE(next) != BRANCH) { // No choice.
 				next = OPERAND(scan);          // Avoid recursion.
+			} else if (const KeywordSet *keywords = keyword_set_at(scan)) {
+				MATCH_RETURN(match_keywords(*keywords, branch_index_param));
 			} else {
 				size_t branch_index_local = 0;
 
@@ -1075,6 +1188,9 @@ bool Regex::ExecRE(const char *start, const char *end, bool reverse, int prev_ch
 	eContext.Total_Paren = re->program[1];
 	eContext.Num_Braces  = re->program[2];
 
+	eContext.Program_Start = &re->program[0];
+	eContext.Keyword_Sets  = &re->keyword_sets;
+
 	// Reset the recursion detection flag
 	eContext.Recursion_Limit_Exceeded = false;
 
@@ -1091,6 +1207,13 @@ bool Regex::ExecRE(const char *start, const char *end, bool reverse, int prev_ch
 	std::fill_n(re->startp.begin(), 9, start);
 	std::fill_n(re->endp.begin(), 9, start);
 
+	/* Forget the back references of earlier calls, which may point into
+	   another string. Not every position gets an attempt, so a back reference
+	   to a group which hasn't been opened yet can't rely on 'attempt' having
+	   reset them. */
+	eContext.Back_Ref_Start.fill(nullptr);
+	eContext.Back_Ref_End.fill(nullptr);
+
 	auto checked_return = [](bool value) {
 		if (eContext.Recursion_Limit_Exceeded) {
 			return false;
@@ -1133,10 +1256,10 @@ bool Regex::ExecRE(const char *start, const char *end, bool reverse, int prev_ch
 
 			return checked_return(ret_val);
 		} else {
-			// General case
+			// General case, skipping the characters no match can start with
 			for (str = start; !end_of_string(str) && str != end && !eContext.Recursion_Limit_Exceeded; str++) {
 
-				if (attempt(re, str)) {
+				if (re->first_chars[static_cast<uint8_t>(*str)] && attempt(re, str)) {
 					ret_val = true;
 					break;
 				}
@@ -1204,3 +1327,113 @@ bool Regex::ExecRE(const char *start, const char *end, bool reverse, int prev_ch
 
 	return checked_return(ret_val);
 }
+
+/**
+ * @brief RegexSet::ExecRE
+ * @param start
+ * @param end
+ * @param prev_char
+ * @param succ_char
+ * @param delimiters
+ * @param look_behind_to
+ * @param match_to
+ * @param string_end
+ * @return
+ *
+ * Works like the general case of a forward 'Regex::ExecRE' of a regex made
+ * of the alternatives of the set, except that at each position only the
+ * regexes whose matches can start with the character found there are tried.
+ */
+bool RegexSet::ExecRE(const char *start, const char *end, int prev_char, int succ_char, const char *delimiters, const char *look_behind_to, const char *match_to, const char *string_end) {
+
+	const char *str;
+	uint8_t braces = 0;
+
+	for (Regex &re : regexes_) {
+		// Check validity of program.
+		if (!re.isValid()) {
+			reg_error("corrupted program");
+			return false;
+		}
+
+		// See 'Regex::ExecRE'
+		std::fill_n(re.startp.begin(), 9, start);
+		std::fill_n(re.endp.begin(), 9, start);
+
+		braces = std::max(braces, re.program[2]);
+	}
+
+	// If caller has supplied delimiters, make a delimiter table
+	eContext.Current_Delimiters = delimiters ? Regex::makeDelimiterTable(delimiters) : Regex::Default_Delimiters;
+
+	// Remember the logical and physical end of the string.
+	eContext.End_Of_String      = match_to;
+	eContext.Real_End_Of_String = string_end;
+
+	if (!end) {
+		succ_char = '\n';
+	}
+
+	// Remember the beginning of the string for matching BOL
+	eContext.Start_Of_String = start;
+	eContext.Look_Behind_To  = (look_behind_to ? look_behind_to : start);
+
+	eContext.Prev_Is_BOL   = (prev_char == '\n') || (prev_char == -1);
+	eContext.Succ_Is_EOL   = (succ_char == '\n') || (succ_char == -1);
+	eContext.Prev_Is_Delim = (prev_char == -1) || eContext.Current_Delimiters[static_cast<uint8_t>(prev_char)];
+	eContext.Succ_Is_Delim = (succ_char == -1) || eContext.Current_Delimiters[static_cast<uint8_t>(succ_char)];
+
+	// Reset the recursion detection flag
+	eContext.Recursion_Limit_Exceeded = false;
+
+	// See 'Regex::ExecRE'
+	eContext.Back_Ref_Start.fill(nullptr);
+	eContext.Back_Ref_End.fill(nullptr);
+
+	// Big enough for the {m,n} constructs of any of the regexes.
+	if (braces > 0) {
+		eContext.BraceCounts = std::make_unique<uint32_t[]>(braces);
+	}
+
+	auto attempt_regex = [this](size_t index, const char *string) {
+		Regex *const re = &regexes_[index];
+
+		eContext.Total_Paren   = re->program[1];
+		eContext.Num_Braces    = re->program[2];
+		eContext.Program_Start = &re->program[0];
+		eContext.Keyword_Sets  = &re->keyword_sets;
+
+		if (attempt(re, string)) {
+			startp     = re->startp[0];
+			endp       = re->endp[0];
+			top_branch = index;
+			return true;
+		}
+
+		return false;
+	};
+
+	for (str = start; !end_of_string(str) && str != end && !eContext.Recursion_Limit_Exceeded; str++) {
+
+		for (size_t index : candidates_[candidates_at_[static_cast<uint8_t>(*str)]]) {
+			if (attempt_regex(index, str)) {
+				return !eContext.Recursion_Limit_Exceeded;
+			}
+
+			if (eContext.Recursion_Limit_Exceeded) {
+				break;
+			}
+		}
+	}
+
+	// Beware of a single $ matching \0
+	if (end_of_string(str)) {
+		for (size_t index = 0; index < regexes_.size() && !eContext.Recursion_Limit_Exceeded; ++index) {
+			if (attempt_regex(index, str)) {
+				return !eContext.Recursion_Limit_Exceeded;
+			}
+		}
+	}
+
+	return false;
+}
@@ -3,17 +3,19 @@
 #define EXECUTE_H_
 
 #include "Constants.h"
+#include "KeywordSet.h"
 #include "Util/string_view.h"
 #include <array>
 #include <bitset>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
 // #define ENABLE_CROSS_REGEX_BACKREF
 
 class Regex;
 
-// Global work variables for 'ExecRE'.
+// Per-thread work variables for 'ExecRE'.
 
 template <size_t N>
 using array_iterator = typename std::array<const char *, N>::iterator;
@@ -32,6 +34,8 @@ struct ExecuteContext {
 	std::array<const char *, 10> Back_Ref_Start; // Back_Ref_Start [0] and
 	std::array<const char *, 10> Back_Ref_End;   // Back_Ref_End [0] are not used. This simplifies indexing.
 	int Recursion_Count;                         // Recursion counter
+	uint8_t *Program_Start;                      // Start of the program being run, for finding its keyword sets
+	const std::vector<KeywordSet> *Keyword_Sets; // Keyword sets of the program being run
 
 #ifdef ENABLE_CROSS_REGEX_BACKREF
 	Regex *Cross_Regex_Backref;
@@ -46,6 +50,6 @@ struct ExecuteContext {
 	std::bitset<256> Current_Delimiters; // Current delimiter table
 };
 
-extern ExecuteContext eContext;
+extern thread_local ExecuteContext eContext;
 
 #endif
@@ -0,0 +1,36 @@
+
+#ifndef KEYWORD_SET_H_
+#define KEYWORD_SET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* A choice between plain strings, like the "(?:abort|abs|accept|...)" found
+   in many syntax highlighting patterns. Rather than trying the alternatives
+   one after another, 'ExecRE' walks a trie of them, which finds all of the
+   alternatives matching at the current position by looking at each character
+   only once. They are then tried in their original order, so the result is
+   the same as that of the BRANCH nodes it stands in for. */
+struct KeywordSet {
+	static constexpr uint16_t NoBranch = 0xffff;
+
+	struct Node {
+		uint32_t first_edge; // Index of the first edge to a child in 'edges'
+		uint16_t edge_count; // Number of children, their edges are sorted by character
+		uint16_t branch;     // Index of the alternative which ends here, or NoBranch
+	};
+
+	struct Edge {
+		uint8_t ch;
+		uint32_t node;
+	};
+
+	size_t offset;           // Offset of the first BRANCH node of the choice in the program
+	size_t next;             // Offset of the node following the choice
+	bool case_insensitive;   // Characters are lower cased before they are looked up
+	std::vector<Node> nodes; // nodes[0] is the root
+	std::vector<Edge> edges;
+};
+
+#endif
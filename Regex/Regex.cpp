@@ -87,8 +87,9 @@
 // Default table for determining whether a character is a word delimiter.
 std::bitset<256> Regex::Default_Delimiters;
 
-ExecuteContext eContext;
-ParseContext pContext;
+// each thread compiling or executing a regex gets its own work variables
+thread_local ExecuteContext eContext;
+thread_local ParseContext pContext;
 
 /* The "internal use only" fields in `Regex.h' are present to pass info from
  * `CompileRE' to `ExecRE' which permits the execute phase to run lots faster on
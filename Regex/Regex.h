@@ -3,6 +3,7 @@
 #define REGEX_H_
 
 #include "Constants.h"
+#include "KeywordSet.h"
 #include "RegexError.h"
 #include "Util/string_view.h"
 
@@ -22,8 +23,8 @@ enum RE_DEFAULT_FLAG {
 class Regex {
 public:
 	Regex(view::string_view exp, int defaultFlags);
-	Regex(const Regex &)            = delete;
-	Regex &operator=(const Regex &) = delete;
+	Regex(const Regex &)            = default;
+	Regex &operator=(const Regex &) = default;
 	~Regex()                        = default;
 
 public:
@@ -126,6 +127,8 @@ public:
 	char match_start                            = '\0';    /* Internal use only. */
 	char anchor                                 = '\0';    /* Internal use only. */
 	std::vector<uint8_t> program;
+	std::vector<KeywordSet> keyword_sets; /* Internal use only. Sorted by offset. */
+	std::bitset<256> first_chars;         /* Internal use only. Characters a match can start with. */
 
 public:
 	static std::bitset<256> Default_Delimiters;
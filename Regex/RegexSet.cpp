@@ -0,0 +1,40 @@
+
+#include "RegexSet.h"
+
+#include <algorithm>
+#include <utility>
+
+/**
+ * @brief RegexSet::RegexSet
+ * @param regexes
+ */
+RegexSet::RegexSet(std::vector<Regex> regexes) : regexes_(std::move(regexes)) {
+
+	/* Find the regexes which may match starting with each character.  Most
+	   characters share their list with many others, so each different list
+	   is only kept once. */
+	for (size_t ch = 0; ch < 256; ++ch) {
+
+		std::vector<size_t> list;
+		for (size_t i = 0; i < regexes_.size(); ++i) {
+			if (regexes_[i].first_chars[ch]) {
+				list.push_back(i);
+			}
+		}
+
+		auto it = std::find(candidates_.begin(), candidates_.end(), list);
+		if (it == candidates_.end()) {
+			it = candidates_.insert(candidates_.end(), std::move(list));
+		}
+
+		candidates_at_[ch] = static_cast<uint8_t>(it - candidates_.begin());
+	}
+}
+
+/**
+ * @brief RegexSet::size
+ * @return the number of regexes in the set
+ */
+size_t RegexSet::size() const noexcept {
+	return regexes_.size();
+}
@@ -0,0 +1,46 @@
+
+#ifndef REGEX_SET_H_
+#define REGEX_SET_H_
+
+#include "Regex.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* A list of regexes which are searched for together, as if they were the
+   alternatives of one big regex: 'ExecRE' finds the leftmost position where
+   any of them matches, and of the ones matching there the first.  Each regex
+   is only tried where a match of it can start, and unlike one big regex, the
+   total size isn't limited by the 16 bit NEXT pointers.  Used by syntax
+   highlighting to find the sub-pattern, end or error pattern which comes
+   next. */
+class RegexSet {
+public:
+	explicit RegexSet(std::vector<Regex> regexes);
+	RegexSet(const RegexSet &)            = default;
+	RegexSet &operator=(const RegexSet &) = default;
+	~RegexSet()                           = default;
+
+public:
+	/**
+	 * Match the regexes against a string, searching forward.  The parameters
+	 * are the same as those of 'Regex::ExecRE'.
+	 */
+	bool ExecRE(const char *start, const char *end, int prev_char, int succ_char, const char *delimiters, const char *look_behind_to, const char *match_to, const char *string_end);
+
+	size_t size() const noexcept;
+
+public:
+	const char *startp = nullptr; /* Start of the last match. */
+	const char *endp   = nullptr; /* One char after the end of the last match. */
+	size_t top_branch  = 0;       /* Index of the regex which matched last. */
+
+private:
+	std::vector<Regex> regexes_;
+	std::vector<std::vector<size_t>> candidates_; // Lists of regexes to try, in order
+	std::array<uint8_t, 256> candidates_at_;      // Index into candidates_ for each character
+};
+
+#endif
@@ -1,7 +1,11 @@
 
 #include "Decompile.h"
 #include "Regex.h"
+#include "RegexSet.h"
 #include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace {
 
@@ -20,6 +24,73 @@ int test_regex_match(view::string_view regex, view::string_view input) {
 	return -1;
 }
 
+/* A choice between plain strings is matched with a trie rather than by trying
+   each alternative in turn, this checks that it still matches what trying them
+   in turn would */
+int test_keyword_match(view::string_view regex, view::string_view input, view::string_view expected, size_t branch) {
+	Regex re(regex, REDFLT_STANDARD);
+
+	if (re.keyword_sets.empty()) {
+		return -1;
+	}
+
+	if (!re.execute(input, 0, " ")) {
+		return -1;
+	}
+
+	if (view::string_view(re.startp[0], static_cast<size_t>(re.endp[0] - re.startp[0])) != expected || re.top_branch != branch) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* A back reference to a group which wasn't opened in this search must not
+   see the groups of an earlier search, which may have been of a string which
+   no longer exists, so the same search gives the same match every time */
+int test_stale_back_reference() {
+	Regex re("^(|c|Ac|)(Ac)|a\\1", REDFLT_CASE_INSENSITIVE);
+	const std::string input = ".A\nAaa";
+
+	if (!re.execute(input)) {
+		return -1;
+	}
+
+	const view::string_view expected(re.startp[0], static_cast<size_t>(re.endp[0] - re.startp[0]));
+
+	{
+		Regex other("<(1Bb|a|c|Aa|__|11)>|", REDFLT_STANDARD);
+		const std::string otherInput = "a A.Ab1bbA1baa1";
+		other.execute(otherInput);
+	}
+
+	if (!re.execute(input)) {
+		return -1;
+	}
+
+	if (re.startp[0] != expected.begin() || re.endp[0] != expected.end()) {
+		return -1;
+	}
+
+	return 0;
+}
+
+/* A set of regexes finds the leftmost match of any of them, the first of them
+   if several match there, like one regex made of them as alternatives would */
+int test_set_match(std::vector<Regex> regexes, view::string_view input, view::string_view expected, size_t branch) {
+	RegexSet set(std::move(regexes));
+
+	if (!set.ExecRE(input.begin(), input.end(), -1, -1, " ", input.begin(), input.end(), input.end())) {
+		return -1;
+	}
+
+	if (view::string_view(set.startp, static_cast<size_t>(set.endp - set.startp)) != expected || set.top_branch != branch) {
+		return -1;
+	}
+
+	return 0;
+}
+
 }
 
 int main() {
@@ -773,6 +844,61 @@ int main() {
 		return -1;
 	}
 
+	if (test_keyword_match("<(ab|abc|abcd|abcde)>", "xy abcd z", "abcd", 0) != 0) {
+		std::cerr << "ERROR    : Failed to backtrack into a longer keyword" << std::endl;
+		return -1;
+	}
+
+	if (test_keyword_match("in|int|integer|i", "integer", "in", 0) != 0) {
+		std::cerr << "ERROR    : Failed to prefer the first matching keyword" << std::endl;
+		return -1;
+	}
+
+	if (test_keyword_match("alpha|beta|gamma|delta", "the gamma ray", "gamma", 2) != 0) {
+		std::cerr << "ERROR    : Failed to report the matching keyword's branch" << std::endl;
+		return -1;
+	}
+
+	if (test_keyword_match("if|else|if|then", "then", "then", 3) != 0) {
+		std::cerr << "ERROR    : Failed to match keywords after a duplicate" << std::endl;
+		return -1;
+	}
+
+	if (test_keyword_match("(?ifoo|bar|baz|qux)", "a BAZ", "BAZ", 2) != 0) {
+		std::cerr << "ERROR    : Failed to match case insensitive keywords" << std::endl;
+		return -1;
+	}
+
+	if (test_keyword_match("(one|two|three|four)s", "threes", "threes", 0) != 0) {
+		std::cerr << "ERROR    : Failed to match keywords in a group" << std::endl;
+		return -1;
+	}
+
+	if (test_set_match({Regex("world", REDFLT_STANDARD), Regex("hello", REDFLT_STANDARD)}, "hello world", "hello", 1) != 0) {
+		std::cerr << "ERROR    : Failed to find the leftmost match of a set" << std::endl;
+		return -1;
+	}
+
+	if (test_set_match({Regex("<\\l+>", REDFLT_STANDARD), Regex("<if>", REDFLT_STANDARD)}, "if x", "if", 0) != 0) {
+		std::cerr << "ERROR    : Failed to prefer the first regex of a set" << std::endl;
+		return -1;
+	}
+
+	if (test_set_match({Regex("\\d+", REDFLT_STANDARD), Regex("(?=b)\\l+", REDFLT_STANDARD)}, "a bc 12", "bc", 1) != 0) {
+		std::cerr << "ERROR    : Failed to match a set member starting with a look-ahead" << std::endl;
+		return -1;
+	}
+
+	if (test_set_match({Regex("z", REDFLT_STANDARD), Regex("$", REDFLT_STANDARD)}, "abc", "", 1) != 0) {
+		std::cerr << "ERROR    : Failed to match an empty set member at the end" << std::endl;
+		return -1;
+	}
+
+	if (test_stale_back_reference() != 0) {
+		std::cerr << "ERROR    : Back reference to a group of an earlier search" << std::endl;
+		return -1;
+	}
+
 #if 0 // testing "catastrophic backtracking" 
     if (test_regex_match(R"((\\?.)*\\\n)", R"(Ada:Default\n\tAwk:Default\n\tC++:Default\n\tC:Default\n\tCSS:Default\n\tCsh:Default\n\tFortran:Default\n\tJava:Default\n\tJavaScript:Default\n\tLaTeX:Default\n\tLex:Default\n\tMakefile:Default\n\tMatlab:Default\n\tNEdit Macro:Default\n\tPascal:Default\n\tPerl:Default\n\tPostScript:Default\n\tPython:Default\n\tRegex:Default\n\tSGML HTML:Default\n\tSQL:Default\n\tSh Ksh Bash:Default\n\tTcl:Default\n\tVHDL:Default\n\tVerilog:Default\n\tXML:Default\n\tX Resources:Default\n\tYacc:Default)") != 0) {
 		std::cerr << "ERROR    : Failed to X resources match" << std::endl;
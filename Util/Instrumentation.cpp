@@ -0,0 +1,331 @@
+
+#include "Util/Instrumentation.h"
+
+#include <QCoreApplication>
+#include <QSaveFile>
+#include <QString>
+#include <QtDebug>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+
+namespace Instrumentation {
+
+std::atomic<bool> Active{false};
+
+namespace {
+
+// a trace is capped at roughly 100MB of events, the rest is dropped
+constexpr size_t MaxTraceEvents = 2 * 1024 * 1024;
+
+struct TraceEvent {
+	const char *name;
+	int64_t start;   // nanoseconds since the trace was started
+	int64_t value;   // the duration for a timer, the running total for a counter
+	uint32_t thread;
+	ProbeType type;
+};
+
+struct Registry {
+	std::mutex probesLock;
+	std::vector<Probe *> probes;
+
+	std::mutex traceLock;
+	std::vector<TraceEvent> events;
+	Clock::time_point traceStart;
+	size_t dropped = 0;
+
+	bool statistics = false;
+	std::atomic<bool> tracing{false};
+};
+
+Registry &registry() {
+	static Registry instance;
+	return instance;
+}
+
+/**
+ * @brief threadIndex
+ * @return a small number identifying the calling thread in a trace
+ */
+uint32_t threadIndex() {
+	static std::atomic<uint32_t> nextIndex{1};
+	thread_local const uint32_t index = nextIndex++;
+	return index;
+}
+
+/**
+ * @brief updateActive
+ * @param reg
+ */
+void updateActive(const Registry &reg) {
+	Active = reg.statistics || reg.tracing;
+}
+
+/**
+ * @brief traceEvent
+ * @param name
+ * @param type
+ * @param start
+ * @param value
+ */
+void traceEvent(const char *name, ProbeType type, Clock::time_point start, int64_t value) {
+
+	Registry &reg = registry();
+
+	std::lock_guard<std::mutex> lock(reg.traceLock);
+	if (!reg.tracing) {
+		return;
+	}
+
+	if (reg.events.size() >= MaxTraceEvents) {
+		++reg.dropped;
+		return;
+	}
+
+	const int64_t offset = std::chrono::duration_cast<std::chrono::nanoseconds>(start - reg.traceStart).count();
+	reg.events.push_back({name, offset, value, threadIndex(), type});
+}
+
+/**
+ * @brief microseconds
+ * @param ns
+ * @return ns as a decimal number of microseconds, which is the unit used by
+ * the trace event format
+ */
+QByteArray microseconds(int64_t ns) {
+	return QByteArray::number(static_cast<double>(ns) / 1000.0, 'f', 3);
+}
+
+}
+
+/**
+ * @brief Probe::Probe
+ * @param name a string literal, it is referenced and not copied
+ * @param type
+ */
+Probe::Probe(const char *name, ProbeType type)
+	: name(name), type(type) {
+
+	Registry &reg = registry();
+	std::lock_guard<std::mutex> lock(reg.probesLock);
+	reg.probes.push_back(this);
+}
+
+/**
+ * @brief Probe::record
+ * @param start
+ * @param end
+ */
+void Probe::record(Clock::time_point start, Clock::time_point end) noexcept {
+
+	const int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+	calls.fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(elapsed, std::memory_order_relaxed);
+
+	int64_t previous = max.load(std::memory_order_relaxed);
+	while (previous < elapsed && !max.compare_exchange_weak(previous, elapsed, std::memory_order_relaxed)) {
+	}
+
+	if (registry().tracing.load(std::memory_order_relaxed)) {
+		traceEvent(name, type, start, elapsed);
+	}
+}
+
+/**
+ * @brief Probe::add
+ * @param n
+ */
+void Probe::add(int64_t n) noexcept {
+
+	calls.fetch_add(1, std::memory_order_relaxed);
+	const int64_t value = total.fetch_add(n, std::memory_order_relaxed) + n;
+
+	if (registry().tracing.load(std::memory_order_relaxed)) {
+		traceEvent(name, type, Clock::now(), value);
+	}
+}
+
+/**
+ * @brief setStatisticsEnabled
+ * @param enabled
+ */
+void setStatisticsEnabled(bool enabled) {
+	Registry &reg  = registry();
+	reg.statistics = enabled;
+	updateActive(reg);
+}
+
+/**
+ * @brief statisticsEnabled
+ * @return
+ */
+bool statisticsEnabled() {
+	return registry().statistics;
+}
+
+/**
+ * @brief resetStatistics
+ */
+void resetStatistics() {
+	Registry &reg = registry();
+
+	std::lock_guard<std::mutex> lock(reg.probesLock);
+	for (Probe *probe : reg.probes) {
+		probe->calls = 0;
+		probe->total = 0;
+		probe->max   = 0;
+	}
+}
+
+/**
+ * @brief statistics
+ * @return the accumulated numbers of every probe which has been hit so far.
+ * Probes sharing a name (such as a probe in a template) are merged
+ */
+std::vector<Statistic> statistics() {
+
+	Registry &reg = registry();
+	std::vector<Statistic> stats;
+
+	std::lock_guard<std::mutex> lock(reg.probesLock);
+	for (const Probe *probe : reg.probes) {
+
+		const uint64_t calls = probe->calls;
+		if (calls == 0) {
+			continue;
+		}
+
+		auto it = std::find_if(stats.begin(), stats.end(), [probe](const Statistic &stat) {
+			return stat.type == probe->type && std::strcmp(stat.name, probe->name) == 0;
+		});
+
+		if (it == stats.end()) {
+			stats.push_back({probe->name, probe->type, calls, probe->total, probe->max});
+		} else {
+			it->calls += calls;
+			it->total += probe->total;
+			it->max = std::max<int64_t>(it->max, probe->max);
+		}
+	}
+
+	return stats;
+}
+
+/**
+ * @brief startTrace
+ *
+ * starts recording a new trace, discarding any events of a previous one
+ */
+void startTrace() {
+	Registry &reg = registry();
+
+	{
+		std::lock_guard<std::mutex> lock(reg.traceLock);
+		reg.events.clear();
+		reg.dropped    = 0;
+		reg.traceStart = Clock::now();
+		reg.tracing    = true;
+	}
+
+	updateActive(reg);
+}
+
+/**
+ * @brief isTracing
+ * @return
+ */
+bool isTracing() {
+	return registry().tracing;
+}
+
+/**
+ * @brief stopTrace
+ * @param filename
+ * @return true if the trace recorded since startTrace() was written to
+ * filename in the Chrome trace event format. An empty filename discards the
+ * trace
+ */
+bool stopTrace(const QString &filename) {
+
+	Registry &reg = registry();
+
+	std::vector<TraceEvent> events;
+	size_t dropped;
+
+	{
+		std::lock_guard<std::mutex> lock(reg.traceLock);
+		reg.tracing = false;
+		events      = std::move(reg.events);
+		dropped     = reg.dropped;
+		reg.events  = {};
+	}
+
+	updateActive(reg);
+
+	if (filename.isEmpty()) {
+		return false;
+	}
+
+	if (dropped != 0) {
+		qWarning("NEdit: trace buffer full, %zu events were dropped", dropped);
+	}
+
+	QSaveFile file(filename);
+	if (!file.open(QIODevice::WriteOnly)) {
+		qWarning("NEdit: Could not write trace file %s", qPrintable(filename));
+		return false;
+	}
+
+	const QByteArray pid = QByteArray::number(QCoreApplication::applicationPid());
+
+	QByteArray chunk;
+	chunk.reserve(1024 * 1024);
+	chunk.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+	bool first = true;
+	for (const TraceEvent &event : events) {
+
+		if (!first) {
+			chunk.append(",\n");
+		}
+		first = false;
+
+		// names are string literals from the source code, no escaping needed
+		chunk.append("{\"name\":\"");
+		chunk.append(event.name);
+		chunk.append("\",\"pid\":");
+		chunk.append(pid);
+		chunk.append(",\"tid\":");
+		chunk.append(QByteArray::number(event.thread));
+		chunk.append(",\"ts\":");
+		chunk.append(microseconds(event.start));
+
+		switch (event.type) {
+		case ProbeType::Timer:
+			chunk.append(",\"ph\":\"X\",\"dur\":");
+			chunk.append(microseconds(event.value));
+			chunk.append("}");
+			break;
+		case ProbeType::Counter:
+			chunk.append(",\"ph\":\"C\",\"args\":{\"value\":");
+			chunk.append(QByteArray::number(static_cast<qlonglong>(event.value)));
+			chunk.append("}}");
+			break;
+		}
+
+		if (chunk.size() > 1024 * 1024) {
+			file.write(chunk);
+			chunk.clear();
+		}
+	}
+
+	chunk.append("\n]}\n");
+	file.write(chunk);
+
+	return file.commit();
+}
+
+}
@@ -0,0 +1,123 @@
+
+#ifndef UTIL_INSTRUMENTATION_H_
+#define UTIL_INSTRUMENTATION_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+class QString;
+
+/*
+ * Runtime instrumentation of the hot paths of the editor.
+ *
+ * Every instrumented place owns a static Probe which accumulates the number
+ * of calls and the time spent there (or, for counters, a running total).
+ * Nothing is measured unless statistics or a trace are switched on, so the
+ * cost of a disabled probe is a single relaxed atomic load.
+ *
+ * While a trace is being recorded every timed scope and counter update is
+ * also logged as an event, and the session can be written out in the Chrome
+ * trace event format, which chrome://tracing and Perfetto can load.
+ *
+ * Use the INSTRUMENT_SCOPE and INSTRUMENT_COUNT macros rather than the
+ * classes directly, they compile to nothing if NEDIT_INSTRUMENTATION isn't
+ * defined.
+ */
+namespace Instrumentation {
+
+using Clock = std::chrono::steady_clock;
+
+enum class ProbeType {
+	Timer,
+	Counter
+};
+
+struct Statistic {
+	const char *name;
+	ProbeType type;
+	uint64_t calls;
+	int64_t total; // nanoseconds for timers
+	int64_t max;   // nanoseconds for timers
+};
+
+class Probe {
+public:
+	Probe(const char *name, ProbeType type);
+	Probe(const Probe &) = delete;
+	Probe &operator=(const Probe &) = delete;
+
+public:
+	void record(Clock::time_point start, Clock::time_point end) noexcept;
+	void add(int64_t n) noexcept;
+
+public:
+	const char *const name;
+	const ProbeType type;
+	std::atomic<uint64_t> calls{0};
+	std::atomic<int64_t> total{0};
+	std::atomic<int64_t> max{0};
+};
+
+extern std::atomic<bool> Active;
+
+inline bool active() noexcept {
+	return Active.load(std::memory_order_relaxed);
+}
+
+class ScopedTimer {
+public:
+	explicit ScopedTimer(Probe &probe) noexcept
+		: probe_(active() ? &probe : nullptr) {
+		if (probe_) {
+			start_ = Clock::now();
+		}
+	}
+
+	~ScopedTimer() noexcept {
+		if (probe_) {
+			probe_->record(start_, Clock::now());
+		}
+	}
+
+	ScopedTimer(const ScopedTimer &) = delete;
+	ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+private:
+	Probe *probe_;
+	Clock::time_point start_;
+};
+
+void setStatisticsEnabled(bool enabled);
+bool statisticsEnabled();
+void resetStatistics();
+std::vector<Statistic> statistics();
+
+void startTrace();
+bool isTracing();
+bool stopTrace(const QString &filename);
+
+}
+
+#define INSTRUMENT_CONCAT_(a, b) a##b
+#define INSTRUMENT_CONCAT(a, b)  INSTRUMENT_CONCAT_(a, b)
+
+#ifdef NEDIT_INSTRUMENTATION
+#define INSTRUMENT_SCOPE(name)                                                                                       \
+	static Instrumentation::Probe INSTRUMENT_CONCAT(instrumentProbe_, __LINE__)(name, Instrumentation::ProbeType::Timer); \
+	const Instrumentation::ScopedTimer INSTRUMENT_CONCAT(instrumentTimer_, __LINE__)(INSTRUMENT_CONCAT(instrumentProbe_, __LINE__))
+
+#define INSTRUMENT_COUNT(name, n)                                                                   \
+	do {                                                                                            \
+		if (Instrumentation::active()) {                                                            \
+			static Instrumentation::Probe instrumentProbe_(name, Instrumentation::ProbeType::Counter); \
+			instrumentProbe_.add(n);                                                                \
+		}                                                                                           \
+	} while (0)
+#else
+#define INSTRUMENT_SCOPE(name) (void)0
+#define INSTRUMENT_COUNT(name, n) (void)0
+#endif
+
+#endif
@@ -34,7 +34,7 @@ constexpr const char cmdLineHelp[] = "Usage: nc-ng [-read] [-create]\n"
 
 struct CommandLine {
 	QStringList arguments;
-	QByteArray jsonRequest;
+	QByteArray request; // a JSON object per file, each in its own frame
 };
 
 struct {
@@ -168,7 +168,20 @@ boost::optional<CommandLine> parseCommandLine(const QStringList &args) {
 	bool opts        = true;
 	bool debug_proto = false;
 
-	QVariantList commandData;
+	/* Every file gets its own frame, so the server can get on with opening
+	   the first files while the rest of the list is still on its way. An
+	   empty frame ends the request */
+	QDataStream stream(&commandLine.request, QIODevice::WriteOnly);
+	stream.setVersion(QDataStream::Qt_5_0);
+
+	auto addEntry = [&stream, &debug_proto](const QVariantMap &file) {
+		const QByteArray json = QJsonDocument::fromVariant(file).toJson(QJsonDocument::Compact);
+		if (debug_proto) {
+			std::cout << json.constData() << std::endl;
+		}
+
+		stream << json;
+	};
 
 	for (int i = 1; i < args.size(); i++) {
 
@@ -291,7 +304,7 @@ boost::optional<CommandLine> parseCommandLine(const QStringList &args) {
 			file[QLatin1String("langMode")]    = langMode;
 			file[QLatin1String("geometry")]    = geometry;
 			file[QLatin1String("wait")]        = ServerPreferences.waitForClose;
-			commandData.append(file);
+			addEntry(file);
 
 			++fileCount;
 
@@ -319,15 +332,10 @@ boost::optional<CommandLine> parseCommandLine(const QStringList &args) {
 		file[QLatin1String("langMode")]    = langMode;
 		file[QLatin1String("geometry")]    = geometry;
 		file[QLatin1String("wait")]        = ServerPreferences.waitForClose;
-		commandData.append(file);
+		addEntry(file);
 	}
 
-	auto doc                = QJsonDocument::fromVariant(commandData);
-	commandLine.jsonRequest = doc.toJson(QJsonDocument::Compact);
-
-	if (debug_proto) {
-		std::cout << doc.toJson(QJsonDocument::Compact).constData() << std::endl;
-	}
+	stream << QByteArray();
 
 	return commandLine;
 }
@@ -401,7 +409,15 @@ int startServer(const char *message, const QStringList &commandLineArgs) {
 	}
 }
 
-bool writeToSocket(QLocalSocket *socket, const QByteArray &data) {
+/**
+ * @brief writeToSocket
+ * @param socket
+ * @param data
+ * @param timeout
+ * @return false if the data couldn't be written, or the server didn't take
+ * any of it for "timeout"
+ */
+bool writeToSocket(QLocalSocket *socket, const QByteArray &data, std::chrono::milliseconds timeout) {
 	int remaining   = data.size();
 	const char *ptr = data.data();
 
@@ -413,7 +429,11 @@ bool writeToSocket(QLocalSocket *socket, const QByteArray &data) {
 			return false;
 		}
 
-		socket->waitForBytesWritten(-1);
+		while (socket->bytesToWrite() > 0) {
+			if (!socket->waitForBytesWritten(static_cast<int>(timeout.count()))) {
+				return false;
+			}
+		}
 
 		ptr += written;
 		remaining -= written;
@@ -495,12 +515,10 @@ int main(int argc, char *argv[]) {
 			continue;
 		}
 
-		QByteArray ba;
-		QDataStream stream(&ba, QIODevice::WriteOnly);
-		stream.setVersion(QDataStream::Qt_5_0);
-		stream << commandLine.jsonRequest;
-
-		writeToSocket(socket.get(), ba);
+		if (!writeToSocket(socket.get(), commandLine.request, timeout)) {
+			fprintf(stderr, "nc-ng: Failed to send request to server: %s\n", qPrintable(socket->errorString()));
+			return -1;
+		}
 
 		// if we are enabling wait mode, we simply wait for the server
 		// to close the socket. We'll leave it to the server to track
@@ -0,0 +1,455 @@
+
+#include "BracketIndex.h"
+#include "TextBuffer.h"
+
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+namespace {
+
+struct BracketPair {
+	char open;
+	char close;
+};
+
+constexpr BracketPair BracketPairs[] = {
+	{'{', '}'},
+	{'(', ')'},
+	{'[', ']'},
+	{'<', '>'},
+};
+
+/**
+ * @brief lookupBracket
+ * @param ch
+ * @param pair
+ * @param opening
+ * @return true if ch is one of the brackets in BracketPairs, in which case
+ * "pair" and "opening" tell which one it is
+ */
+bool lookupBracket(char ch, uint8_t *pair, bool *opening) {
+
+	auto it = std::find_if(std::begin(BracketPairs), std::end(BracketPairs), [ch](const BracketPair &entry) {
+		return entry.open == ch || entry.close == ch;
+	});
+
+	if (it == std::end(BracketPairs)) {
+		return false;
+	}
+
+	*pair    = static_cast<uint8_t>(std::distance(std::begin(BracketPairs), it));
+	*opening = (it->open == ch);
+	return true;
+}
+
+void bufferModifiedCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user) {
+	Q_UNUSED(nRestyled)
+	Q_UNUSED(deletedText)
+
+	if (auto *index = static_cast<BracketIndex *>(user)) {
+		if (nInserted != 0 || nDeleted != 0) {
+			index->updatePos(pos, nInserted, nDeleted);
+		}
+	}
+}
+
+void styleModifiedCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user) {
+	Q_UNUSED(nDeleted)
+	Q_UNUSED(deletedText)
+
+	if (auto *index = static_cast<BracketIndex *>(user)) {
+		index->invalidateStyles(pos, pos + std::max(nInserted, nRestyled));
+	}
+}
+
+}
+
+/**
+ * @brief BracketIndex::BracketIndex
+ * @param buffer
+ */
+BracketIndex::BracketIndex(TextBuffer *buffer)
+	: buffer_(buffer) {
+	/* The index must be up to date before the highlighting code gets to hear
+	   about a change, its updates to the style buffer are relative to the new
+	   text. */
+	buffer->BufAddHighPriorityModifyCB(bufferModifiedCB, this);
+}
+
+/**
+ * @brief BracketIndex::~BracketIndex
+ */
+BracketIndex::~BracketIndex() {
+	detachStyleBuffer();
+	buffer_->BufRemoveModifyCB(bufferModifiedCB, this);
+}
+
+/**
+ * @brief BracketIndex::isBracket
+ * @param ch
+ * @return
+ */
+bool BracketIndex::isBracket(char ch) {
+	uint8_t pair;
+	bool opening;
+	return lookupBracket(ch, &pair, &opening);
+}
+
+/**
+ * @brief BracketIndex::attachStyleBuffer
+ * @param styleBuffer
+ *
+ * Have the style buffer tell the index when the styles of some text change.
+ * It must be detached again before it is destroyed
+ */
+void BracketIndex::attachStyleBuffer(TextBuffer *styleBuffer) {
+	detachStyleBuffer();
+
+	styleBuffer_ = styleBuffer;
+	styleBuffer_->BufAddModifyCB(styleModifiedCB, this);
+	invalidateStyles();
+}
+
+/**
+ * @brief BracketIndex::detachStyleBuffer
+ *
+ * Stop listening to the style buffer, if there is one. The styles known so
+ * far are forgotten, nothing tells the index about their changes any more
+ */
+void BracketIndex::detachStyleBuffer() {
+	if (styleBuffer_) {
+		styleBuffer_->BufRemoveModifyCB(styleModifiedCB, this);
+		styleBuffer_ = nullptr;
+	}
+
+	invalidateStyles();
+}
+
+/**
+ * @brief BracketIndex::invalidateStyles
+ *
+ * Forget the highlight styles of all brackets, to be called when the meaning
+ * of the styles changes
+ */
+void BracketIndex::invalidateStyles() {
+	for (Chunk &chunk : chunks_) {
+		chunk.styledValid = false;
+		chunk.styleDirty  = true;
+	}
+}
+
+/**
+ * @brief BracketIndex::invalidateStyles
+ * @param start
+ * @param end
+ *
+ * Forget the highlight styles of the brackets from start to end
+ */
+void BracketIndex::invalidateStyles(TextCursor start, TextCursor end) {
+
+	if (chunks_.empty()) {
+		return;
+	}
+
+	for (size_t i = chunkAt(start); i < chunks_.size() && chunks_[i].start <= end; ++i) {
+		chunks_[i].styledValid = false;
+		chunks_[i].styleDirty  = true;
+	}
+}
+
+/**
+ * @brief BracketIndex::chunkAt
+ * @param pos
+ * @return the index of the chunk containing pos (the last one if pos is the end
+ * of the buffer). There must be at least one chunk
+ */
+size_t BracketIndex::chunkAt(TextCursor pos) const {
+
+	auto it = std::upper_bound(chunks_.begin(), chunks_.end(), pos, [](TextCursor value, const Chunk &chunk) {
+		return value < chunk.start;
+	});
+
+	if (it == chunks_.begin()) {
+		return 0;
+	}
+
+	return static_cast<size_t>(std::distance(chunks_.begin(), it)) - 1;
+}
+
+/**
+ * @brief BracketIndex::scan
+ * @param start
+ * @param end
+ * @return the text from start to end cut into chunks, with its brackets found
+ */
+auto BracketIndex::scan(TextCursor start, TextCursor end) const -> std::vector<Chunk> {
+
+	std::vector<Chunk> chunks;
+
+	const int64_t length = end - start;
+	if (length <= 0) {
+		return chunks;
+	}
+
+	// looked at where it is, the text may be split by the buffer gap
+	const std::pair<view::string_view, view::string_view> segments = buffer_->BufGetSegments(start, end);
+	const auto split = static_cast<int64_t>(segments.first.size());
+
+	// the last chunk takes what is left over, up to twice the usual size
+	const int64_t count = std::max<int64_t>(length / ChunkSize, 1);
+	chunks.reserve(static_cast<size_t>(count));
+
+	for (int64_t i = 0; i < count; ++i) {
+		Chunk chunk;
+		chunk.start  = start + i * ChunkSize;
+		chunk.length = (i == count - 1) ? length - i * ChunkSize : ChunkSize;
+
+		for (int64_t offset = 0; offset < chunk.length; ++offset) {
+			const int64_t pos = i * ChunkSize + offset;
+			const char ch     = (pos < split) ? segments.first[static_cast<size_t>(pos)] : segments.second[static_cast<size_t>(pos - split)];
+
+			Bracket bracket;
+			if (lookupBracket(ch, &bracket.pair, &bracket.opening)) {
+				bracket.offset = static_cast<uint32_t>(offset);
+				chunk.brackets.push_back(bracket);
+			}
+		}
+
+		for (const Bracket &bracket : chunk.brackets) {
+			Summary &summary = chunk.all[bracket.pair];
+			summary.net += bracket.opening ? 1 : -1;
+			summary.minForward = std::min(summary.minForward, summary.net);
+		}
+
+		Summaries backward;
+		for (auto it = chunk.brackets.rbegin(); it != chunk.brackets.rend(); ++it) {
+			Summary &summary = backward[it->pair];
+			summary.net += it->opening ? -1 : 1;
+			summary.minBackward = std::min(summary.minBackward, summary.net);
+			chunk.all[it->pair].minBackward = summary.minBackward;
+		}
+
+		chunks.push_back(std::move(chunk));
+	}
+
+	return chunks;
+}
+
+/**
+ * @brief BracketIndex::build
+ */
+void BracketIndex::build() {
+	chunks_ = scan(buffer_->BufStartOfBuffer(), buffer_->BufEndOfBuffer());
+	built_  = true;
+}
+
+/**
+ * @brief BracketIndex::updatePos
+ * @param pos
+ * @param nInserted
+ * @param nDeleted
+ *
+ * Rescan the chunks touched by a modification of the buffer, and move the ones
+ * after it
+ */
+void BracketIndex::updatePos(TextCursor pos, int64_t nInserted, int64_t nDeleted) {
+
+	if (!built_) {
+		return;
+	}
+
+	if (chunks_.empty()) {
+		build();
+		return;
+	}
+
+	const int64_t delta = nInserted - nDeleted;
+
+	size_t first = chunkAt(pos);
+	size_t last  = chunkAt(pos + nDeleted);
+
+	// don't let deletions leave lots of tiny chunks behind
+	TextCursor regionStart = chunks_[first].start;
+	TextCursor regionEnd   = chunks_[last].start + chunks_[last].length + delta;
+	if (regionEnd - regionStart < ChunkSize / 2) {
+		if (last + 1 < chunks_.size()) {
+			++last;
+			regionEnd += chunks_[last].length;
+		} else if (first > 0) {
+			--first;
+			regionStart = chunks_[first].start;
+		}
+	}
+
+	std::vector<Chunk> replacement = scan(regionStart, regionEnd);
+
+	for (size_t i = last + 1; i < chunks_.size(); ++i) {
+		chunks_[i].start += delta;
+	}
+
+	auto it = chunks_.erase(chunks_.begin() + static_cast<ptrdiff_t>(first), chunks_.begin() + static_cast<ptrdiff_t>(last) + 1);
+	chunks_.insert(it, std::make_move_iterator(replacement.begin()), std::make_move_iterator(replacement.end()));
+}
+
+/**
+ * @brief BracketIndex::summaryOf
+ * @param index
+ * @param pair
+ * @param styleToMatch
+ * @param styleOf
+ * @param user
+ * @return how the brackets of the given pair in the chunk change the nesting
+ * depth, only counting the ones with style "styleToMatch" if styleOf is given
+ */
+auto BracketIndex::summaryOf(size_t index, uint8_t pair, Style styleToMatch, StyleCallback styleOf, void *user) -> const Summary & {
+
+	if (!styleOf) {
+		return chunks_[index].all[pair];
+	}
+
+	if (chunks_[index].styledValid && chunks_[index].style == styleToMatch) {
+		return chunks_[index].styled[pair];
+	}
+
+	/* looking up a style may cause part of the buffer to be parsed for
+	   highlighting, which can change the styles of this very chunk, in which
+	   case the result is only good for this search */
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		Chunk &chunk     = chunks_[index];
+		chunk.styleDirty = false;
+
+		Summaries forward;
+		std::vector<bool> counted(chunk.brackets.size());
+		for (size_t i = 0; i < chunk.brackets.size(); ++i) {
+			const Bracket &bracket = chunk.brackets[i];
+			if (styleOf(chunk.start + bracket.offset, user) == styleToMatch) {
+				Summary &summary = forward[bracket.pair];
+				summary.net += bracket.opening ? 1 : -1;
+				summary.minForward = std::min(summary.minForward, summary.net);
+				counted[i]         = true;
+			}
+		}
+
+		Summaries backward;
+		for (size_t i = chunk.brackets.size(); i-- > 0;) {
+			const Bracket &bracket = chunk.brackets[i];
+			if (counted[i]) {
+				Summary &summary = backward[bracket.pair];
+				summary.net += bracket.opening ? -1 : 1;
+				summary.minBackward               = std::min(summary.minBackward, summary.net);
+				forward[bracket.pair].minBackward = summary.minBackward;
+			}
+		}
+
+		chunk.styled      = forward;
+		chunk.style       = styleToMatch;
+		chunk.styledValid = !chunk.styleDirty;
+		if (chunk.styledValid) {
+			break;
+		}
+	}
+
+	return chunks_[index].styled[pair];
+}
+
+/**
+ * @brief BracketIndex::findMatch
+ * @param toMatch the bracket to find the match of
+ * @param charPos where it is
+ * @param startLimit
+ * @param endLimit
+ * @param styleToMatch
+ * @param styleOf if not null, only brackets for which it returns styleToMatch
+ * are considered
+ * @param user passed to styleOf
+ * @return the position of the matching bracket, if there is one between
+ * startLimit and endLimit
+ */
+boost::optional<TextCursor> BracketIndex::findMatch(char toMatch, TextCursor charPos, TextCursor startLimit, TextCursor endLimit, Style styleToMatch, StyleCallback styleOf, void *user) {
+
+	uint8_t pair;
+	bool opening;
+	if (!lookupBracket(toMatch, &pair, &opening)) {
+		return boost::none;
+	}
+
+	if (!built_) {
+		build();
+	}
+
+	if (chunks_.empty()) {
+		return boost::none;
+	}
+
+	auto counts = [&](const Bracket &bracket, TextCursor pos) {
+		return bracket.pair == pair && (!styleOf || styleOf(pos, user) == styleToMatch);
+	};
+
+	int64_t nestDepth = 1;
+
+	if (opening) {
+		for (size_t i = chunkAt(charPos); i < chunks_.size() && chunks_[i].start < endLimit; ++i) {
+
+			// step over whole chunks which can't bring the depth down to 0
+			if (chunks_[i].start > charPos && chunks_[i].start + chunks_[i].length <= endLimit) {
+				const Summary &summary = summaryOf(i, pair, styleToMatch, styleOf, user);
+				if (nestDepth + summary.minForward > 0) {
+					nestDepth += summary.net;
+					continue;
+				}
+			}
+
+			const Chunk &chunk = chunks_[i];
+			for (const Bracket &bracket : chunk.brackets) {
+				const TextCursor pos = chunk.start + bracket.offset;
+				if (pos <= charPos) {
+					continue;
+				}
+
+				if (pos >= endLimit) {
+					break;
+				}
+
+				if (counts(bracket, pos)) {
+					nestDepth += bracket.opening ? 1 : -1;
+					if (nestDepth == 0) {
+						return pos;
+					}
+				}
+			}
+		}
+	} else {
+		for (size_t i = chunkAt(charPos) + 1; i-- > 0 && chunks_[i].start + chunks_[i].length > startLimit;) {
+
+			if (chunks_[i].start >= startLimit && chunks_[i].start + chunks_[i].length <= charPos) {
+				const Summary &summary = summaryOf(i, pair, styleToMatch, styleOf, user);
+				if (nestDepth + summary.minBackward > 0) {
+					nestDepth -= summary.net;
+					continue;
+				}
+			}
+
+			const Chunk &chunk = chunks_[i];
+			for (auto it = chunk.brackets.rbegin(); it != chunk.brackets.rend(); ++it) {
+				const TextCursor pos = chunk.start + it->offset;
+				if (pos >= charPos) {
+					continue;
+				}
+
+				if (pos < startLimit) {
+					break;
+				}
+
+				if (counts(*it, pos)) {
+					nestDepth += it->opening ? -1 : 1;
+					if (nestDepth == 0) {
+						return pos;
+					}
+				}
+			}
+		}
+	}
+
+	return boost::none;
+}
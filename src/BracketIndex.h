@@ -0,0 +1,97 @@
+
+#ifndef BRACKET_INDEX_H_
+#define BRACKET_INDEX_H_
+
+#include "Style.h"
+#include "TextBufferFwd.h"
+#include "TextCursor.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <boost/optional.hpp>
+
+/**
+ * @brief Keeps track of where the brackets ({}, (), [] and <>) of a buffer are,
+ * so that finding the one matching a bracket doesn't require looking at every
+ * character in between.
+ *
+ * The buffer is cut into chunks of a few KB. Each chunk knows the positions
+ * of its brackets and, for every kind of bracket, how much it changes the
+ * nesting depth and how deep it dips on the way. A search can then step over
+ * any chunk which can't contain the match in one go, and only looks at the
+ * brackets themselves in the chunks where it starts and ends.
+ *
+ * When matching is syntax based, only the brackets with the same highlight
+ * style as the one being matched count. The numbers for that are worked out
+ * the first time a chunk is stepped over and kept until the styles of the
+ * chunk change (which the index is told about by the style buffer).
+ *
+ * The index is built the first time it is used, and from then on every edit
+ * only rescans the chunks it touches.
+ */
+class BracketIndex {
+public:
+	using StyleCallback = Style (*)(TextCursor pos, void *user);
+
+public:
+	explicit BracketIndex(TextBuffer *buffer);
+	BracketIndex(const BracketIndex &)            = delete;
+	BracketIndex &operator=(const BracketIndex &) = delete;
+	~BracketIndex();
+
+public:
+	static bool isBracket(char ch);
+
+public:
+	boost::optional<TextCursor> findMatch(char toMatch, TextCursor charPos, TextCursor startLimit, TextCursor endLimit, Style styleToMatch, StyleCallback styleOf, void *user);
+	void attachStyleBuffer(TextBuffer *styleBuffer);
+	void detachStyleBuffer();
+	void invalidateStyles();
+	void invalidateStyles(TextCursor start, TextCursor end);
+	void updatePos(TextCursor pos, int64_t nInserted, int64_t nDeleted);
+
+private:
+	static constexpr int64_t ChunkSize = 4096;
+	static constexpr size_t PairCount  = 4;
+
+	struct Bracket {
+		uint32_t offset; // from the start of the chunk
+		uint8_t pair;    // index into the table of bracket pairs
+		bool opening;
+	};
+
+	struct Summary {
+		int64_t net         = 0; // change in depth, opening brackets count +1
+		int64_t minForward  = 0; // lowest depth reached going forward
+		int64_t minBackward = 0; // same going backward, closing brackets count +1
+	};
+
+	using Summaries = std::array<Summary, PairCount>;
+
+	struct Chunk {
+		TextCursor start;
+		int64_t length;
+		std::vector<Bracket> brackets;
+		Summaries all;
+		Summaries styled; // of the brackets with style "style" only
+		Style style;
+		bool styledValid = false;
+		bool styleDirty  = false;
+	};
+
+private:
+	size_t chunkAt(TextCursor pos) const;
+	std::vector<Chunk> scan(TextCursor start, TextCursor end) const;
+	const Summary &summaryOf(size_t index, uint8_t pair, Style styleToMatch, StyleCallback styleOf, void *user);
+	void build();
+
+private:
+	TextBuffer *buffer_;
+	TextBuffer *styleBuffer_ = nullptr;
+	std::vector<Chunk> chunks_;
+	bool built_ = false;
+};
+
+#endif
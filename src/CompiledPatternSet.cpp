@@ -0,0 +1,260 @@
+
+#include "CompiledPatternSet.h"
+#include "PatternSet.h"
+#include "Util/algorithm.h"
+
+#include <QThread>
+
+#include <algorithm>
+
+namespace {
+
+struct CacheEntry {
+	PatternSet source; // what "compiled" was compiled from
+	std::shared_ptr<const CompiledPatternSet> compiled;
+};
+
+// only ever used from the GUI thread
+std::vector<CacheEntry> Cache;
+
+/**
+ * @brief copyRegex
+ * @param re
+ * @return
+ */
+std::unique_ptr<Regex> copyRegex(const std::unique_ptr<Regex> &re) {
+	if (!re) {
+		return nullptr;
+	}
+
+	return std::make_unique<Regex>(*re);
+}
+
+/**
+ * @brief copyRegexSet
+ * @param set
+ * @return
+ */
+std::unique_ptr<RegexSet> copyRegexSet(const std::unique_ptr<RegexSet> &set) {
+	if (!set) {
+		return nullptr;
+	}
+
+	return std::make_unique<RegexSet>(*set);
+}
+
+/**
+ * @brief copyPatterns
+ * @param patterns
+ * @return a deep copy of a list of compiled patterns, with the sub pattern
+ * pointers of the copy pointing into the copy
+ */
+std::unique_ptr<HighlightData[]> copyPatterns(const std::unique_ptr<HighlightData[]> &patterns) {
+
+	if (!patterns) {
+		return nullptr;
+	}
+
+	// the list is terminated by a record with style == 0
+	size_t count = 0;
+	while (patterns[count].style != 0) {
+		++count;
+	}
+
+	auto copy = std::make_unique<HighlightData[]>(count + 1);
+
+	for (size_t i = 0; i <= count; ++i) {
+		const HighlightData &from = patterns[i];
+		HighlightData &to         = copy[i];
+
+		to.startRE        = copyRegex(from.startRE);
+		to.endRE          = copyRegex(from.endRE);
+		to.errorRE        = copyRegex(from.errorRE);
+		to.subPatternRE   = copyRegexSet(from.subPatternRE);
+		to.startSubexprs  = from.startSubexprs;
+		to.endSubexprs    = from.endSubexprs;
+		to.userStyleIndex = from.userStyleIndex;
+		to.nSubPatterns   = from.nSubPatterns;
+		to.flags          = from.flags;
+		to.colorOnly      = from.colorOnly;
+		to.style          = from.style;
+
+		if (from.subPatterns) {
+			to.subPatterns = std::make_unique<HighlightData *[]>(from.nSubPatterns);
+			for (size_t j = 0; j < from.nSubPatterns; ++j) {
+				to.subPatterns[j] = &copy[static_cast<size_t>(from.subPatterns[j] - &patterns[0])];
+			}
+		}
+	}
+
+	return copy;
+}
+
+}
+
+/**
+ * @brief CompiledPatternSet::clone
+ * @return a copy which shares nothing with this one, for parsing on another
+ * thread. Copying the compiled expressions is a lot cheaper than compiling
+ * them again
+ */
+std::shared_ptr<CompiledPatternSet> CompiledPatternSet::clone() const {
+
+	auto copy                 = std::make_shared<CompiledPatternSet>();
+	copy->pass1Patterns       = copyPatterns(pass1Patterns);
+	copy->pass2Patterns       = copyPatterns(pass2Patterns);
+	copy->parentStyles        = parentStyles;
+	copy->contextRequirements = contextRequirements;
+	return copy;
+}
+
+/**
+ * @brief CompiledPatternSet::reserveWorkerCopy
+ * @return the copies of this pattern set for parsing on other threads, with
+ * one reserved for the caller. The worker then has to either borrow it or
+ * release the reservation. Must be called on the GUI thread
+ */
+std::shared_ptr<WorkerCopies> CompiledPatternSet::reserveWorkerCopy() const {
+
+	if (!workerCopies_) {
+		workerCopies_ = std::make_shared<WorkerCopies>(static_cast<size_t>(std::max(1, QThread::idealThreadCount())));
+	}
+
+	workerCopies_->reserve(*this);
+	return workerCopies_;
+}
+
+/**
+ * @brief CompiledPatternSet::lookup
+ * @param patternSet
+ * @return the compiled form of "patternSet" if it was compiled before and
+ * hasn't changed since, otherwise nullptr
+ */
+std::shared_ptr<const CompiledPatternSet> CompiledPatternSet::lookup(const PatternSet &patternSet) {
+
+	auto it = std::find_if(Cache.begin(), Cache.end(), [&patternSet](const CacheEntry &entry) {
+		return entry.source.languageMode == patternSet.languageMode;
+	});
+
+	if (it == Cache.end() || it->source != patternSet) {
+		return nullptr;
+	}
+
+	return it->compiled;
+}
+
+/**
+ * @brief CompiledPatternSet::store
+ * @param patternSet
+ * @param compiled
+ *
+ * Remembers the compiled form of a pattern set, replacing any older one of
+ * the same language mode
+ */
+void CompiledPatternSet::store(const PatternSet &patternSet, const std::shared_ptr<const CompiledPatternSet> &compiled) {
+	insert_or_replace(Cache, CacheEntry{patternSet, compiled}, [&patternSet](const CacheEntry &entry) {
+		return entry.source.languageMode == patternSet.languageMode;
+	});
+}
+
+/**
+ * @brief CompiledPatternSet::invalidate
+ * @param languageMode
+ *
+ * To be called when the pattern set of "languageMode" is changed or removed
+ */
+void CompiledPatternSet::invalidate(const QString &languageMode) {
+	Cache.erase(std::remove_if(Cache.begin(), Cache.end(), [&languageMode](const CacheEntry &entry) {
+					return entry.source.languageMode == languageMode;
+				}),
+				Cache.end());
+}
+
+/**
+ * @brief CompiledPatternSet::invalidateAll
+ *
+ * To be called when all of the pattern sets are reloaded, or the highlight
+ * styles (which the compiled patterns refer to by index) are changed.
+ * Documents keep using the patterns they have until they are highlighted
+ * again
+ */
+void CompiledPatternSet::invalidateAll() {
+	Cache.clear();
+}
+
+/**
+ * @brief WorkerCopies::WorkerCopies
+ * @param limit
+ */
+WorkerCopies::WorkerCopies(size_t limit)
+	: limit_(limit) {
+}
+
+/**
+ * @brief WorkerCopies::reserve
+ * @param patterns the pattern set these are copies of
+ *
+ * Called on the GUI thread, which is the only one the pattern set itself may
+ * be read on
+ */
+void WorkerCopies::reserve(const CompiledPatternSet &patterns) {
+
+	bool copy;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		++reserved_;
+		copy = reserved_ > copies_ && copies_ < limit_;
+		if (copy) {
+			++copies_;
+		}
+	}
+
+	if (copy) {
+		giveBack(patterns.clone());
+	}
+}
+
+/**
+ * @brief WorkerCopies::borrow
+ * @return a copy of the pattern set for the calling worker to parse with,
+ * which is given back when it is released. Waits until one is free
+ */
+std::shared_ptr<const CompiledPatternSet> WorkerCopies::borrow() {
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	returned_.wait(lock, [this]() {
+		return !spare_.empty();
+	});
+
+	std::shared_ptr<CompiledPatternSet> copy = std::move(spare_.back());
+	spare_.pop_back();
+
+	CompiledPatternSet *patterns = copy.get();
+	return std::shared_ptr<const CompiledPatternSet>(patterns, [self = shared_from_this(), copy = std::move(copy)](const CompiledPatternSet *) mutable {
+		self->giveBack(std::move(copy));
+		self->release();
+	});
+}
+
+/**
+ * @brief WorkerCopies::release
+ *
+ * Gives up a reservation by a worker which doesn't need its copy after all
+ */
+void WorkerCopies::release() {
+	std::lock_guard<std::mutex> lock(mutex_);
+	--reserved_;
+}
+
+/**
+ * @brief WorkerCopies::giveBack
+ * @param copy
+ */
+void WorkerCopies::giveBack(std::shared_ptr<CompiledPatternSet> copy) {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		spare_.push_back(std::move(copy));
+	}
+
+	returned_.notify_one();
+}
@@ -0,0 +1,80 @@
+
+#ifndef COMPILED_PATTERN_SET_H_
+#define COMPILED_PATTERN_SET_H_
+
+#include "HighlightData.h"
+#include "ReparseContext.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class PatternSet;
+class QString;
+class WorkerCopies;
+
+/**
+ * @brief The compiled form of a pattern set. Nothing in it depends on the
+ * document it is used for, so every document highlighted with the same
+ * pattern set shares one, which is kept here until the pattern set or the
+ * highlight styles change. Even if it isn't invalidated, one which no longer
+ * matches its pattern set is never handed out.
+ *
+ * The regular expressions keep the state of their last match, so a shared
+ * one may only be used from the GUI thread. Parsing on another thread needs
+ * a copy of its own (see reserveWorkerCopy).
+ */
+struct CompiledPatternSet {
+	std::unique_ptr<HighlightData[]> pass1Patterns;
+	std::unique_ptr<HighlightData[]> pass2Patterns;
+	std::vector<uint8_t> parentStyles;
+	ReparseContext contextRequirements = {0, 0};
+
+	std::shared_ptr<CompiledPatternSet> clone() const;
+	std::shared_ptr<WorkerCopies> reserveWorkerCopy() const;
+
+	static std::shared_ptr<const CompiledPatternSet> lookup(const PatternSet &patternSet);
+	static void store(const PatternSet &patternSet, const std::shared_ptr<const CompiledPatternSet> &compiled);
+	static void invalidate(const QString &languageMode);
+	static void invalidateAll();
+
+private:
+	mutable std::shared_ptr<WorkerCopies> workerCopies_;
+};
+
+/**
+ * @brief Copies of a compiled pattern set which are lent to the workers
+ * parsing with it, one worker at a time. Copies are made (on the GUI thread)
+ * only while more workers want one than there are copies, up to one for each
+ * thread of the thread pool, so all of the documents parsed in the background
+ * share a few copies instead of cloning the patterns for each of them.
+ */
+class WorkerCopies : public std::enable_shared_from_this<WorkerCopies> {
+	friend struct CompiledPatternSet;
+
+public:
+	explicit WorkerCopies(size_t limit);
+	WorkerCopies(const WorkerCopies &) = delete;
+	WorkerCopies &operator=(const WorkerCopies &) = delete;
+	~WorkerCopies() = default;
+
+public:
+	std::shared_ptr<const CompiledPatternSet> borrow();
+	void release();
+
+private:
+	void reserve(const CompiledPatternSet &patterns);
+	void giveBack(std::shared_ptr<CompiledPatternSet> copy);
+
+private:
+	std::mutex mutex_;
+	std::condition_variable returned_;
+	std::vector<std::shared_ptr<CompiledPatternSet>> spare_; // the copies which aren't lent out
+	size_t copies_   = 0;                                     // how many copies were made
+	size_t reserved_ = 0;                                     // copies reserved by workers which haven't given theirs back yet
+	size_t limit_;                                            // most copies to make
+};
+
+#endif
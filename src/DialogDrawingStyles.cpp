@@ -1,6 +1,7 @@
 
 #include "DialogDrawingStyles.h"
 #include "CommonDialog.h"
+#include "CompiledPatternSet.h"
 #include "DialogSyntaxPatterns.h"
 #include "DocumentWidget.h"
 #include "Highlight.h"
@@ -368,6 +369,9 @@ bool DialogDrawingStyles::applyDialogChanges() {
 
 	highlightStyles_ = newStyles;
 
+	// the compiled patterns refer to the styles by index
+	CompiledPatternSet::invalidateAll();
+
 	// If a syntax highlighting dialog is up, update its menu
 	if (dialogSyntaxPatterns_) {
 		dialogSyntaxPatterns_->updateHighlightStyleMenu();
@@ -81,7 +81,7 @@ bool DialogDuplicateTags::applySelection() {
 	const int id = item->data(Qt::UserRole).toInt();
 
 	if (Tags::searchMode == Tags::SearchMode::TAG) {
-		document_->editTaggedLocation(area_, id); // Open the file with the definition
+		document_->editTaggedLocation(id); // Open the file with the definition
 	} else {
 		Tags::showMatchingCalltip(this, area_, id);
 	}
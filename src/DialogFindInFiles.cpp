@@ -0,0 +1,369 @@
+
+#include "DialogFindInFiles.h"
+#include "DocumentWidget.h"
+#include "MainWindow.h"
+#include "Preferences.h"
+#include "Regex.h"
+#include "Search.h"
+#include "TextArea.h"
+#include "TextBuffer.h"
+#include "Util/regex.h"
+
+#include <QCloseEvent>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHeaderView>
+#include <QMessageBox>
+
+#include <algorithm>
+
+namespace {
+
+constexpr int PathRole   = Qt::UserRole;
+constexpr int LineRole   = Qt::UserRole + 1;
+constexpr int ColumnRole = Qt::UserRole + 2;
+constexpr int LengthRole = Qt::UserRole + 3;
+
+/**
+ * @brief splitPatterns
+ * @param text
+ * @return
+ */
+QStringList splitPatterns(const QString &text) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+	return text.split(QLatin1Char(' '), Qt::SkipEmptyParts);
+#else
+	return text.split(QLatin1Char(' '), QString::SkipEmptyParts);
+#endif
+}
+
+}
+
+/**
+ * @brief DialogFindInFiles::DialogFindInFiles
+ * @param window
+ * @param f
+ */
+DialogFindInFiles::DialogFindInFiles(MainWindow *window, Qt::WindowFlags f)
+	: Dialog(window, f), window_(window) {
+	ui.setupUi(this);
+	connectSlots();
+
+	ui.textExclude->setText(QLatin1String("CVS *.o *.obj *.a *.so *.dll *.exe"));
+	ui.treeResults->header()->setStretchLastSection(true);
+}
+
+/**
+ * @brief DialogFindInFiles::connectSlots
+ */
+void DialogFindInFiles::connectSlots() {
+	connect(ui.buttonBrowse, &QPushButton::clicked, this, &DialogFindInFiles::buttonBrowse_clicked);
+	connect(ui.buttonFind, &QPushButton::clicked, this, &DialogFindInFiles::buttonFind_clicked);
+	connect(ui.buttonStop, &QPushButton::clicked, this, &DialogFindInFiles::buttonStop_clicked);
+	connect(ui.checkRegex, &QCheckBox::toggled, this, &DialogFindInFiles::checkRegex_toggled);
+	connect(ui.treeResults, &QTreeWidget::itemActivated, this, &DialogFindInFiles::treeResults_itemActivated);
+	connect(&search_, &FileSearch::hitsFound, this, &DialogFindInFiles::search_hitsFound);
+	connect(&search_, &FileSearch::filesFound, this, &DialogFindInFiles::search_filesFound);
+	connect(&search_, &FileSearch::finished, this, &DialogFindInFiles::search_finished);
+}
+
+/**
+ * @brief DialogFindInFiles::showEvent
+ * @param event
+ */
+void DialogFindInFiles::showEvent(QShowEvent *event) {
+	Dialog::showEvent(event);
+	ui.textFind->setFocus();
+}
+
+/**
+ * @brief DialogFindInFiles::closeEvent
+ * @param event
+ */
+void DialogFindInFiles::closeEvent(QCloseEvent *event) {
+	search_.cancel();
+	Dialog::closeEvent(event);
+}
+
+/**
+ * @brief DialogFindInFiles::setDocument
+ * @param document
+ *
+ * The document results are opened from. Its directory is offered as the place
+ * to search, and its text selection as the string to search for
+ */
+void DialogFindInFiles::setDocument(DocumentWidget *document) {
+	document_ = document;
+
+	if (ui.textDirectory->text().isEmpty()) {
+		ui.textDirectory->setText(QDir::toNativeSeparators(document->path()));
+	}
+
+	if (Preferences::GetPrefFindReplaceUsesSelection()) {
+		const QString selection = document->getAnySelection();
+		if (!selection.isEmpty()) {
+			ui.textFind->setText(selection);
+		}
+	}
+}
+
+/**
+ * @brief DialogFindInFiles::initToggleButtons
+ * @param searchType
+ */
+void DialogFindInFiles::initToggleButtons(SearchType searchType) {
+	switch (searchType) {
+	case SearchType::Literal:
+		ui.checkRegex->setChecked(false);
+		ui.checkCase->setChecked(false);
+		ui.checkWord->setChecked(false);
+		break;
+	case SearchType::CaseSense:
+		ui.checkRegex->setChecked(false);
+		ui.checkCase->setChecked(true);
+		ui.checkWord->setChecked(false);
+		break;
+	case SearchType::LiteralWord:
+		ui.checkRegex->setChecked(false);
+		ui.checkCase->setChecked(false);
+		ui.checkWord->setChecked(true);
+		break;
+	case SearchType::CaseSenseWord:
+		ui.checkRegex->setChecked(false);
+		ui.checkCase->setChecked(true);
+		ui.checkWord->setChecked(true);
+		break;
+	case SearchType::Regex:
+		ui.checkRegex->setChecked(true);
+		ui.checkCase->setChecked(true);
+		ui.checkWord->setChecked(false);
+		break;
+	case SearchType::RegexNoCase:
+		ui.checkRegex->setChecked(true);
+		ui.checkCase->setChecked(false);
+		ui.checkWord->setChecked(false);
+		break;
+	}
+}
+
+/**
+ * @brief DialogFindInFiles::checkRegex_toggled
+ * @param checked
+ */
+void DialogFindInFiles::checkRegex_toggled(bool checked) {
+	// make the Whole Word button insensitive for regex searches
+	ui.checkWord->setEnabled(!checked);
+}
+
+/**
+ * @brief DialogFindInFiles::buttonBrowse_clicked
+ */
+void DialogFindInFiles::buttonBrowse_clicked() {
+
+	const QString directory = QFileDialog::getExistingDirectory(this, tr("Directory to Search"), ui.textDirectory->text());
+	if (!directory.isEmpty()) {
+		ui.textDirectory->setText(QDir::toNativeSeparators(directory));
+	}
+}
+
+/*
+** Fetch and verify (particularly regular expression) search string, search
+** type and file selection from the dialog.
+*/
+boost::optional<FileSearch::Options> DialogFindInFiles::readFields() {
+
+	FileSearch::Options options;
+
+	options.searchString = ui.textFind->text();
+	if (options.searchString.isEmpty()) {
+		return boost::none;
+	}
+
+	if (ui.checkRegex->isChecked()) {
+		options.searchType = ui.checkCase->isChecked() ? SearchType::Regex : SearchType::RegexNoCase;
+
+		/* If the search type is a regular expression, test compile it
+		   immediately and present error messages */
+		try {
+			auto compiledRE = make_regex(options.searchString, Search::defaultRegexFlags(options.searchType));
+		} catch (const RegexError &e) {
+			QMessageBox::warning(
+				this,
+				tr("Regex Error"),
+				tr("Please respecify the search string:\n%1").arg(QString::fromLatin1(e.what())));
+			return boost::none;
+		}
+	} else if (ui.checkCase->isChecked()) {
+		options.searchType = ui.checkWord->isChecked() ? SearchType::CaseSenseWord : SearchType::CaseSense;
+	} else {
+		options.searchType = ui.checkWord->isChecked() ? SearchType::LiteralWord : SearchType::Literal;
+	}
+
+	options.directory = QDir::fromNativeSeparators(ui.textDirectory->text());
+	if (!QFileInfo(options.directory).isDir()) {
+		QMessageBox::warning(
+			this,
+			tr("Find in Files"),
+			tr("%1 is not a directory").arg(ui.textDirectory->text()));
+		return boost::none;
+	}
+
+	options.filePatterns    = splitPatterns(ui.textFiles->text());
+	options.excludePatterns = splitPatterns(ui.textExclude->text());
+
+	if (document_) {
+		options.delimiters = document_->getWindowDelimiters();
+	}
+
+	return options;
+}
+
+/**
+ * @brief DialogFindInFiles::buttonFind_clicked
+ */
+void DialogFindInFiles::buttonFind_clicked() {
+
+	boost::optional<FileSearch::Options> options = readFields();
+	if (!options) {
+		return;
+	}
+
+	Search::saveSearchHistory(options->searchString, QString(), options->searchType, /*isIncremental=*/false);
+
+	ui.treeResults->clear();
+	filesTotal_ = -1;
+	filesHit_   = 0;
+	hits_       = 0;
+	running_    = true;
+	stopped_    = false;
+
+	/* results are delivered through queued signals, only allow a new search
+	   once the last one has been heard from so they can't get mixed up */
+	ui.buttonFind->setEnabled(false);
+	ui.buttonStop->setEnabled(true);
+	updateStatus();
+
+	search_.start(*options);
+}
+
+/**
+ * @brief DialogFindInFiles::buttonStop_clicked
+ */
+void DialogFindInFiles::buttonStop_clicked() {
+	search_.cancel();
+}
+
+/**
+ * @brief DialogFindInFiles::search_filesFound
+ * @param count
+ */
+void DialogFindInFiles::search_filesFound(int count) {
+	filesTotal_ = count;
+	updateStatus();
+}
+
+/**
+ * @brief DialogFindInFiles::search_hitsFound
+ * @param path
+ * @param hits
+ */
+void DialogFindInFiles::search_hitsFound(const QString &path, const QVector<FileSearchHit> &hits) {
+
+	const QString displayPath = QDir::toNativeSeparators(QDir(ui.textDirectory->text()).relativeFilePath(path));
+
+	QList<QTreeWidgetItem *> items;
+	items.reserve(hits.size());
+
+	for (const FileSearchHit &hit : hits) {
+		auto item = new QTreeWidgetItem(QStringList{displayPath, QString::number(hit.line), hit.text.trimmed()});
+		item->setData(0, PathRole, path);
+		item->setData(0, LineRole, static_cast<qlonglong>(hit.line));
+		item->setData(0, ColumnRole, static_cast<qlonglong>(hit.column));
+		item->setData(0, LengthRole, static_cast<qlonglong>(hit.length));
+		items.push_back(item);
+	}
+
+	ui.treeResults->addTopLevelItems(items);
+
+	++filesHit_;
+	hits_ += hits.size();
+	updateStatus();
+}
+
+/**
+ * @brief DialogFindInFiles::search_finished
+ * @param canceled
+ */
+void DialogFindInFiles::search_finished(bool canceled) {
+	running_ = false;
+	stopped_ = canceled;
+	ui.buttonFind->setEnabled(true);
+	ui.buttonStop->setEnabled(false);
+	ui.treeResults->resizeColumnToContents(0);
+	ui.treeResults->resizeColumnToContents(1);
+	updateStatus();
+}
+
+/**
+ * @brief DialogFindInFiles::updateStatus
+ */
+void DialogFindInFiles::updateStatus() {
+
+	if (running_) {
+		if (filesTotal_ < 0) {
+			ui.labelStatus->setText(tr("Looking for files..."));
+		} else {
+			ui.labelStatus->setText(tr("Searching %1 files: %2 matches in %3 files").arg(filesTotal_).arg(hits_).arg(filesHit_));
+		}
+	} else if (stopped_) {
+		ui.labelStatus->setText(tr("Stopped: %1 matches in %2 files").arg(hits_).arg(filesHit_));
+	} else {
+		ui.labelStatus->setText(tr("%1 matches in %2 of %3 files").arg(hits_).arg(filesHit_).arg(std::max(filesTotal_, 0)));
+	}
+}
+
+/**
+ * @brief DialogFindInFiles::treeResults_itemActivated
+ * @param item
+ * @param column
+ *
+ * Opens the file of the result (or switches to it if it is already open), and
+ * selects the match
+ */
+void DialogFindInFiles::treeResults_itemActivated(QTreeWidgetItem *item, int column) {
+	Q_UNUSED(column)
+
+	DocumentWidget *origin = document_ ? document_.data() : window_->currentDocument();
+	if (!origin) {
+		return;
+	}
+
+	const QString path = item->data(0, PathRole).toString();
+
+	DocumentWidget *document = origin->open(path);
+	if (!document) {
+		return;
+	}
+
+	TextArea *area = document->firstPane();
+	if (!area) {
+		return;
+	}
+
+	const int64_t line   = item->data(0, LineRole).toLongLong();
+	const int64_t offset = item->data(0, ColumnRole).toLongLong();
+	const int64_t length = item->data(0, LengthRole).toLongLong();
+
+	/* the file may have changed since it was searched, so don't go past the
+	   end of the line or the buffer */
+	TextBuffer *buffer         = document->buffer();
+	const TextCursor lineStart = buffer->BufCountForwardNLines(buffer->BufStartOfBuffer(), line - 1);
+	const TextCursor lineEnd   = buffer->BufEndOfLine(lineStart);
+	const TextCursor start     = std::min(lineStart + offset, lineEnd);
+	const TextCursor end       = std::min(start + length, buffer->BufEndOfBuffer());
+
+	buffer->BufSelect(start, end);
+	document->makeSelectionVisible(area);
+	area->TextSetCursorPos(end);
+}
@@ -0,0 +1,61 @@
+
+#ifndef DIALOG_FIND_IN_FILES_H_
+#define DIALOG_FIND_IN_FILES_H_
+
+#include "Dialog.h"
+#include "FileSearch.h"
+#include "SearchType.h"
+
+#include <QPointer>
+
+#include <boost/optional.hpp>
+
+#include "ui_DialogFindInFiles.h"
+
+class DocumentWidget;
+class MainWindow;
+class QTreeWidgetItem;
+
+class DialogFindInFiles : public Dialog {
+	Q_OBJECT
+
+public:
+	explicit DialogFindInFiles(MainWindow *window, Qt::WindowFlags f = Qt::WindowFlags());
+	~DialogFindInFiles() override = default;
+
+protected:
+	void showEvent(QShowEvent *event) override;
+	void closeEvent(QCloseEvent *event) override;
+
+public:
+	void initToggleButtons(SearchType searchType);
+	void setDocument(DocumentWidget *document);
+
+private:
+	boost::optional<FileSearch::Options> readFields();
+	void updateStatus();
+
+private:
+	void buttonBrowse_clicked();
+	void buttonFind_clicked();
+	void buttonStop_clicked();
+	void checkRegex_toggled(bool checked);
+	void treeResults_itemActivated(QTreeWidgetItem *item, int column);
+	void search_hitsFound(const QString &path, const QVector<FileSearchHit> &hits);
+	void search_filesFound(int count);
+	void search_finished(bool canceled);
+	void connectSlots();
+
+private:
+	Ui::DialogFindInFiles ui;
+	MainWindow *window_;
+	QPointer<DocumentWidget> document_;
+	FileSearch search_;
+	int filesTotal_ = -1;
+	int filesHit_   = 0;
+	int hits_       = 0;
+	bool running_   = false;
+	bool stopped_   = false;
+};
+
+#endif
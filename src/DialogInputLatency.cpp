@@ -0,0 +1,88 @@
+
+#include "DialogInputLatency.h"
+#include "InputLatency.h"
+
+#include <QFileDialog>
+#include <QMessageBox>
+#include <QPushButton>
+
+namespace {
+
+constexpr int RefreshInterval = 500; // ms
+
+// the number of these dialogs which are open, latency is tracked while any is
+int OpenDialogs = 0;
+
+}
+
+/**
+ * @brief DialogInputLatency::DialogInputLatency
+ * @param parent
+ * @param f
+ */
+DialogInputLatency::DialogInputLatency(QWidget *parent, Qt::WindowFlags f)
+	: Dialog(parent, f) {
+
+	ui.setupUi(this);
+	ui.buttonBox->button(QDialogButtonBox::Save)->setText(tr("Save Log..."));
+
+	connect(ui.buttonBox, &QDialogButtonBox::clicked, this, &DialogInputLatency::buttonBox_clicked);
+	connect(&timer_, &QTimer::timeout, this, &DialogInputLatency::updateReport);
+
+	++OpenDialogs;
+	InputLatency::setEnabled(true);
+
+	timer_.start(RefreshInterval);
+	updateReport();
+}
+
+/**
+ * @brief DialogInputLatency::~DialogInputLatency
+ */
+DialogInputLatency::~DialogInputLatency() {
+	if (--OpenDialogs == 0) {
+		InputLatency::setEnabled(false);
+	}
+}
+
+/**
+ * @brief DialogInputLatency::buttonBox_clicked
+ * @param button
+ */
+void DialogInputLatency::buttonBox_clicked(QAbstractButton *button) {
+
+	switch (ui.buttonBox->standardButton(button)) {
+	case QDialogButtonBox::Reset:
+		InputLatency::reset();
+		updateReport();
+		break;
+	case QDialogButtonBox::Save: {
+		const QString filename = QFileDialog::getSaveFileName(
+			this,
+			tr("Save Input Latency Log"),
+			QString(),
+			tr("Log Files (*.log *.txt);;All Files (*)"));
+
+		if (!filename.isEmpty() && !InputLatency::writeLog(filename)) {
+			QMessageBox::warning(
+				this,
+				tr("Error writing log"),
+				tr("Unable to write the log to %1").arg(filename));
+		}
+		break;
+	}
+	default:
+		break;
+	}
+}
+
+/**
+ * @brief DialogInputLatency::updateReport
+ */
+void DialogInputLatency::updateReport() {
+
+	const QString text = InputLatency::report();
+	if (text != ui.plainTextEdit->toPlainText()) {
+		ui.plainTextEdit->setPlainText(text);
+	}
+}
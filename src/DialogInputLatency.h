@@ -0,0 +1,28 @@
+
+#ifndef DIALOG_INPUT_LATENCY_H_
+#define DIALOG_INPUT_LATENCY_H_
+
+#include "Dialog.h"
+#include "ui_DialogInputLatency.h"
+
+#include <QTimer>
+
+class QAbstractButton;
+
+class DialogInputLatency final : public Dialog {
+	Q_OBJECT
+
+public:
+	explicit DialogInputLatency(QWidget *parent = nullptr, Qt::WindowFlags f = Qt::WindowFlags());
+	~DialogInputLatency() override;
+
+private:
+	void buttonBox_clicked(QAbstractButton *button);
+	void updateReport();
+
+private:
+	Ui::DialogInputLatency ui;
+	QTimer timer_;
+};
+
+#endif
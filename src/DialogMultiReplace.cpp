@@ -5,8 +5,58 @@
 #include "DocumentWidget.h"
 #include "MainWindow.h"
 #include "Preferences.h"
+#include "Search.h"
+#include "TextArea.h"
+#include "TextBuffer.h"
+#include "WindowMenuEvent.h"
 
+#include <QEventLoop>
+#include <QFutureWatcher>
 #include <QMessageBox>
+#include <QPointer>
+#include <QProgressDialog>
+#include <QtConcurrentMap>
+
+namespace {
+
+struct ReplaceJob {
+	QPointer<DocumentWidget> document;
+	TextBuffer::Snapshot snapshot; // the document as it was before the replacement started
+	QString delimiters;
+	QString searchString;
+	QString replaceString;
+	SearchType searchType;
+};
+
+struct ReplaceResult {
+	boost::optional<std::string> replacement;
+	int64_t copyStart = -1;
+	int64_t copyEnd   = -1;
+};
+
+/**
+ * @brief replaceInDocument
+ * @param job
+ * @return
+ *
+ * Runs on a worker thread, only looks at the snapshot of the text held by the job
+ */
+ReplaceResult replaceInDocument(const ReplaceJob &job) {
+
+	ReplaceResult result;
+	result.replacement = Search::ReplaceAllInString(
+		job.snapshot.text(),
+		job.searchString,
+		job.replaceString,
+		job.searchType,
+		&result.copyStart,
+		&result.copyEnd,
+		job.delimiters);
+
+	return result;
+}
+
+}
 
 /**
  * @brief DialogMultiReplace::DialogMultiReplace
@@ -95,37 +145,115 @@ void DialogMultiReplace::buttonReplace_clicked() {
 	// Set the initial focus of the dialog back to the search string
 	replace_->ui.textFind->setFocus();
 
-	bool replaceFailed  = true;
-	bool noWritableLeft = true;
+	// reject empty string
+	if (fields->searchString.isEmpty()) {
+		return;
+	}
 
-	// Perform the replacements and mark the selected files (history)
+	/* First check again whether the files are still writable. If the file
+	 * status has changed or the file was locked in the mean time, we just
+	 * skip the window. The replacements in the others are worked out on
+	 * worker threads, from snapshots of their text */
+	std::vector<ReplaceJob> jobs;
 	for (QModelIndex index : selections) {
 		if (DocumentWidget *writeableDocument = model_->itemFromIndex(index)) {
-
-			/* First check again whether the file is still writable. If the
-			 * file status has changed or the file was locked in the mean time,
-			 * we just skip the window. */
 			if (!writeableDocument->lockReasons().isAnyLocked()) {
-				noWritableLeft                    = false;
-				writeableDocument->multiFileBusy_ = true; // Avoid multi-beep/dialog
-				writeableDocument->replaceFailed_ = false;
-
-				if (MainWindow *win = MainWindow::fromDocument(writeableDocument)) {
-					win->action_Replace_All(
-						writeableDocument,
-						fields->searchString,
-						fields->replaceString,
-						fields->searchType);
-				}
-
-				writeableDocument->multiFileBusy_ = false;
-				if (!writeableDocument->replaceFailed_) {
-					replaceFailed = false;
-				}
+				jobs.push_back({writeableDocument,
+								writeableDocument->buffer()->BufSnapshot(),
+								writeableDocument->getWindowDelimiters(),
+								fields->searchString,
+								fields->replaceString,
+								fields->searchType});
 			}
 		}
 	}
 
+	const bool noWritableLeft = jobs.empty();
+	bool replaceFailed        = true;
+
+	// save a copy of search and replace strings in the search history
+	Search::saveSearchHistory(fields->searchString, fields->replaceString, fields->searchType, /*isIncremental=*/false);
+
+	const int nJobs = static_cast<int>(jobs.size());
+
+	/* the progress dialog is up before the event loop below runs, so that
+	 * nothing in this window can be used in the meantime. Other windows can,
+	 * which is why the results are carried over the edits made to the
+	 * documents since they were snapshotted, and only applied where the
+	 * replaced text wasn't edited */
+	QProgressDialog progress(tr("Replacing in %1 files...").arg(nJobs), tr("Cancel"), 0, nJobs, this);
+	progress.setWindowModality(Qt::WindowModal);
+	progress.setMinimumDuration(0);
+	progress.show();
+
+	QFutureWatcher<ReplaceResult> watcher;
+	QEventLoop loop;
+	connect(&watcher, &QFutureWatcherBase::progressValueChanged, &progress, &QProgressDialog::setValue);
+	connect(&watcher, &QFutureWatcherBase::finished, &loop, &QEventLoop::quit);
+	connect(&progress, &QProgressDialog::canceled, &watcher, &QFutureWatcherBase::cancel);
+
+	ui.buttonReplace->setEnabled(false);
+	watcher.setFuture(QtConcurrent::mapped(jobs.cbegin(), jobs.cend(), replaceInDocument));
+	if (!watcher.isFinished()) {
+		loop.exec();
+	}
+	watcher.waitForFinished();
+	ui.buttonReplace->setEnabled(true);
+
+	progress.reset();
+
+	// a cancelled replacement leaves every file alone
+	if (watcher.isCanceled()) {
+		return;
+	}
+
+	/* Apply the replacements, each file gets a single edit and therefore a
+	 * single undo record */
+	int nChanged = 0;
+	for (int i = 0; i < nJobs; ++i) {
+		const ReplaceJob &job       = jobs[static_cast<size_t>(i)];
+		const ReplaceResult &result = watcher.resultAt(i);
+
+		DocumentWidget *document = job.document;
+		if (!document) {
+			++nChanged;
+			continue;
+		}
+
+		if (!result.replacement) {
+			continue;
+		}
+
+		/* the replacement was worked out on a snapshot, if the file was
+		 * locked since then, or the text it replaces was edited, it no longer
+		 * applies. Edits elsewhere just move it */
+		TextBuffer *buffer = document->buffer();
+		if (document->lockReasons().isAnyLocked()) {
+			++nChanged;
+			continue;
+		}
+
+		const boost::optional<TextRange> range = buffer->BufRebase(TextRange{TextCursor(result.copyStart), TextCursor(result.copyEnd)}, job.snapshot.version());
+		if (!range) {
+			++nChanged;
+			continue;
+		}
+
+		const TextCursor copyStart = range->start;
+		const TextCursor copyEnd   = range->end;
+
+		emit_event("replace_all", job.searchString, job.replaceString, to_string(job.searchType));
+
+		buffer->BufReplace(copyStart, copyEnd, *result.replacement);
+
+		// Move the cursor to the end of the last replacement
+		if (TextArea *area = document->firstPane()) {
+			area->TextSetCursorPos(copyStart + static_cast<int64_t>(result.replacement->size()));
+		}
+
+		replaceFailed = false;
+	}
+
 	if (!replace_->keepDialog()) {
 		replace_->hide();
 	}
@@ -134,7 +262,9 @@ void DialogMultiReplace::buttonReplace_clicked() {
 
 	/* We suppressed multiple beeps/dialogs. If there wasn't any file in
 	   which the replacement succeeded, we should still warn the user */
-	if (replaceFailed) {
+	if (nChanged != 0) {
+		QMessageBox::information(this, tr("Files Changed"), tr("%n file(s) were closed or locked, or the text to replace in them was edited, while the replacements were worked out, and were left unchanged.", nullptr, nChanged));
+	} else if (replaceFailed) {
 		if (Preferences::GetPrefSearchDlogs()) {
 			if (noWritableLeft) {
 				QMessageBox::information(this, tr("Read-only Files"), tr("All selected files have become read-only."));
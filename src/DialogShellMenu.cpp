@@ -323,7 +323,7 @@ bool DialogShellMenu::applyDialogChanges() {
 	for (int i = 0; i < model_->rowCount(); ++i) {
 		QModelIndex index = model_->index(i, 0);
 		auto item         = model_->itemFromIndex(index);
-		newItems.push_back({*item, nullptr});
+		newItems.push_back({*item, nullptr, nullptr});
 	}
 
 	ShellMenuData = std::move(newItems);
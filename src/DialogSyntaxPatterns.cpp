@@ -1,6 +1,7 @@
 
 #include "DialogSyntaxPatterns.h"
 #include "CommonDialog.h"
+#include "CompiledPatternSet.h"
 #include "DialogDrawingStyles.h"
 #include "DialogLanguageModes.h"
 #include "DocumentWidget.h"
@@ -431,6 +432,8 @@ void DialogSyntaxPatterns::buttonDeletePattern_clicked() {
 		Highlight::PatternSets.erase(it);
 	}
 
+	CompiledPatternSet::invalidate(languageMode);
+
 	model_->clear();
 
 	// Clear out the dialog
@@ -478,6 +481,8 @@ void DialogSyntaxPatterns::buttonRestore_clicked() {
 		return pattern.languageMode == languageMode;
 	});
 
+	CompiledPatternSet::invalidate(languageMode);
+
 	model_->clear();
 
 	// Update the dialog
@@ -669,6 +674,8 @@ bool DialogSyntaxPatterns::updatePatternSet() {
 		*it    = *patternSet;
 	}
 
+	CompiledPatternSet::invalidate(patternSet->languageMode);
+
 	// Find windows that are currently using this pattern set and re-do the highlighting
 	for (DocumentWidget *document : DocumentWidget::allDocuments()) {
 		if (!patternSet->patterns.empty()) {
@@ -914,18 +921,14 @@ bool DialogSyntaxPatterns::validateFields(Verbosity verbosity) {
 */
 bool DialogSyntaxPatterns::TestHighlightPatterns(const std::unique_ptr<PatternSet> &patSet) {
 
-	try {
-		/* Compile the patterns (passing a random window as a source for fonts, and
-		   parent for dialogs, since we really don't care what fonts are used) */
-		if (PatternSet *const patternSet = patSet.get()) {
-			for (DocumentWidget *document : DocumentWidget::allDocuments()) {
-				if (document->createHighlightData(patternSet, Verbosity::Verbose)) {
-					return true;
-				}
+	/* Compile the patterns (passing a random window as a source for fonts, and
+	   parent for dialogs, since we really don't care what fonts are used) */
+	if (PatternSet *const patternSet = patSet.get()) {
+		for (DocumentWidget *document : DocumentWidget::allDocuments()) {
+			if (document->createHighlightData(patternSet)) {
+				return true;
 			}
 		}
-	} catch (const RegexError &e) {
-		QMessageBox::critical(this, tr("Error"), tr("Error compiling syntax highlight patterns:\n%1").arg(QString::fromLatin1(e.what())));
 	}
 
 	return false;
@@ -0,0 +1,124 @@
+
+#include "DisplayColumnCache.h"
+
+#include <algorithm>
+
+/**
+ * @brief DisplayColumnCache::lookup
+ * @param lineStart
+ * @param tabDist
+ * @return the entry for the line starting at lineStart, a new one is made
+ * (replacing the least recently used one if the cache is full) if there is
+ * none yet
+ */
+auto DisplayColumnCache::lookup(TextCursor lineStart, int tabDist) -> Line & {
+
+	++useCount_;
+
+	auto it = std::find_if(lines_.begin(), lines_.end(), [lineStart](const Line &line) {
+		return line.start == lineStart;
+	});
+
+	if (it == lines_.end()) {
+		if (lines_.size() < MaxLines) {
+			lines_.emplace_back();
+			it = std::prev(lines_.end());
+		} else {
+			it = std::min_element(lines_.begin(), lines_.end(), [](const Line &lhs, const Line &rhs) {
+				return lhs.lastUse < rhs.lastUse;
+			});
+		}
+
+		it->start       = lineStart;
+		it->tabDist     = tabDist;
+		it->length      = -1;
+		it->checkpoints = {{0, 0}};
+	} else if (it->tabDist != tabDist) {
+		it->tabDist     = tabDist;
+		it->length      = -1;
+		it->checkpoints = {{0, 0}};
+	}
+
+	it->lastUse = useCount_;
+	return *it;
+}
+
+/**
+ * @brief DisplayColumnCache::find
+ * @param lineStart
+ * @return the entry for the line starting at lineStart, or nullptr if there
+ * is none
+ */
+auto DisplayColumnCache::find(TextCursor lineStart) const -> const Line * {
+
+	auto it = std::find_if(lines_.begin(), lines_.end(), [lineStart](const Line &line) {
+		return line.start == lineStart;
+	});
+
+	if (it == lines_.end()) {
+		return nullptr;
+	}
+
+	return &*it;
+}
+
+/**
+ * @brief DisplayColumnCache::lastCheckpoint
+ * @param line
+ * @param maxOffset
+ * @param maxColumn
+ * @return the last checkpoint of "line" which is neither past "maxOffset"
+ * nor past "maxColumn". The offsets and the columns of the checkpoints both
+ * go up, so there is one which is last on both counts
+ */
+auto DisplayColumnCache::lastCheckpoint(const Line &line, int64_t maxOffset, int64_t maxColumn) -> Checkpoint {
+
+	auto it = std::partition_point(line.checkpoints.begin(), line.checkpoints.end(), [maxOffset, maxColumn](const Checkpoint &checkpoint) {
+		return checkpoint.offset <= maxOffset && checkpoint.column <= maxColumn;
+	});
+
+	if (it == line.checkpoints.begin()) {
+		return {0, 0};
+	}
+
+	return *std::prev(it);
+}
+
+/**
+ * @brief DisplayColumnCache::invalidate
+ * @param pos
+ *
+ * To be called when the buffer is modified at "pos"
+ */
+void DisplayColumnCache::invalidate(TextCursor pos) {
+
+	// lines starting after the edit moved, and may have merged or split
+	lines_.erase(std::remove_if(lines_.begin(), lines_.end(), [pos](const Line &line) {
+					 return line.start > pos;
+				 }),
+				 lines_.end());
+
+	for (Line &line : lines_) {
+		const int64_t offset = pos - line.start;
+
+		// an edit past the end of the line doesn't change it
+		if (line.length != -1 && offset > line.length) {
+			continue;
+		}
+
+		// the checkpoints of the lines containing the edit are good up to it
+		auto it = std::upper_bound(line.checkpoints.begin(), line.checkpoints.end(), offset, [](int64_t value, const Checkpoint &checkpoint) {
+			return value < checkpoint.offset;
+		});
+
+		line.checkpoints.erase(it, line.checkpoints.end());
+		line.length = -1;
+	}
+}
+
+/**
+ * @brief DisplayColumnCache::clear
+ */
+void DisplayColumnCache::clear() {
+	lines_.clear();
+}
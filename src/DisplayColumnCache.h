@@ -0,0 +1,59 @@
+
+#ifndef DISPLAY_COLUMN_CACHE_H_
+#define DISPLAY_COLUMN_CACHE_H_
+
+#include "TextCursor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Remembers, for a few very long lines, the display column reached
+ * every Interval characters. Going from a display column to a position in
+ * such a line or back (to find what is under the left edge of the window when
+ * it is scrolled horizontally, to move the cursor up and down, or to show the
+ * column it is at) then only needs to scan from the nearest checkpoint
+ * instead of from the start of the line.
+ *
+ * Lines are identified by the position they start at, and end at the next
+ * newline. The checkpoints are filled in by the text buffer, which owns the
+ * cache. An edit throws away the checkpoints which follow it, the ones before
+ * it stay valid.
+ */
+class DisplayColumnCache {
+public:
+	// lines shorter than this are cheap enough to scan every time
+	static constexpr int64_t Interval = 4096;
+
+	struct Checkpoint {
+		int64_t offset; // from the start of the line
+		int64_t column; // display column of the character at offset
+	};
+
+	struct Line {
+		TextCursor start;
+		int tabDist;
+		uint64_t lastUse;
+		int64_t length;                      // where the line ends, -1 until the checkpoints have reached it
+		std::vector<Checkpoint> checkpoints; // never empty, starts with {0, 0}
+	};
+
+public:
+	Line &lookup(TextCursor lineStart, int tabDist);
+	const Line *find(TextCursor lineStart) const;
+	void invalidate(TextCursor pos);
+	void clear();
+
+public:
+	static Checkpoint lastCheckpoint(const Line &line, int64_t maxOffset, int64_t maxColumn);
+
+private:
+	// at most a few screenfuls of long lines are in use at any time
+	static constexpr size_t MaxLines = 128;
+
+	std::vector<Line> lines_;
+	uint64_t useCount_ = 0;
+};
+
+#endif
@@ -2,6 +2,8 @@
 #ifndef DOCUMENT_INFO_H_
 #define DOCUMENT_INFO_H_
 
+#include "EditJournal.h"
+#include "FileSignature.h"
 #include "IndentStyle.h"
 #include "LockReasons.h"
 #include "ShowMatchingStyle.h"
@@ -16,6 +18,8 @@
 #include <memory>
 #include <qplatformdefs.h>
 
+#include <boost/optional.hpp>
+
 #ifdef Q_OS_MACOS
 #include <sys/stat.h>
 #include <unistd.h>
@@ -28,13 +32,16 @@ struct DocumentInfo {
 	std::deque<UndoInfo> undo;                        // info for undoing last operation
 	LockReasons lockReasons;                          // all ways a file can be locked
 	std::unique_ptr<SmartIndentData> smartIndentData; // compiled macros for smart indent
+	std::unique_ptr<EditJournal> journal;             // crash recovery log of the unsaved edits
 
 	QT_STATBUF statbuf = {}; // we care about MOST of the fields of this structure.
 							 // So instead of trying to match the OS specific types, just use it
 
+	boost::optional<FileSignature> fileSignature; // of the file as it was last read or written
+
 	FileFormats fileFormat = FileFormats::Unix;                    // whether to save the file straight (Unix format), or convert it to MS DOS style with \r\n line breaks
 	std::shared_ptr<TextBuffer> buffer;                            // holds the text being edited
-	int autoSaveCharCount               = 0;                       // count of single characters typed since last backup file generated
+	int autoSaveCharCount               = 0;                       // count of single characters typed since the journal was last synced
 	int autoSaveOpCount                 = 0;                       // count of editing operations
 	bool filenameSet                    = false;                   // is the window still "Untitled"?
 	bool fileChanged                    = false;                   // has window been modified?
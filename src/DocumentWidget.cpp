@@ -1,6 +1,7 @@
 
 #include "DocumentWidget.h"
 #include "CommandRecorder.h"
+#include "CompiledPatternSet.h"
 #include "DialogDuplicateTags.h"
 #include "DialogMoveDocument.h"
 #include "DialogOutput.h"
@@ -8,11 +9,15 @@
 #include "DialogReplace.h"
 #include "DragEndEvent.h"
 #include "EditFlags.h"
+#include "FileMonitor.h"
+#include "FilePrefetch.h"
 #include "Font.h"
 #include "Highlight.h"
 #include "HighlightData.h"
 #include "HighlightStyle.h"
+#include "InputLatency.h"
 #include "MainWindow.h"
+#include "MenuData.h"
 #include "PatternSet.h"
 #include "Preferences.h"
 #include "Search.h"
@@ -27,6 +32,7 @@
 #include "Util/ClearCase.h"
 #include "Util/FileSystem.h"
 #include "Util/Input.h"
+#include "Util/Instrumentation.h"
 #include "Util/User.h"
 #include "Util/regex.h"
 #include "Util/utils.h"
@@ -41,6 +47,8 @@
 #include <QButtonGroup>
 #include <QClipboard>
 #include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #include <QMimeData>
 #include <QRadioButton>
@@ -48,15 +56,13 @@
 #include <QSplitter>
 #include <QTemporaryFile>
 #include <QTimer>
+#include <QtConcurrentRun>
 #include <qplatformdefs.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
-
-#if defined(Q_OS_WIN)
-#define FDOPEN _fdopen
-#else
-#define FDOPEN fdopen
-#endif
+#include <deque>
 
 // NOTE(eteran): generally, this class reaches out to MainWindow FAR too much
 // it would be better to create some fundamental signals that MainWindow could
@@ -78,6 +84,25 @@ struct ShellCommandData {
 	bool bannerIsUp;
 };
 
+/* a highlighting parse of a document which is done in the background, for
+ * the document to pick up when its highlighting is started */
+struct DocumentWidget::PrefetchedHighlighting {
+	PrefetchedHighlighting()
+		: cancelled(std::make_shared<std::atomic<bool>>(false)) {
+	}
+
+	~PrefetchedHighlighting() {
+		*cancelled = true;
+	}
+
+	std::unique_ptr<WindowHighlightData> highlightData; // the patterns it parses with
+	TextBuffer::Snapshot text;                          // the text it parses
+	QFuture<std::string> styles;                        // its result
+	QFutureWatcher<std::string> watcher;                // tells when it is done
+	std::shared_ptr<std::atomic<bool>> cancelled;       // set when it is no longer wanted
+	bool startWhenDone = false;                         // start the highlighting once it is done
+};
+
 DocumentWidget *DocumentWidget::LastCreated = nullptr;
 
 namespace {
@@ -224,6 +249,110 @@ void handleUnparsedRegionCB(const TextArea *area, TextCursor pos, const void *us
 	}
 }
 
+/**
+ * @brief parsePass1
+ * @param patterns
+ * @param text
+ * @param delimiters
+ * @return the styles of "text" according to the pass 1 patterns of
+ * "patterns". If there are none, all of it is UNFINISHED_STYLE, to trigger
+ * parsing later
+ */
+std::string parsePass1(const CompiledPatternSet *patterns, view::string_view text, const QString &delimiters) {
+
+	std::string style_buffer(text.size(), UNFINISHED_STYLE);
+	if (patterns->pass1Patterns) {
+		char *stylePtr = &style_buffer[0];
+
+		int prev_char = -1;
+		Highlight::ParseContext ctx;
+		ctx.prev_char         = &prev_char;
+		ctx.delimiters        = delimiters;
+		ctx.text              = text;
+		const char *stringPtr = &ctx.text[0];
+
+		Highlight::parseString(
+			&patterns->pass1Patterns[0],
+			stringPtr,
+			stylePtr,
+			static_cast<int64_t>(text.size()),
+			&ctx,
+			nullptr,
+			nullptr);
+	}
+
+	return style_buffer;
+}
+
+/**
+ * @brief rebaseStyles
+ * @param buffer
+ * @param snapshot the text "styles" were worked out for
+ * @param styles
+ * @param changed set to the part of the current text of "buffer" which
+ * changed since "snapshot" was taken. It is styled UNFINISHED_STYLE
+ * @return "styles" carried over to the current text of "buffer". Nothing if
+ * the edits since "snapshot" are no longer known
+ */
+boost::optional<std::string> rebaseStyles(const TextBuffer *buffer, const TextBuffer::Snapshot &snapshot, std::string styles, TextRange *changed) {
+
+	const uint64_t version = snapshot.version();
+	const int64_t length   = snapshot.length();
+
+	if (static_cast<int64_t>(styles.size()) != length) {
+		return boost::none;
+	}
+
+	if (buffer->BufVersion() == version) {
+		*changed = TextRange{buffer->BufEndOfBuffer(), buffer->BufEndOfBuffer()};
+		return styles;
+	}
+
+	/* the longest start and end of the text which no edit touched, both are
+	   found with a binary search as every longer one was touched as well */
+	auto prefixKept = [buffer, version](int64_t end) {
+		const boost::optional<TextRange> range = buffer->BufRebase(TextRange{TextCursor(), TextCursor(end)}, version);
+		return range && range->start == TextCursor();
+	};
+
+	// text appended since is outside of the range, but not part of the suffix
+	auto suffixKept = [buffer, version, length](int64_t start) {
+		const boost::optional<TextRange> range = buffer->BufRebase(TextRange{TextCursor(start), TextCursor(length)}, version);
+		return range && range->end == buffer->BufEndOfBuffer();
+	};
+
+	int64_t prefixEnd = 0;
+	int64_t upper     = length;
+	while (prefixEnd < upper) {
+		const int64_t middle = prefixEnd + (upper - prefixEnd + 1) / 2;
+		if (prefixKept(middle)) {
+			prefixEnd = middle;
+		} else {
+			upper = middle - 1;
+		}
+	}
+
+	int64_t suffixStart = prefixEnd;
+	upper               = length;
+	while (suffixStart < upper) {
+		const int64_t middle = suffixStart + (upper - suffixStart) / 2;
+		if (suffixKept(middle)) {
+			upper = middle;
+		} else {
+			suffixStart = middle + 1;
+		}
+	}
+
+	const boost::optional<TextRange> suffix = buffer->BufRebase(TextRange{TextCursor(suffixStart), TextCursor(length)}, version);
+	if (!suffix || suffix->start < TextCursor(prefixEnd) || suffix->end != buffer->BufEndOfBuffer()) {
+		return boost::none;
+	}
+
+	*changed = TextRange{TextCursor(prefixEnd), suffix->start};
+	styles.replace(static_cast<size_t>(prefixEnd), static_cast<size_t>(suffixStart - prefixEnd), static_cast<size_t>(suffix->start - TextCursor(prefixEnd)), UNFINISHED_STYLE);
+	return styles;
+}
+
 /*
 ** Buffer replacement wrapper routine to be used for inserting output from
 ** a command into the buffer, which takes into account that the buffer may
@@ -364,6 +493,59 @@ QString escapeCommand(const QString &command, const QString &fullName, int lineN
 	return ret;
 }
 
+/* Macros which are run by name or text over and over again, like the ones
+   bound to keys or sent with -do, are only compiled the first time. Nothing
+   in a Program changes while it runs, all of that is in its MacroContext, so
+   the same one may run in several documents at once */
+struct CompiledMacro {
+	QString source;
+	std::shared_ptr<Program> program;
+};
+
+constexpr size_t CompiledMacroCacheSize = 16;
+
+// most recently used first, only ever used from the GUI thread
+std::deque<CompiledMacro> CompiledMacros;
+
+/**
+ * @brief lookupCompiledMacro
+ * @param source
+ * @return the program compiled from "source" before, or nullptr if there is
+ * none
+ */
+std::shared_ptr<Program> lookupCompiledMacro(const QString &source) {
+
+	auto it = std::find_if(CompiledMacros.begin(), CompiledMacros.end(), [&source](const CompiledMacro &entry) {
+		return entry.source == source;
+	});
+
+	if (it == CompiledMacros.end()) {
+		return nullptr;
+	}
+
+	std::shared_ptr<Program> program = it->program;
+	if (it != CompiledMacros.begin()) {
+		CompiledMacro entry = std::move(*it);
+		CompiledMacros.erase(it);
+		CompiledMacros.push_front(std::move(entry));
+	}
+
+	return program;
+}
+
+/**
+ * @brief storeCompiledMacro
+ * @param source
+ * @param program
+ */
+void storeCompiledMacro(const QString &source, const std::shared_ptr<Program> &program) {
+
+	CompiledMacros.push_front(CompiledMacro{source, program});
+	if (CompiledMacros.size() > CompiledMacroCacheSize) {
+		CompiledMacros.pop_back();
+	}
+}
+
 }
 
 /*
@@ -466,6 +648,9 @@ DocumentWidget *DocumentWidget::editExistingFile(DocumentWidget *inDocument, con
 
 	if (!background) {
 		document->raiseDocument();
+	} else if (document->highlightSyntax_ && !document->highlightData_) {
+		// get the deferred highlighting ready while the document is hidden
+		document->prefetchHighlighting();
 	}
 
 	/* Bring the title bar and statistics line up to date, doOpen does
@@ -553,6 +738,7 @@ DocumentWidget::DocumentWidget(std::shared_ptr<DocumentInfo> &info_ptr, QWidget
 	auto area = createTextArea(info_->buffer);
 
 	info_->buffer->BufAddModifyCB(modifiedCB, this);
+	bracketIndex_ = std::make_unique<BracketIndex>(info_->buffer.get());
 
 	static int n = 0;
 	area->setObjectName(tr("TextArea_Clone_%1").arg(n++));
@@ -634,6 +820,7 @@ DocumentWidget::DocumentWidget(const QString &name, QWidget *parent, Qt::WindowF
 	auto area = createTextArea(info_->buffer);
 
 	info_->buffer->BufAddModifyCB(modifiedCB, this);
+	bracketIndex_ = std::make_unique<BracketIndex>(info_->buffer.get());
 
 	// Set the requested hardware tab distance and useTabs in the text buffer
 	info_->buffer->BufSetTabDistance(Preferences::GetPrefTabDist(PLAIN_LANGUAGE_MODE), true);
@@ -650,6 +837,9 @@ DocumentWidget::DocumentWidget(const QString &name, QWidget *parent, Qt::WindowF
  */
 DocumentWidget::~DocumentWidget() {
 
+	FileMonitor::unwatch(this);
+	InputLatency::forget(this);
+
 	// first delete all of the text area's so that they can properly
 	// remove themselves from the buffer's callbacks
 	const std::vector<TextArea *> textAreas = textPanes();
@@ -659,7 +849,9 @@ DocumentWidget::~DocumentWidget() {
 	rangesetTable_ = nullptr;
 
 	// Free syntax highlighting patterns, if any. w/o redisplaying
+	dropPrefetchedHighlighting();
 	freeHighlightingData();
+	bracketIndex_ = nullptr;
 
 	info_->buffer->BufRemoveModifyCB(modifiedCB, this);
 	info_->buffer->BufRemoveModifyCB(Highlight::SyntaxHighlightModifyCB, this);
@@ -980,12 +1172,6 @@ void DocumentWidget::updateMarkTable(TextCursor pos, int64_t nInserted, int64_t
 void DocumentWidget::modifiedCallback(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, TextArea *area) {
 	Q_UNUSED(nRestyled)
 
-	// number of distinct chars the user can typebefore NEdit gens. new backup file
-	const int autoSaveCharLimit = Preferences::GetPrefAutoSaveCharLimit();
-
-	// number of distinct editing operations user can do before NEdit gens. new backup file
-	const int autoSaveOpLimit = Preferences::GetPrefAutoSaveOpLimit();
-
 	const bool selected = info_->buffer->primary.hasSelection();
 
 	// update the table of bookmarks
@@ -1028,12 +1214,8 @@ void DocumentWidget::modifiedCallback(TextCursor pos, int64_t nInserted, int64_t
 	   characters and editing operations for triggering autosave */
 	saveUndoInformation(pos, nInserted, nDeleted, deletedText);
 
-	// Trigger automatic backup if operation or character limits reached
-	if (info_->autoSave && (info_->autoSaveCharCount > autoSaveCharLimit || info_->autoSaveOpCount > autoSaveOpLimit)) {
-		writeBackupFile();
-		info_->autoSaveCharCount = 0;
-		info_->autoSaveOpCount   = 0;
-	}
+	// Record the change for crash recovery
+	updateJournal(pos, nInserted, nDeleted);
 
 	// Indicate that the window has now been modified
 	setWindowModified(true);
@@ -1090,6 +1272,8 @@ void DocumentWidget::smartIndentCallback(TextArea *area, SmartIndentEvent *event
 		return;
 	}
 
+	const InputLatency::StageTimer timer(InputLatency::Stage::SmartIndent);
+
 	switch (event->reason) {
 	case CHAR_TYPED:
 		executeModMacro(event);
@@ -1474,11 +1658,15 @@ QString DocumentWidget::getWindowsMenuEntry() const {
 ** related data.
 */
 void DocumentWidget::stopHighlighting() {
+
+	dropPrefetchedHighlighting();
+
 	if (!highlightData_) {
 		return;
 	}
 
 	// Free and remove the highlight data from the window
+	bracketIndex_->detachStyleBuffer();
 	highlightData_ = nullptr;
 
 	/* Remove and detach style buffer and style table from all text
@@ -1930,7 +2118,9 @@ void DocumentWidget::makeSelectionVisible(TextArea *area) {
 }
 
 /*
-** Remove the backup file associated with this window
+** Remove the backup file associated with this window, that is the journal of
+** the changes made since it was last saved, or the copy of the text of an
+** untitled document
 */
 void DocumentWidget::removeBackupFile() const {
 
@@ -1939,6 +2129,14 @@ void DocumentWidget::removeBackupFile() const {
 		return;
 	}
 
+	if (info_->journal) {
+		info_->journal->discard();
+		info_->journal = nullptr;
+	}
+
+	QFile::remove(journalFileName());
+
+	// and any backup left behind by a version which didn't keep a journal
 	QFile::remove(backupFileName());
 }
 
@@ -1955,6 +2153,14 @@ QString DocumentWidget::backupFileName() const {
 	}
 }
 
+/*
+** Generate the name of the crash recovery journal for this window. It lives
+** next to where NEdit used to write the backup file
+*/
+QString DocumentWidget::journalFileName() const {
+	return backupFileName() + QLatin1String(".journal");
+}
+
 /*
 ** Check if the file in the window was changed by an external source.
 ** and put up a warning dialog if it has.
@@ -1967,7 +2173,6 @@ void DocumentWidget::checkForChangesToFile() {
 	 * is slow to process stat requests (which I'm not sure exists) */
 	constexpr auto CheckInterval = std::chrono::milliseconds(3000);
 
-	// TODO(eteran): 2.0, this concept can probably be reworked in terms of QFileSystemWatcher
 	static QPointer<DocumentWidget> lastCheckWindow;
 	static std::chrono::high_resolution_clock::time_point lastCheckTime;
 
@@ -1975,14 +2180,24 @@ void DocumentWidget::checkForChangesToFile() {
 		return;
 	}
 
-	// If last check was very recent, don't impact performance
 	auto timestamp = std::chrono::high_resolution_clock::now();
-	if (this == lastCheckWindow && (timestamp - lastCheckTime) < CheckInterval) {
-		return;
+	if (!fileChangeReported_) {
+		/* A file which the file monitor watches only needs to be looked at
+		 * once in a while, for the changes it can't see (such as those made
+		 * by other hosts on network file systems) */
+		if (fileWatched_ && (timestamp - lastFileCheck_) < CheckInterval) {
+			return;
+		}
+
+		// If last check was very recent, don't impact performance
+		if (this == lastCheckWindow && (timestamp - lastCheckTime) < CheckInterval) {
+			return;
+		}
 	}
 
 	lastCheckWindow = this;
 	lastCheckTime   = timestamp;
+	lastFileCheck_  = timestamp;
 
 	MainWindow *win = MainWindow::fromDocument(this);
 	if (!win) {
@@ -1995,6 +2210,11 @@ void DocumentWidget::checkForChangesToFile() {
 	 */
 	const bool silent = (!isTopDocument() || !win->isVisible());
 
+	// a reported change has been dealt with once the user could be told about it
+	if (!silent) {
+		fileChangeReported_ = false;
+	}
+
 	// Get the file mode and modification time
 	QString fullname = fullPath();
 
@@ -2103,7 +2323,7 @@ void DocumentWidget::checkForChangesToFile() {
 			return;
 		}
 
-		if (Preferences::GetPrefWarnRealFileMods() && !compareDocumentToFile(fullname)) {
+		if (Preferences::GetPrefWarnRealFileMods() && !fileContentsChanged(fullname)) {
 			// Contents hasn't changed. Update the modification time.
 			info_->statbuf.st_mtime = statbuf.st_mtime;
 			return;
@@ -2130,6 +2350,21 @@ void DocumentWidget::checkForChangesToFile() {
 	}
 }
 
+/*
+** Called by the file monitor when the document's file was changed by another
+** program. The user is warned right away if they are looking at the
+** document, and otherwise when they get to it.
+*/
+void DocumentWidget::fileChangedOnDisk() {
+
+	fileChangeReported_ = true;
+
+	MainWindow *win = MainWindow::fromDocument(this);
+	if (win && win->isActiveWindow() && isTopDocument()) {
+		checkForChangesToFile();
+	}
+}
+
 /**
  * @brief DocumentWidget::fullPath
  * @return
@@ -2168,6 +2403,59 @@ QString DocumentWidget::path() const {
 	return info_->path;
 }
 
+/*
+ * Check if the contents of the file named fileName differ from what the
+ * document last read from it or wrote to it. When the signature of those is
+ * known, this only needs the file to be hashed (and only its size if that
+ * changed), otherwise the file is compared to the document.
+ *
+ * Return values
+ * false: no difference found
+ * true : difference found or could not compare contents.
+ */
+bool DocumentWidget::fileContentsChanged(const QString &fileName) const {
+
+	if (!info_->fileSignature) {
+		return compareDocumentToFile(fileName);
+	}
+
+	// a change of size tells without reading anything
+	const int64_t fileLen = QFileInfo(fileName).size();
+	if (fileLen != info_->fileSignature->size) {
+		return true;
+	}
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return true;
+	}
+
+	/* read a piece at a time rather than mapped (a mapping of a file which is
+	   truncated while it is read faults) or read whole */
+	constexpr int64_t ChunkSize = 256 * 1024;
+	QByteArray chunk(static_cast<int>(std::min(ChunkSize, fileLen)), Qt::Uninitialized);
+
+	FileSignature::Hasher hasher;
+
+	for (int64_t offset = 0; offset < fileLen;) {
+		const qint64 n = file.read(chunk.data(), std::min<int64_t>(chunk.size(), fileLen - offset));
+		if (n <= 0) {
+			return true;
+		}
+
+		hasher.update(view::string_view(chunk.constData(), static_cast<size_t>(n)));
+		offset += n;
+	}
+
+	// it may have grown since its size was looked at
+	char ch;
+	if (file.getChar(&ch)) {
+		return true;
+	}
+
+	return hasher.result() != *info_->fileSignature;
+}
+
 /*
  * Check if the contents of the TextBuffer is equal
  * the contens of the file named fileName. The format of
@@ -2346,6 +2634,96 @@ void DocumentWidget::revertToSaved() {
 	}
 }
 
+/*
+** Record a modification of the buffer in the crash recovery journal. The
+** journal is started by the first change after the document was loaded or
+** saved, and is synced in batches whenever the autosave character or
+** operation limits are reached (or after a short delay), rather than
+** rewriting a backup of the whole document every time.
+*/
+void DocumentWidget::updateJournal(TextCursor pos, int64_t nInserted, int64_t nDeleted) {
+
+	if (!info_->autoSave) {
+		// backups were switched off since the journal was started
+		if (info_->journal && info_->journal->isStarted()) {
+			info_->journal->discard();
+		}
+		return;
+	}
+
+	/* untitled documents aren't opened again, so there is nothing a journal
+	   could be replayed onto. They keep a plain copy of their text instead,
+	   which the user can open after a crash, rewritten whenever the autosave
+	   character or operation limits are reached */
+	if (!info_->filenameSet) {
+		if (info_->autoSaveCharCount > Preferences::GetPrefAutoSaveCharLimit() || info_->autoSaveOpCount > Preferences::GetPrefAutoSaveOpLimit()) {
+			writeBackupFile();
+			info_->autoSaveCharCount = 0;
+			info_->autoSaveOpCount   = 0;
+		}
+		return;
+	}
+
+	if (!info_->journal) {
+		info_->journal = std::make_unique<EditJournal>(journalFileName());
+	}
+
+	EditJournal *journal = info_->journal.get();
+
+	if (!journal->isStarted()) {
+		/* if the document matched the file on disk before this change, the
+		   journal can refer to that file, as it was when it was loaded or
+		   last saved. Otherwise it needs a copy of the text, which already
+		   includes this change */
+		if (!info_->fileChanged && !info_->fileMissing && info_->statbuf.st_mtime > 0) {
+			if (!journal->start(info_->statbuf.st_size, info_->statbuf.st_mtime)) {
+				QMessageBox::warning(
+					this,
+					tr("Error writing Backup"),
+					tr("Unable to save backup for %1:\n%2\nAutomatic backup is now off").arg(info_->filename, errorString(errno)));
+
+				info_->autoSave = false;
+
+				if (auto win = MainWindow::fromDocument(this)) {
+					no_signals(win->ui.action_Incremental_Backup)->setChecked(false);
+				}
+				return;
+			}
+
+			journal->append(to_integer(pos), nDeleted, info_->buffer->BufGetRange(pos, pos + nInserted));
+		} else {
+			journal->start(info_->buffer->BufGetAll());
+		}
+	} else {
+		journal->append(to_integer(pos), nDeleted, info_->buffer->BufGetRange(pos, pos + nInserted));
+	}
+
+	// sync early if operation or character limits are reached
+	if (info_->autoSaveCharCount > Preferences::GetPrefAutoSaveCharLimit() || info_->autoSaveOpCount > Preferences::GetPrefAutoSaveOpLimit()) {
+		journal->flush();
+		info_->autoSaveCharCount = 0;
+		info_->autoSaveOpCount   = 0;
+	}
+
+	if (journal->needsCompaction(info_->buffer->length())) {
+		journal->compact(info_->buffer->BufGetAll());
+	}
+
+	if (journal->hasFailed()) {
+		QMessageBox::critical(
+			this,
+			tr("Error saving Backup"),
+			tr("Error while saving backup for %1\nAutomatic backup is now off").arg(info_->filename));
+
+		journal->discard();
+		info_->autoSave = false;
+
+		if (auto win = MainWindow::fromDocument(this)) {
+			no_signals(win->ui.action_Incremental_Backup)->setChecked(false);
+		}
+	}
+}
+
 /*
 ** Create a backup file for the current document.  The name for the backup file
 ** is generated using the name and path stored in the window and adding a
@@ -2411,6 +2789,102 @@ bool DocumentWidget::writeBackupFile() {
 	return true;
 }
 
+
+/*
+** If a crash recovery journal was left behind for the file being opened,
+** offer to replay it onto "text", the contents of the file. Returns true if
+** "text" now holds the recovered document.
+*/
+bool DocumentWidget::recoverFromJournal(std::string *text) {
+
+	const QString journalFile = journalFileName();
+	if (!QFile::exists(journalFile)) {
+		return recoverFromBackup(text);
+	}
+
+	// the session ended before the first change was written, nothing to recover
+	if (EditJournal::isEmpty(journalFile)) {
+		QFile::remove(journalFile);
+		return recoverFromBackup(text);
+	}
+
+	const int resp = QMessageBox::question(
+		this,
+		tr("Recover Changes"),
+		tr("%1 has unsaved changes from an editing session which did not end normally.\n\nRecover them?").arg(info_->filename),
+		QMessageBox::Yes | QMessageBox::No);
+
+	if (resp != QMessageBox::Yes) {
+		QFile::remove(journalFile);
+		return false;
+	}
+
+	QString error;
+	if (!EditJournal::replay(journalFile, fullPath(), text, &error)) {
+
+		/* keep what is left of the changes for the user to look at, but out
+		   of the way so that they aren't offered again on the next open */
+		const QString failedFile = journalFile + QLatin1String(".failed");
+		QFile::remove(failedFile);
+		QFile::rename(journalFile, failedFile);
+
+		QMessageBox::warning(
+			this,
+			tr("Recover Changes"),
+			tr("The changes to %1 could not be recovered:\n%2\n\nThe journal was kept as %3").arg(info_->filename, error, failedFile));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+** If a backup file written by a version of NEdit which didn't keep an edit
+** journal is newer than the file being opened, offer to load it instead of
+** "text", the contents of the file. Returns true if "text" now holds the
+** contents of the backup.
+*/
+bool DocumentWidget::recoverFromBackup(std::string *text) {
+
+	const QString backupFile = backupFileName();
+
+	const QFileInfo backupInfo(backupFile);
+	if (!backupInfo.exists() || backupInfo.lastModified() <= QFileInfo(fullPath()).lastModified()) {
+		return false;
+	}
+
+	const int resp = QMessageBox::question(
+		this,
+		tr("Recover Changes"),
+		tr("The backup file %1 is newer than %2.\n\nOpen the backup instead?").arg(backupFile, info_->filename),
+		QMessageBox::Yes | QMessageBox::No);
+
+	if (resp != QMessageBox::Yes) {
+		return false;
+	}
+
+	QFile file(backupFile);
+	if (!file.open(QIODevice::ReadOnly)) {
+		QMessageBox::warning(
+			this,
+			tr("Recover Changes"),
+			tr("The backup file %1 could not be read:\n%2").arg(backupFile, file.errorString()));
+		return false;
+	}
+
+	const QByteArray contents = file.readAll();
+	if (file.error() != QFileDevice::NoError) {
+		QMessageBox::warning(
+			this,
+			tr("Recover Changes"),
+			tr("The backup file %1 could not be read:\n%2").arg(backupFile, file.errorString()));
+		return false;
+	}
+
+	text->assign(contents.constData(), static_cast<size_t>(contents.size()));
+	return true;
+}
+
 /**
  * @brief DocumentWidget::saveDocument
  * @return
@@ -2474,6 +2948,8 @@ bool DocumentWidget::saveDocument() {
 
 bool DocumentWidget::doSave() {
 
+	INSTRUMENT_SCOPE("doSave");
+
 	QString fullname = fullPath();
 
 	/*  Check for root and warn him if he wants to write to a file with
@@ -2540,6 +3016,8 @@ bool DocumentWidget::doSave() {
 		break;
 	}
 
+	INSTRUMENT_COUNT("doSave bytes", static_cast<int64_t>(text.size()));
+
 	// write to the file
 	if (file.write(text.data(), static_cast<int64_t>(text.size())) == -1) {
 		QMessageBox::critical(this, tr("Error saving File"), tr("%1 not saved:\n%2").arg(info_->filename, file.errorString()));
@@ -2550,14 +3028,19 @@ bool DocumentWidget::doSave() {
 
 	// success, file was written
 	setWindowModified(false);
+	info_->fileSignature = FileSignature::of(text);
 
 	// update the modification time
 	QT_STATBUF statbuf;
 	if (QT_STAT(fullname.toUtf8().data(), &statbuf) == 0) {
 		info_->statbuf.st_mtime = statbuf.st_mtime;
+		info_->statbuf.st_size  = statbuf.st_size;
 		info_->fileMissing      = false;
 		info_->statbuf.st_dev   = statbuf.st_dev;
 		info_->statbuf.st_ino   = statbuf.st_ino;
+
+		// the file may be new, or have been saved under a new name
+		fileWatched_ = FileMonitor::watch(this, fullname);
 	} else {
 		// This needs to produce an error message -- the file can't be accessed!
 		info_->statbuf.st_mtime = 0;
@@ -2859,7 +3342,7 @@ bool DocumentWidget::fileWasModifiedExternally() const {
 		return false;
 	}
 
-	if (Preferences::GetPrefWarnRealFileMods() && !compareDocumentToFile(fullname)) {
+	if (Preferences::GetPrefWarnRealFileMods() && !fileContentsChanged(fullname)) {
 		return false;
 	}
 
@@ -2969,8 +3452,12 @@ void DocumentWidget::closeDocument() {
 		info_->statbuf.st_dev   = 0;
 		info_->statbuf.st_ino   = 0;
 		info_->filename         = name;
+		info_->fileSignature    = boost::none;
 		setPath(QString());
 
+		FileMonitor::unwatch(this);
+		fileWatched_ = false;
+
 		markTable_.clear();
 
 		// clear the buffer, but ignore changes
@@ -3083,6 +3570,8 @@ DocumentWidget *DocumentWidget::open(const QString &fullpath) {
  */
 bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags) {
 
+	INSTRUMENT_SCOPE("doOpen");
+
 	MainWindow *win = MainWindow::fromDocument(this);
 	if (!win) {
 		return false;
@@ -3093,15 +3582,19 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 
 	// Update the window data structure
 	setPath(path);
-	info_->filename    = name;
-	info_->filenameSet = true;
-	info_->fileMissing = true;
+	info_->filename      = name;
+	info_->filenameSet   = true;
+	info_->fileMissing   = true;
+	info_->fileSignature = boost::none;
 
 	FILE *fp = nullptr;
 
 	// Get the full name of the file
 	const QString fullname = fullPath();
 
+	// The file may have been read ahead of time, along with others opened with it
+	boost::optional<FilePrefetch::PrefetchedFile> prefetched = FilePrefetch::take(fullname);
+
 	// Open the file
 	/* The only advantage of this is if you use clearcase,
 	   which messes up the mtime of files opened with r+,
@@ -3226,7 +3719,24 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 
 		std::string text;
 
-		if (file.size() != 0) {
+		/* only use what was read ahead of time if the file is still the same
+		   one, and it was converted (or not) the way it would be now */
+		if (prefetched) {
+			const bool unchanged =
+				prefetched->statbuf.st_dev == statbuf.st_dev &&
+				prefetched->statbuf.st_ino == statbuf.st_ino &&
+				prefetched->statbuf.st_size == statbuf.st_size &&
+				prefetched->statbuf.st_mtime == statbuf.st_mtime &&
+				prefetched->converted == Preferences::GetPrefForceOSConversion();
+
+			if (!unchanged) {
+				prefetched = boost::none;
+			}
+		}
+
+		if (prefetched) {
+			text = std::move(prefetched->text);
+		} else if (file.size() != 0) {
 			uchar *memory = file.map(0, file.size());
 			if (!memory) {
 				info_->filenameSet = false; // Temp. prevent check for changes.
@@ -3239,6 +3749,9 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 			file.unmap(memory);
 		}
 
+		// remember what the file looked like, before any conversion
+		info_->fileSignature = prefetched ? prefetched->signature : FileSignature::of(text);
+
 		/* Any errors that happen after this point leave the window in a
 		 * "broken" state, and thus RevertToSaved will abandon the window if
 		 * info_->fileMissing is false and doOpen fails. */
@@ -3246,12 +3759,17 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 		info_->statbuf.st_uid   = statbuf.st_uid;
 		info_->statbuf.st_gid   = statbuf.st_gid;
 		info_->statbuf.st_mtime = statbuf.st_mtime;
+		info_->statbuf.st_size  = statbuf.st_size;
 		info_->statbuf.st_dev   = statbuf.st_dev;
 		info_->statbuf.st_ino   = statbuf.st_ino;
 		info_->fileMissing      = false;
 
+		fileWatched_ = FileMonitor::watch(this, fullname);
+
 		// Detect and convert DOS and Macintosh format files
-		if (Preferences::GetPrefForceOSConversion()) {
+		if (prefetched && prefetched->converted) {
+			info_->fileFormat = prefetched->format;
+		} else if (Preferences::GetPrefForceOSConversion()) {
 			info_->fileFormat = FormatOfFile(text);
 			switch (info_->fileFormat) {
 			case FileFormats::Dos:
@@ -3265,6 +3783,11 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 			}
 		}
 
+		INSTRUMENT_COUNT("doOpen bytes", static_cast<int64_t>(text.size()));
+
+		// Offer to restore what a crashed session didn't save
+		const bool recovered = recoverFromJournal(&text);
+
 		// Display the file contents in the text widget
 		info_->ignoreModify = true;
 		info_->buffer->BufSetAll(text);
@@ -3276,10 +3799,10 @@ bool DocumentWidget::doOpen(const QString &name, const QString &path, int flags)
 		}
 
 		if (info_->lockReasons.isPermLocked()) {
-			info_->fileChanged = false;
+			info_->fileChanged = recovered;
 			Q_EMIT updateWindowTitle(this);
 		} else {
-			setWindowModified(false);
+			setWindowModified(recovered);
 			if (info_->lockReasons.isAnyLocked()) {
 				Q_EMIT updateWindowTitle(this);
 			}
@@ -3440,7 +3963,7 @@ void DocumentWidget::executeNewlineMacro(SmartIndentEvent *event) {
 		++(winData->inNewLineMacro);
 
 		std::shared_ptr<MacroContext> continuation;
-		int stat = executeMacro(this, winData->newlineMacro.get(), args, &result, continuation, &errMsg);
+		int stat = executeMacro(this, winData->newlineMacro.get(), tr("(smart indent newline)"), args, &result, continuation, &errMsg);
 
 		// Don't allow preemption or time limit.  Must get return value
 		while (stat == MACRO_TIME_LIMIT) {
@@ -3528,7 +4051,7 @@ void DocumentWidget::executeModMacro(SmartIndentEvent *event) {
 		++(winData->inModMacro);
 
 		std::shared_ptr<MacroContext> continuation;
-		int stat = executeMacro(this, winData->modMacro.get(), args, &result, continuation, &errMsg);
+		int stat = executeMacro(this, winData->modMacro.get(), tr("(smart indent modify)"), args, &result, continuation, &errMsg);
 
 		while (stat == MACRO_TIME_LIMIT) {
 			stat = continueMacro(continuation, &result, &errMsg);
@@ -3670,6 +4193,20 @@ boost::optional<TextCursor> DocumentWidget::findMatchingChar(char toMatch, Style
 		return boost::none;
 	}
 
+	/* brackets are found with the bracket index, which doesn't have to look at
+	   all of the text in between */
+	if (BracketIndex::isBracket(toMatch)) {
+		if (!matchSyntaxBased || !highlightData_) {
+			return bracketIndex_->findMatch(toMatch, charPos, startLimit, endLimit, styleToMatch, nullptr, nullptr);
+		}
+
+		auto styleOf = [](TextCursor pos, void *user) {
+			return static_cast<DocumentWidget *>(user)->getHighlightInfo(pos);
+		};
+
+		return bracketIndex_->findMatch(toMatch, charPos, startLimit, endLimit, styleToMatch, styleOf, this);
+	}
+
 	const char matchChar      = matchIt->match;
 	const Direction direction = matchIt->direction;
 
@@ -5178,16 +5715,21 @@ void DocumentWidget::repeatMacro(const QString &macro, int how) {
 	}
 
 	// Parse the resulting macro into an executable program "prog"
-	QString errMsg;
-	int stoppedAt;
-	Program *const prog = compileMacro(loopedCmd, &errMsg, &stoppedAt);
+	std::shared_ptr<Program> prog = lookupCompiledMacro(loopedCmd);
 	if (!prog) {
-		qWarning("NEdit: internal error, repeat macro syntax wrong: %s", qPrintable(errMsg));
-		return;
+		QString errMsg;
+		int stoppedAt;
+		prog = std::shared_ptr<Program>(compileMacro(loopedCmd, &errMsg, &stoppedAt));
+		if (!prog) {
+			qWarning("NEdit: internal error, repeat macro syntax wrong: %s", qPrintable(errMsg));
+			return;
+		}
+
+		storeCompiledMacro(loopedCmd, prog);
 	}
 
 	// run the executable program
-	runMacro(prog);
+	runMacro(prog, tr("(repeat)"));
 }
 
 /**
@@ -5281,15 +5823,17 @@ void DocumentWidget::readMacroFile(const QString &fileName, bool warnNotExist) {
 /*
 ** Run a pre-compiled macro, changing the interface state to reflect that
 ** a macro is running, and handling preemption, resumption, and cancellation.
-** frees prog when macro execution is complete;
+** frees prog when macro execution is complete; "name" is what the macro is
+** called in profiles
 */
-void DocumentWidget::runMacro(Program *prog) {
+void DocumentWidget::runMacro(const std::shared_ptr<Program> &prog, const QString &name) {
 
 	/* If a macro is already running, just call the program as a subroutine,
 	   instead of starting a new one, so we don't have to keep a separate
 	   context, and the macros will serialize themselves automatically */
 	if (macroCmdData_) {
-		RunMacroAsSubrCall(prog);
+		macroCmdData_->subroutines.push_back(prog);
+		RunMacroAsSubrCall(prog.get(), name);
 		return;
 	}
 
@@ -5307,7 +5851,7 @@ void DocumentWidget::runMacro(Program *prog) {
 	auto cmdData               = std::make_unique<MacroCommandData>();
 	cmdData->bannerIsUp        = false;
 	cmdData->closeOnCompletion = false;
-	cmdData->program           = std::unique_ptr<Program>(prog);
+	cmdData->program           = prog;
 	cmdData->context           = nullptr;
 
 	macroCmdData_ = std::move(cmdData);
@@ -5320,7 +5864,7 @@ void DocumentWidget::runMacro(Program *prog) {
 	// Begin macro execution
 	DataValue result;
 	QString errMsg;
-	const int stat = executeMacro(this, prog, {}, &result, macroCmdData_->context, &errMsg);
+	const int stat = executeMacro(this, prog.get(), name, {}, &result, macroCmdData_->context, &errMsg);
 
 	switch (stat) {
 	case MACRO_ERROR:
@@ -5574,6 +6118,7 @@ void DocumentWidget::freeHighlightingData() {
 		return;
 	}
 
+	bracketIndex_->detachStyleBuffer();
 	highlightData_ = nullptr;
 
 	/* The text display may make a last desperate attempt to access highlight
@@ -5591,6 +6136,9 @@ void DocumentWidget::updateHighlightStyles() {
 
 	std::unique_ptr<WindowHighlightData> &oldHighlightData = highlightData_;
 
+	// a parse waiting in the background has the old styles
+	dropPrefetchedHighlighting();
+
 	// Do nothing if window not highlighted
 	if (!oldHighlightData) {
 		return;
@@ -5617,6 +6165,9 @@ void DocumentWidget::updateHighlightStyles() {
 
 	highlightData_ = std::move(newHighlightData);
 
+	// the same styles may now go by different names
+	bracketIndex_->invalidateStyles();
+
 	/* Attach new highlight information to text widgets in each pane
 	   (and redraw) */
 	for (TextArea *area : textPanes()) {
@@ -5685,12 +6236,14 @@ Style DocumentWidget::getHighlightInfo(TextCursor pos) {
 		style = highlightData->styleBuffer->BufGetCharacter(pos);
 	}
 
-	if (highlightData->pass1Patterns) {
-		pattern = Highlight::patternOfStyle(highlightData->pass1Patterns, style);
+	const std::shared_ptr<const CompiledPatternSet> &patterns = highlightData->compiledPatterns;
+
+	if (patterns->pass1Patterns) {
+		pattern = Highlight::patternOfStyle(patterns->pass1Patterns, style);
 	}
 
-	if (!pattern && highlightData->pass2Patterns) {
-		pattern = Highlight::patternOfStyle(highlightData->pass2Patterns, style);
+	if (!pattern && patterns->pass2Patterns) {
+		pattern = Highlight::patternOfStyle(patterns->pass2Patterns, style);
 	}
 
 	if (!pattern) {
@@ -5869,8 +6422,8 @@ void DocumentWidget::handleUnparsedRegion(TextBuffer *styleBuf, TextCursor pos)
 	TextBuffer *buf                                           = info_->buffer.get();
 	const std::unique_ptr<WindowHighlightData> &highlightData = highlightData_;
 
-	const ReparseContext &context                         = highlightData->contextRequirements;
-	const std::unique_ptr<HighlightData[]> &pass2Patterns = highlightData->pass2Patterns;
+	const ReparseContext &context                         = highlightData->compiledPatterns->contextRequirements;
+	const std::unique_ptr<HighlightData[]> &pass2Patterns = highlightData->compiledPatterns->pass2Patterns;
 
 	if (!pass2Patterns) {
 		return;
@@ -5919,9 +6472,23 @@ void DocumentWidget::handleUnparsedRegion(TextBuffer *styleBuf, TextCursor pos)
 		}
 	}
 
-	// Copy the buffer range into a string
-	std::string str    = buf->BufGetRange(beginSafety, endSafety);
-	const char *string = &str[0];
+	/* This is called while the text is being drawn, which holds on to views
+	   of the text buffer, so the gap must not move. The range is parsed in
+	   place unless it straddles the gap, in which case it is copied */
+	const std::pair<view::string_view, view::string_view> segments = buf->BufGetSegments(beginSafety, endSafety);
+
+	std::string copy;
+	view::string_view str;
+	if (segments.second.empty()) {
+		str = segments.first;
+	} else if (segments.first.empty()) {
+		str = segments.second;
+	} else {
+		copy = buf->BufGetRange(beginSafety, endSafety);
+		str  = copy;
+	}
+
+	const char *string = str.data();
 
 	std::string styleStr    = styleBuf->BufGetRange(beginSafety, endSafety);
 	char *const styleString = &styleStr[0];
@@ -5971,9 +6538,10 @@ void DocumentWidget::startHighlighting(Verbosity verbosity) {
 		return;
 	}
 
-	// Compile the patterns
-	std::unique_ptr<WindowHighlightData> highlightData = createHighlightData(patterns);
-	if (!highlightData) {
+	/* Don't wait for a parse which is still running in the background, the
+	   highlighting is started when it is done */
+	if (prefetchedHighlighting_ && prefetchedHighlighting_->highlightData->patternSetForWindow == patterns && !prefetchedHighlighting_->styles.isFinished()) {
+		prefetchedHighlighting_->startWhenDone = true;
 		return;
 	}
 
@@ -5981,36 +6549,52 @@ void DocumentWidget::startHighlighting(Verbosity verbosity) {
 	const QCursor prevCursor = cursor();
 	setCursor(Qt::WaitCursor);
 
-	const int64_t bufLength = info_->buffer->length();
+	std::unique_ptr<WindowHighlightData> highlightData;
+	std::string style_buffer;
+	boost::optional<TextRange> changed;
+
+	/* Pick up the parse done in the background, if there is one. The text
+	   may have been edited since, the styles of what changed are then worked
+	   out again below */
+	if (prefetchedHighlighting_ && prefetchedHighlighting_->highlightData->patternSetForWindow == patterns) {
+		TextRange range;
+		if (boost::optional<std::string> styles = rebaseStyles(info_->buffer.get(), prefetchedHighlighting_->text, prefetchedHighlighting_->styles.result(), &range)) {
+			style_buffer  = std::move(*styles);
+			highlightData = std::move(prefetchedHighlighting_->highlightData);
+			if (prefetchedHighlighting_->text.version() != info_->buffer->BufVersion()) {
+				changed = range;
+			}
+		}
+	}
 
-	/* Parse the buffer with pass 1 patterns.  If there are none, initialize
-	   the style buffer to all UNFINISHED_STYLE to trigger parsing later */
-	std::string style_buffer(static_cast<size_t>(bufLength), UNFINISHED_STYLE);
-	if (highlightData->pass1Patterns) {
-		char *stylePtr = &style_buffer[0];
+	dropPrefetchedHighlighting();
 
-		int prev_char = -1;
-		Highlight::ParseContext ctx;
-		ctx.prev_char         = &prev_char;
-		ctx.delimiters        = documentDelimiters();
-		ctx.text              = info_->buffer->BufAsString();
-		const char *stringPtr = &ctx.text[0];
+	if (!highlightData) {
+		// Compile the patterns
+		highlightData = createHighlightData(patterns);
+		if (!highlightData) {
+			setCursor(prevCursor);
+			return;
+		}
 
-		Highlight::parseString(
-			&highlightData->pass1Patterns[0],
-			stringPtr,
-			stylePtr,
-			bufLength,
-			&ctx,
-			nullptr,
-			nullptr);
+		// Parse the buffer with pass 1 patterns
+		style_buffer = parsePass1(highlightData->compiledPatterns.get(), info_->buffer->BufAsString(), documentDelimiters());
 	}
 
+	bracketIndex_->attachStyleBuffer(highlightData->styleBuffer.get());
 	highlightData->styleBuffer->BufSetAll(style_buffer);
 
 	// install highlight pattern data in the window data structure
 	highlightData_ = std::move(highlightData);
 
+	// the same way as the text had been edited after the parse
+	if (changed) {
+		const std::shared_ptr<TextBuffer> &styleBuffer = highlightData_->styleBuffer;
+		styleBuffer->BufSelect(changed->start, changed->end);
+		Highlight::incrementalReparse(highlightData_, info_->buffer.get(), changed->start, changed->end - changed->start);
+		styleBuffer->BufUnselect();
+	}
+
 	// Attach highlight information to text widgets in each pane
 	for (TextArea *area : textPanes()) {
 		attachHighlightToWidget(area);
@@ -6019,6 +6603,68 @@ void DocumentWidget::startHighlighting(Verbosity verbosity) {
 	setCursor(prevCursor);
 }
 
+/*
+** Parse the document with the pass 1 patterns of its language mode on the
+** thread pool, for startHighlighting to pick up when the document is raised.
+** This is for documents opened in the background, whose highlighting is
+** deferred until then.
+*/
+void DocumentWidget::prefetchHighlighting() {
+
+	dropPrefetchedHighlighting();
+
+	PatternSet *patterns = findPatternsForWindow(Verbosity::Silent);
+	if (!patterns) {
+		return;
+	}
+
+	std::unique_ptr<WindowHighlightData> highlightData = createHighlightData(patterns);
+	if (!highlightData || !highlightData->compiledPatterns->pass1Patterns) {
+		return;
+	}
+
+	/* the parse works on a snapshot of the text and copies of everything else
+	   it needs, so the document can change or go away while it runs. The
+	   compiled patterns may be in use on the GUI thread meanwhile, so it
+	   borrows one of the copies kept for the workers. The snapshot is kept
+	   until the result is picked up, for it to be rebased onto the text as it
+	   is then */
+	auto prefetch  = std::make_unique<PrefetchedHighlighting>();
+	prefetch->text = info_->buffer->BufSnapshot();
+
+	connect(&prefetch->watcher, &QFutureWatcher<std::string>::finished, this, [this]() {
+		if (prefetchedHighlighting_ && prefetchedHighlighting_->startWhenDone && highlightSyntax_ && !highlightData_) {
+			startHighlighting(Verbosity::Silent);
+		}
+	}, Qt::QueuedConnection);
+
+	prefetch->styles = QtConcurrent::run([copies = highlightData->compiledPatterns->reserveWorkerCopy(), cancelled = prefetch->cancelled, delimiters = documentDelimiters(), snapshot = prefetch->text]() {
+		// the document may be gone or highlighted by the time this gets to run
+		if (*cancelled) {
+			copies->release();
+			return std::string();
+		}
+
+		const std::shared_ptr<const CompiledPatternSet> patterns = copies->borrow();
+		if (*cancelled) {
+			return std::string();
+		}
+
+		return parsePass1(patterns.get(), snapshot.text(), delimiters);
+	});
+
+	prefetch->watcher.setFuture(prefetch->styles);
+	prefetch->highlightData = std::move(highlightData);
+	prefetchedHighlighting_ = std::move(prefetch);
+}
+
+/**
+ * @brief DocumentWidget::dropPrefetchedHighlighting
+ */
+void DocumentWidget::dropPrefetchedHighlighting() {
+	prefetchedHighlighting_ = nullptr;
+}
+
 /*
 ** Attach style information from a window's highlight data to a
 ** text widget and redisplay.
@@ -6039,7 +6685,7 @@ void DocumentWidget::attachHighlightToWidget(TextArea *area) {
 ** highlighting fonts from "window", includes pattern compilation.  If errors
 ** are encountered, warns user with a dialog and returns nullptr.
 */
-std::unique_ptr<WindowHighlightData> DocumentWidget::createHighlightData(PatternSet *patternSet, Verbosity verbosity) {
+std::unique_ptr<WindowHighlightData> DocumentWidget::createHighlightData(PatternSet *patternSet) {
 
 	std::vector<HighlightPattern> &patterns = patternSet->patterns;
 
@@ -6131,19 +6777,109 @@ std::unique_ptr<WindowHighlightData> DocumentWidget::createHighlightData(Pattern
 		pass2PatternSrc.clear();
 	}
 
+	/* The compiled patterns don't depend on the document, so the documents
+	   using one of the stored pattern sets share them. Others (such as one
+	   being tested by the syntax patterns dialog) are compiled every time */
+	const bool shared = (Highlight::FindPatternSet(patternSet->languageMode) == patternSet);
+
+	std::shared_ptr<const CompiledPatternSet> compiledPatterns;
+	if (shared) {
+		compiledPatterns = CompiledPatternSet::lookup(*patternSet);
+	}
+
+	if (!compiledPatterns) {
+		compiledPatterns = compilePatternSet(patternSet, pass1PatternSrc, pass2PatternSrc);
+		if (!compiledPatterns) {
+			return nullptr;
+		}
+
+		if (shared) {
+			CompiledPatternSet::store(*patternSet, compiledPatterns);
+		}
+	}
+
+	const bool zeroPass1 = (pass1PatternSrc.empty());
+	const bool zeroPass2 = (pass2PatternSrc.empty());
+
+	// Set up table for mapping colors and fonts to syntax
+	std::vector<StyleTableEntry> styleTable;
+	styleTable.reserve(pass1PatternSrc.size() + pass2PatternSrc.size());
+
+	auto it = std::back_inserter(styleTable);
+
+	auto createStyleTableEntry = [](HighlightPattern *pat) {
+		StyleTableEntry p;
+
+		p.isUnderlined  = false;
+		p.highlightName = pat->name;
+		p.styleName     = pat->style;
+		p.colorName     = Highlight::FgColorOfNamedStyle(pat->style);
+		p.bgColorName   = Highlight::BgColorOfNamedStyle(pat->style);
+		p.isBold        = Highlight::FontOfNamedStyleIsBold(pat->style);
+		p.isItalic      = Highlight::FontOfNamedStyleIsItalic(pat->style);
+
+		// And now for the more physical stuff
+		p.color = X11Colors::fromString(p.colorName);
+
+		if (!p.bgColorName.isNull()) {
+			p.bgColor = X11Colors::fromString(p.bgColorName);
+		} else {
+			p.bgColor = p.color;
+		}
+
+		return p;
+	};
+
+	// PLAIN_STYLE (pass 1)
+	it++ = createStyleTableEntry(zeroPass1 ? &pass2PatternSrc[0] : &pass1PatternSrc[0]);
+
+	// PLAIN_STYLE (pass 2)
+	it++ = createStyleTableEntry(zeroPass2 ? &pass1PatternSrc[0] : &pass2PatternSrc[0]);
+
+	// explicit styles (pass 1)
+	for (size_t i = 1; i < pass1PatternSrc.size(); i++) {
+		it++ = createStyleTableEntry(&pass1PatternSrc[i]);
+	}
+
+	// explicit styles (pass 2)
+	for (size_t i = 1; i < pass2PatternSrc.size(); i++) {
+		it++ = createStyleTableEntry(&pass2PatternSrc[i]);
+	}
+
+	// Create the style buffer
+	auto styleBuf = std::make_unique<TextBuffer>();
+	styleBuf->BufSetSyncXSelection(false);
+
+	// Collect all of the highlighting information in a single structure
+	auto highlightData                 = std::make_unique<WindowHighlightData>();
+	highlightData->compiledPatterns    = std::move(compiledPatterns);
+	highlightData->styleTable          = std::move(styleTable);
+	highlightData->styleBuffer         = std::move(styleBuf);
+	highlightData->patternSetForWindow = patternSet;
+
+	return highlightData;
+}
+
+/*
+** Compile the patterns of "patternSet", already sorted into those for pass 1
+** and pass 2 parsing, and work out the styles they are given. Returns nullptr
+** (after warning the user) if any of them doesn't compile.
+*/
+std::shared_ptr<CompiledPatternSet> DocumentWidget::compilePatternSet(const PatternSet *patternSet, const std::vector<HighlightPattern> &pass1PatternSrc, const std::vector<HighlightPattern> &pass2PatternSrc) {
+
 	std::unique_ptr<HighlightData[]> pass1Pats;
 	std::unique_ptr<HighlightData[]> pass2Pats;
 
 	// Compile patterns
 	if (!pass1PatternSrc.empty()) {
-		pass1Pats = compilePatterns(pass1PatternSrc, verbosity);
+		pass1Pats = compilePatterns(pass1PatternSrc);
 		if (!pass1Pats) {
 			return nullptr;
 		}
 	}
 
 	if (!pass2PatternSrc.empty()) {
-		pass2Pats = compilePatterns(pass2PatternSrc, verbosity);
+		pass2Pats = compilePatterns(pass2PatternSrc);
 		if (!pass2Pats) {
 			return nullptr;
 		}
@@ -6206,70 +6942,14 @@ std::unique_ptr<WindowHighlightData> DocumentWidget::createHighlightData(Pattern
 		}
 	}
 
-	// Set up table for mapping colors and fonts to syntax
-	std::vector<StyleTableEntry> styleTable;
-	styleTable.reserve(pass1PatternSrc.size() + pass2PatternSrc.size());
-
-	auto it = std::back_inserter(styleTable);
-
-	auto createStyleTableEntry = [](HighlightPattern *pat) {
-		StyleTableEntry p;
-
-		p.isUnderlined  = false;
-		p.highlightName = pat->name;
-		p.styleName     = pat->style;
-		p.colorName     = Highlight::FgColorOfNamedStyle(pat->style);
-		p.bgColorName   = Highlight::BgColorOfNamedStyle(pat->style);
-		p.isBold        = Highlight::FontOfNamedStyleIsBold(pat->style);
-		p.isItalic      = Highlight::FontOfNamedStyleIsItalic(pat->style);
-
-		// And now for the more physical stuff
-		p.color = X11Colors::fromString(p.colorName);
-
-		if (!p.bgColorName.isNull()) {
-			p.bgColor = X11Colors::fromString(p.bgColorName);
-		} else {
-			p.bgColor = p.color;
-		}
-
-		return p;
-	};
-
-	// PLAIN_STYLE (pass 1)
-	it++ = createStyleTableEntry(zeroPass1 ? &pass2PatternSrc[0] : &pass1PatternSrc[0]);
-
-	// PLAIN_STYLE (pass 2)
-	it++ = createStyleTableEntry(zeroPass2 ? &pass1PatternSrc[0] : &pass2PatternSrc[0]);
-
-	// explicit styles (pass 1)
-	for (size_t i = 1; i < pass1PatternSrc.size(); i++) {
-		it++ = createStyleTableEntry(&pass1PatternSrc[i]);
-	}
-
-	// explicit styles (pass 2)
-	for (size_t i = 1; i < pass2PatternSrc.size(); i++) {
-		it++ = createStyleTableEntry(&pass2PatternSrc[i]);
-	}
-
-	// Create the style buffer
-	auto styleBuf = std::make_unique<TextBuffer>();
-	styleBuf->BufSetSyncXSelection(false);
-
-	const int contextLines = patternSet->lineContext;
-	const int contextChars = patternSet->charContext;
-
-	// Collect all of the highlighting information in a single structure
-	auto highlightData                        = std::make_unique<WindowHighlightData>();
-	highlightData->pass1Patterns              = std::move(pass1Pats);
-	highlightData->pass2Patterns              = std::move(pass2Pats);
-	highlightData->parentStyles               = std::move(parentStyles);
-	highlightData->styleTable                 = std::move(styleTable);
-	highlightData->styleBuffer                = std::move(styleBuf);
-	highlightData->contextRequirements.nLines = contextLines;
-	highlightData->contextRequirements.nChars = contextChars;
-	highlightData->patternSetForWindow        = patternSet;
+	auto compiledPatterns                        = std::make_shared<CompiledPatternSet>();
+	compiledPatterns->pass1Patterns              = std::move(pass1Pats);
+	compiledPatterns->pass2Patterns              = std::move(pass2Pats);
+	compiledPatterns->parentStyles               = std::move(parentStyles);
+	compiledPatterns->contextRequirements.nLines = patternSet->lineContext;
+	compiledPatterns->contextRequirements.nChars = patternSet->charContext;
 
-	return highlightData;
+	return compiledPatterns;
 }
 
 /*
@@ -6277,7 +6957,7 @@ std::unique_ptr<WindowHighlightData> DocumentWidget::createHighlightData(Pattern
 ** actually used by the code.  Output is a tree of HighlightData structures
 ** containing compiled regular expressions and style information.
 */
-std::unique_ptr<HighlightData[]> DocumentWidget::compilePatterns(const std::vector<HighlightPattern> &patternSrc, Verbosity verbosity) {
+std::unique_ptr<HighlightData[]> DocumentWidget::compilePatterns(const std::vector<HighlightPattern> &patternSrc) {
 
 	/* Allocate memory for the compiled patterns.  The list is terminated
 	   by a record with style == 0. */
@@ -6288,7 +6968,6 @@ std::unique_ptr<HighlightData[]> DocumentWidget::compilePatterns(const std::vect
 	// Build the tree of parse expressions
 	for (size_t i = 0; i < patternSrc.size(); i++) {
 		compiledPats[i].nSubPatterns = 0;
-		compiledPats[i].nSubBranches = 0;
 	}
 
 	for (size_t i = 1; i < patternSrc.size(); i++) {
@@ -6409,79 +7088,41 @@ std::unique_ptr<HighlightData[]> DocumentWidget::compilePatterns(const std::vect
 		}
 	}
 
-	/* Construct and compile the great hairy pattern to match the OR of the
-	   end pattern, the error pattern, and all of the start patterns of the
-	   sub-patterns */
+	/* Gather the end pattern, the error pattern, and all of the start
+	   patterns of the sub-patterns into a set which finds the first of them
+	   to match. The order matters, parseString tells them apart by their
+	   index in the set */
 	for (size_t patternNum = 0; patternNum < patternSrc.size(); patternNum++) {
-		if (patternSrc[patternNum].endRE.isNull() && patternSrc[patternNum].errorRE.isNull() && compiledPats[patternNum].nSubPatterns == 0) {
-			compiledPats[patternNum].subPatternRE = nullptr;
-			continue;
-		}
-
-		int length;
-		length = (compiledPats[patternNum].colorOnly || patternSrc[patternNum].endRE.isNull()) ? 0 : patternSrc[patternNum].endRE.size() + 5;
-		length += (compiledPats[patternNum].colorOnly || patternSrc[patternNum].errorRE.isNull()) ? 0 : patternSrc[patternNum].errorRE.size() + 5;
+		HighlightData &pattern = compiledPats[patternNum];
 
-		for (size_t i = 0; i < compiledPats[patternNum].nSubPatterns; i++) {
-			const size_t subPatIndex = compiledPats[patternNum].subPatterns[i] - &compiledPats[0];
-			length += compiledPats[subPatIndex].colorOnly ? 0 : patternSrc[subPatIndex].startRE.size() + 5;
-		}
-
-		if (length == 0) {
-			compiledPats[patternNum].subPatternRE = nullptr;
+		if (pattern.colorOnly) {
+			pattern.subPatternRE = nullptr;
 			continue;
 		}
 
-		std::string bigPattern;
-		bigPattern.reserve(static_cast<size_t>(length));
+		std::vector<Regex> regexes;
 
-		if (!patternSrc[patternNum].endRE.isNull()) {
-			bigPattern += '(';
-			bigPattern += '?';
-			bigPattern += ':';
-			bigPattern += patternSrc[patternNum].endRE.toStdString();
-			bigPattern += ')';
-			bigPattern += '|';
-			compiledPats[patternNum].nSubBranches++;
+		if (pattern.endRE) {
+			regexes.push_back(*pattern.endRE);
 		}
 
-		if (!patternSrc[patternNum].errorRE.isNull()) {
-			bigPattern += '(';
-			bigPattern += '?';
-			bigPattern += ':';
-			bigPattern += patternSrc[patternNum].errorRE.toStdString();
-			bigPattern += ')';
-			bigPattern += '|';
-			compiledPats[patternNum].nSubBranches++;
+		if (pattern.errorRE) {
+			regexes.push_back(*pattern.errorRE);
 		}
 
-		for (size_t i = 0; i < compiledPats[patternNum].nSubPatterns; i++) {
-			const size_t subPatIndex = compiledPats[patternNum].subPatterns[i] - &compiledPats[0];
-
-			if (compiledPats[subPatIndex].colorOnly) {
-				continue;
+		for (size_t i = 0; i < pattern.nSubPatterns; i++) {
+			const HighlightData *subPat = pattern.subPatterns[i];
+			if (!subPat->colorOnly) {
+				regexes.push_back(*subPat->startRE);
 			}
-
-			bigPattern += '(';
-			bigPattern += '?';
-			bigPattern += ':';
-			bigPattern += patternSrc[subPatIndex].startRE.toStdString();
-			bigPattern += ')';
-			bigPattern += '|';
-			compiledPats[patternNum].nSubBranches++;
 		}
 
-		bigPattern.pop_back(); // remove last '|' character
-
-		try {
-			compiledPats[patternNum].subPatternRE = std::make_unique<Regex>(bigPattern, REDFLT_STANDARD);
-		} catch (const RegexError &e) {
-			qWarning("NEdit: Error compiling syntax highlight patterns:\n%s", e.what());
-			if (verbosity == Verbosity::Verbose) {
-				throw;
-			}
-			return nullptr;
+		if (regexes.empty()) {
+			pattern.subPatternRE = nullptr;
+			continue;
 		}
+
+		pattern.subPatternRE = std::make_unique<RegexSet>(std::move(regexes));
 	}
 
 	// Copy remaining parameters from pattern template to compiled tree
@@ -6615,13 +7256,13 @@ void DocumentWidget::replay() {
 		QString errMsg;
 		int stoppedAt;
 
-		Program *prog = compileMacro(replayMacro, &errMsg, &stoppedAt);
+		auto prog = std::shared_ptr<Program>(compileMacro(replayMacro, &errMsg, &stoppedAt));
 		if (!prog) {
 			qWarning("NEdit: internal error, learn/replay macro syntax error: %s", qPrintable(errMsg));
 			return;
 		}
 
-		runMacro(prog);
+		runMacro(prog, tr("(replay)"));
 	}
 }
 
@@ -6681,21 +7322,53 @@ void DocumentWidget::finishLearning() {
 */
 void DocumentWidget::doMacro(const QString &macro, const QString &errInName) {
 
+	if (std::shared_ptr<Program> prog = compileMacroString(macro, errInName)) {
+		runMacro(prog, errInName);
+	}
+}
+
+/*
+** Executes the macro of a macro or background menu item, which is compiled
+** the first time it is run and kept with the item until the menu changes.
+*/
+void DocumentWidget::doMacro(MenuData *menuItem, const QString &errInName) {
+
+	if (!menuItem->program) {
+		menuItem->program = compileMacroString(menuItem->item.cmd, errInName);
+	}
+
+	// the menu may change while it runs
+	if (std::shared_ptr<Program> prog = menuItem->program) {
+		runMacro(prog, menuItem->item.name);
+	}
+}
+
+/*
+** Compiles macro string "macro", or reuses the program compiled from the same
+** string recently.  Reports errors via a dialog, integrating the name
+** "errInName" into the message, and returns nullptr in that case.
+*/
+std::shared_ptr<Program> DocumentWidget::compileMacroString(const QString &macro, const QString &errInName) {
+
 	/* Add a terminating newline (which command line users are likely to omit
 	   since they are typically invoking a single routine) */
 	QString qMacro = macro + QLatin1Char('\n');
-	QString errMsg;
+
+	if (std::shared_ptr<Program> prog = lookupCompiledMacro(qMacro)) {
+		return prog;
+	}
 
 	// Parse the macro and report errors if it fails
+	QString errMsg;
 	int stoppedAt;
-	Program *const prog = compileMacro(qMacro, &errMsg, &stoppedAt);
+	auto prog = std::shared_ptr<Program>(compileMacro(qMacro, &errMsg, &stoppedAt));
 	if (!prog) {
 		Preferences::reportError(this, qMacro, stoppedAt, errInName, errMsg);
-		return;
+		return nullptr;
 	}
 
-	// run the executable program (prog is freed upon completion)
-	runMacro(prog);
+	storeCompiledMacro(qMacro, prog);
+	return prog;
 }
 
 /*
@@ -7064,7 +7737,19 @@ int DocumentWidget::findAllMatches(TextArea *area, const QString &string) {
 
 	Tags::tagName = string;
 
-	QList<Tags::Tag> tags = Tags::lookupTag(string, Tags::searchMode);
+	const Tags::SearchMode mode = Tags::searchMode;
+	QPointer<TextArea> areaPtr  = area;
+
+	QList<Tags::Tag> tags = Tags::lookupTag(string, mode);
+
+	// waiting for the tags files to load processes events, the document may
+	// have been closed, and other lookups may have changed the tags state
+	if (!areaPtr) {
+		return -1;
+	}
+
+	Tags::tagName    = string;
+	Tags::searchMode = mode;
 
 	// First look up all of the matching tags
 	for (const Tags::Tag &tag : tags) {
@@ -7181,7 +7866,7 @@ int DocumentWidget::findAllMatches(TextArea *area, const QString &string) {
 	**  Go directly to the tag
 	*/
 	if (Tags::searchMode == Tags::SearchMode::TAG) {
-		editTaggedLocation(area, 0);
+		editTaggedLocation(0);
 	} else {
 		Tags::showMatchingCalltip(this, area, 0);
 	}
@@ -7240,7 +7925,7 @@ int DocumentWidget::showTipString(const QString &text, bool anchored, int pos, b
 
 /*  Open a new (or existing) editor window to the location specified in
 	tagFiles[i], tagSearch[i], tagPosInf[i] */
-void DocumentWidget::editTaggedLocation(TextArea *area, int i) {
+void DocumentWidget::editTaggedLocation(int i) {
 
 	const PathInfo fi = parseFilename(Tags::tagFiles[i]);
 
@@ -7265,39 +7950,61 @@ void DocumentWidget::editTaggedLocation(TextArea *area, int i) {
 		return;
 	}
 
+	TextBuffer *tagBuffer       = documentToSearch->buffer();
 	const int64_t tagLineNumber = Tags::tagPosInf[i];
 
+	TextCursor startPos;
+	TextCursor endPos;
+	TextCursor cursorPos;
+
 	if (Tags::tagSearch[i].isEmpty()) {
 		// if the search string is empty, select the numbered line
-		selectNumberedLine(area, tagLineNumber);
-		return;
-	}
+		const int64_t linesBefore = std::max<int64_t>(tagLineNumber, 1) - 1;
 
-	int64_t startPos = tagLineNumber;
-	int64_t endPos;
+		startPos = tagBuffer->BufCountForwardNLines(tagBuffer->BufStartOfBuffer(), linesBefore);
+		if (startPos == tagBuffer->BufEndOfBuffer() && tagBuffer->BufCountLines(tagBuffer->BufStartOfBuffer(), startPos) < linesBefore) {
+			/* Line was not found -> position the selection & cursor at the end
+			   without making a real selection and beep */
+			endPos = startPos;
+			QApplication::beep();
+		} else {
+			// select the line including its terminator, if it has one
+			endPos = tagBuffer->BufEndOfLine(startPos);
+			if (endPos != tagBuffer->BufEndOfBuffer()) {
+				++endPos;
+			}
+		}
 
-	// search for the tags file search string in the newly opened file
-	if (!Tags::fakeRegExSearch(documentToSearch->buffer()->BufAsString(), Tags::tagSearch[i], &startPos, &endPos)) {
-		QMessageBox::warning(
-			this,
-			tr("Tag Error"),
-			tr("Definition for %1\nnot found in %2").arg(Tags::tagName, Tags::tagFiles[i]));
-		return;
+		cursorPos = startPos;
+	} else {
+		// search for the tags file search string in the newly opened file
+		int64_t matchStart = tagLineNumber;
+		int64_t matchEnd;
+		if (!Tags::fakeRegExSearch(tagBuffer, Tags::tagSearch[i], &matchStart, &matchEnd)) {
+			QMessageBox::warning(
+				this,
+				tr("Tag Error"),
+				tr("Definition for %1\nnot found in %2").arg(Tags::tagName, Tags::tagFiles[i]));
+			return;
+		}
+
+		startPos  = TextCursor(matchStart);
+		endPos    = TextCursor(matchEnd);
+		cursorPos = endPos;
 	}
 
+	// Position it nicely in the window, about 1/4 of the way down from the top
+	const int64_t lineNum = tagBuffer->BufCountLines(tagBuffer->BufStartOfBuffer(), startPos);
+
 	// select the matched string
-	documentToSearch->buffer()->BufSelect(TextCursor(startPos), TextCursor(endPos));
+	tagBuffer->BufSelect(startPos, endPos);
 	documentToSearch->raiseFocusDocumentWindow(true);
 
-	/* Position it nicely in the window,
-	   about 1/4 of the way down from the top */
-	const int64_t lineNum = documentToSearch->buffer()->BufCountLines(TextCursor(0), TextCursor(startPos));
-
 	QPointer<TextArea> tagArea = MainWindow::fromDocument(documentToSearch)->lastFocus();
 	int rows                   = tagArea->getRows();
 	tagArea->verticalScrollBar()->setValue(lineNum - (rows / 4));
 	tagArea->horizontalScrollBar()->setValue(0);
-	tagArea->TextSetCursorPos(TextCursor(endPos));
+	tagArea->TextSetCursorPos(cursorPos);
 }
 
 /**
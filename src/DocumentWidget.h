@@ -3,6 +3,7 @@
 #define DOCUMENT_WIDGET_H_
 
 #include "Bookmark.h"
+#include "BracketIndex.h"
 #include "CallTip.h"
 #include "CloseMode.h"
 #include "CommandSource.h"
@@ -31,6 +32,8 @@
 
 #include <gsl/span>
 
+#include <chrono>
+
 #include <boost/optional.hpp>
 
 #include <sys/stat.h>
@@ -43,9 +46,11 @@ class Style;
 class StyleTableEntry;
 class TextArea;
 class UndoInfo;
+struct CompiledPatternSet;
 struct DragEndEvent;
 struct HighlightData;
 struct MacroCommandData;
+struct MenuData;
 struct Program;
 struct ShellCommandData;
 struct SmartIndentData;
@@ -155,7 +160,7 @@ public:
 	int64_t styleLengthOfCodeFromPos(TextCursor pos) const;
 	size_t getLanguageMode() const;
 	size_t highlightCodeOfPos(TextCursor pos) const;
-	std::unique_ptr<WindowHighlightData> createHighlightData(PatternSet *patternSet, Verbosity verbosity = Verbosity::Silent);
+	std::unique_ptr<WindowHighlightData> createHighlightData(PatternSet *patternSet);
 	std::vector<TextArea *> textPanes() const;
 	void abortShellCommand();
 	void addMark(TextArea *area, QChar label);
@@ -165,10 +170,12 @@ public:
 	void clearModeMessage();
 	void closePane();
 	void doMacro(const QString &macro, const QString &errInName);
-	void editTaggedLocation(TextArea *area, int i);
+	void doMacro(MenuData *menuItem, const QString &errInName);
+	void editTaggedLocation(int i);
 	void endSmartIndent();
 	void execAP(TextArea *area, const QString &command);
 	void executeShellCommand(TextArea *area, const QString &command, CommandSource source);
+	void fileChangedOnDisk();
 	void findDefinition(TextArea *area, const QString &tagName);
 	void findDefinitionCalltip(TextArea *area, const QString &tipName);
 	void findDefinitionHelper(TextArea *area, const QString &arg, Tags::SearchMode search_type);
@@ -189,7 +196,8 @@ public:
 	void readMacroInitFile();
 	void repeatMacro(const QString &macro, int how);
 	void resumeMacroExecution();
-	void runMacro(Program *prog);
+	std::shared_ptr<Program> compileMacroString(const QString &macro, const QString &errInName);
+	void runMacro(const std::shared_ptr<Program> &prog, const QString &name);
 	void selectNumberedLine(TextArea *area, int64_t lineNum);
 	void setAutoIndent(IndentStyle indentStyle);
 	void setAutoScroll(int margin);
@@ -227,6 +235,7 @@ private:
 	MacroContinuationCode continueWorkProc();
 	PatternSet *findPatternsForWindow(Verbosity verbosity);
 	QString backupFileName() const;
+	QString journalFileName() const;
 	QString getWindowsMenuEntry() const;
 	Style getHighlightInfo(TextCursor pos);
 	StyleTableEntry *styleTableEntryOfCode(size_t hCode) const;
@@ -235,17 +244,20 @@ private:
 	bool compareDocumentToFile(const QString &fileName) const;
 	bool doOpen(const QString &name, const QString &path, int flags);
 	bool doSave();
+	bool fileContentsChanged(const QString &fileName) const;
 	bool fileWasModifiedExternally() const;
 	void includeFile(const QString &name);
 	bool macroWindowCloseActions();
 	bool saveDocument();
 	bool saveDocumentAs(const QString &newName, bool addWrap);
-	bool writeBackupFile();
+	bool recoverFromBackup(std::string *text);
+	bool recoverFromJournal(std::string *text);
 	bool writeBckVersion();
 	boost::optional<TextCursor> findMatchingChar(char toMatch, Style styleToMatch, TextCursor charPos, TextCursor startLimit, TextCursor endLimit);
 	int findAllMatches(TextArea *area, const QString &string);
 	size_t matchLanguageMode() const;
-	std::unique_ptr<HighlightData[]> compilePatterns(const std::vector<HighlightPattern> &patternSrc, Verbosity verbosity = Verbosity::Silent);
+	std::shared_ptr<CompiledPatternSet> compilePatternSet(const PatternSet *patternSet, const std::vector<HighlightPattern> &pass1PatternSrc, const std::vector<HighlightPattern> &pass2PatternSrc);
+	std::unique_ptr<HighlightData[]> compilePatterns(const std::vector<HighlightPattern> &patternSrc);
 	std::unique_ptr<Regex> compileRegexAndWarn(const QString &re);
 	void abortMacroCommand();
 	void actionClose(CloseMode mode);
@@ -271,8 +283,10 @@ private:
 	void filterSelection(const QString &command, CommandSource source);
 	void finishLearning();
 	void flashMatchingChar(TextArea *area);
+	void dropPrefetchedHighlighting();
 	void freeHighlightingData();
 	void issueCommand(MainWindow *window, TextArea *area, const QString &command, const QString &input, int flags, TextCursor replaceLeft, TextCursor replaceRight, CommandSource source);
+	void prefetchHighlighting();
 	void processFinished(int exitCode, QProcess::ExitStatus exitStatus);
 	void reapplyLanguageMode(size_t mode, bool forceDefaults);
 	void redo();
@@ -291,6 +305,8 @@ private:
 	void trimUndoList(size_t maxLength);
 	void undo();
 	void unloadLanguageModeTipsFile();
+	void updateJournal(TextCursor pos, int64_t nInserted, int64_t nDeleted);
+	bool writeBackupFile();
 	void updateMarkTable(TextCursor pos, int64_t nInserted, int64_t nDeleted);
 	void updateSelectionSensitiveMenu(QMenu *menu, const gsl::span<MenuData> &menuList, bool enabled);
 	void updateSelectionSensitiveMenus(bool enabled);
@@ -303,8 +319,6 @@ public:
 	std::shared_ptr<DocumentInfo> info_;
 
 public:
-	bool replaceFailed_  = false;               // flags replacements failures during multi-file replacements
-	bool multiFileBusy_  = false;               // suppresses multiple beeps/dialogs during multi-file replacements
 	size_t languageMode_ = PLAIN_LANGUAGE_MODE; // identifies language mode currently selected in the window
 
 public:
@@ -314,6 +328,16 @@ public:
 	std::shared_ptr<MacroCommandData> macroCmdData_;     // same for macro commands
 	std::unique_ptr<RangesetTable> rangesetTable_;       // current range sets
 	std::unique_ptr<WindowHighlightData> highlightData_; // info for syntax highlighting
+	std::unique_ptr<BracketIndex> bracketIndex_;         // where the brackets are, for matching them
+
+private:
+	struct PrefetchedHighlighting;
+	std::unique_ptr<PrefetchedHighlighting> prefetchedHighlighting_; // a deferred highlighting parse running in the background
+
+private:
+	std::chrono::high_resolution_clock::time_point lastFileCheck_; // when the file was last looked at for changes
+	bool fileWatched_        = false;                              // does the file monitor report changes to the file?
+	bool fileChangeReported_ = false;                              // has it reported one which wasn't looked at yet?
 
 private:
 	QSplitter *splitter_;
@@ -0,0 +1,567 @@
+
+#include "EditJournal.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtConcurrentRun>
+#include <QtDebug>
+#include <QtEndian>
+#include <qplatformdefs.h>
+
+#include <cstring>
+#include <memory>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#endif
+
+namespace {
+
+// bump the version whenever the layout changes
+constexpr char JournalMagic[8] = {'N', 'E', 'J', 'R', 'N', 'L', '0', '2'};
+
+constexpr int FlushDelay             = 2000; // ms
+constexpr int64_t MinCompactionSize  = 16 * 1024 * 1024;
+constexpr int64_t HeaderSize         = sizeof(JournalMagic) + 2 * sizeof(qint64);
+constexpr int64_t EditRecordOverhead = 1 + 3 * sizeof(qint64) + sizeof(quint32);
+constexpr int64_t SnapshotOverhead   = 1 + sizeof(qint64) + sizeof(quint32);
+constexpr qint64 NoBaseFile          = -1;
+
+enum RecordType : char {
+	EditRecord     = 'E',
+	SnapshotRecord = 'S'
+};
+
+/**
+ * @brief FNV-1a, which lets a record be checksummed in pieces
+ */
+class Checksum {
+public:
+	void update(const char *data, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash_ = (hash_ ^ static_cast<uint8_t>(data[i])) * 16777619u;
+		}
+	}
+
+	quint32 value() const {
+		return hash_;
+	}
+
+private:
+	quint32 hash_ = 2166136261u;
+};
+
+template <class T>
+void appendInteger(QByteArray &data, T value) {
+	const T le = qToLittleEndian(value);
+	data.append(reinterpret_cast<const char *>(&le), sizeof(le));
+}
+
+template <class T>
+bool readInteger(const QByteArray &data, int64_t &offset, T *value) {
+	if (offset + static_cast<int64_t>(sizeof(T)) > data.size()) {
+		return false;
+	}
+
+	T le;
+	std::memcpy(&le, data.constData() + offset, sizeof(T));
+	*value = qFromLittleEndian(le);
+	offset += sizeof(T);
+	return true;
+}
+
+/**
+ * @brief header
+ * @param baseSize
+ * @param baseModified
+ * @return
+ */
+QByteArray header(qint64 baseSize, qint64 baseModified) {
+	QByteArray data(JournalMagic, sizeof(JournalMagic));
+	appendInteger<qint64>(data, baseSize);
+	appendInteger<qint64>(data, baseModified);
+	return data;
+}
+
+/**
+ * @brief writeAll
+ * @param fd
+ * @param data
+ * @param size
+ * @return
+ */
+bool writeAll(int fd, const char *data, size_t size) {
+	while (size != 0) {
+		const auto n = QT_WRITE(fd, data, size);
+		if (n <= 0) {
+			return false;
+		}
+
+		data += n;
+		size -= static_cast<size_t>(n);
+	}
+
+	return true;
+}
+
+/**
+ * @brief syncFile
+ * @param fd
+ * @return
+ */
+bool syncFile(int fd) {
+#ifdef Q_OS_WIN
+	return ::_commit(fd) == 0;
+#else
+	return ::fsync(fd) == 0;
+#endif
+}
+
+/**
+ * @brief openForAppend
+ * @param filename
+ * @param truncate
+ * @return
+ */
+int openForAppend(const QString &filename, bool truncate) {
+
+	const int flags = QT_OPEN_CREAT | QT_OPEN_WRONLY | QT_OPEN_APPEND | (truncate ? QT_OPEN_TRUNC : 0);
+
+	// the journal holds the document text, so only the user may read it
+#ifdef Q_OS_WIN
+	return QT_OPEN(filename.toUtf8().data(), flags, _S_IREAD | _S_IWRITE);
+#else
+	return QT_OPEN(filename.toUtf8().data(), flags, S_IRUSR | S_IWUSR);
+#endif
+}
+
+}
+
+/**
+ * @brief EditJournal::EditJournal
+ * @param filename where the journal is written
+ */
+EditJournal::EditJournal(QString filename)
+	: filename_(std::move(filename)) {
+
+	flushTimer_.setSingleShot(true);
+	flushTimer_.setInterval(FlushDelay);
+	QObject::connect(&flushTimer_, &QTimer::timeout, [this]() {
+		flush();
+	});
+}
+
+/**
+ * @brief EditJournal::~EditJournal
+ *
+ * writes out what is still pending, but leaves the journal on disk. Use
+ * discard() once the changes it records have been saved or abandoned.
+ */
+EditJournal::~EditJournal() {
+	if (started_) {
+		flush();
+	}
+
+	close();
+}
+
+/**
+ * @brief EditJournal::start
+ * @param baseSize the size of the file the document was loaded from, which
+ * the document text must still be identical to
+ * @param baseModified the modification time of that file, in seconds as stat
+ * reports it
+ * @return false if the journal could not be created
+ *
+ * The size and modification time are the ones the file had when it was
+ * loaded, not when the journal is started, so that a file changed on disk in
+ * between can't be mistaken for the base of the journal
+ */
+bool EditJournal::start(qint64 baseSize, qint64 baseModified) {
+
+	discard();
+
+	fd_ = openForAppend(filename_, /*truncate=*/true);
+	if (fd_ == -1) {
+		return false;
+	}
+
+	pending_ = header(baseSize, baseModified);
+	size_    = pending_.size();
+	started_ = true;
+
+	flushTimer_.start();
+	return true;
+}
+
+/**
+ * @brief EditJournal::start
+ * @param snapshot the current document text, used as the base of the journal
+ * when the document doesn't match any file on disk
+ */
+void EditJournal::start(std::string snapshot) {
+	discard();
+
+	started_ = true;
+	compact(std::move(snapshot));
+}
+
+/**
+ * @brief EditJournal::append
+ * @param pos
+ * @param nDeleted
+ * @param inserted
+ *
+ * records that nDeleted characters at pos were replaced with inserted
+ */
+void EditJournal::append(int64_t pos, int64_t nDeleted, view::string_view inserted) {
+
+	if (!started_) {
+		return;
+	}
+
+	const int start = pending_.size();
+
+	pending_.append(EditRecord);
+	appendInteger<qint64>(pending_, pos);
+	appendInteger<qint64>(pending_, nDeleted);
+	appendInteger<qint64>(pending_, static_cast<qint64>(inserted.size()));
+	pending_.append(inserted.data(), static_cast<int>(inserted.size()));
+
+	Checksum checksum;
+	checksum.update(pending_.constData() + start, static_cast<size_t>(pending_.size() - start));
+	appendInteger<quint32>(pending_, checksum.value());
+
+	size_ += EditRecordOverhead + static_cast<int64_t>(inserted.size());
+
+	if (!flushTimer_.isActive()) {
+		flushTimer_.start();
+	}
+}
+
+/**
+ * @brief EditJournal::flush
+ *
+ * hands the pending records to a worker thread, which writes and syncs them
+ * as one batch. If the previous batch is still being written, this is retried
+ * a little later rather than waiting for it.
+ */
+void EditJournal::flush() {
+
+	flushTimer_.stop();
+
+	if (!started_ || pending_.isEmpty()) {
+		return;
+	}
+
+	if (!finishJob(/*wait=*/false)) {
+		flushTimer_.start();
+		return;
+	}
+
+	auto data = std::make_shared<QByteArray>(std::move(pending_));
+	pending_  = QByteArray();
+
+	const int fd = fd_;
+
+	job_ = QtConcurrent::run([this, fd, data]() {
+		if (fd == -1 || !writeAll(fd, data->constData(), static_cast<size_t>(data->size())) || !syncFile(fd)) {
+			failed_ = true;
+		}
+
+		return -1;
+	});
+}
+
+/**
+ * @brief EditJournal::needsCompaction
+ * @param textLength the current length of the document
+ * @return true once replaying the journal would be more work than reading a
+ * snapshot of the whole text
+ */
+bool EditJournal::needsCompaction(int64_t textLength) const {
+	return started_ && size_ > MinCompactionSize && size_ > 2 * textLength;
+}
+
+/**
+ * @brief EditJournal::compact
+ * @param snapshot the current document text
+ *
+ * replaces the journal with one holding just snapshot. The new journal is
+ * written next to the old one and renamed over it on a worker thread, edits
+ * appended in the meantime follow once it is in place.
+ */
+void EditJournal::compact(std::string snapshot) {
+
+	if (!started_) {
+		return;
+	}
+
+	flushTimer_.stop();
+	finishJob(/*wait=*/true);
+
+	// everything still pending is part of the snapshot
+	pending_ = QByteArray();
+	size_    = HeaderSize + SnapshotOverhead + static_cast<int64_t>(snapshot.size());
+
+	auto text = std::make_shared<std::string>(std::move(snapshot));
+
+	compacting_ = true;
+
+	// the new journal is opened here, but only the GUI thread switches to it
+	job_ = QtConcurrent::run([this, text]() {
+		QSaveFile file(filename_);
+		if (!file.open(QIODevice::WriteOnly)) {
+			failed_ = true;
+			return -1;
+		}
+
+		QByteArray record = header(NoBaseFile, NoBaseFile);
+		const int start   = record.size();
+
+		record.append(SnapshotRecord);
+		appendInteger<qint64>(record, static_cast<qint64>(text->size()));
+
+		Checksum checksum;
+		checksum.update(record.constData() + start, static_cast<size_t>(record.size() - start));
+		checksum.update(text->data(), text->size());
+
+		QByteArray trailer;
+		appendInteger<quint32>(trailer, checksum.value());
+
+		file.write(record);
+		file.write(text->data(), static_cast<qint64>(text->size()));
+		file.write(trailer);
+
+		// the journal holds the document text, so only the user may read it
+		file.setPermissions(QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+
+		if (!file.commit()) {
+			failed_ = true;
+			return -1;
+		}
+
+		const int fd = openForAppend(filename_, /*truncate=*/false);
+		if (fd == -1) {
+			failed_ = true;
+		}
+
+		return fd;
+	});
+}
+
+/**
+ * @brief EditJournal::finishJob
+ * @param wait whether to wait for a job which is still running
+ * @return false if the job is still running. Once a compaction is done, the
+ * journal it wrote is appended to from then on
+ */
+bool EditJournal::finishJob(bool wait) {
+
+	if (wait) {
+		job_.waitForFinished();
+	} else if (job_.isRunning()) {
+		return false;
+	}
+
+	if (compacting_) {
+		compacting_ = false;
+
+		const int fd = job_.result();
+		if (fd != -1) {
+			if (fd_ != -1) {
+				QT_CLOSE(fd_);
+			}
+
+			fd_ = fd;
+		}
+	}
+
+	return true;
+}
+
+/**
+ * @brief EditJournal::discard
+ *
+ * stops journaling and removes the journal file
+ */
+void EditJournal::discard() {
+
+	flushTimer_.stop();
+	pending_ = QByteArray();
+	close();
+
+	if (started_) {
+		QFile::remove(filename_);
+	}
+
+	size_    = 0;
+	started_ = false;
+	failed_  = false;
+}
+
+/**
+ * @brief EditJournal::close
+ *
+ * waits for the worker thread, then writes what was left pending because it
+ * was busy, so that no edit is lost on the way out
+ */
+void EditJournal::close() {
+	finishJob(/*wait=*/true);
+
+	if (started_ && !pending_.isEmpty()) {
+		if (fd_ == -1 || !writeAll(fd_, pending_.constData(), static_cast<size_t>(pending_.size())) || !syncFile(fd_)) {
+			failed_ = true;
+		}
+
+		pending_ = QByteArray();
+	}
+
+	if (fd_ != -1) {
+		QT_CLOSE(fd_);
+		fd_ = -1;
+	}
+}
+
+/**
+ * @brief EditJournal::isStarted
+ * @return
+ */
+bool EditJournal::isStarted() const {
+	return started_;
+}
+
+/**
+ * @brief EditJournal::hasFailed
+ * @return true if writing the journal failed, in which case it can't be
+ * relied on for recovery
+ */
+bool EditJournal::hasFailed() const {
+	return failed_;
+}
+
+/**
+ * @brief EditJournal::isEmpty
+ * @param filename the journal
+ * @return true if the journal holds no edits, which is the case if it was
+ * started but the first edit was never written
+ */
+bool EditJournal::isEmpty(const QString &filename) {
+	return QFileInfo(filename).size() <= HeaderSize;
+}
+
+/**
+ * @brief EditJournal::replay
+ * @param filename the journal
+ * @param baseFile the file text was loaded from
+ * @param text the contents of baseFile on entry, the recovered document on
+ * success
+ * @param error why the journal couldn't be replayed, on failure
+ * @return true if the journal applies to baseFile and was replayed. A record
+ * torn by the crash ends the replay, everything before it is recovered.
+ *
+ * The records are read one at a time, so that the journal doesn't have to
+ * fit in memory next to the text.
+ */
+bool EditJournal::replay(const QString &filename, const QString &baseFile, std::string *text, QString *error) {
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) {
+		*error = file.errorString();
+		return false;
+	}
+
+	const qint64 fileSize = file.size();
+
+	QByteArray head = file.read(HeaderSize);
+	if (head.size() < HeaderSize || std::memcmp(head.constData(), JournalMagic, sizeof(JournalMagic)) != 0) {
+		*error = QObject::tr("%1 is not an edit journal").arg(filename);
+		return false;
+	}
+
+	int64_t offset = sizeof(JournalMagic);
+	qint64 baseSize;
+	qint64 baseModified;
+	readInteger(head, offset, &baseSize);
+	readInteger(head, offset, &baseModified);
+
+	if (baseSize != NoBaseFile) {
+		QT_STATBUF statbuf;
+		if (QT_STAT(baseFile.toUtf8().data(), &statbuf) != 0 || statbuf.st_size != baseSize || statbuf.st_mtime != baseModified) {
+			*error = QObject::tr("%1 was modified after the changes were made").arg(baseFile);
+			return false;
+		}
+	}
+
+	std::string result = *text;
+	std::string bytes;
+
+	while (!file.atEnd()) {
+
+		// the fixed size part of the record, which is checksummed with the text
+		QByteArray record = file.read(1);
+		if (record.size() != 1) {
+			break;
+		}
+
+		const char type = record[0];
+		if (type == EditRecord) {
+			record.append(file.read(3 * sizeof(qint64)));
+		} else if (type == SnapshotRecord) {
+			record.append(file.read(sizeof(qint64)));
+		} else {
+			break;
+		}
+
+		int64_t field   = 1;
+		qint64 pos      = 0;
+		qint64 nDeleted = 0;
+		qint64 length;
+
+		if (type == EditRecord && (!readInteger(record, field, &pos) || !readInteger(record, field, &nDeleted))) {
+			break;
+		}
+
+		if (!readInteger(record, field, &length) || length < 0 || length > fileSize - file.pos()) {
+			break;
+		}
+
+		bytes.resize(static_cast<size_t>(length));
+		if (file.read(&bytes[0], length) != length) {
+			break;
+		}
+
+		Checksum checksum;
+		checksum.update(record.constData(), static_cast<size_t>(record.size()));
+		checksum.update(bytes.data(), bytes.size());
+
+		const QByteArray trailer = file.read(sizeof(quint32));
+
+		int64_t trailerOffset = 0;
+		quint32 expected;
+		if (!readInteger(trailer, trailerOffset, &expected) || checksum.value() != expected) {
+			break;
+		}
+
+		if (type == SnapshotRecord) {
+			result.swap(bytes);
+			continue;
+		}
+
+		if (pos < 0 || nDeleted < 0 || static_cast<uint64_t>(pos) + static_cast<uint64_t>(nDeleted) > result.size()) {
+			qWarning("NEdit: Invalid record in edit journal %s", qPrintable(filename));
+			break;
+		}
+
+		result.replace(static_cast<size_t>(pos), static_cast<size_t>(nDeleted), bytes);
+	}
+
+	if (file.error() != QFileDevice::NoError) {
+		*error = file.errorString();
+		return false;
+	}
+
+	*text = std::move(result);
+	return true;
+}
@@ -0,0 +1,66 @@
+
+#ifndef EDIT_JOURNAL_H_
+#define EDIT_JOURNAL_H_
+
+#include "Util/string_view.h"
+
+#include <QByteArray>
+#include <QFuture>
+#include <QString>
+#include <QTimer>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief An append-only log of the edits made to a document, used to recover
+ * unsaved changes after a crash.
+ *
+ * The journal starts either from the file on disk (identified by the size and
+ * modification time it had when it was loaded) or from a snapshot of the text
+ * stored in the journal itself. Every edit appends a small (position,
+ * deleted, inserted) record. Records are collected in memory and written and
+ * synced in batches on a worker thread. When the journal grows larger than
+ * the text it describes, it is compacted into a fresh snapshot, also in the
+ * background.
+ */
+class EditJournal {
+public:
+	explicit EditJournal(QString filename);
+	EditJournal(const EditJournal &) = delete;
+	EditJournal &operator=(const EditJournal &) = delete;
+	~EditJournal();
+
+public:
+	bool start(qint64 baseSize, qint64 baseModified);
+	void start(std::string snapshot);
+	void append(int64_t pos, int64_t nDeleted, view::string_view inserted);
+	void flush();
+	bool needsCompaction(int64_t textLength) const;
+	void compact(std::string snapshot);
+	void discard();
+	bool isStarted() const;
+	bool hasFailed() const;
+
+public:
+	static bool isEmpty(const QString &filename);
+	static bool replay(const QString &filename, const QString &baseFile, std::string *text, QString *error);
+
+private:
+	bool finishJob(bool wait);
+	void close();
+
+private:
+	QString filename_;
+	QByteArray pending_;
+	QFuture<int> job_; // a write or a compaction, which yields the descriptor of the new journal
+	QTimer flushTimer_;
+	int fd_          = -1;
+	int64_t size_    = 0;
+	bool started_    = false;
+	bool compacting_ = false;
+	std::atomic<bool> failed_{false};
+};
+
+#endif
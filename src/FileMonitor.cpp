@@ -0,0 +1,148 @@
+
+#include "FileMonitor.h"
+#include "DocumentWidget.h"
+
+#include <QCoreApplication>
+#include <QFileInfo>
+#include <QPointer>
+
+#include <vector>
+
+/**
+ * @brief FileMonitor::instance
+ * @return the monitor, or nullptr once the application is gone
+ */
+FileMonitor *FileMonitor::instance() {
+
+	// owned by the application, so that the watcher goes away before Qt does
+	static QPointer<FileMonitor> monitor;
+
+	if (!monitor && QCoreApplication::instance()) {
+		monitor = new FileMonitor(QCoreApplication::instance());
+	}
+
+	return monitor;
+}
+
+/**
+ * @brief FileMonitor::FileMonitor
+ * @param parent
+ */
+FileMonitor::FileMonitor(QObject *parent)
+	: QObject(parent) {
+
+	debounce_.setSingleShot(true);
+	debounce_.setInterval(DebounceDelay);
+
+	connect(&watcher_, &QFileSystemWatcher::fileChanged, this, &FileMonitor::fileChanged);
+	connect(&debounce_, &QTimer::timeout, this, &FileMonitor::deliverChanges);
+}
+
+/**
+ * @brief FileMonitor::watch
+ * @param document
+ * @param fullname
+ * @return true if changes to the file will be reported to the document, which
+ * may not be possible (for example when the system runs out of watches)
+ *
+ * Starts watching the file "fullname" on behalf of "document", and stops
+ * watching the one it had before
+ */
+bool FileMonitor::watch(DocumentWidget *document, const QString &fullname) {
+	if (FileMonitor *monitor = instance()) {
+		return monitor->addDocument(document, fullname);
+	}
+
+	return false;
+}
+
+/**
+ * @brief FileMonitor::unwatch
+ * @param document
+ */
+void FileMonitor::unwatch(DocumentWidget *document) {
+	if (FileMonitor *monitor = instance()) {
+		monitor->removeDocument(document);
+	}
+}
+
+/**
+ * @brief FileMonitor::addDocument
+ * @param document
+ * @param fullname
+ * @return
+ */
+bool FileMonitor::addDocument(DocumentWidget *document, const QString &fullname) {
+
+	removeDocument(document);
+	documents_.insert(document, fullname);
+
+	if (watcher_.files().contains(fullname)) {
+		return true;
+	}
+
+	return watcher_.addPath(fullname);
+}
+
+/**
+ * @brief FileMonitor::removeDocument
+ * @param document
+ */
+void FileMonitor::removeDocument(DocumentWidget *document) {
+
+	auto it = documents_.find(document);
+	if (it == documents_.end()) {
+		return;
+	}
+
+	const QString path = it.value();
+	documents_.erase(it);
+
+	// stop watching the file when no document has it open anymore
+	if (!documents_.key(path)) {
+		watcher_.removePath(path);
+		changed_.remove(path);
+	}
+}
+
+/**
+ * @brief FileMonitor::fileChanged
+ * @param path
+ */
+void FileMonitor::fileChanged(const QString &path) {
+	changed_.insert(path);
+	debounce_.start();
+}
+
+/**
+ * @brief FileMonitor::deliverChanges
+ */
+void FileMonitor::deliverChanges() {
+
+	const QSet<QString> changed = changed_;
+	changed_.clear();
+
+	/* a file which was replaced (rather than rewritten) or deleted is no
+	 * longer watched, pick it up again if it is back */
+	const QStringList watched = watcher_.files();
+	for (const QString &path : changed) {
+		if (!watched.contains(path) && QFileInfo::exists(path)) {
+			watcher_.addPath(path);
+		}
+	}
+
+	/* the documents may put up dialogs, while which documents come and go, so
+	 * find all of them first */
+	std::vector<QPointer<DocumentWidget>> documents;
+	for (auto it = documents_.cbegin(); it != documents_.cend(); ++it) {
+		if (changed.contains(it.value())) {
+			documents.emplace_back(it.key());
+		}
+	}
+
+	for (const QPointer<DocumentWidget> &document : documents) {
+		if (document) {
+			document->fileChangedOnDisk();
+		}
+	}
+}
@@ -0,0 +1,49 @@
+
+#ifndef FILE_MONITOR_H_
+#define FILE_MONITOR_H_
+
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+class DocumentWidget;
+
+/**
+ * @brief Watches the files of all documents for changes made by other
+ * programs, with a single QFileSystemWatcher. Changes are collected for a
+ * moment, since a program writing a file usually triggers several of them,
+ * and then each document of a changed file is told about it.
+ */
+class FileMonitor : public QObject {
+	Q_OBJECT
+public:
+	static bool watch(DocumentWidget *document, const QString &fullname);
+	static void unwatch(DocumentWidget *document);
+
+private:
+	static FileMonitor *instance();
+
+private:
+	explicit FileMonitor(QObject *parent = nullptr);
+	~FileMonitor() override = default;
+
+private:
+	bool addDocument(DocumentWidget *document, const QString &fullname);
+	void removeDocument(DocumentWidget *document);
+	void fileChanged(const QString &path);
+	void deliverChanges();
+
+private:
+	// how long to wait for more changes to a file before looking at it
+	static constexpr int DebounceDelay = 250; // ms
+
+	QFileSystemWatcher watcher_;
+	QTimer debounce_;
+	QHash<DocumentWidget *, QString> documents_;
+	QSet<QString> changed_;
+};
+
+#endif
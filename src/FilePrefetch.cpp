@@ -0,0 +1,231 @@
+
+#include "FilePrefetch.h"
+#include "Preferences.h"
+#include "Util/FileSystem.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QFuture>
+#include <QHash>
+#include <QtConcurrentRun>
+
+#include <algorithm>
+#include <deque>
+
+#ifdef Q_OS_WIN
+#define S_ISREG(m) (((m)&S_IFMT) == S_IFREG)
+#endif
+
+namespace FilePrefetch {
+namespace {
+
+/* files are read at most this far ahead of being opened (in total, counting
+   those read but not opened yet), so that opening a large tree doesn't read
+   all of it into memory before the first document is even shown */
+constexpr qint64 MaxPendingBytes = 256 * 1024 * 1024;
+
+struct Waiting {
+	QString fullname;
+	bool convert;
+};
+
+struct Reading {
+	QFuture<boost::optional<PrefetchedFile>> future;
+	qint64 size;
+};
+
+// only ever used from the GUI thread
+std::deque<Waiting> Queue;
+QHash<QString, Reading> Pending;
+qint64 PendingBytes = 0;
+
+/**
+ * @brief readFile
+ * @param fullname
+ * @param convert
+ * @return the contents of the file, or boost::none if it can't be read (doOpen
+ * will find out why and tell the user)
+ */
+boost::optional<PrefetchedFile> readFile(const QString &fullname, bool convert) {
+
+	PrefetchedFile file;
+
+	if (QT_STAT(fullname.toUtf8().data(), &file.statbuf) != 0) {
+		return boost::none;
+	}
+
+	if (!S_ISREG(file.statbuf.st_mode) || file.statbuf.st_size > (0x100000000ll)) {
+		return boost::none;
+	}
+
+	QFile f(fullname);
+	if (!f.open(QIODevice::ReadOnly)) {
+		return boost::none;
+	}
+
+	/* read rather than mapped, so that a file which is truncated while it is
+	 * read comes out short (and doOpen reads it again, since its size no
+	 * longer matches) instead of faulting */
+	if (f.size() != 0) {
+		file.text.resize(static_cast<size_t>(f.size()));
+
+		const qint64 n = f.read(&file.text[0], f.size());
+		if (n < 0) {
+			return boost::none;
+		}
+
+		file.text.resize(static_cast<size_t>(n));
+	}
+
+	file.signature = FileSignature::of(file.text);
+
+	if (convert) {
+		file.format    = FormatOfFile(file.text);
+		file.converted = true;
+		switch (file.format) {
+		case FileFormats::Dos:
+			ConvertFromDos(file.text);
+			break;
+		case FileFormats::Mac:
+			ConvertFromMac(file.text);
+			break;
+		case FileFormats::Unix:
+			break;
+		}
+	}
+
+	return file;
+}
+
+/**
+ * @brief fill
+ *
+ * Starts reading queued files, in order, as long as that keeps the files
+ * being read or waiting to be taken under MaxPendingBytes. The first one is
+ * always started, however large it is, it would be read anyway
+ */
+void fill() {
+
+	while (!Queue.empty()) {
+		const Waiting &next = Queue.front();
+		const qint64 size   = QFileInfo(next.fullname).size();
+
+		if (!Pending.isEmpty() && PendingBytes + size > MaxPendingBytes) {
+			break;
+		}
+
+		Pending.insert(next.fullname, Reading{QtConcurrent::run(readFile, next.fullname, next.convert), size});
+		PendingBytes += size;
+		Queue.pop_front();
+	}
+}
+
+/**
+ * @brief findQueued
+ * @param fullname
+ * @return where fullname is in the queue of files waiting to be read
+ */
+std::deque<Waiting>::iterator findQueued(const QString &fullname) {
+	return std::find_if(Queue.begin(), Queue.end(), [&fullname](const Waiting &waiting) {
+		return waiting.fullname == fullname;
+	});
+}
+
+/**
+ * @brief unqueue
+ * @param fullname
+ * @return true if fullname was waiting to be read, it no longer is
+ */
+bool unqueue(const QString &fullname) {
+
+	auto it = findQueued(fullname);
+	if (it == Queue.end()) {
+		return false;
+	}
+
+	Queue.erase(it);
+	return true;
+}
+
+/**
+ * @brief release
+ * @param fullname
+ * @return the read of fullname, which is no longer pending, if there was one
+ */
+boost::optional<QFuture<boost::optional<PrefetchedFile>>> release(const QString &fullname) {
+
+	auto it = Pending.find(fullname);
+	if (it == Pending.end()) {
+		return boost::none;
+	}
+
+	QFuture<boost::optional<PrefetchedFile>> future = it->future;
+	PendingBytes -= it->size;
+	Pending.erase(it);
+	return future;
+}
+
+}
+
+/**
+ * @brief prefetch
+ * @param fullnames
+ *
+ * Start reading the given files in the background, as far ahead of them
+ * being opened as MaxPendingBytes allows. Every file passed here should
+ * either be opened, or passed to discard afterwards
+ */
+void prefetch(const QStringList &fullnames) {
+
+	const bool convert = Preferences::GetPrefForceOSConversion();
+
+	for (const QString &fullname : fullnames) {
+		if (!Pending.contains(fullname) && findQueued(fullname) == Queue.end()) {
+			Queue.push_back(Waiting{fullname, convert});
+		}
+	}
+
+	fill();
+}
+
+/**
+ * @brief discard
+ * @param fullnames
+ *
+ * Forget about files which were prefetched but not opened after all
+ */
+void discard(const QStringList &fullnames) {
+	for (const QString &fullname : fullnames) {
+		if (!unqueue(fullname)) {
+			release(fullname);
+		}
+	}
+
+	fill();
+}
+
+/**
+ * @brief take
+ * @param fullname
+ * @return the contents of the file if it was prefetched. If it isn't read yet,
+ * this waits for it (a read which hasn't started yet is done right here). A
+ * file still waiting for its turn isn't read here, doOpen reads it itself
+ */
+boost::optional<PrefetchedFile> take(const QString &fullname) {
+
+	if (unqueue(fullname)) {
+		return boost::none;
+	}
+
+	boost::optional<QFuture<boost::optional<PrefetchedFile>>> future = release(fullname);
+	if (!future) {
+		return boost::none;
+	}
+
+	// make room for the next files before waiting for this one
+	fill();
+
+	return future->result();
+}
+
+}
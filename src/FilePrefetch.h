@@ -0,0 +1,39 @@
+
+#ifndef FILE_PREFETCH_H_
+#define FILE_PREFETCH_H_
+
+#include "FileSignature.h"
+#include "Util/FileFormats.h"
+
+#include <QStringList>
+#include <qplatformdefs.h>
+
+#include <string>
+
+#include <boost/optional.hpp>
+
+/*
+ * When many files are opened at once (from the command line or by nc-ng),
+ * they are read on the global thread pool ahead of time, in the order they
+ * were given, while the documents are created one after the other. doOpen
+ * then takes the contents of its file from here instead of reading it
+ * itself, as long as the file hasn't changed in the meantime. Reading stays
+ * only a limited number of bytes ahead of the files being opened.
+ */
+namespace FilePrefetch {
+
+struct PrefetchedFile {
+	std::string text;
+	QT_STATBUF statbuf      = {};
+	FileSignature signature = {}; // of the file as it is on disk
+	FileFormats format      = FileFormats::Unix;
+	bool converted          = false; // was it converted from its format?
+};
+
+void prefetch(const QStringList &fullnames);
+void discard(const QStringList &fullnames);
+boost::optional<PrefetchedFile> take(const QString &fullname);
+
+}
+
+#endif
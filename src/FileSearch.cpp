@@ -0,0 +1,373 @@
+
+#include "FileSearch.h"
+#include "Preferences.h"
+#include "Regex.h"
+#include "Search.h"
+#include "Util/FileFormats.h"
+#include "Util/FileSystem.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QtConcurrentMap>
+#include <QtConcurrentRun>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace {
+
+// a file with a NUL in its first block is taken to be binary and skipped
+constexpr int64_t BinaryProbeSize = 8192;
+
+// files are read this much at a time, QFile::readAll can't hold 2GB or more
+constexpr qint64 ReadBlockSize = 256 * 1024;
+
+// keep runaway searches (such as ".*" across a source tree) manageable
+constexpr int MaxHitsPerFile = 1000;
+constexpr int MaxHits        = 50000;
+
+// lines longer than this are shown truncated in the results
+constexpr int MaxLineText = 256;
+
+/**
+ * @brief collectFiles
+ * @param options
+ * @param canceled
+ * @return the files below options.directory which should be searched. Hidden
+ * files and directories, symbolic links to directories, and anything matching
+ * one of the exclude patterns are skipped
+ */
+QStringList collectFiles(const FileSearch::Options &options, const std::atomic<bool> &canceled) {
+
+	QStringList files;
+	QStringList directories = {options.directory};
+
+	while (!directories.isEmpty() && !canceled) {
+		const QDir dir(directories.takeLast());
+
+		const QFileInfoList entries = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+		for (const QFileInfo &entry : entries) {
+
+			const QString name = entry.fileName();
+			if (!options.excludePatterns.isEmpty() && QDir::match(options.excludePatterns, name)) {
+				continue;
+			}
+
+			if (entry.isDir()) {
+				if (!entry.isSymLink()) {
+					directories.push_back(entry.filePath());
+				}
+			} else if (options.filePatterns.isEmpty() || QDir::match(options.filePatterns, name)) {
+				files.push_back(entry.filePath());
+			}
+		}
+	}
+
+	return files;
+}
+
+/**
+ * @brief lineText
+ * @param text
+ * @param lineStart
+ * @return the line of text starting at lineStart, without its line terminator
+ */
+QString lineText(view::string_view text, size_t lineStart) {
+
+	size_t lineEnd = text.find('\n', lineStart);
+	if (lineEnd == view::string_view::npos) {
+		lineEnd = text.size();
+	}
+
+	if (lineEnd > lineStart && text[lineEnd - 1] == '\r') {
+		--lineEnd;
+	}
+
+	const size_t length = std::min<size_t>(lineEnd - lineStart, MaxLineText);
+	return QString::fromLocal8Bit(&text[lineStart], static_cast<int>(length));
+}
+
+/**
+ * @brief readText
+ * @param file
+ * @param convert true if DOS and Macintosh files are converted to Unix line
+ * ends, as the document loader does
+ * @return the contents of file, or nothing if it looks like a binary file
+ *
+ * The file is read a block at a time straight into the result, converting
+ * each block in place as it comes in
+ */
+boost::optional<std::string> readText(QFile &file, bool convert) {
+
+	const qint64 size = file.size();
+
+	std::string text(static_cast<size_t>(size), '\0');
+	FileFormats format = FileFormats::Unix;
+	char pendingCR     = '\0';
+	size_t length      = 0;
+	qint64 filePos     = 0;
+
+	while (filePos < size) {
+
+		// a '\r' left over from the previous block goes in front of this one
+		size_t offset = length;
+		if (pendingCR) {
+			text[offset++] = pendingCR;
+		}
+
+		const qint64 nRead = file.read(&text[offset], std::min(ReadBlockSize, size - filePos));
+		if (nRead <= 0) {
+			// the file shrank while we read it
+			break;
+		}
+
+		if (filePos == 0) {
+			if (std::memchr(&text[offset], '\0', static_cast<size_t>(std::min<qint64>(nRead, BinaryProbeSize)))) {
+				return boost::none;
+			}
+
+			if (convert) {
+				format = FormatOfFile(view::string_view(&text[offset], static_cast<size_t>(nRead)));
+			}
+		}
+
+		filePos += nRead;
+
+		int64_t blockLength = static_cast<int64_t>(offset - length) + nRead;
+		switch (format) {
+		case FileFormats::Mac:
+			ConvertFromMac(&text[length], blockLength);
+			break;
+		case FileFormats::Dos:
+			ConvertFromDos(&text[length], &blockLength, &pendingCR);
+			break;
+		case FileFormats::Unix:
+			break;
+		}
+
+		length += static_cast<size_t>(blockLength);
+	}
+
+	if (pendingCR) {
+		text[length++] = pendingCR;
+	}
+
+	text.resize(length);
+	return text;
+}
+
+}
+
+/**
+ * @brief What a search looks for, prepared once and shared by all the files
+ * searched
+ */
+struct FileSearch::Matcher {
+	const Options &options;
+	boost::optional<Regex> regex; // compiled for the regex search types
+	QByteArray delimiters;
+	bool convert;
+
+	bool find(Regex *re, view::string_view text, int64_t beginPos, Search::Result *result) const;
+};
+
+/**
+ * @brief FileSearch::Matcher::find
+ * @param re this file's copy of regex, if any
+ * @param text
+ * @param beginPos
+ * @param result
+ * @return true if there is a match at or after beginPos
+ */
+bool FileSearch::Matcher::find(Regex *re, view::string_view text, int64_t beginPos, Search::Result *result) const {
+
+	const char *delims = options.delimiters.isNull() ? nullptr : delimiters.data();
+
+	if (!re) {
+		return Search::SearchString(text, options.searchString, Direction::Forward, options.searchType, WrapMode::NoWrap, beginPos, result, options.delimiters);
+	}
+
+	try {
+		if (!re->execute(text, static_cast<size_t>(beginPos), delims, false)) {
+			return false;
+		}
+	} catch (const RegexError &) {
+		return false;
+	}
+
+	result->start    = re->startp[0] - text.data();
+	result->end      = re->endp[0] - text.data();
+	result->extentFW = re->extentpFW - text.data();
+	result->extentBW = re->extentpBW - text.data();
+	return true;
+}
+
+/**
+ * @brief FileSearch::FileSearch
+ * @param parent
+ */
+FileSearch::FileSearch(QObject *parent)
+	: QObject(parent) {
+
+	qRegisterMetaType<FileSearchHit>();
+	qRegisterMetaType<QVector<FileSearchHit>>();
+}
+
+/**
+ * @brief FileSearch::~FileSearch
+ */
+FileSearch::~FileSearch() {
+	cancel();
+	job_.waitForFinished();
+}
+
+/**
+ * @brief FileSearch::start
+ * @param options
+ *
+ * starts a new search, abandoning the one which may still be running
+ */
+void FileSearch::start(const Options &options) {
+
+	cancel();
+	job_.waitForFinished();
+
+	canceled_ = false;
+	hitCount_ = 0;
+
+	const bool convert = Preferences::GetPrefForceOSConversion();
+
+	job_ = QtConcurrent::run([this, options, convert]() {
+		run(options, convert);
+	});
+}
+
+/**
+ * @brief FileSearch::cancel
+ */
+void FileSearch::cancel() {
+	canceled_ = true;
+}
+
+/**
+ * @brief FileSearch::isRunning
+ * @return
+ */
+bool FileSearch::isRunning() const {
+	return job_.isRunning();
+}
+
+/**
+ * @brief FileSearch::run
+ * @param options
+ * @param convert true if DOS and Macintosh files are converted when read
+ *
+ * Runs on a worker thread
+ */
+void FileSearch::run(const Options &options, bool convert) {
+
+	Matcher matcher{options, boost::none, options.delimiters.toLatin1(), convert};
+
+	if (Search::isRegexType(options.searchType)) {
+		try {
+			matcher.regex = Regex(options.searchString.toStdString(), Search::defaultRegexFlags(options.searchType));
+		} catch (const RegexError &) {
+			// the dialog checks the expression before it starts a search
+			Q_EMIT filesFound(0);
+			Q_EMIT finished(canceled_);
+			return;
+		}
+	}
+
+	QStringList files = collectFiles(options, canceled_);
+	Q_EMIT filesFound(files.size());
+
+	// each pool thread picks the next file as soon as it is done with one,
+	// so a few large files don't hold up the rest
+	QtConcurrent::blockingMap(files, [this, &matcher](const QString &path) {
+		searchFile(matcher, path);
+	});
+
+	Q_EMIT finished(canceled_);
+}
+
+/**
+ * @brief FileSearch::searchFile
+ * @param matcher
+ * @param path
+ *
+ * Runs on a pool thread
+ */
+void FileSearch::searchFile(const Matcher &matcher, const QString &path) {
+
+	if (canceled_) {
+		return;
+	}
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+		return;
+	}
+
+	// read rather than mapped, the files searched may well be rewritten while we look at them
+	const boost::optional<std::string> contents = readText(file, matcher.convert);
+	if (!contents) {
+		return;
+	}
+
+	const view::string_view text = *contents;
+
+	// the expression is compiled once per search, but execute() keeps the
+	// match in the Regex, so every file works on its own copy
+	boost::optional<Regex> regex = matcher.regex;
+
+	QVector<FileSearchHit> hits;
+
+	int64_t line      = 1;
+	int64_t lineStart = 0;
+	int64_t counted   = 0;
+	int64_t beginPos  = 0;
+	const auto length = static_cast<int64_t>(text.size());
+
+	Search::Result result;
+	while (beginPos <= length && hits.size() < MaxHitsPerFile && !canceled_) {
+
+		if (!matcher.find(regex.get_ptr(), text, beginPos, &result)) {
+			break;
+		}
+
+		// advance the line count up to the match
+		const char *first = text.data() + counted;
+		const char *last  = text.data() + result.start;
+		while (auto newline = static_cast<const char *>(std::memchr(first, '\n', static_cast<size_t>(last - first)))) {
+			++line;
+			lineStart = (newline - text.data()) + 1;
+			first     = newline + 1;
+		}
+		counted = result.start;
+
+		FileSearchHit hit;
+		hit.line   = line;
+		hit.column = result.start - lineStart;
+		hit.length = result.end - result.start;
+		hit.text   = lineText(text, static_cast<size_t>(lineStart));
+		hits.push_back(hit);
+
+		// start next after match unless match was empty, then endPos+1
+		beginPos = (result.start == result.end) ? result.end + 1 : result.end;
+	}
+
+	if (hits.isEmpty()) {
+		return;
+	}
+
+	if ((hitCount_ += hits.size()) >= MaxHits) {
+		canceled_ = true;
+	}
+
+	Q_EMIT hitsFound(path, hits);
+}
@@ -0,0 +1,79 @@
+
+#ifndef FILE_SEARCH_H_
+#define FILE_SEARCH_H_
+
+#include "SearchType.h"
+
+#include <QFuture>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <atomic>
+#include <cstdint>
+
+struct FileSearchHit {
+	int64_t line   = 0; // 1 based
+	int64_t column = 0; // offset of the match from the start of the line
+	int64_t length = 0;
+	QString text;       // the line containing the match
+};
+
+Q_DECLARE_METATYPE(FileSearchHit)
+
+/**
+ * @brief Searches every file below a directory, without opening them in a
+ * document. The matching rules are the same as Search::SearchString, so a
+ * search gives the same results as one done on the opened file.
+ *
+ * The directory tree is walked on a worker thread, then the files are read a
+ * block at a time and searched in parallel by the global thread pool. DOS and
+ * Macintosh line ends are converted the way they are when a file is opened,
+ * so the reported lines are the ones the document shows. The hits of each
+ * file are reported through hitsFound() as soon as it is done.
+ */
+class FileSearch : public QObject {
+	Q_OBJECT
+
+public:
+	struct Options {
+		QString directory;
+		QStringList filePatterns;    // file names to search, everything if empty
+		QStringList excludePatterns; // file and directory names to skip
+		QString searchString;
+		SearchType searchType;
+		QString delimiters;
+	};
+
+public:
+	explicit FileSearch(QObject *parent = nullptr);
+	FileSearch(const FileSearch &) = delete;
+	FileSearch &operator=(const FileSearch &) = delete;
+	~FileSearch() override;
+
+public:
+	void start(const Options &options);
+	void cancel();
+	bool isRunning() const;
+
+Q_SIGNALS:
+	void hitsFound(const QString &path, const QVector<FileSearchHit> &hits);
+	void filesFound(int count);
+	void finished(bool canceled);
+
+private:
+	struct Matcher;
+
+private:
+	void run(const Options &options, bool convert);
+	void searchFile(const Matcher &matcher, const QString &path);
+
+private:
+	QFuture<void> job_;
+	std::atomic<bool> canceled_{false};
+	std::atomic<int> hitCount_{0};
+};
+
+#endif
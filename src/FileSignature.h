@@ -0,0 +1,121 @@
+
+#ifndef FILE_SIGNATURE_H_
+#define FILE_SIGNATURE_H_
+
+#include "Util/string_view.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief Identifies the contents of a file as they were when it was last read
+ * or written, so that when its modification time changes, it can be told
+ * whether it really was changed without comparing it to the document
+ */
+struct FileSignature {
+	class Hasher;
+
+	int64_t size;
+	uint64_t hash;
+
+	static FileSignature of(view::string_view contents) noexcept;
+};
+
+/**
+ * @brief Works out the signature of contents which are read a piece at a
+ * time, so that a large file doesn't have to be held in memory whole. The
+ * pieces may be of any size, the result is the same as for the whole
+ */
+class FileSignature::Hasher {
+public:
+	void update(view::string_view piece) noexcept;
+	FileSignature result() const noexcept;
+
+private:
+	static constexpr uint64_t Multiplier = 0x9e3779b97f4a7c15ull;
+
+	void addWord(const char *p) noexcept {
+		uint64_t word;
+		std::memcpy(&word, p, sizeof(word));
+		hash_ = (hash_ ^ word) * Multiplier;
+		hash_ ^= hash_ >> 32;
+	}
+
+private:
+	uint64_t hash_     = 0xcbf29ce484222325ull;
+	int64_t size_      = 0;
+	size_t tailLength_ = 0;
+	char tail_[sizeof(uint64_t)]; // the bytes after the last whole word
+};
+
+inline bool operator==(const FileSignature &lhs, const FileSignature &rhs) {
+	return lhs.size == rhs.size && lhs.hash == rhs.hash;
+}
+
+inline bool operator!=(const FileSignature &lhs, const FileSignature &rhs) {
+	return !(lhs == rhs);
+}
+
+/**
+ * @brief FileSignature::Hasher::update
+ * @param piece the contents which follow the ones given so far. They are
+ * hashed a word at a time since this is done to whole files
+ */
+inline void FileSignature::Hasher::update(view::string_view piece) noexcept {
+
+	const char *p = piece.data();
+	size_t n      = piece.size();
+
+	size_ += static_cast<int64_t>(n);
+
+	// complete the word the last piece ended in
+	if (tailLength_ != 0) {
+		const size_t count = std::min(n, sizeof(tail_) - tailLength_);
+		std::memcpy(tail_ + tailLength_, p, count);
+		tailLength_ += count;
+		p += count;
+		n -= count;
+
+		if (tailLength_ < sizeof(tail_)) {
+			return;
+		}
+
+		addWord(tail_);
+		tailLength_ = 0;
+	}
+
+	for (; n >= sizeof(uint64_t); p += sizeof(uint64_t), n -= sizeof(uint64_t)) {
+		addWord(p);
+	}
+
+	std::memcpy(tail_, p, n);
+	tailLength_ = n;
+}
+
+/**
+ * @brief FileSignature::Hasher::result
+ * @return the signature of all of the pieces given so far
+ */
+inline FileSignature FileSignature::Hasher::result() const noexcept {
+
+	uint64_t hash = hash_;
+	for (size_t i = 0; i < tailLength_; ++i) {
+		hash = (hash ^ static_cast<uint8_t>(tail_[i])) * Multiplier;
+	}
+
+	return {size_, hash ^ (hash >> 29)};
+}
+
+/**
+ * @brief FileSignature::of
+ * @param contents
+ * @return the signature of "contents"
+ */
+inline FileSignature FileSignature::of(view::string_view contents) noexcept {
+	Hasher hasher;
+	hasher.update(contents);
+	return hasher.result();
+}
+
+#endif
@@ -1,5 +1,6 @@
 
 #include "Highlight.h"
+#include "CompiledPatternSet.h"
 #include "DocumentWidget.h"
 #include "HighlightData.h"
 #include "HighlightPattern.h"
@@ -12,6 +13,7 @@
 #include "StyleTableEntry.h"
 #include "TextBuffer.h"
 #include "Util/Input.h"
+#include "Util/Instrumentation.h"
 #include "Util/Resource.h"
 #include "Util/algorithm.h"
 #include "WindowHighlightData.h"
@@ -299,6 +301,8 @@ void modifyStyleBuf(const std::shared_ptr<TextBuffer> &styleBuf, char *styleStri
 */
 TextCursor parseBufferRange(const HighlightData *pass1Patterns, const std::unique_ptr<HighlightData[]> &pass2Patterns, TextBuffer *buf, const std::shared_ptr<TextBuffer> &styleBuf, const ReparseContext &contextRequirements, TextCursor beginParse, TextCursor endParse) {
 
+	INSTRUMENT_SCOPE("parseBufferRange");
+
 	TextCursor endSafety;
 	TextCursor endPass2Safety;
 	TextCursor startPass2Safety;
@@ -345,12 +349,12 @@ TextCursor parseBufferRange(const HighlightData *pass1Patterns, const std::uniqu
 		endSafety = std::min(buf->BufEndOfBuffer(), buf->BufEndOfLine(endParse) + 1);
 	}
 
-	// copy the buffer range into a string
-
-	std::string str      = buf->BufGetRange(beginSafety, endSafety);
-	std::string styleStr = styleBuf->BufGetRange(beginSafety, endSafety);
+	/* parse the text in place, only the styles are copied since they are
+	   modified while parsing. The text is left alone until we're done */
+	const view::string_view str = buf->BufGetRangeView(beginSafety, endSafety);
+	std::string styleStr        = styleBuf->BufGetRange(beginSafety, endSafety);
 
-	const char *const string   = &str[0];
+	const char *const string   = str.data();
 	char *const styleString    = &styleStr[0];
 	const char *const match_to = string + str.size();
 
@@ -499,9 +503,9 @@ int findSafeParseRestartPos(TextBuffer *buf, const std::unique_ptr<WindowHighlig
 	TextCursor checkBackTo;
 	TextCursor safeParseStart;
 
-	std::vector<uint8_t> &parentStyles                    = highlightData->parentStyles;
-	const std::unique_ptr<HighlightData[]> &pass1Patterns = highlightData->pass1Patterns;
-	const ReparseContext &context                         = highlightData->contextRequirements;
+	const std::vector<uint8_t> &parentStyles              = highlightData->compiledPatterns->parentStyles;
+	const std::unique_ptr<HighlightData[]> &pass1Patterns = highlightData->compiledPatterns->pass1Patterns;
+	const ReparseContext &context                         = highlightData->compiledPatterns->contextRequirements;
 
 	// We must begin at least one context distance back from the change
 	*pos = backwardOneContext(buf, context, *pos);
@@ -626,6 +630,8 @@ int findSafeParseRestartPos(TextBuffer *buf, const std::unique_ptr<WindowHighlig
 	}
 }
 
+}
+
 /*
 ** Re-parse the smallest region possible around a modification to buffer "buf"
 ** to gurantee that the promised context lines and characters have
@@ -634,11 +640,13 @@ int findSafeParseRestartPos(TextBuffer *buf, const std::unique_ptr<WindowHighlig
 */
 void incrementalReparse(const std::unique_ptr<WindowHighlightData> &highlightData, TextBuffer *buf, TextCursor pos, int64_t nInserted) {
 
+	INSTRUMENT_SCOPE("incrementalReparse");
+
 	const std::shared_ptr<TextBuffer> &styleBuf           = highlightData->styleBuffer;
-	const std::unique_ptr<HighlightData[]> &pass1Patterns = highlightData->pass1Patterns;
-	const std::unique_ptr<HighlightData[]> &pass2Patterns = highlightData->pass2Patterns;
-	const ReparseContext &context                         = highlightData->contextRequirements;
-	const std::vector<uint8_t> &parentStyles              = highlightData->parentStyles;
+	const std::unique_ptr<HighlightData[]> &pass1Patterns = highlightData->compiledPatterns->pass1Patterns;
+	const std::unique_ptr<HighlightData[]> &pass2Patterns = highlightData->compiledPatterns->pass2Patterns;
+	const ReparseContext &context                         = highlightData->compiledPatterns->contextRequirements;
+	const std::vector<uint8_t> &parentStyles              = highlightData->compiledPatterns->parentStyles;
 
 	/* Find the position "beginParse" at which to begin reparsing.  This is
 	   far enough back in the buffer such that the guranteed number of
@@ -701,6 +709,8 @@ void incrementalReparse(const std::unique_ptr<WindowHighlightData> &highlightDat
 	}
 }
 
+namespace {
+
 /**
  * @brief readHighlightPattern
  * @param in
@@ -1102,7 +1112,7 @@ void SyntaxHighlightModifyCB(TextCursor pos, int64_t nInserted, int64_t nDeleted
 	styleBuffer->BufSelect(pos, pos + nInserted);
 
 	// Re-parse around the changed region
-	if (highlightData->pass1Patterns) {
+	if (highlightData->compiledPatterns->pass1Patterns) {
 		incrementalReparse(highlightData, document->buffer(), pos, nInserted);
 	}
 }
@@ -1146,7 +1156,7 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 	const char *stringPtr = string_ptr;
 	char *stylePtr        = style_ptr;
 
-	const std::unique_ptr<Regex> &subPatternRE = pattern->subPatternRE;
+	const std::unique_ptr<RegexSet> &subPatternRE = pattern->subPatternRE;
 
 	const QByteArray delimitersString = ctx->delimiters.toLatin1();
 	const char *delimitersPtr         = ctx->delimiters.isNull() ? nullptr : delimitersString.data();
@@ -1154,7 +1164,6 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 	while (subPatternRE->ExecRE(
 		stringPtr,
 		string_ptr + length + 1,
-		false,
 		*ctx->prev_char,
 		next_char,
 		delimitersPtr,
@@ -1162,17 +1171,14 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 		match_to,
 		ctx->text.end())) {
 
-		/* Beware of the case where only one real branch exists, but that
-		   branch has sub-branches itself. In that case the top_branch refers
-		   to the matching sub-branch and must be ignored. */
-		size_t subIndex = (pattern->nSubBranches > 1) ? subPatternRE->top_branch : 0;
+		size_t subIndex = subPatternRE->top_branch;
 
 		// Combination of all sub-patterns and end pattern matched
 		const char *const startingStringPtr = stringPtr;
 
 		/* Fill in the pattern style for the text that was skipped over before
 		   the match, and advance the pointers to the start of the pattern */
-		fillStyleString(stringPtr, stylePtr, subPatternRE->startp[0], pattern->style, ctx);
+		fillStyleString(stringPtr, stylePtr, subPatternRE->startp, pattern->style, ctx);
 
 		/* If the combined pattern matched this pattern's end pattern, we're
 		   done.  Fill in the style string, update the pointers, color the
@@ -1182,7 +1188,7 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 
 		if (pattern->endRE) {
 			if (subIndex == 0) {
-				fillStyleString(stringPtr, stylePtr, subPatternRE->endp[0], pattern->style, ctx);
+				fillStyleString(stringPtr, stylePtr, subPatternRE->endp, pattern->style, ctx);
 				subExecuted = false;
 
 				for (size_t i = 0; i < pattern->nSubPatterns; i++) {
@@ -1222,7 +1228,7 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 		   done.  Fill in the style string, update the pointers, and return */
 		if (pattern->errorRE) {
 			if (subIndex == 0) {
-				fillStyleString(stringPtr, stylePtr, subPatternRE->startp[0], pattern->style, ctx);
+				fillStyleString(stringPtr, stylePtr, subPatternRE->startp, pattern->style, ctx);
 				string_ptr = stringPtr;
 				style_ptr  = stylePtr;
 				return false;
@@ -1235,7 +1241,7 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 
 		// the sub-pattern is a simple match, just color it
 		if (!subPat->subPatternRE) {
-			fillStyleString(stringPtr, stylePtr, subPatternRE->endp[0], /* subPat->startRE->endp[0],*/ subPat->style, ctx);
+			fillStyleString(stringPtr, stylePtr, subPatternRE->endp, /* subPat->startRE->endp[0],*/ subPat->style, ctx);
 
 			// Parse the remainder of the sub-pattern
 		} else if (subPat->endRE) {
@@ -1248,7 +1254,7 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 				fillStyleString(
 					stringPtr,
 					stylePtr,
-					subPatternRE->endp[0], // subPat->startRE->endp[0],
+					subPatternRE->endp, // subPat->startRE->endp[0],
 					subPat->style,
 					ctx);
 			}
@@ -1275,10 +1281,10 @@ bool parseString(const HighlightData *pattern, const char *&string_ptr, char *&s
 				subPat,
 				stringPtr,
 				stylePtr,
-				subPatternRE->endp[0] - stringPtr,
+				subPatternRE->endp - stringPtr,
 				ctx,
 				look_behind_to,
-				subPatternRE->endp[0]);
+				subPatternRE->endp);
 		}
 
 		/* If the sub-pattern has color-only sub-sub-patterns, add color
@@ -1449,6 +1455,8 @@ size_t findTopLevelParentIndex(const std::vector<HighlightPattern> &patterns, si
 */
 void LoadHighlightString(const QString &string) {
 
+	CompiledPatternSet::invalidateAll();
+
 	if (string == QLatin1String("*")) {
 
 		YAML::Node patternSets;
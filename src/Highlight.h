@@ -18,6 +18,7 @@ class PatternSet;
 struct HighlightData;
 struct HighlightStyle;
 struct ReparseContext;
+struct WindowHighlightData;
 
 class QColor;
 class QString;
@@ -68,6 +69,7 @@ size_t IndexOfNamedStyle(const QString &styleName);
 boost::optional<PatternSet> readDefaultPatternSet(const QString &langModeName);
 TextCursor backwardOneContext(TextBuffer *buf, const ReparseContext &context, TextCursor fromPos);
 TextCursor forwardOneContext(TextBuffer *buf, const ReparseContext &context, TextCursor fromPos);
+void incrementalReparse(const std::unique_ptr<WindowHighlightData> &highlightData, TextBuffer *buf, TextCursor pos, int64_t nInserted);
 void RenameHighlightPattern(const QString &oldName, const QString &newName);
 void SyntaxHighlightModifyCB(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user);
 
@@ -3,6 +3,7 @@
 #define HIGHLIGHT_DATA_H_X_
 
 #include "Regex.h"
+#include "RegexSet.h"
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -12,13 +13,12 @@ struct HighlightData {
 	std::unique_ptr<Regex> startRE;
 	std::unique_ptr<Regex> endRE;
 	std::unique_ptr<Regex> errorRE;
-	std::unique_ptr<Regex> subPatternRE;
+	std::unique_ptr<RegexSet> subPatternRE; // The end, error and sub-pattern start expressions
 	std::vector<size_t> startSubexprs;
 	std::vector<size_t> endSubexprs;
 	std::unique_ptr<HighlightData *[]> subPatterns;
 	size_t userStyleIndex;
 	size_t nSubPatterns;
-	size_t nSubBranches; // Number of top-level branches of subPatternRE
 	int flags;
 	bool colorOnly;
 	uint8_t style;
@@ -0,0 +1,385 @@
+
+#include "InputLatency.h"
+#include "DocumentWidget.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+
+namespace InputLatency {
+
+bool InProgress = false;
+
+namespace {
+
+/*
+ * A histogram of durations in microseconds, precise to within 1/16th of the
+ * value. Values below 16 get a bucket each, after that every power of two is
+ * split into 16 buckets, so that it stays small however long the worst case
+ * is.
+ */
+class Histogram {
+public:
+	static constexpr int SubBuckets = 16;
+	static constexpr int SubBits    = 4;
+
+public:
+	void add(int64_t value) {
+		value              = std::max<int64_t>(value, 0);
+		const size_t index = bucketOf(value);
+		if (index >= counts_.size()) {
+			counts_.resize(index + 1);
+		}
+
+		++counts_[index];
+		++count_;
+		max_ = std::max(max_, value);
+	}
+
+	uint64_t count() const {
+		return count_;
+	}
+
+	int64_t max() const {
+		return max_;
+	}
+
+	/**
+	 * @brief percentile
+	 * @param p between 0 and 1
+	 * @return the smallest value which at least "p" of the values are at or
+	 * below, rounded up to the end of its bucket
+	 */
+	int64_t percentile(double p) const {
+
+		if (count_ == 0) {
+			return 0;
+		}
+
+		const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p * static_cast<double>(count_))));
+
+		uint64_t seen = 0;
+		for (size_t i = 0; i < counts_.size(); ++i) {
+			seen += counts_[i];
+			if (seen >= rank) {
+				return std::min(lastValueOf(i), max_);
+			}
+		}
+
+		return max_;
+	}
+
+private:
+	static size_t bucketOf(int64_t value) {
+		if (value < SubBuckets) {
+			return static_cast<size_t>(value);
+		}
+
+		int exponent = 0;
+		while ((value >> (exponent + 1)) != 0) {
+			++exponent;
+		}
+
+		const int shift = exponent - SubBits;
+		const auto sub  = static_cast<size_t>((value >> shift) & (SubBuckets - 1));
+		return SubBuckets + static_cast<size_t>(shift) * SubBuckets + sub;
+	}
+
+	static int64_t lastValueOf(size_t index) {
+		if (index < SubBuckets) {
+			return static_cast<int64_t>(index);
+		}
+
+		const auto shift = static_cast<int>((index - SubBuckets) / SubBuckets);
+		const auto sub   = static_cast<int64_t>((index - SubBuckets) % SubBuckets);
+		return ((SubBuckets + sub + 1) << shift) - 1;
+	}
+
+private:
+	std::vector<uint64_t> counts_;
+	uint64_t count_ = 0;
+	int64_t max_    = 0;
+};
+
+struct DocumentStats {
+	std::array<Histogram, StageCount> stages;
+};
+
+// the key press which hasn't been painted yet
+struct Input {
+	const DocumentWidget *document = nullptr;
+	Clock::time_point start;
+	std::array<Clock::duration, StageCount> stages;
+	std::array<bool, StageCount> running;
+	bool changed = false;
+};
+
+// only ever used from the GUI thread
+bool Enabled = false;
+Input Current;
+std::map<const DocumentWidget *, DocumentStats> Documents;
+
+constexpr double Percentile50 = 0.50;
+constexpr double Percentile99 = 0.99;
+
+/**
+ * @brief microseconds
+ * @param d
+ * @return
+ */
+int64_t microseconds(Clock::duration d) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+/**
+ * @brief milliseconds
+ * @param us
+ * @return
+ */
+QString milliseconds(int64_t us) {
+	return QString::number(static_cast<double>(us) / 1000.0, 'f', 2);
+}
+
+}
+
+/**
+ * @brief setEnabled
+ * @param enabled
+ */
+void setEnabled(bool enabled) {
+	Enabled = enabled;
+	if (!enabled) {
+		InProgress = false;
+	}
+}
+
+/**
+ * @brief enabled
+ * @return
+ */
+bool enabled() {
+	return Enabled;
+}
+
+/**
+ * @brief reset
+ *
+ * Throws away all of the histograms
+ */
+void reset() {
+	Documents.clear();
+	InProgress = false;
+}
+
+/**
+ * @brief forget
+ * @param document
+ *
+ * To be called when "document" is closed
+ */
+void forget(const DocumentWidget *document) {
+	Documents.erase(document);
+	if (Current.document == document) {
+		InProgress = false;
+	}
+}
+
+/**
+ * @brief keyPressed
+ * @param document
+ *
+ * A key was pressed in "document". If an earlier key press in it hasn't been
+ * painted yet, the user is still waiting for that one, so it isn't restarted
+ */
+void keyPressed(const DocumentWidget *document) {
+
+	if (!Enabled || (InProgress && Current.document == document)) {
+		return;
+	}
+
+	Current.document = document;
+	Current.start    = Clock::now();
+	Current.stages.fill(Clock::duration::zero());
+	Current.running.fill(false);
+	Current.changed = false;
+	InProgress      = true;
+}
+
+/**
+ * @brief keyHandled
+ * @param changed whether the key press moved the cursor or scrolled
+ *
+ * A key press has been handled. If it changed nothing which will be painted
+ * there is nothing to wait for
+ */
+void keyHandled(bool changed) {
+
+	if (!InProgress) {
+		return;
+	}
+
+	Current.changed = Current.changed || changed;
+	if (!Current.changed) {
+		InProgress = false;
+	}
+}
+
+/**
+ * @brief painted
+ * @param document
+ *
+ * A text area of "document" has been painted, which ends the key press in
+ * progress if it was made in "document"
+ */
+void painted(const DocumentWidget *document) {
+
+	if (!InProgress || Current.document != document) {
+		return;
+	}
+
+	InProgress = false;
+
+	DocumentStats &stats = Documents[document];
+	for (size_t i = 0; i < static_cast<size_t>(Stage::Total); ++i) {
+		stats.stages[i].add(microseconds(Current.stages[i]));
+	}
+
+	stats.stages[static_cast<size_t>(Stage::Total)].add(microseconds(Clock::now() - Current.start));
+}
+
+/**
+ * @brief beginStage
+ * @param stage
+ * @return false if "stage" is already being timed further up the stack, in
+ * which case the inner call is part of that time
+ */
+bool beginStage(Stage stage) {
+
+	bool &running = Current.running[static_cast<size_t>(stage)];
+	if (running) {
+		return false;
+	}
+
+	running = true;
+	return true;
+}
+
+/**
+ * @brief endStage
+ * @param stage
+ * @param elapsed
+ */
+void endStage(Stage stage, Clock::duration elapsed) {
+
+	const auto index       = static_cast<size_t>(stage);
+	Current.running[index] = false;
+	Current.stages[index] += elapsed;
+
+	if (stage == Stage::Modify) {
+		Current.changed = true;
+	}
+}
+
+/**
+ * @brief stageName
+ * @param stage
+ * @return
+ */
+const char *stageName(Stage stage) {
+	switch (stage) {
+	case Stage::Insert:
+		return "insert";
+	case Stage::Modify:
+		return "modify_callbacks";
+	case Stage::SmartIndent:
+		return "smart_indent";
+	case Stage::Paint:
+		return "paint";
+	case Stage::Total:
+		return "total";
+	}
+
+	return "";
+}
+
+/**
+ * @brief summaries
+ * @return the percentiles of every stage of every document, in the order the
+ * stages are listed in
+ */
+std::vector<Summary> summaries() {
+
+	std::vector<Summary> result;
+
+	for (const std::pair<const DocumentWidget *const, DocumentStats> &entry : Documents) {
+
+		const QString name = entry.first->filename();
+
+		for (size_t i = 0; i < StageCount; ++i) {
+			const Histogram &histogram = entry.second.stages[i];
+			result.push_back(Summary{
+				name,
+				static_cast<Stage>(i),
+				histogram.count(),
+				histogram.percentile(Percentile50),
+				histogram.percentile(Percentile99),
+				histogram.max()});
+		}
+	}
+
+	return result;
+}
+
+/**
+ * @brief report
+ * @return a table of the percentiles of every stage of every document, as
+ * plain text
+ */
+QString report() {
+
+	QString text;
+	text += QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+				.arg(QStringLiteral("Document"), -30)
+				.arg(QStringLiteral("Stage"), -18)
+				.arg(QStringLiteral("Keys"), 8)
+				.arg(QStringLiteral("p50 ms"), 10)
+				.arg(QStringLiteral("p99 ms"), 10)
+				.arg(QStringLiteral("Max ms"), 10);
+
+	for (const Summary &summary : summaries()) {
+		text += QStringLiteral("%1 %2 %3 %4 %5 %6\n")
+					.arg(summary.document, -30)
+					.arg(QLatin1String(stageName(summary.stage)), -18)
+					.arg(summary.count, 8)
+					.arg(milliseconds(summary.p50), 10)
+					.arg(milliseconds(summary.p99), 10)
+					.arg(milliseconds(summary.max), 10);
+	}
+
+	return text;
+}
+
+/**
+ * @brief writeLog
+ * @param filename
+ * @return true if the report was written to "filename"
+ */
+bool writeLog(const QString &filename) {
+
+	QFile file(filename);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return false;
+	}
+
+	QTextStream ts(&file);
+	ts << report();
+	ts.flush();
+
+	return file.error() == QFile::NoError;
+}
+
+}
@@ -0,0 +1,104 @@
+
+#ifndef INPUT_LATENCY_H_
+#define INPUT_LATENCY_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <QString>
+
+class DocumentWidget;
+
+/*
+ * Tracking of the time from a key press to the moment its effect is painted.
+ *
+ * TextArea::keyPressEvent stamps the key press, and the first paint of the
+ * document after it ends it. In between, the time spent in the stages of
+ * handling it (inserting the text, the buffer modification callbacks which
+ * update the undo list, the highlighting and the rangesets, running the
+ * smart indent macros, and painting) is added up with StageTimers. The
+ * stages nest (the callbacks run as part of the insert), so they don't add
+ * up to the total, which also includes the time waiting in the event queue.
+ *
+ * Each document gets a histogram per stage, from which the report gives the
+ * median, the 99th percentile and the worst case. Key presses which neither
+ * change the text nor move the cursor or the view don't paint anything and
+ * are not counted.
+ *
+ * Nothing is measured unless it is enabled, and outside of a key press a
+ * StageTimer costs a single test.
+ */
+namespace InputLatency {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Stage {
+	Insert,
+	Modify,
+	SmartIndent,
+	Paint,
+	Total,
+};
+
+constexpr size_t StageCount = static_cast<size_t>(Stage::Total) + 1;
+
+struct Summary {
+	QString document;
+	Stage stage;
+	uint64_t count;
+	int64_t p50; // microseconds
+	int64_t p99; // microseconds
+	int64_t max; // microseconds
+};
+
+extern bool InProgress;
+
+inline bool inProgress() noexcept {
+	return InProgress;
+}
+
+void setEnabled(bool enabled);
+bool enabled();
+void reset();
+void forget(const DocumentWidget *document);
+
+void keyPressed(const DocumentWidget *document);
+void keyHandled(bool changed);
+void painted(const DocumentWidget *document);
+bool beginStage(Stage stage);
+void endStage(Stage stage, Clock::duration elapsed);
+
+const char *stageName(Stage stage);
+std::vector<Summary> summaries();
+QString report();
+bool writeLog(const QString &filename);
+
+class StageTimer {
+public:
+	explicit StageTimer(Stage stage) noexcept
+		: stage_(stage), timing_(inProgress() && beginStage(stage)) {
+		if (timing_) {
+			start_ = Clock::now();
+		}
+	}
+
+	~StageTimer() noexcept {
+		if (timing_) {
+			endStage(stage_, Clock::now() - start_);
+		}
+	}
+
+	StageTimer(const StageTimer &) = delete;
+	StageTimer &operator=(const StageTimer &) = delete;
+
+private:
+	Stage stage_;
+	bool timing_;
+	Clock::time_point start_;
+};
+
+}
+
+#endif
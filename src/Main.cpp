@@ -4,12 +4,14 @@
 #include "DialogAbout.h"
 #include "DocumentWidget.h"
 #include "EditFlags.h"
+#include "FilePrefetch.h"
 #include "MainWindow.h"
 #include "NeditServer.h"
 #include "Preferences.h"
 #include "Regex.h"
 #include "Settings.h"
 #include "Util/FileSystem.h"
+#include "Util/Instrumentation.h"
 #include "interpret.h"
 #include "macro.h"
 #include "nedit.h"
@@ -19,6 +21,9 @@
 #include <QFile>
 #include <QString>
 
+#include <algorithm>
+#include <vector>
+
 namespace {
 
 constexpr const char cmdLineHelp[] =
@@ -27,8 +32,45 @@ constexpr const char cmdLineHelp[] =
 	"                [-autoindent] [-noautoindent] [-autosave] [-noautosave]\n"
 	"                [-lm languagemode] [-rows n] [-columns n] [-font font]\n"
 	"                [-geometry geometry] [-iconic] [-noiconic] [-svrname name]\n"
-	"                [-import file] [-tabbed] [-untabbed] [-group] [-V|-version]\n"
-	"                [-h|-help] [--] [file...]\n";
+	"                [-import file] [-tabbed] [-untabbed] [-group]\n"
+#ifdef NEDIT_INSTRUMENTATION
+	"                [-trace file]\n"
+#endif
+	"                [-V|-version] [-h|-help] [--] [file...]\n";
+
+// what the options seen so far ask for the files which follow them
+struct OpenOptions {
+	int lineNum   = 0;
+	int editFlags = EditFlags::CREATE;
+	bool gotoLine = false;
+	bool iconic   = false;
+	int tabbed    = -1;
+	int group     = 0;
+	QString geometry;
+	QString langMode;
+	QString toDoCommand;
+};
+
+struct CommandLineOption {
+	QLatin1String name;
+	bool hasArgument;
+	void (*handle)(OpenOptions *options, const QString &argument); // argument is empty if the option has none
+};
+
+/**
+ * @brief findOption
+ * @param options
+ * @param arg
+ * @return the option "arg" names, or nullptr if it isn't one
+ */
+const CommandLineOption *findOption(const std::vector<CommandLineOption> &options, const QString &arg) {
+
+	auto it = std::find_if(options.begin(), options.end(), [&arg](const CommandLineOption &option) {
+		return arg == option.name;
+	});
+
+	return (it != options.end()) ? &*it : nullptr;
+}
 
 /**
  * @brief nextArg
@@ -49,12 +91,51 @@ int nextArg(const QStringList &args, int argIndex) {
 	return ++argIndex;
 }
 
+/**
+ * @brief filesToPrefetch
+ * @param args
+ * @param options the options Main understands
+ * @return the full names of the files named on the command line which aren't
+ * open yet, in the order they will be opened
+ */
+QStringList filesToPrefetch(const QStringList &args, const std::vector<CommandLineOption> &options) {
+
+	QStringList files;
+	bool opts = true;
+
+	for (int i = 1; i < args.size(); ++i) {
+
+		const QString &arg = args[i];
+
+		if (opts && arg == QLatin1String("--")) {
+			opts = false;
+		} else if (opts && (arg.startsWith(QLatin1Char('-')) || arg.startsWith(QLatin1Char('+')))) {
+			const CommandLineOption *option = findOption(options, arg);
+			if (option && option->hasArgument) {
+				++i;
+			}
+		} else {
+			const PathInfo fi = parseFilename(arg);
+			if (!MainWindow::findWindowWithFile(fi)) {
+				files.push_back(fi.pathname + fi.filename);
+			}
+		}
+	}
+
+	return files;
+}
+
 }
 
 /**
  * @brief Main::~Main
  */
 Main::~Main() {
+	// the trace may have been stopped from the menu in the meantime
+	if (!traceFile_.isEmpty() && Instrumentation::isTracing()) {
+		Instrumentation::stopTrace(traceFile_);
+	}
+
 	CleanupMacroGlobals();
 }
 
@@ -64,18 +145,10 @@ Main::~Main() {
  */
 Main::Main(const QStringList &args) {
 
-	int lineNum          = 0;
-	int editFlags        = EditFlags::CREATE;
-	bool gotoLine        = false;
 	bool macroFileReadEx = false;
-	bool iconic          = false;
 	bool opts            = true;
-	int tabbed           = -1;
-	int group            = 0;
 	int isTabbed;
-	QString geometry;
-	QString langMode;
-	QString toDoCommand;
+	OpenOptions openOptions;
 	QPointer<DocumentWidget> lastFile;
 
 	// Enable a Qt style sheet if present
@@ -103,7 +176,8 @@ Main::Main(const QStringList &args) {
 
 	/* Process -import command line argument before others which might
 	   open windows (loading preferences doesn't update menu settings,
-	   which would then be out of sync with the real preference settings) */
+	   which would then be out of sync with the real preference settings).
+	   -trace is handled here too, so that opening the files is recorded */
 	for (int i = 1; i < args.size(); ++i) {
 
 		const QString arg = args[i];
@@ -113,6 +187,14 @@ Main::Main(const QStringList &args) {
 		} else if (arg == QLatin1String("-import")) {
 			i = nextArg(args, i);
 			Preferences::ImportPrefFile(args[i]);
+		} else if (arg == QLatin1String("-trace")) {
+			i          = nextArg(args, i);
+			traceFile_ = args[i];
+#ifdef NEDIT_INSTRUMENTATION
+			Instrumentation::startTrace();
+#else
+			fprintf(stderr, "NEdit: -trace needs a build with NEDIT_INSTRUMENTATION enabled\n");
+#endif
 		}
 	}
 
@@ -129,147 +211,157 @@ Main::Main(const QStringList &args) {
 
 	bool fileSpecified = false;
 
-	for (int i = 1; i < args.size(); i++) {
-
-		if (opts && args[i] == QLatin1String("--")) {
-			opts = false; // treat all remaining arguments as filenames
-			continue;
-		} else if (opts && args[i] == QLatin1String("-tags")) {
-			i = nextArg(args, i);
-			if (!Tags::addTagsFile(args[i], Tags::SearchMode::TAG)) {
+	// every option understood here, the files are what is left
+	const std::vector<CommandLineOption> options = {
+		{QLatin1String("-tags"), true, [](OpenOptions *, const QString &arg) {
+			if (!Tags::addTagsFile(arg, Tags::SearchMode::TAG)) {
 				fprintf(stderr, "NEdit: Unable to load tags file\n");
 			}
-
-		} else if (opts && args[i] == QLatin1String("-do")) {
-			i = nextArg(args, i);
-			if (checkDoMacroArg(args[i])) {
-				toDoCommand = args[i];
+		}},
+		{QLatin1String("-do"), true, [](OpenOptions *options, const QString &arg) {
+			if (checkDoMacroArg(arg)) {
+				options->toDoCommand = arg;
 			}
-		} else if (opts && args[i] == QLatin1String("-svrname")) {
-			i = nextArg(args, i);
-
-			Settings::serverNameOverride = args[i];
+		}},
+		{QLatin1String("-svrname"), true, [](OpenOptions *, const QString &arg) {
+			Settings::serverNameOverride = arg;
 			IsServer                     = true;
-		} else if (opts && (args[i] == QLatin1String("-font") || args[i] == QLatin1String("-fn"))) {
-			i = nextArg(args, i);
-
-			Settings::fontName = args[i];
-		} else if (opts && args[i] == QLatin1String("-wrap")) {
-			Settings::autoWrap = WrapStyle::Continuous;
-		} else if (opts && args[i] == QLatin1String("-nowrap")) {
-			Settings::autoWrap = WrapStyle::None;
-		} else if (opts && args[i] == QLatin1String("-autowrap")) {
-			Settings::autoWrap = WrapStyle::Newline;
-		} else if (opts && args[i] == QLatin1String("-autoindent")) {
-			Settings::autoIndent = IndentStyle::Auto;
-		} else if (opts && args[i] == QLatin1String("-noautoindent")) {
-			Settings::autoIndent = IndentStyle::None;
-		} else if (opts && args[i] == QLatin1String("-autosave")) {
-			Settings::autoSave = true;
-		} else if (opts && args[i] == QLatin1String("-noautosave")) {
-			Settings::autoSave = false;
-		} else if (opts && args[i] == QLatin1String("-rows")) {
-			i = nextArg(args, i);
-
+		}},
+		{QLatin1String("-font"), true, [](OpenOptions *, const QString &arg) { Settings::fontName = arg; }},
+		{QLatin1String("-fn"), true, [](OpenOptions *, const QString &arg) { Settings::fontName = arg; }},
+		{QLatin1String("-wrap"), false, [](OpenOptions *, const QString &) { Settings::autoWrap = WrapStyle::Continuous; }},
+		{QLatin1String("-nowrap"), false, [](OpenOptions *, const QString &) { Settings::autoWrap = WrapStyle::None; }},
+		{QLatin1String("-autowrap"), false, [](OpenOptions *, const QString &) { Settings::autoWrap = WrapStyle::Newline; }},
+		{QLatin1String("-autoindent"), false, [](OpenOptions *, const QString &) { Settings::autoIndent = IndentStyle::Auto; }},
+		{QLatin1String("-noautoindent"), false, [](OpenOptions *, const QString &) { Settings::autoIndent = IndentStyle::None; }},
+		{QLatin1String("-autosave"), false, [](OpenOptions *, const QString &) { Settings::autoSave = true; }},
+		{QLatin1String("-noautosave"), false, [](OpenOptions *, const QString &) { Settings::autoSave = false; }},
+		{QLatin1String("-rows"), true, [](OpenOptions *, const QString &arg) {
 			bool ok;
-			int n = args[i].toInt(&ok);
+			int n = arg.toInt(&ok);
 			if (!ok) {
 				fprintf(stderr, "NEdit: argument to rows should be a number\n");
 			} else {
 				Settings::textRows = n;
 			}
-		} else if (opts && args[i] == QLatin1String("-columns")) {
-			i = nextArg(args, i);
-
+		}},
+		{QLatin1String("-columns"), true, [](OpenOptions *, const QString &arg) {
 			bool ok;
-			int n = args[i].toInt(&ok);
+			int n = arg.toInt(&ok);
 			if (!ok) {
 				fprintf(stderr, "NEdit: argument to cols should be a number\n");
 			} else {
 				Settings::textCols = n;
 			}
-		} else if (opts && args[i] == QLatin1String("-tabs")) {
-			i = nextArg(args, i);
-
+		}},
+		{QLatin1String("-tabs"), true, [](OpenOptions *, const QString &arg) {
 			bool ok;
-			int n = args[i].toInt(&ok);
+			int n = arg.toInt(&ok);
 			if (!ok) {
 				fprintf(stderr, "NEdit: argument to tabs should be a number\n");
 			} else {
 				Settings::tabDistance = n;
 			}
-		} else if (opts && args[i] == QLatin1String("-read")) {
-			editFlags |= PREF_READ_ONLY;
-		} else if (opts && args[i] == QLatin1String("-create")) {
-			editFlags |= SUPPRESS_CREATE_WARN;
-		} else if (opts && args[i] == QLatin1String("-tabbed")) {
-			tabbed = 1;
-			group  = 0; // override -group option
-		} else if (opts && args[i] == QLatin1String("-untabbed")) {
-			tabbed = 0;
-			group  = 0; // override -group option
-		} else if (opts && args[i] == QLatin1String("-group")) {
-			group = 2; // 2: start new group, 1: in group
-		} else if (opts && args[i] == QLatin1String("-line")) {
-			i = nextArg(args, i);
-
+		}},
+		{QLatin1String("-read"), false, [](OpenOptions *options, const QString &) { options->editFlags |= PREF_READ_ONLY; }},
+		{QLatin1String("-create"), false, [](OpenOptions *options, const QString &) { options->editFlags |= SUPPRESS_CREATE_WARN; }},
+		{QLatin1String("-tabbed"), false, [](OpenOptions *options, const QString &) {
+			options->tabbed = 1;
+			options->group  = 0; // override -group option
+		}},
+		{QLatin1String("-untabbed"), false, [](OpenOptions *options, const QString &) {
+			options->tabbed = 0;
+			options->group  = 0; // override -group option
+		}},
+		{QLatin1String("-group"), false, [](OpenOptions *options, const QString &) {
+			options->group = 2; // 2: start new group, 1: in group
+		}},
+		{QLatin1String("-line"), true, [](OpenOptions *options, const QString &arg) {
 			bool ok;
-			lineNum = args[i].toInt(&ok);
+			options->lineNum = arg.toInt(&ok);
 			if (!ok) {
 				fprintf(stderr, "NEdit: argument to line should be a number\n");
 			} else {
-				gotoLine = true;
+				options->gotoLine = true;
 			}
+		}},
+		{QLatin1String("-server"), false, [](OpenOptions *, const QString &) { IsServer = true; }},
+		{QLatin1String("-iconic"), false, [](OpenOptions *options, const QString &) { options->iconic = true; }},
+		{QLatin1String("-icon"), false, [](OpenOptions *options, const QString &) { options->iconic = true; }},
+		{QLatin1String("-noiconic"), false, [](OpenOptions *options, const QString &) { options->iconic = false; }},
+		{QLatin1String("-geometry"), true, [](OpenOptions *options, const QString &arg) { options->geometry = arg; }},
+		{QLatin1String("-g"), true, [](OpenOptions *options, const QString &arg) { options->geometry = arg; }},
+		{QLatin1String("-lm"), true, [](OpenOptions *options, const QString &arg) { options->langMode = arg; }},
+		// already processed above
+		{QLatin1String("-import"), true, [](OpenOptions *, const QString &) {}},
+		{QLatin1String("-trace"), true, [](OpenOptions *, const QString &) {}},
+		{QLatin1String("-V"), false, [](OpenOptions *, const QString &) {
+			QString infoString = DialogAbout::createInfoString();
+			printf("%s", qPrintable(infoString));
+			exit(EXIT_SUCCESS);
+		}},
+		{QLatin1String("-version"), false, [](OpenOptions *, const QString &) {
+			QString infoString = DialogAbout::createInfoString();
+			printf("%s", qPrintable(infoString));
+			exit(EXIT_SUCCESS);
+		}},
+		{QLatin1String("-h"), false, [](OpenOptions *, const QString &) {
+			fprintf(stderr, "%s", cmdLineHelp);
+			exit(EXIT_SUCCESS);
+		}},
+		{QLatin1String("-help"), false, [](OpenOptions *, const QString &) {
+			fprintf(stderr, "%s", cmdLineHelp);
+			exit(EXIT_SUCCESS);
+		}},
+	};
+
+	/* Read the files in the background while the documents are created, one
+	   after the other, below */
+	const QStringList prefetched = filesToPrefetch(args, options);
+	FilePrefetch::prefetch(prefetched);
+
+	for (int i = 1; i < args.size(); i++) {
+
+		if (opts && args[i] == QLatin1String("--")) {
+			opts = false; // treat all remaining arguments as filenames
+			continue;
 		} else if (opts && (args[i].startsWith(QLatin1Char('+')))) {
 			bool ok;
-			lineNum = args[i].toInt(&ok);
+			openOptions.lineNum = args[i].toInt(&ok);
 			if (!ok) {
 				fprintf(stderr, "NEdit: argument to + should be a number\n");
 			} else {
-				gotoLine = true;
+				openOptions.gotoLine = true;
 			}
-		} else if (opts && args[i] == QLatin1String("-server")) {
-			IsServer = true;
-		} else if (opts && (args[i] == QLatin1String("-iconic") || args[i] == QLatin1String("-icon"))) {
-			iconic = true;
-		} else if (opts && args[i] == QLatin1String("-noiconic")) {
-			iconic = false;
-		} else if (opts && (args[i] == QLatin1String("-geometry") || args[i] == QLatin1String("-g"))) {
-			i = nextArg(args, i);
-
-			geometry = args[i];
-		} else if (opts && args[i] == QLatin1String("-lm")) {
-			i = nextArg(args, i);
-
-			langMode = args[i];
-		} else if (opts && args[i] == QLatin1String("-import")) {
-			i = nextArg(args, i); // already processed, skip
-		} else if (opts && (args[i] == QLatin1String("-V") || args[i] == QLatin1String("-version"))) {
-			QString infoString = DialogAbout::createInfoString();
-			printf("%s", qPrintable(infoString));
-			exit(EXIT_SUCCESS);
-		} else if (opts && (args[i] == QLatin1String("-h") || args[i] == QLatin1String("-help"))) {
-			fprintf(stderr, "%s", cmdLineHelp);
-			exit(EXIT_SUCCESS);
 		} else if (opts && (args[i].startsWith(QLatin1Char('-')))) {
-			fprintf(stderr, "nedit: Unrecognized option %s\n%s", qPrintable(args[i]), cmdLineHelp);
-			exit(EXIT_FAILURE);
+			const CommandLineOption *option = findOption(options, args[i]);
+			if (!option) {
+				fprintf(stderr, "nedit: Unrecognized option %s\n%s", qPrintable(args[i]), cmdLineHelp);
+				exit(EXIT_FAILURE);
+			}
+
+			if (option->hasArgument) {
+				i = nextArg(args, i);
+				option->handle(&openOptions, args[i]);
+			} else {
+				option->handle(&openOptions, QString());
+			}
 		} else {
 
 			const PathInfo fi = parseFilename(args[i]);
 
 			/* determine if file is to be openned in new tab, by
 			   factoring the options -group, -tabbed & -untabbed */
-			switch (group) {
+			switch (openOptions.group) {
 			case 2:
-				isTabbed = 0; // start a new window for new group
-				group    = 1; // next file will be within group
+				isTabbed          = 0; // start a new window for new group
+				openOptions.group = 1; // next file will be within group
 				break;
 			case 1:
 				isTabbed = 1; // new tab for file in group
 				break;
 			default: // not in group
-				isTabbed = (tabbed == -1) ? Preferences::GetPrefOpenInTab() : tabbed;
+				isTabbed = (openOptions.tabbed == -1) ? Preferences::GetPrefOpenInTab() : openOptions.tabbed;
 			}
 
 			/* Files are opened in background to improve opening speed
@@ -286,10 +378,10 @@ Main::Main(const QStringList &args) {
 					window->currentDocument(),
 					fi.filename,
 					fi.pathname,
-					editFlags,
-					geometry,
-					iconic,
-					langMode,
+					openOptions.editFlags,
+					openOptions.geometry,
+					openOptions.iconic,
+					openOptions.langMode,
 					isTabbed,
 					/*bgOpen=*/true);
 			} else {
@@ -297,10 +389,10 @@ Main::Main(const QStringList &args) {
 					nullptr,
 					fi.filename,
 					fi.pathname,
-					editFlags,
-					geometry,
-					iconic,
-					langMode,
+					openOptions.editFlags,
+					openOptions.geometry,
+					openOptions.iconic,
+					openOptions.langMode,
 					isTabbed,
 					/*bgOpen=*/true);
 			}
@@ -318,13 +410,13 @@ Main::Main(const QStringList &args) {
 					document->readMacroInitFile();
 					macroFileReadEx = true;
 				}
-				if (gotoLine) {
-					document->selectNumberedLine(document->firstPane(), lineNum);
+				if (openOptions.gotoLine) {
+					document->selectNumberedLine(document->firstPane(), openOptions.lineNum);
 				}
 
-				if (!toDoCommand.isNull()) {
-					document->doMacro(toDoCommand, QLatin1String("-do macro"));
-					toDoCommand = QString();
+				if (!openOptions.toDoCommand.isNull()) {
+					document->doMacro(openOptions.toDoCommand, QLatin1String("-do macro"));
+					openOptions.toDoCommand = QString();
 				}
 			}
 
@@ -334,10 +426,13 @@ Main::Main(const QStringList &args) {
 			}
 
 			// -line/+n does only affect the file following this switch
-			gotoLine = false;
+			openOptions.gotoLine = false;
 		}
 	}
 
+	// forget about the files which couldn't be opened
+	FilePrefetch::discard(prefetched);
+
 	// Raise the last file opened
 	if (lastFile) {
 		lastFile->raiseDocument();
@@ -347,13 +442,13 @@ Main::Main(const QStringList &args) {
 
 	// If no file to edit was specified, open a window to edit "Untitled"
 	if (!fileSpecified) {
-		DocumentWidget *document = MainWindow::editNewFile(nullptr, geometry, iconic, langMode);
+		DocumentWidget *document = MainWindow::editNewFile(nullptr, openOptions.geometry, openOptions.iconic, openOptions.langMode);
 
 		document->readMacroInitFile();
 		MainWindow::checkCloseEnableState();
 
-		if (!toDoCommand.isNull()) {
-			document->doMacro(toDoCommand, QLatin1String("-do macro"));
+		if (!openOptions.toDoCommand.isNull()) {
+			document->doMacro(openOptions.toDoCommand, QLatin1String("-do macro"));
 		}
 	}
 
@@ -3,10 +3,10 @@
 #define MAIN_H_
 
 #include <QCoreApplication>
+#include <QString>
 #include <QStringList>
 #include <memory>
 
-class QString;
 class NeditServer;
 
 class Main {
@@ -21,6 +21,7 @@ private:
 
 private:
 	std::unique_ptr<NeditServer> server_;
+	QString traceFile_;
 };
 
 #endif
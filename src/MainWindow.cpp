@@ -7,7 +7,9 @@
 #include "DialogExecuteCommand.h"
 #include "DialogFilter.h"
 #include "DialogFind.h"
+#include "DialogFindInFiles.h"
 #include "DialogFonts.h"
+#include "DialogInputLatency.h"
 #include "DialogLanguageModes.h"
 #include "DialogMacros.h"
 #include "DialogRepeat.h"
@@ -27,7 +29,9 @@
 #include "LanguageMode.h"
 #include "Location.h"
 #include "PatternSet.h"
+#include "PerformanceOverlay.h"
 #include "Preferences.h"
+#include "Profiler.h"
 #include "Regex.h"
 #include "Search.h"
 #include "Settings.h"
@@ -37,6 +41,7 @@
 #include "TextBuffer.h"
 #include "Util/ClearCase.h"
 #include "Util/FileSystem.h"
+#include "Util/Instrumentation.h"
 #include "Util/algorithm.h"
 #include "Util/regex.h"
 #include "Util/utils.h"
@@ -67,6 +72,7 @@ namespace {
 bool currentlyBusy   = false;
 bool modeMessageSet  = false;
 qint64 busyStartTime = 0;
+QString busyMessage; // the mode message shown, once modeMessageSet
 
 QPointer<DocumentWidget> lastFocusDocument;
 
@@ -232,6 +238,7 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags)
 	createLanguageModeSubMenu();
 	setupMenuDefaults();
 	setupMenuGroups();
+	showPerformanceOverlay(Instrumentation::statisticsEnabled());
 
 	setupPrevOpenMenuActions();
 	updatePrevOpenMenu();
@@ -268,6 +275,16 @@ MainWindow::~MainWindow() {
 	// disconnect this signal explicitly or we set off the UBSAN during qApp
 	// destruction
 	disconnect(qApp, &QApplication::focusChanged, this, &MainWindow::focusChanged);
+
+	// nobody is left to look at the statistics
+	const std::vector<MainWindow *> windows = MainWindow::allWindows(true);
+	const bool lastWindow = std::all_of(windows.begin(), windows.end(), [this](MainWindow *window) {
+		return window == this;
+	});
+
+	if (lastWindow) {
+		Instrumentation::setStatisticsEnabled(false);
+	}
 }
 
 /**
@@ -339,6 +356,7 @@ void MainWindow::connectSlots() {
 	connect(ui.action_Replace, &QAction::triggered, this, &MainWindow::action_Replace_triggered);
 	connect(ui.action_Replace_Find_Again, &QAction::triggered, this, &MainWindow::action_Replace_Find_Again_triggered);
 	connect(ui.action_Replace_Again, &QAction::triggered, this, &MainWindow::action_Replace_Again_triggered);
+	connect(ui.action_Find_in_Files, &QAction::triggered, this, &MainWindow::action_Find_in_Files_triggered);
 	connect(ui.action_Mark, &QAction::triggered, this, &MainWindow::action_Mark_triggered);
 	connect(ui.action_Goto_Mark, &QAction::triggered, this, &MainWindow::action_Goto_Mark_triggered);
 	connect(ui.action_Goto_Matching, &QAction::triggered, this, &MainWindow::action_Goto_Matching_triggered);
@@ -377,6 +395,7 @@ void MainWindow::connectSlots() {
 	connect(ui.action_About, &QAction::triggered, this, &MainWindow::action_About_triggered);
 	connect(ui.action_About_Qt, &QAction::triggered, this, &MainWindow::action_About_Qt_triggered);
 	connect(ui.action_Help, &QAction::triggered, this, &MainWindow::action_Help_triggered);
+	connect(ui.action_Input_Latency, &QAction::triggered, this, &MainWindow::action_Input_Latency_triggered);
 
 	connect(ui.action_Statistics_Line, &QAction::toggled, this, &MainWindow::action_Statistics_Line_toggled);
 	connect(ui.action_Incremental_Search_Line, &QAction::toggled, this, &MainWindow::action_Incremental_Search_Line_toggled);
@@ -388,6 +407,9 @@ void MainWindow::connectSlots() {
 	connect(ui.action_Matching_Syntax, &QAction::toggled, this, &MainWindow::action_Matching_Syntax_toggled);
 	connect(ui.action_Overtype, &QAction::toggled, this, &MainWindow::action_Overtype_toggled);
 	connect(ui.action_Read_Only, &QAction::toggled, this, &MainWindow::action_Read_Only_toggled);
+	connect(ui.action_Performance_Statistics, &QAction::toggled, this, &MainWindow::action_Performance_Statistics_toggled);
+	connect(ui.action_Record_Performance_Trace, &QAction::toggled, this, &MainWindow::action_Record_Performance_Trace_toggled);
+	connect(ui.action_Profile_Macros, &QAction::toggled, this, &MainWindow::action_Profile_Macros_toggled);
 	connect(ui.action_Default_Sort_Open_Prev_Menu, &QAction::toggled, this, &MainWindow::action_Default_Sort_Open_Prev_Menu_toggled);
 	connect(ui.action_Default_Show_Path_In_Windows_Menu, &QAction::toggled, this, &MainWindow::action_Default_Show_Path_In_Windows_Menu_toggled);
 	connect(ui.action_Default_Search_Verbose, &QAction::toggled, this, &MainWindow::action_Default_Search_Verbose_toggled);
@@ -684,6 +706,14 @@ void MainWindow::setupMenuDefaults() {
 	no_signals(ui.action_Make_Backup_Copy)->setChecked(Preferences::GetPrefAutoSave());
 	no_signals(ui.action_Incremental_Backup)->setChecked(Preferences::GetPrefSaveOldVersion());
 	no_signals(ui.action_Matching_Syntax)->setChecked(Preferences::GetPrefMatchSyntaxBased());
+	no_signals(ui.action_Record_Performance_Trace)->setChecked(Instrumentation::isTracing());
+	no_signals(ui.action_Performance_Statistics)->setChecked(Instrumentation::statisticsEnabled());
+	no_signals(ui.action_Profile_Macros)->setChecked(Profiler::active());
+
+#ifndef NEDIT_INSTRUMENTATION
+	ui.action_Performance_Statistics->setVisible(false);
+	ui.action_Record_Performance_Trace->setVisible(false);
+#endif
 
 	setupGlobalPrefenceDefaults();
 	setupDocumentPreferenceDefaults();
@@ -3184,6 +3214,28 @@ void MainWindow::action_Replace_Again_triggered() {
 	}
 }
 
+/**
+ * @brief MainWindow::action_Find_in_Files_triggered
+ */
+void MainWindow::action_Find_in_Files_triggered() {
+
+	DocumentWidget *document = currentDocument();
+	if (!document) {
+		return;
+	}
+
+	if (!dialogFindInFiles_) {
+		dialogFindInFiles_ = new DialogFindInFiles(this);
+		dialogFindInFiles_->initToggleButtons(Preferences::GetPrefSearch());
+	}
+
+	dialogFindInFiles_->setDocument(document);
+
+	dialogFindInFiles_->show();
+	dialogFindInFiles_->raise();
+	dialogFindInFiles_->activateWindow();
+}
+
 /**
  * @brief MainWindow::action_Shift_Replace_Again_triggered
  */
@@ -3729,6 +3781,125 @@ void MainWindow::action_About_Qt_triggered() {
 	QMessageBox::aboutQt(this);
 }
 
+/**
+ * @brief MainWindow::showPerformanceOverlay
+ * @param show
+ */
+void MainWindow::showPerformanceOverlay(bool show) {
+
+	if (show) {
+		if (!performanceOverlay_) {
+			performanceOverlay_ = new PerformanceOverlay(centralWidget());
+			performanceOverlay_->show();
+		}
+	} else {
+		delete performanceOverlay_;
+	}
+}
+
+/**
+ * @brief MainWindow::action_Performance_Statistics_toggled
+ * @param state
+ *
+ * the statistics are gathered for the whole application, so they are shown
+ * in every window or in none
+ */
+void MainWindow::action_Performance_Statistics_toggled(bool state) {
+
+	Instrumentation::setStatisticsEnabled(state);
+
+	for (MainWindow *window : MainWindow::allWindows(true)) {
+		no_signals(window->ui.action_Performance_Statistics)->setChecked(state);
+		window->showPerformanceOverlay(state);
+	}
+}
+
+/**
+ * @brief MainWindow::action_Record_Performance_Trace_toggled
+ * @param state
+ *
+ * starts recording a trace of the instrumented code paths, and when toggled
+ * off again asks where to save it
+ */
+void MainWindow::action_Record_Performance_Trace_toggled(bool state) {
+
+	if (state) {
+		Instrumentation::startTrace();
+	} else {
+		const QString filename = QFileDialog::getSaveFileName(
+			this,
+			tr("Save Performance Trace"),
+			QString(),
+			tr("Trace Files (*.json);;All Files (*)"));
+
+		if (!Instrumentation::stopTrace(filename) && !filename.isEmpty()) {
+			QMessageBox::warning(
+				this,
+				tr("Error writing trace"),
+				tr("Unable to write the trace to %1").arg(filename));
+		}
+	}
+
+	for (MainWindow *window : MainWindow::allWindows()) {
+		no_signals(window->ui.action_Record_Performance_Trace)->setChecked(state);
+	}
+}
+
+/**
+ * @brief MainWindow::action_Profile_Macros_toggled
+ * @param state
+ *
+ * starts profiling the macros which run from now on, and when toggled off
+ * again asks where to save the report
+ */
+void MainWindow::action_Profile_Macros_toggled(bool state) {
+
+	if (state) {
+		Profiler::start();
+	} else {
+		Profiler::stop();
+
+		const QString filename = QFileDialog::getSaveFileName(
+			this,
+			tr("Save Macro Profile"),
+			QString(),
+			tr("Text Files (*.txt);;All Files (*)"));
+
+		if (!filename.isEmpty()) {
+			QFile file(filename);
+			if (file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+				QTextStream ts(&file);
+				ts << Profiler::report();
+			}
+
+			if (file.error() != QFile::NoError) {
+				QMessageBox::warning(
+					this,
+					tr("Error writing profile"),
+					tr("Unable to write the profile to %1").arg(filename));
+			}
+		}
+	}
+
+	MainWindow::updateMenuItems();
+}
+
+/**
+ * @brief MainWindow::action_Input_Latency_triggered
+ *
+ * shows how long key presses take to be painted, which is tracked for as
+ * long as the dialog is open
+ */
+void MainWindow::action_Input_Latency_triggered() {
+	if (!dialogInputLatency_) {
+		dialogInputLatency_ = new DialogInputLatency(this);
+		dialogInputLatency_->setAttribute(Qt::WA_DeleteOnClose);
+	}
+
+	dialogInputLatency_->show();
+	dialogInputLatency_->raise();
+}
+
 /**
  * @brief MainWindow::currentDocument
  * @return
@@ -4897,13 +5068,15 @@ void MainWindow::allDocumentsBusy(const QString &message) {
 		 */
 		QApplication::setOverrideCursor(Qt::WaitCursor);
 
-	} else if (!modeMessageSet && !message.isNull() && (QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() - busyStartTime) > 1000) {
+	} else if ((!modeMessageSet || message != busyMessage) && !message.isNull() && (QDateTime::currentDateTimeUtc().toMSecsSinceEpoch() - busyStartTime) > 1000) {
 
-		// Show the mode message when we've been busy for more than a second
+		// Show the mode message when we've been busy for more than a second,
+		// and update it when it changes (to show progress)
 		for (DocumentWidget *document : documents) {
 			document->setModeMessage(message);
 		}
 		modeMessageSet = true;
+		busyMessage    = message;
 	}
 
 	/* Keep UI alive while loading large files */
@@ -4923,6 +5096,7 @@ void MainWindow::allDocumentsUnbusy() {
 	currentlyBusy  = false;
 	modeMessageSet = false;
 	busyStartTime  = 0;
+	busyMessage.clear();
 
 	QApplication::restoreOverrideCursor();
 }
@@ -7145,10 +7319,7 @@ bool MainWindow::replaceAll(DocumentWidget *document, TextArea *area, const QStr
 		delimieters);
 
 	if (!newFileString) {
-		if (document->multiFileBusy_) {
-			// only needed during multi-file replacements
-			document->replaceFailed_ = true;
-		} else if (Preferences::GetPrefSearchDlogs()) {
+		if (Preferences::GetPrefSearchDlogs()) {
 
 			if (dialogFind_) {
 				if (!dialogFind_->keepDialog()) {
@@ -7321,6 +7492,7 @@ void MainWindow::updateMenuItems() {
 		window->ui.action_Unload_Tags_File->setEnabled(tagStat);
 		window->ui.action_Show_Calltip->setEnabled(tipStat || tagStat);
 		window->ui.action_Find_Definition->setEnabled(tagStat);
+		no_signals(window->ui.action_Profile_Macros)->setChecked(Profiler::active());
 	}
 }
 
@@ -7360,7 +7532,7 @@ bool MainWindow::execNamedMacroMenuCmd(DocumentWidget *document, TextArea *area,
 
 	if (MenuData *p = find_menu_item(name, CommandTypes::Macro)) {
 		document->doMacro(
-			p->item.cmd,
+			p,
 			tr("macro menu command"));
 
 		return true;
@@ -7384,7 +7556,7 @@ bool MainWindow::execNamedBGMenuCmd(DocumentWidget *document, TextArea *area, co
 
 	if (MenuData *p = find_menu_item(name, CommandTypes::Context)) {
 		document->doMacro(
-			p->item.cmd,
+			p,
 			tr("background menu macro"));
 
 		return true;
@@ -27,6 +27,7 @@
 
 class DialogColors;
 class DialogFind;
+class DialogFindInFiles;
 class DialogMacros;
 class DialogReplace;
 class DialogShellMenu;
@@ -37,6 +38,8 @@ class DialogLanguageModes;
 class DocumentWidget;
 class DialogWindowTitle;
 class DialogFonts;
+class DialogInputLatency;
+class PerformanceOverlay;
 class TextArea;
 struct MenuData;
 struct PathInfo;
@@ -128,6 +131,7 @@ private:
 	QFileInfoList openFileHelperSystem(DocumentWidget *document, const QRegularExpressionMatch &match, QString *searchPath, QString *searchName) const;
 	QFileInfoList openFileHelperLocal(DocumentWidget *document, const QRegularExpressionMatch &match, QString *searchPath, QString *searchName) const;
 	QFileInfoList openFileHelperString(DocumentWidget *document, const QString &text, QString *searchPath, QString *searchName) const;
+	void showPerformanceOverlay(bool show);
 
 public:
 	static bool closeAllFilesAndWindows();
@@ -341,6 +345,7 @@ public:
 	void action_Replace_triggered();
 	void action_Replace_Find_Again_triggered();
 	void action_Replace_Again_triggered();
+	void action_Find_in_Files_triggered();
 	void action_Mark_triggered();
 	void action_Goto_Mark_triggered();
 	void action_Goto_Matching_triggered();
@@ -417,6 +422,10 @@ public:
 	void action_Replay_Keystrokes_triggered();
 	void action_About_triggered();
 	void action_About_Qt_triggered();
+	void action_Performance_Statistics_toggled(bool state);
+	void action_Record_Performance_Trace_toggled(bool state);
+	void action_Profile_Macros_toggled(bool state);
+	void action_Input_Latency_triggered();
 	void action_Help_triggered();
 
 private:
@@ -445,6 +454,7 @@ private:
 	QList<QAction *> previousOpenFilesList_;
 	QPointer<DialogFind> dialogFind_;
 	QPointer<DialogReplace> dialogReplace_;
+	QPointer<DialogFindInFiles> dialogFindInFiles_;
 	QPointer<DialogShellMenu> dialogShellMenu_;
 	QPointer<DialogMacros> dialogMacros_;
 	QPointer<DialogColors> dialogColors_;
@@ -454,7 +464,9 @@ private:
 	QPointer<DialogLanguageModes> dialogLanguageModes_;
 	QPointer<DialogFonts> dialogFonts_;
 	QPointer<DialogWindowTitle> dialogWindowTitle_;
+	QPointer<DialogInputLatency> dialogInputLatency_;
 	QPointer<TextArea> lastFocus_;
+	QPointer<PerformanceOverlay> performanceOverlay_;
 
 private:
 	bool iSearchLastLiteralCase_    = false;          // idem, for literal mode
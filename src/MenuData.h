@@ -6,6 +6,8 @@
 #include <memory>
 #include <vector>
 
+struct Program;
+
 /* Structure holding info about a single menu item.
    According to above example there exist 5 user menu items:
    a.) "menuItem1"  (hierarchical ID = {0} means: element nbr. "0" of main menu)
@@ -25,6 +27,7 @@ struct UserMenuInfo {
 struct MenuData {
 	MenuItem item;
 	std::unique_ptr<UserMenuInfo> info;
+	std::shared_ptr<Program> program; // compiled macro of a macro or background menu item, made on first use
 };
 
 #endif
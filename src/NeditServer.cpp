@@ -2,6 +2,7 @@
 #include "NeditServer.h"
 #include "DocumentWidget.h"
 #include "EditFlags.h"
+#include "FilePrefetch.h"
 #include "MainWindow.h"
 #include "Preferences.h"
 #include "Util/FileSystem.h"
@@ -16,9 +17,10 @@
 #include <QLocalServer>
 #include <QLocalSocket>
 #include <QScreen>
+#include <QTimer>
 #include <QVarLengthArray>
 
-#include <memory>
+#include <deque>
 
 namespace {
 
@@ -116,100 +118,235 @@ QScreen *current_desktop() {
 	return screenAt(QCursor::pos());
 }
 
-}
-
 /**
- * @brief NeditServer::NeditServer
- * @param parent
+ * @brief Reads the request of a single nc-ng client, and carries it out.
+ *
+ * Nothing here ever blocks waiting for the client: the request is read as it
+ * arrives, and the files it names are opened one per pass through the event
+ * loop while the rest of it is still coming in. A client which stops sending
+ * before the request is complete is dropped after RequestTimeout.
+ *
+ * A request is either a single frame holding a JSON array with an entry for
+ * every file (what older clients send), or a frame per entry, each holding a
+ * JSON object, followed by an empty frame.
  */
-NeditServer::NeditServer(QObject *parent)
-	: QObject(parent) {
+class ServerConnection : public QObject {
+public:
+	ServerConnection(QLocalSocket *socket, QObject *parent)
+		: QObject(parent), socket_(socket), stream_(socket), desktop_(current_desktop()) {
 
-	QString socketName = LocalSocketName(Preferences::GetPrefServerName());
-	server_            = new QLocalServer(this);
-	server_->setSocketOptions(QLocalServer::UserAccessOption);
-	connect(server_, &QLocalServer::newConnection, this, &NeditServer::newConnection);
+		socket->setParent(this);
+		stream_.setVersion(QDataStream::Qt_5_0);
 
-	QLocalServer::removeServer(socketName);
+		timer_.setSingleShot(true);
+		timer_.setInterval(RequestTimeout);
 
-	if (!server_->listen(socketName)) {
-		qWarning() << "NEdit: server failed to start: " << server_->errorString();
+		connect(socket, &QLocalSocket::readyRead, this, &ServerConnection::readFrames);
+		connect(socket, &QLocalSocket::disconnected, this, &ServerConnection::clientDisconnected);
+		connect(&timer_, &QTimer::timeout, this, &ServerConnection::requestTimedOut);
+
+		timer_.start();
+
+		// some of it may have arrived already
+		readFrames();
 	}
-}
 
-/**
- * @brief NeditServer::newConnection
- */
-void NeditServer::newConnection() {
+private:
+	/**
+	 * @brief readFrames
+	 *
+	 * Take every frame which has arrived completely off the socket
+	 */
+	void readFrames() {
+
+		while (!inputComplete_) {
+			QByteArray frame;
+
+			stream_.startTransaction();
+			stream_ >> frame;
+			if (!stream_.commitTransaction()) {
+				break;
+			}
+
+			timer_.start();
+			readFrame(frame);
+		}
+
+		if (inputComplete_) {
+			timer_.stop();
+		}
+
+		scheduleNext();
+	}
+
+	/**
+	 * @brief readFrame
+	 * @param frame
+	 */
+	void readFrame(const QByteArray &frame) {
 
-	// NOTE(eteran): shared because later a lambda will capture this
-	// and use it to keep this socket alive until it returns
-	std::shared_ptr<QLocalSocket> socket(server_->nextPendingConnection());
+		if (frame.isEmpty()) {
+			inputComplete_ = true;
+			return;
+		}
 
-	QDataStream stream(socket.get());
-	stream.setVersion(QDataStream::Qt_5_0);
+		QJsonParseError error;
+		auto jsonDocument = QJsonDocument::fromJson(frame, &error);
 
-	QByteArray jsonString;
-	do {
-		if (!socket->waitForReadyRead()) {
-			qWarning("NEdit: error processing server request: [%d] %s", socket->error(), qPrintable(socket->errorString()));
+		if (error.error != QJsonParseError::NoError) {
+			qWarning("NEdit: error parsing JSON: [%d] %s \n", error.error, qPrintable(error.errorString()));
+			abandon();
 			return;
 		}
 
-		stream.startTransaction();
-		stream >> jsonString;
-	} while (!stream.commitTransaction());
+		if (jsonDocument.isObject()) {
+			prefetch(jsonDocument.object());
+			pending_.push_back(jsonDocument.object());
+			streamed_ = true;
+			return;
+		}
+
+		if (streamed_ || !jsonDocument.isArray()) {
+			qWarning("NEdit: error processing server request. Top level JSON value is not an array.");
+			abandon();
+			return;
+		}
 
-	QJsonParseError error;
-	auto jsonDocument = QJsonDocument::fromJson(jsonString, &error);
+		const QJsonArray array = jsonDocument.array();
+		for (auto entry : array) {
+			prefetch(entry);
+			pending_.push_back(entry);
+		}
 
-	if (error.error != QJsonParseError::NoError) {
-		qWarning("NEdit: error parsing JSON: [%d] %s \n", error.error, qPrintable(error.errorString()));
-		return;
+		/* If the command string is empty, put up an empty, Untitled window
+		   (or just pop one up if it already exists) */
+		untitled_      = array.isEmpty();
+		inputComplete_ = true;
 	}
 
-	if (!jsonDocument.isArray()) {
-		qWarning("NEdit: error processing server request. Top level JSON value is not an array.");
-		return;
+	/**
+	 * @brief prefetch
+	 * @param entry
+	 *
+	 * Start reading the file of an entry while the ones before it are opened
+	 */
+	void prefetch(const QJsonValue &entry) {
+
+		const QString fullname = entry.toObject()[QLatin1String("path")].toString();
+		if (fullname.isEmpty()) {
+			return;
+		}
+
+		const PathInfo fi = parseFilename(fullname);
+		if (MainWindow::findWindowWithFile(fi)) {
+			return;
+		}
+
+		const QString name = fi.pathname + fi.filename;
+		FilePrefetch::prefetch({name});
+		prefetched_.push_back(name);
 	}
 
-	int lastIconic = 0;
+	/**
+	 * @brief clientDisconnected
+	 */
+	void clientDisconnected() {
 
-	QPointer<DocumentWidget> lastFile;
-	QScreen *const currentDesktop = current_desktop();
+		// whatever the client sent before going away is still there to read
+		readFrames();
 
-	auto array = jsonDocument.array();
-	/* If the command string is empty, put up an empty, Untitled window
-	   (or just pop one up if it already exists) */
-	if (array.isEmpty()) {
-		std::vector<DocumentWidget *> documents = DocumentWidget::allDocuments();
+		if (!inputComplete_) {
+			if (!streamed_) {
+				qWarning("NEdit: error processing server request: [%d] %s", socket_->error(), qPrintable(socket_->errorString()));
+			}
+
+			// open what we were told about, a streamed request is usable up to here
+			inputComplete_ = true;
+			timer_.stop();
+			scheduleNext();
+		}
+	}
 
-		auto it = std::find_if(documents.begin(), documents.end(), [currentDesktop](DocumentWidget *document) {
-			return (!document->filenameSet() && !document->fileChanged() && isLocatedOnDesktop(MainWindow::fromDocument(document), currentDesktop));
-		});
+	/**
+	 * @brief requestTimedOut
+	 */
+	void requestTimedOut() {
+		qWarning("NEdit: error processing server request: timed out waiting for the client");
+		socket_->abort();
+		clientDisconnected();
+	}
 
-		if (it == documents.end()) {
+	/**
+	 * @brief abandon
+	 *
+	 * Give up on the rest of a broken request
+	 */
+	void abandon() {
+		pending_.clear();
+		FilePrefetch::discard(prefetched_);
+		prefetched_.clear();
+		lastFile_      = nullptr;
+		inputComplete_ = true;
+		stopped_       = true;
+		socket_->abort();
+	}
 
-			const int tabbed = -1;
+	/**
+	 * @brief scheduleNext
+	 */
+	void scheduleNext() {
+		if (!scheduled_) {
+			scheduled_ = true;
+			QTimer::singleShot(0, this, &ServerConnection::processNext);
+		}
+	}
 
-			MainWindow::editNewFile(
-				MainWindow::fromDocument(findDocumentOnDesktop(tabbed, currentDesktop)),
-				QString(),
-				false,
-				QString());
+	/**
+	 * @brief processNext
+	 *
+	 * Carry out one entry of the request, so that the editor keeps responding
+	 * to the user (and to the client) while a long list of files is opened
+	 */
+	void processNext() {
+		scheduled_ = false;
+
+		if (!pending_.empty() && !stopped_) {
+			const QJsonValue entry = pending_.front();
+			pending_.pop_front();
+
+			if (!processEntry(entry)) {
+				pending_.clear();
+				stopped_ = true;
+			}
+		}
 
-			MainWindow::checkCloseEnableState();
-		} else {
-			(*it)->raiseDocument();
+		if (!pending_.empty() && !stopped_) {
+			scheduleNext();
+			return;
+		}
+
+		if (inputComplete_ && !finished_) {
+			finished_ = true;
+
+			// whatever wasn't opened after all
+			FilePrefetch::discard(prefetched_);
+			prefetched_.clear();
+
+			finishRequest();
+			closeIfDone();
 		}
-		return;
 	}
 
-	for (auto entry : array) {
+	/**
+	 * @brief processEntry
+	 * @param entry
+	 * @return false if the rest of the request is not to be carried out
+	 */
+	bool processEntry(const QJsonValue &entry) {
 
 		if (!entry.isObject()) {
 			qWarning("NEdit: error processing server request. Non-object in JSON array.");
-			break;
+			return false;
 		}
 
 		auto file = entry.toObject();
@@ -235,14 +372,14 @@ void NeditServer::newConnection() {
 
 			if (doCommand.isEmpty()) {
 
-				auto it = std::find_if(documents.begin(), documents.end(), [currentDesktop](DocumentWidget *doc) {
-					return (!doc->filenameSet() && !doc->fileChanged() && isLocatedOnDesktop(MainWindow::fromDocument(doc), currentDesktop));
+				auto it = std::find_if(documents.begin(), documents.end(), [this](DocumentWidget *doc) {
+					return (!doc->filenameSet() && !doc->fileChanged() && isLocatedOnDesktop(MainWindow::fromDocument(doc), desktop_));
 				});
 
 				if (it == documents.end()) {
 
 					MainWindow::editNewFile(
-						MainWindow::fromDocument(findDocumentOnDesktop(tabbed, currentDesktop)),
+						MainWindow::fromDocument(findDocumentOnDesktop(tabbed, desktop_)),
 						QString(),
 						iconicFlag,
 						languageMode.isEmpty() ? QString() : languageMode);
@@ -275,7 +412,10 @@ void NeditServer::newConnection() {
 			}
 
 			MainWindow::checkCloseEnableState();
-			return;
+
+			// this ends the request, without raising the last file opened
+			lastFile_ = nullptr;
+			return false;
 		}
 
 		/* Process the filename by looking for the files in an
@@ -297,7 +437,7 @@ void NeditServer::newConnection() {
 			   macros to execute on. */
 
 			document = DocumentWidget::editExistingFile(
-				findDocumentOnDesktop(tabbed, currentDesktop),
+				findDocumentOnDesktop(tabbed, desktop_),
 				fi.filename,
 				fi.pathname,
 				editFlags,
@@ -308,8 +448,8 @@ void NeditServer::newConnection() {
 				/*bgOpen=*/true);
 
 			if (document) {
-				if (lastFile && MainWindow::fromDocument(document) != MainWindow::fromDocument(lastFile)) {
-					lastFile->raiseDocument();
+				if (lastFile_ && MainWindow::fromDocument(document) != MainWindow::fromDocument(lastFile_)) {
+					lastFile_->raiseDocument();
 				}
 			}
 		}
@@ -339,33 +479,132 @@ void NeditServer::newConnection() {
 
 			// register the last file opened for later use
 			if (document) {
-				lastFile   = document;
-				lastIconic = iconicFlag;
+				lastFile_   = document;
+				lastIconic_ = iconicFlag;
 			}
 
 			if (wait) {
-				// by creating this lambda, we are incrmenting the reference
-				// count of the socket, so it won't be destroyed until all open
-				// documents are closed.
-				// We create the dummy QObject in order to manage the lifetime
-				// of the connection, which matters in the case of the last
-				// document being "closed" and instead of being destroyed,
-				// becomes an untitled window
+				/* the client is kept connected until all of the documents it
+				   waits for are closed. The dummy QObject limits this to the
+				   first time the document is "closed", which matters in the
+				   case of the last document being turned into an untitled
+				   window instead of being destroyed */
 				auto obj = new QObject(this);
-				connect(document, &DocumentWidget::documentClosed, obj, [socket, obj]() {
+				++waiting_;
+				connect(document, &DocumentWidget::documentClosed, obj, [this, obj, document]() {
+					disconnect(document, nullptr, obj, nullptr);
 					obj->deleteLater();
+					--waiting_;
+					closeIfDone();
 				});
 			}
 		}
+
+		return true;
+	}
+
+	/**
+	 * @brief finishRequest
+	 */
+	void finishRequest() {
+
+		if (untitled_) {
+			std::vector<DocumentWidget *> documents = DocumentWidget::allDocuments();
+
+			auto it = std::find_if(documents.begin(), documents.end(), [this](DocumentWidget *document) {
+				return (!document->filenameSet() && !document->fileChanged() && isLocatedOnDesktop(MainWindow::fromDocument(document), desktop_));
+			});
+
+			if (it == documents.end()) {
+
+				const int tabbed = -1;
+
+				MainWindow::editNewFile(
+					MainWindow::fromDocument(findDocumentOnDesktop(tabbed, desktop_)),
+					QString(),
+					false,
+					QString());
+
+				MainWindow::checkCloseEnableState();
+			} else {
+				(*it)->raiseDocument();
+			}
+			return;
+		}
+
+		// Raise the last file opened
+		if (lastFile_) {
+			if (lastIconic_) {
+				lastFile_->raiseDocument();
+			} else {
+				lastFile_->raiseDocumentWindow();
+			}
+			MainWindow::checkCloseEnableState();
+		}
 	}
 
-	// Raise the last file opened
-	if (lastFile) {
-		if (lastIconic) {
-			lastFile->raiseDocument();
-		} else {
-			lastFile->raiseDocumentWindow();
+	/**
+	 * @brief closeIfDone
+	 *
+	 * Lets the client go once its request is carried out, and nothing it
+	 * waits for is open anymore
+	 */
+	void closeIfDone() {
+		if (finished_ && waiting_ == 0) {
+			disconnect(socket_, nullptr, this, nullptr);
+			socket_->disconnectFromServer();
+			deleteLater();
 		}
-		MainWindow::checkCloseEnableState();
+	}
+
+private:
+	// how long to wait for the rest of a request that has started arriving
+	static constexpr int RequestTimeout = 30000;
+
+	QLocalSocket *socket_;
+	QDataStream stream_;
+	QTimer timer_;
+	QScreen *desktop_;
+	std::deque<QJsonValue> pending_;
+	QStringList prefetched_;
+	QPointer<DocumentWidget> lastFile_;
+	int lastIconic_     = 0;
+	int waiting_        = 0;
+	bool inputComplete_ = false;
+	bool streamed_      = false;
+	bool untitled_      = false;
+	bool scheduled_     = false;
+	bool stopped_       = false;
+	bool finished_      = false;
+};
+
+}
+
+/**
+ * @brief NeditServer::NeditServer
+ * @param parent
+ */
+NeditServer::NeditServer(QObject *parent)
+	: QObject(parent) {
+
+	QString socketName = LocalSocketName(Preferences::GetPrefServerName());
+	server_            = new QLocalServer(this);
+	server_->setSocketOptions(QLocalServer::UserAccessOption);
+	connect(server_, &QLocalServer::newConnection, this, &NeditServer::newConnection);
+
+	QLocalServer::removeServer(socketName);
+
+	if (!server_->listen(socketName)) {
+		qWarning() << "NEdit: server failed to start: " << server_->errorString();
+	}
+}
+
+/**
+ * @brief NeditServer::newConnection
+ */
+void NeditServer::newConnection() {
+
+	while (QLocalSocket *socket = server_->nextPendingConnection()) {
+		new ServerConnection(socket, this);
 	}
 }
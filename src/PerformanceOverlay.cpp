@@ -0,0 +1,154 @@
+
+#include "PerformanceOverlay.h"
+#include "Util/Instrumentation.h"
+
+#include <QEvent>
+#include <QFontDatabase>
+#include <QFontMetrics>
+#include <QPainter>
+
+#include <algorithm>
+
+namespace {
+
+constexpr int RefreshInterval = 500; // ms
+constexpr int Margin          = 8;
+
+/**
+ * @brief milliseconds
+ * @param ns
+ * @return
+ */
+QString milliseconds(int64_t ns) {
+	return QString::number(static_cast<double>(ns) / 1.0e6, 'f', 2);
+}
+
+}
+
+/**
+ * @brief PerformanceOverlay::PerformanceOverlay
+ * @param parent
+ */
+PerformanceOverlay::PerformanceOverlay(QWidget *parent)
+	: QWidget(parent) {
+
+	setAttribute(Qt::WA_TransparentForMouseEvents);
+	setFocusPolicy(Qt::NoFocus);
+	setFont(QFontDatabase::systemFont(QFontDatabase::FixedFont));
+
+	parent->installEventFilter(this);
+
+	connect(&timer_, &QTimer::timeout, this, &PerformanceOverlay::updateStatistics);
+	timer_.start(RefreshInterval);
+
+	updateStatistics();
+	raise();
+}
+
+/**
+ * @brief PerformanceOverlay::eventFilter
+ * @param object
+ * @param event
+ * @return
+ */
+bool PerformanceOverlay::eventFilter(QObject *object, QEvent *event) {
+
+	// stay in the corner, and on top of any widget added after us
+	if (object == parentWidget() && (event->type() == QEvent::Resize || event->type() == QEvent::ChildAdded)) {
+		reposition();
+		raise();
+	}
+
+	return QWidget::eventFilter(object, event);
+}
+
+/**
+ * @brief PerformanceOverlay::reposition
+ */
+void PerformanceOverlay::reposition() {
+
+	const QFontMetrics fm(font());
+
+	int width = 0;
+	for (const QString &line : lines_) {
+		width = std::max(width, fm.boundingRect(line).width());
+	}
+
+	const int w = width + 2 * Margin;
+	const int h = (lines_.size() * fm.lineSpacing()) + 2 * Margin;
+
+	setGeometry(parentWidget()->width() - w - Margin, Margin, w, h);
+}
+
+/**
+ * @brief PerformanceOverlay::updateStatistics
+ */
+void PerformanceOverlay::updateStatistics() {
+
+	std::vector<Instrumentation::Statistic> stats = Instrumentation::statistics();
+
+	// timers first, the most expensive at the top, then the counters
+	std::sort(stats.begin(), stats.end(), [](const Instrumentation::Statistic &lhs, const Instrumentation::Statistic &rhs) {
+		if (lhs.type != rhs.type) {
+			return lhs.type == Instrumentation::ProbeType::Timer;
+		}
+
+		return lhs.total > rhs.total;
+	});
+
+	lines_.clear();
+	lines_.push_back(QStringLiteral("%1 %2 %3 %4 %5")
+						 .arg(tr("Probe"), -32)
+						 .arg(tr("Calls"), 9)
+						 .arg(tr("Total ms"), 11)
+						 .arg(tr("Avg ms"), 9)
+						 .arg(tr("Max ms"), 9));
+
+	for (const Instrumentation::Statistic &stat : stats) {
+		const QString name = QString::fromLatin1(stat.name);
+
+		switch (stat.type) {
+		case Instrumentation::ProbeType::Timer:
+			lines_.push_back(QStringLiteral("%1 %2 %3 %4 %5")
+								 .arg(name, -32)
+								 .arg(stat.calls, 9)
+								 .arg(milliseconds(stat.total), 11)
+								 .arg(milliseconds(stat.total / static_cast<int64_t>(stat.calls)), 9)
+								 .arg(milliseconds(stat.max), 9));
+			break;
+		case Instrumentation::ProbeType::Counter:
+			lines_.push_back(QStringLiteral("%1 %2 %3")
+								 .arg(name, -32)
+								 .arg(stat.calls, 9)
+								 .arg(stat.total, 11));
+			break;
+		}
+	}
+
+	if (Instrumentation::isTracing()) {
+		lines_.push_back(tr("Recording trace..."));
+	}
+
+	reposition();
+	update();
+}
+
+/**
+ * @brief PerformanceOverlay::paintEvent
+ * @param event
+ */
+void PerformanceOverlay::paintEvent(QPaintEvent *event) {
+	Q_UNUSED(event)
+
+	QPainter painter(this);
+	painter.fillRect(rect(), QColor(0, 0, 0, 180));
+	painter.setPen(Qt::white);
+
+	const QFontMetrics fm(font());
+
+	int y = Margin + fm.ascent();
+	for (const QString &line : lines_) {
+		painter.drawText(Margin, y, line);
+		y += fm.lineSpacing();
+	}
+}
@@ -0,0 +1,34 @@
+
+#ifndef PERFORMANCE_OVERLAY_H_
+#define PERFORMANCE_OVERLAY_H_
+
+#include <QStringList>
+#include <QTimer>
+#include <QWidget>
+
+/**
+ * @brief A translucent panel drawn over the top right corner of its parent,
+ * showing the numbers gathered by the instrumented code paths. It is
+ * refreshed twice a second and ignores all mouse input.
+ */
+class PerformanceOverlay : public QWidget {
+	Q_OBJECT
+
+public:
+	explicit PerformanceOverlay(QWidget *parent);
+	~PerformanceOverlay() override = default;
+
+protected:
+	bool eventFilter(QObject *object, QEvent *event) override;
+	void paintEvent(QPaintEvent *event) override;
+
+private:
+	void reposition();
+	void updateStatistics();
+
+private:
+	QTimer timer_;
+	QStringList lines_;
+};
+
+#endif
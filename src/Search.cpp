@@ -7,6 +7,7 @@
 #include "Regex.h"
 #include "TextBuffer.h"
 #include "TruncSubstitution.h"
+#include "Util/Instrumentation.h"
 #include "Util/String.h"
 #include "Util/algorithm.h"
 #include "Util/utils.h"
@@ -460,6 +461,8 @@ bool replaceUsingRegex(view::string_view searchStr, view::string_view replaceStr
 */
 boost::optional<std::string> Search::ReplaceAllInString(view::string_view inString, const QString &searchString, const QString &replaceString, SearchType searchType, int64_t *copyStart, int64_t *copyEnd, const QString &delimiters) {
 
+	INSTRUMENT_SCOPE("ReplaceAllInString");
+
 	Result searchResult;
 	int64_t lastEndPos;
 
@@ -528,6 +531,8 @@ boost::optional<std::string> Search::ReplaceAllInString(view::string_view inStri
 		return boost::none;
 	}
 
+	INSTRUMENT_COUNT("ReplaceAllInString replacements", nFound);
+
 	const int64_t copyLen = *copyEnd - *copyStart;
 
 	std::string outString;
@@ -600,6 +605,7 @@ boost::optional<std::string> Search::ReplaceAllInString(view::string_view inStri
  * @return
  */
 boost::optional<Search::Result> Search::SearchString(view::string_view string, const QString &searchString, Direction direction, SearchType searchType, WrapMode wrap, int64_t beginPos, const QString &delimiters) {
+	INSTRUMENT_SCOPE("SearchString");
 	return SearchStringEx(string, searchString.toStdString(), direction, searchType, wrap, beginPos, delimiters.isNull() ? nullptr : delimiters.toLatin1().data());
 }
 
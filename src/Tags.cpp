@@ -7,6 +7,7 @@
 #include "Search.h"
 #include "TextArea.h"
 #include "TextBuffer.h"
+#include "TagsIndex.h"
 #include "Util/FileSystem.h"
 #include "Util/Input.h"
 #include "Util/User.h"
@@ -15,13 +16,20 @@
 
 #include <QApplication>
 #include <QDir>
+#include <QEventLoop>
 #include <QFile>
 #include <QFileInfo>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #include <QRegularExpression>
 #include <QTextStream>
+#include <QThread>
+#include <QTimer>
+#include <QtConcurrentRun>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cctype>
 #include <cstdio>
 #include <cstdlib>
@@ -32,6 +40,7 @@
 #include <memory>
 #include <sstream>
 #include <unordered_map>
+#include <vector>
 
 #ifdef Q_OS_UNIX
 #include <sys/param.h>
@@ -41,19 +50,37 @@ namespace Tags {
 
 namespace {
 
-int loadTagsFile(const QString &tagSpec, int index, int recLevel);
+int parseTagsFile(const QString &tagSpec, int index, int recLevel, QMultiHash<QString, Tag> *table, std::atomic<qint64> *bytesRead = nullptr);
+void getIndexedTags(const QString &name, QList<Tag> &tags);
 QList<Tag> getUniqueTags(QList<Tag> &tags);
 
 struct CalltipAlias {
 	QString dest;
 	QString sources;
+	QString file;
+	QString path;
 };
 
-// Tag File Type
-enum TFT {
-	TFT_CHECK,
-	TFT_ETAGS,
-	TFT_CTAGS
+// the contents of a tags or calltips file, as parsed on a worker thread
+struct ParsedTagsFile {
+	QMultiHash<QString, Tag> tags;
+	std::vector<CalltipAlias> aliases; // calltips files only, resolved once merged
+	std::shared_ptr<TagsIndex> tagsIndex; // ctags files, which aren't parsed but indexed
+	int nTagsAdded = 0;
+};
+
+// how far the parse of a tags file has got, for the busy message
+struct LoadProgress {
+	std::atomic<qint64> bytesRead{0};
+	qint64 size = 0;
+};
+
+// a tags or calltips file which is being parsed in the background
+struct PendingLoad {
+	int index;
+	SearchMode mode;
+	QFuture<ParsedTagsFile> future;
+	std::shared_ptr<LoadProgress> progress; // tags files only
 };
 
 constexpr int MAX_LINE                        = 2048;
@@ -63,12 +90,31 @@ constexpr int MAX_TAG_INCLUDE_RECURSION_LEVEL = 5;
    (should probably be a language-dependent option, but...) */
 constexpr int TIP_DEFAULT_LINES = 4;
 
+// ctags files with more lines than this are parsed in parallel, in chunks of
+// this many lines
+constexpr int CTAGS_CHUNK_LINES = 16384;
+
 // used  in AddRelTagsFile and AddTagsFile
 int16_t tagFileIndex = 0;
 
 QMultiHash<QString, Tag> LoadedTags;
 QMultiHash<QString, Tag> LoadedTips;
 
+// ctags files are not loaded into LoadedTags, they are looked up on demand
+// through a persistent index instead
+struct IndexedTagsFile {
+	std::shared_ptr<TagsIndex> tagsIndex;
+	QString tagPath;
+	int index;
+};
+
+std::vector<IndexedTagsFile> IndexedTags;
+
+std::vector<PendingLoad> PendingLoads;
+
+// set while waitForLoad runs its event loop
+bool WaitingForLoad = false;
+
 // Check if a line has non-ws characters
 bool lineEmpty(const QString &line) {
 
@@ -91,7 +137,11 @@ QString rstrip(QString s) {
 
 QList<Tag> getTagFromTable(QMultiHash<QString, Tag> &table, const QString &name) {
 	auto tags = table.values(name);
-	tags      = getUniqueTags(tags);
+	if (&table == &LoadedTags) {
+		getIndexedTags(name, tags);
+	}
+
+	tags = getUniqueTags(tags);
 	return tags;
 }
 
@@ -104,10 +154,15 @@ int64_t moveAheadNLines(view::string_view str, int64_t &pos, int64_t n) {
 
 	int64_t i = n;
 	while (static_cast<size_t>(pos) != str.size() && n > 0) {
-		if (str[static_cast<size_t>(pos)] == '\n') {
-			--n;
+		const auto p = static_cast<size_t>(pos);
+		auto nl      = static_cast<const char *>(std::memchr(&str[p], '\n', str.size() - p));
+		if (!nl) {
+			pos = static_cast<int64_t>(str.size());
+			break;
 		}
-		++pos;
+
+		pos = (nl - str.data()) + 1;
+		--n;
 	}
 
 	if (n == 0) {
@@ -117,6 +172,119 @@ int64_t moveAheadNLines(view::string_view str, int64_t &pos, int64_t n) {
 	}
 }
 
+// text which may be in two pieces, such as the two sides of a buffer's gap
+using Segments = std::pair<view::string_view, view::string_view>;
+
+/*
+** Returns the character at <pos> of <text>.
+*/
+char charAt(const Segments &text, size_t pos) {
+	return (pos < text.first.size()) ? text.first[pos] : text.second[pos - text.first.size()];
+}
+
+/*
+** Finds <needle> in <text>, starting at <from> and going in direction <dir>,
+** as find and rfind would if the text were in one piece.
+** Returns view::string_view::npos if it isn't there.
+*/
+size_t findInSegments(const Segments &text, view::string_view needle, size_t from, Direction dir) {
+
+	const auto npos    = view::string_view::npos;
+	const size_t split = text.first.size();
+
+	// the matches which span the split are looked for in a copy of the text
+	// around it, starting at "joint"
+	const size_t joint = (split >= needle.size() - 1) ? split - (needle.size() - 1) : 0;
+	const std::string around = text.first.substr(joint).to_string() + text.second.substr(0, needle.size() - 1).to_string();
+
+	if (dir == Direction::Forward) {
+		if (from < split) {
+			const size_t pos = text.first.find(needle, from);
+			if (pos != npos) {
+				return pos;
+			}
+
+			const size_t aroundPos = around.find(needle.data(), from > joint ? from - joint : 0, needle.size());
+			if (aroundPos != npos) {
+				return joint + aroundPos;
+			}
+		}
+
+		const size_t pos = text.second.find(needle, from > split ? from - split : 0);
+		return (pos == npos) ? npos : split + pos;
+	}
+
+	if (from >= split) {
+		const size_t pos = text.second.rfind(needle, from - split);
+		if (pos != npos) {
+			return split + pos;
+		}
+	}
+
+	if (from >= joint) {
+		const size_t aroundPos = around.rfind(needle.data(), from - joint, needle.size());
+		if (aroundPos != npos && joint + aroundPos < split) {
+			return joint + aroundPos;
+		}
+	}
+
+	return text.first.rfind(needle, from);
+}
+
+/*
+** Nearly every ctags search expression is a complete source line with only
+** slashes escaped, /^text$/, so it can be found with a plain substring search
+** instead of being compiled into a regex. The text is searched where it is,
+** without being made contiguous. Returns false if the expression needs the
+** regex treatment, or if there is no exact match for it (a run of white
+** space may have been changed in the meantime).
+*/
+bool literalTagSearch(const Segments &buffer, const QString &searchString, Direction dir, int64_t *startPos, int64_t *endPos) {
+
+	// searchString[0] is / or ? --> search dir
+	QString text = searchString.mid(1);
+
+	const bool lineStart = text.startsWith(QLatin1Char('^'));
+	if (lineStart) {
+		text.remove(0, 1);
+	}
+
+	const bool lineEnd = text.endsWith(QLatin1Char('$'));
+	if (lineEnd) {
+		text.chop(1);
+	}
+
+	text.replace(QLatin1String("\\/"), QLatin1String("/"));
+
+	// any other escape or a DOS line end is left to fakeRegExSearch
+	if (text.isEmpty() || text.contains(QLatin1Char('\\')) || text.contains(QLatin1Char('\r'))) {
+		return false;
+	}
+
+	const std::string needle = text.toStdString();
+	const auto npos          = view::string_view::npos;
+	const size_t size        = buffer.first.size() + buffer.second.size();
+
+	size_t pos = findInSegments(buffer, needle, (dir == Direction::Forward) ? 0 : npos, dir);
+	while (pos != npos) {
+		const size_t end = pos + needle.size();
+
+		if ((!lineStart || pos == 0 || charAt(buffer, pos - 1) == '\n') && (!lineEnd || end == size || charAt(buffer, end) == '\n')) {
+			*startPos = static_cast<int64_t>(pos);
+			*endPos   = static_cast<int64_t>(end);
+			return true;
+		}
+
+		if (dir == Direction::Forward) {
+			pos = findInSegments(buffer, needle, pos + 1, dir);
+		} else {
+			pos = (pos == 0) ? npos : findInSegments(buffer, needle, pos - 1, dir);
+		}
+	}
+
+	return false;
+}
+
 /**
  * @brief hashTableByType
  * @param mode
@@ -153,10 +321,27 @@ std::deque<File> *tagListByType(SearchMode mode) {
 bool delTag(int index) {
 	int del = 0;
 
+	// a load still in progress is simply abandoned, its result is never merged
+	auto pending = std::remove_if(PendingLoads.begin(), PendingLoads.end(), [index](const PendingLoad &load) {
+		return load.index == index;
+	});
+
+	del += static_cast<int>(std::distance(pending, PendingLoads.end()));
+	PendingLoads.erase(pending, PendingLoads.end());
+
+	if (searchMode != SearchMode::TIP) {
+		auto it = std::remove_if(IndexedTags.begin(), IndexedTags.end(), [index](const IndexedTagsFile &file) {
+			return file.index == index;
+		});
+
+		del += static_cast<int>(std::distance(it, IndexedTags.end()));
+		IndexedTags.erase(it, IndexedTags.end());
+	}
+
 	QMultiHash<QString, Tag> *table = hashTableByType(searchMode);
 
 	if (table->isEmpty()) {
-		return false;
+		return del > 0;
 	}
 
 	for (auto it = table->begin(); it != table->end();) {
@@ -172,20 +357,31 @@ bool delTag(int index) {
 }
 
 /*
-** Scans one <line> from a ctags tags file (<index>) in tagPath.
-** Return value: Number of tag specs added.
+** Add a tag specification to <table>
+** Return Value: 1, this is used as a counter increment
+*/
+int insertTag(QMultiHash<QString, Tag> *table, const QString &name, const QString &file, size_t lang,
+			  const QString &search, int64_t posInf, const QString &path, int index) {
+
+	table->insert(name, Tag{name, file, search, path, lang, posInf, index});
+	return 1;
+}
+
+/*
+** Parses one <line> from a ctags tags file (<index>) in tagPath into <tag>.
+** Return value: true if the line is a tag spec.
 */
-int scanCTagsLine(const QString &line, const QString &tagPath, int index) {
+bool parseCTagsLine(const QString &line, const QString &tagPath, int index, Tag *tag) {
 
 	static const auto regex = QRegularExpression(QLatin1String(R"(^([^\t]+)\t([^\t]+)\t([^\n]+)$)"));
 
 	QRegularExpressionMatch match = regex.match(line);
 	if (!match.hasMatch()) {
-		return 0;
+		return false;
 	}
 
 	if (match.lastCapturedIndex() != 3) {
-		return 0;
+		return false;
 	}
 
 	QString name         = match.captured(1);
@@ -193,7 +389,7 @@ int scanCTagsLine(const QString &line, const QString &tagPath, int index) {
 	QString searchString = match.captured(3);
 
 	if (name.startsWith(QLatin1Char('!'))) {
-		return 0;
+		return false;
 	}
 
 	int pos;
@@ -238,14 +434,123 @@ int scanCTagsLine(const QString &line, const QString &tagPath, int index) {
 	}
 
 	// No ability to read language mode right now
-	return addTag(
-		name,
-		file,
-		PLAIN_LANGUAGE_MODE,
-		searchString,
-		pos,
-		tagPath,
-		index);
+	*tag = {name, file, searchString, tagPath, PLAIN_LANGUAGE_MODE, pos, index};
+	return true;
+}
+
+/*
+** Scans one <line> from a ctags tags file (<index>) in tagPath into <table>.
+** Return value: Number of tag specs added.
+*/
+int scanCTagsLine(const QString &line, const QString &tagPath, int index, QMultiHash<QString, Tag> *table) {
+
+	Tag tag;
+	if (!parseCTagsLine(line, tagPath, index, &tag)) {
+		return 0;
+	}
+
+	table->insert(tag.name, tag);
+	return 1;
+}
+
+/*
+** Scans the lines of a ctags tags file (<index>) in tagPath into <table>, as
+** they are read. The lines are collected into chunks which are scanned in
+** parallel into tables of their own, and merged in order. Only a few chunks
+** are in flight at a time, so the file never is in memory as a whole.
+*/
+class CTagsScanner {
+public:
+	CTagsScanner(QString tagPath, int index, QMultiHash<QString, Tag> *table)
+		: tagPath_(std::move(tagPath)), index_(index), table_(table), maxPending_(static_cast<size_t>(std::max(QThread::idealThreadCount(), 1)) * 2) {
+	}
+
+	CTagsScanner(const CTagsScanner &) = delete;
+	CTagsScanner &operator=(const CTagsScanner &) = delete;
+
+	~CTagsScanner() {
+		for (QFuture<QMultiHash<QString, Tag>> &chunk : pending_) {
+			chunk.waitForFinished();
+		}
+	}
+
+public:
+	void add(const QString &line) {
+		lines_.append(line);
+		if (lines_.size() < CTAGS_CHUNK_LINES) {
+			return;
+		}
+
+		if (pending_.size() >= maxPending_) {
+			mergeNext();
+		}
+
+		pending_.push_back(QtConcurrent::run([lines = std::move(lines_), tagPath = tagPath_, index = index_]() {
+			QMultiHash<QString, Tag> chunkTable;
+			for (const QString &line : lines) {
+				scanCTagsLine(line, tagPath, index, &chunkTable);
+			}
+
+			return chunkTable;
+		}));
+
+		lines_ = QStringList();
+	}
+
+	/*
+	** Waits for the chunks still being scanned, and scans what is left.
+	** Return value: Number of tag specs added.
+	*/
+	int finish() {
+		while (!pending_.empty()) {
+			mergeNext();
+		}
+
+		for (const QString &line : lines_) {
+			nTagsAdded_ += scanCTagsLine(line, tagPath_, index_, table_);
+		}
+
+		lines_.clear();
+		return nTagsAdded_;
+	}
+
+private:
+	void mergeNext() {
+		const QMultiHash<QString, Tag> chunkTable = pending_.front().result();
+		pending_.pop_front();
+
+		nTagsAdded_ += chunkTable.size();
+		table_->unite(chunkTable);
+	}
+
+private:
+	QString tagPath_;
+	int index_;
+	QMultiHash<QString, Tag> *table_;
+	size_t maxPending_;
+	QStringList lines_;
+	std::deque<QFuture<QMultiHash<QString, Tag>>> pending_;
+	int nTagsAdded_ = 0;
+};
+
+/*
+** Looks up <name> in the indexed ctags files and appends the tag specs found
+** to <tags>.
+*/
+void getIndexedTags(const QString &name, QList<Tag> &tags) {
+
+	const QByteArray key = name.toLocal8Bit();
+
+	for (const IndexedTagsFile &file : IndexedTags) {
+		const std::vector<QByteArray> lines = file.tagsIndex->lookup(key);
+
+		for (const QByteArray &line : lines) {
+			Tag tag;
+			if (parseCTagsLine(QString::fromLocal8Bit(line), file.tagPath, file.index, &tag)) {
+				tags.append(tag);
+			}
+		}
+	}
 }
 
 /*
@@ -254,7 +559,7 @@ int scanCTagsLine(const QString &line, const QString &tagPath, int index) {
  * file = destination definition file. possibly modified. len=MAXPATHLEN!
  * Return value: Number of tag specs added.
  */
-int scanETagsLine(const QString &line, const QString &tagPath, int index, QString &file, int recLevel) {
+int scanETagsLine(const QString &line, const QString &tagPath, int index, QString &file, int recLevel, QMultiHash<QString, Tag> *table) {
 
 	// check for destination file separator
 	if (line.startsWith(QLatin1Char('\014'))) { // <np>
@@ -274,7 +579,7 @@ int scanETagsLine(const QString &line, const QString &tagPath, int index, QStrin
 		int pos              = line.midRef(posCOM + 1).toInt();
 
 		// No ability to set language mode for the moment
-		return addTag(name, file, PLAIN_LANGUAGE_MODE, searchString, pos, tagPath, index);
+		return insertTag(table, name, file, PLAIN_LANGUAGE_MODE, searchString, pos, tagPath, index);
 	}
 
 	if (!file.isEmpty() && posDEL != -1 && (posCOM > posDEL)) {
@@ -302,7 +607,7 @@ int scanETagsLine(const QString &line, const QString &tagPath, int index, QStrin
 		QString name = searchString.mid(pos + 1, len - pos);
 		pos          = line.midRef(posCOM + 1).toInt();
 
-		return addTag(name, file, PLAIN_LANGUAGE_MODE, searchString, pos, tagPath, index);
+		return insertTag(table, name, file, PLAIN_LANGUAGE_MODE, searchString, pos, tagPath, index);
 	}
 
 	// check for destination file spec
@@ -316,9 +621,9 @@ int scanETagsLine(const QString &line, const QString &tagPath, int index, QStrin
 			if (!QFileInfo(file).isAbsolute()) {
 
 				QString incPath = NormalizePathname(tr("%1%2").arg(tagPath, file));
-				return loadTagsFile(incPath, index, recLevel + 1);
+				return parseTagsFile(incPath, index, recLevel + 1, table);
 			} else {
-				return loadTagsFile(file, index, recLevel + 1);
+				return parseTagsFile(file, index, recLevel + 1, table);
 			}
 		}
 	}
@@ -327,13 +632,28 @@ int scanETagsLine(const QString &line, const QString &tagPath, int index, QStrin
 }
 
 /*
-** Loads tagsFile into the hash table.
-** Returns the number of added tag specifications.
+** Returns true if tagsFile is a ctags file, which can be looked up through a
+** persistent index rather than loaded. This runs on a worker thread.
 */
-int loadTagsFile(const QString &tagSpec, int index, int recLevel) {
+bool isCTagsFile(const QString &tagsFile) {
+
+	QFile f(tagsFile);
+	if (!f.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	// the first character in the file decides if the file is an etags file
+	char firstChar;
+	return f.peek(&firstChar, 1) == 1 && firstChar != '\x0c';
+}
 
-	int nTagsAdded  = 0;
-	int tagFileType = TFT_CHECK;
+/*
+** Parses tagsFile into <table>, reading it a line at a time. This runs on a
+** worker thread, so it must only touch <table>, and <bytesRead>, which (if
+** not null) is advanced by the size of every line read.
+** Returns the number of added tag specifications.
+*/
+int parseTagsFile(const QString &tagSpec, int index, int recLevel, QMultiHash<QString, Tag> *table, std::atomic<qint64> *bytesRead) {
 
 	if (recLevel > MAX_TAG_INCLUDE_RECURSION_LEVEL) {
 		return 0;
@@ -355,37 +675,54 @@ int loadTagsFile(const QString &tagSpec, int index, int recLevel) {
 
 	const PathInfo tagPathInfo = parseFilename(resolvedTagsFile);
 
-	QString filename;
-
-	QTextStream stream(&f);
-
-	while (!stream.atEnd()) {
-		/* This might take a while if you have a huge tags file (like I do)..
-		   keep the windows up to date and post a busy cursor so the user
-		   doesn't think we died. */
-		MainWindow::allDocumentsBusy(tr("Loading tags file..."));
+	auto readLine = [&f, bytesRead](QString *line) {
+		QByteArray bytes = f.readLine();
+		if (bytes.isEmpty()) {
+			return false;
+		}
 
-		QString line = stream.readLine();
+		if (bytesRead) {
+			*bytesRead += bytes.size();
+		}
 
-		/* the first character in the file decides if the file is treat as
-		   etags or ctags file.
-		 */
-		if (tagFileType == TFT_CHECK) {
-			if (line.startsWith(0x0c)) { // <np>
-				tagFileType = TFT_ETAGS;
-			} else {
-				tagFileType = TFT_CTAGS;
-			}
+		if (bytes.endsWith('\n')) {
+			bytes.chop(1);
 		}
 
-		if (tagFileType == TFT_CTAGS) {
-			nTagsAdded += scanCTagsLine(line, tagPathInfo.pathname, index);
-		} else {
-			nTagsAdded += scanETagsLine(line, tagPathInfo.pathname, index, filename, recLevel);
+		if (bytes.endsWith('\r')) {
+			bytes.chop(1);
 		}
+
+		*line = QString::fromLocal8Bit(bytes);
+		return true;
+	};
+
+	QString line;
+	if (!readLine(&line)) {
+		return 0;
 	}
 
-	MainWindow::allDocumentsUnbusy();
+	/* the first character in the file decides if the file is treat as
+	   etags or ctags file.
+	 */
+	if (!line.startsWith(0x0c)) { // <np>
+		CTagsScanner scanner(tagPathInfo.pathname, index, table);
+		do {
+			scanner.add(line);
+		} while (readLine(&line));
+
+		return scanner.finish();
+	}
+
+	// etags files are a sequence of per source file sections, so they are
+	// scanned in order
+	int nTagsAdded = 0;
+	QString filename;
+
+	do {
+		nTagsAdded += scanETagsLine(line, tagPathInfo.pathname, index, filename, recLevel, table);
+	} while (readLine(&line));
+
 	return nTagsAdded;
 }
 
@@ -586,17 +923,18 @@ CalltipToken nextTFBlock(QTextStream &stream, QString &header, QString &body, in
 }
 
 /*
-** Load a calltips file and insert all of the entries into the global tips
-** database.  Each tip is essentially stored as its filename and the line
-** at which it appears--the exact same way ctags indexes source-code.  That's
-** why calltips and tags share so much code.
+** Parse a calltips file into <result>.  Each tip is essentially stored as its
+** filename and the line at which it appears--the exact same way ctags indexes
+** source-code.  That's why calltips and tags share so much code.
+** This runs on a worker thread, so language modes are looked up in
+** <languageNames> rather than in the preferences, and aliases are left for
+** mergeLoadedFile to resolve.
 */
-int loadTipsFile(const QString &tipsFile, int index, int recLevel) {
+int parseTipsFile(const QString &tipsFile, int index, int recLevel, const QStringList &languageNames, ParsedTagsFile *result) {
 
 	int currLine    = 0;
 	int nTipsAdded  = 0;
 	size_t langMode = PLAIN_LANGUAGE_MODE;
-	std::vector<CalltipAlias> aliases;
 
 	if (recLevel > MAX_TAG_INCLUDE_RECURSION_LEVEL) {
 		qWarning("NEdit: Warning: Reached recursion limit before loading calltips file:\n\t%s",
@@ -649,20 +987,21 @@ int loadTipsFile(const QString &tipsFile, int index, int recLevel) {
 				For the moment I'm just using line numbers because I don't
 				want to have to deal with adding escape characters for
 				regex metacharacters that might appear in the string */
-			nTipsAdded += addTag(header, resolvedTipsFile, langMode, QString(), blkLine, tipPathInfo.pathname, index);
+			nTipsAdded += insertTag(&result->tags, header, resolvedTipsFile, langMode, QString(), blkLine, tipPathInfo.pathname, index);
 			break;
 		case TF_INCLUDE: {
 			// nextTFBlock returns a colon-separated list of tips files in body
 			const QStringList segments = body.split(QLatin1Char(':'));
 
 			for (const QString &tipIncFile : segments) {
-				nTipsAdded += loadTipsFile(tipIncFile, index, recLevel + 1);
+				nTipsAdded += parseTipsFile(tipIncFile, index, recLevel + 1, languageNames, result);
 			}
 			break;
 		}
 		case TF_LANGUAGE: {
 			// Switch to the new language mode if it's valid, else ignore it.
-			const size_t oldLangMode = std::exchange(langMode, Preferences::FindLanguageMode(header));
+			const int mode           = languageNames.indexOf(header);
+			const size_t oldLangMode = std::exchange(langMode, mode == -1 ? PLAIN_LANGUAGE_MODE : static_cast<size_t>(mode));
 
 			if (langMode == PLAIN_LANGUAGE_MODE && header != QLatin1String("Plain")) {
 
@@ -679,35 +1018,211 @@ int loadTipsFile(const QString &tipsFile, int index, int recLevel) {
 					 qPrintable(resolvedTipsFile));
 			break;
 		case TF_ALIAS:
-			aliases.push_back({header, body});
+			result->aliases.push_back({header, body, resolvedTipsFile, tipPathInfo.pathname});
 			break;
 		default:
 			break; // Ignore TF_VERSION for now
 		}
 	}
 
-	// Now resolve any aliases
-	for (const CalltipAlias &alias : aliases) {
+	return nTipsAdded;
+}
+
+/*
+** Starts loading the tags or calltips file <filename> (<index>) in the
+** background. ctags files are not loaded but opened with their persistent
+** index, which is done in the background as well.
+** Returns false if the file can't be loaded.
+*/
+bool startLoading(const QString &filename, int index, SearchMode mode) {
+
+	if (mode == SearchMode::TIP) {
+		QStringList languageNames;
+		for (const LanguageMode &language : Preferences::LanguageModes) {
+			languageNames.append(language.name);
+		}
+
+		QFuture<ParsedTagsFile> future = QtConcurrent::run([filename, index, languageNames]() {
+			ParsedTagsFile result;
+			result.nTagsAdded = parseTipsFile(filename, index, 0, languageNames, &result);
+			return result;
+		});
+
+		PendingLoads.push_back({index, mode, future, nullptr});
+		return true;
+	}
+
+	const QString resolvedTagsFile = QFileInfo(filename).canonicalFilePath();
+	if (resolvedTagsFile.isEmpty()) {
+		return false;
+	}
+
+	// made here, so that it belongs to the GUI thread which uses it
+	auto tagsIndex = std::make_shared<TagsIndex>(resolvedTagsFile);
+
+	auto progress  = std::make_shared<LoadProgress>();
+	progress->size = QFileInfo(resolvedTagsFile).size();
+
+	QFuture<ParsedTagsFile> future = QtConcurrent::run([resolvedTagsFile, index, tagsIndex, progress]() {
+		ParsedTagsFile result;
+		if (isCTagsFile(resolvedTagsFile) && tagsIndex->open()) {
+			result.tagsIndex = tagsIndex;
+		} else {
+			result.nTagsAdded = parseTagsFile(resolvedTagsFile, index, 0, &result.tags, &progress->bytesRead);
+		}
+		return result;
+	});
+
+	PendingLoads.push_back({index, mode, future, progress});
+	return true;
+}
+
+/*
+** Waits for a background load to finish, keeping the windows up to date and
+** posting a busy cursor, so the user doesn't think we died. Tags files being
+** parsed show how much of them has been read so far.
+** Returns false, without waiting, if called from within another wait.
+*/
+bool waitForLoad(const PendingLoad &load, const QString &filename) {
+
+	const QFuture<ParsedTagsFile> &future = load.future;
+
+	if (future.isFinished()) {
+		return true;
+	}
+
+	if (WaitingForLoad) {
+		return false;
+	}
+
+	const std::shared_ptr<LoadProgress> progress = load.progress;
+
+	auto message = [&filename, progress]() {
+		if (!progress || progress->size <= 0 || progress->bytesRead == 0) {
+			return tr("Loading tags file %1...").arg(filename);
+		}
+
+		const qint64 percent = std::min<qint64>(progress->bytesRead * 100 / progress->size, 100);
+		return tr("Loading tags file %1 (%2%)...").arg(filename).arg(percent);
+	};
+
+	QEventLoop loop;
+	QTimer timer;
+	QFutureWatcher<ParsedTagsFile> watcher;
+
+	QObject::connect(&watcher, &QFutureWatcher<ParsedTagsFile>::finished, &loop, &QEventLoop::quit);
+	QObject::connect(&timer, &QTimer::timeout, [&message]() {
+		MainWindow::allDocumentsBusy(message());
+	});
+
+	MainWindow::allDocumentsBusy(message());
+
+	watcher.setFuture(future);
+	timer.start(100);
+
+	if (!future.isFinished()) {
+		WaitingForLoad = true;
+		loop.exec(QEventLoop::ExcludeUserInputEvents);
+		WaitingForLoad = false;
+	}
+
+	MainWindow::allDocumentsUnbusy();
+	return true;
+}
+
+/*
+** Merges a file parsed in the background into the tags or tips table, and
+** resolves the aliases of calltips files against the merged table. Indexed
+** ctags files are added to the indexed files instead.
+*/
+void mergeLoadedFile(const ParsedTagsFile &result, SearchMode mode, int index) {
+
+	if (result.tagsIndex) {
+		IndexedTags.push_back({result.tagsIndex, parseFilename(result.tagsIndex->tagsFilename()).pathname, index});
+		return;
+	}
+
+	QMultiHash<QString, Tag> *const table = (mode == SearchMode::TIP) ? &LoadedTips : &LoadedTags;
 
-		QList<Tag> tags = getTag(alias.dest, SearchMode::TIP);
+	table->unite(result.tags);
+
+	for (const CalltipAlias &alias : result.aliases) {
+
+		QList<Tag> tags = getTagFromTable(*table, alias.dest);
 
 		if (tags.isEmpty()) {
 			qWarning("NEdit: Can't find destination of alias \"%s\"\n"
 					 "in calltips file:\n   \"%s\"\n",
 					 qPrintable(alias.dest),
-					 qPrintable(resolvedTipsFile));
+					 qPrintable(alias.file));
 		} else {
 
 			const Tag &first_tag = tags[0];
 
 			QStringList segments = alias.sources.split(QLatin1Char(':'));
 			for (const QString &src : segments) {
-				addTag(src, resolvedTipsFile, first_tag.language, QString(), first_tag.posInf, tipPathInfo.pathname, index);
+				insertTag(table, src, alias.file, first_tag.language, QString(), first_tag.posInf, alias.path, index);
 			}
 		}
 	}
+}
 
-	return nTipsAdded;
+/*
+** Waits for the background loads of the files in <FileList> and merges them.
+** Loads of other files are left running.
+*/
+void finishLoading(std::deque<File> *FileList) {
+
+	// take the loads out of the list first, processing events while waiting
+	// may add or remove tags files
+	std::vector<std::pair<PendingLoad, QString>> loads;
+
+	for (const File &tf : *FileList) {
+		auto it = std::find_if(PendingLoads.begin(), PendingLoads.end(), [&tf](const PendingLoad &load) {
+			return load.index == tf.index;
+		});
+
+		if (it != PendingLoads.end()) {
+			loads.emplace_back(*it, tf.filename);
+			PendingLoads.erase(it);
+		}
+	}
+
+	for (const std::pair<PendingLoad, QString> &entry : loads) {
+		const PendingLoad &load = entry.first;
+
+		if (!waitForLoad(load, entry.second)) {
+			// leave it to the lookup which is already waiting
+			PendingLoads.push_back(load);
+			continue;
+		}
+
+		auto it = std::find_if(FileList->begin(), FileList->end(), [&load](const File &tf) {
+			return tf.index == load.index;
+		});
+
+		// the file was removed, or unloaded, while we were waiting
+		if (it == FileList->end() || !it->loaded) {
+			continue;
+		}
+
+		// ... or has been reloaded, the newer load replaces this one
+		const bool reloaded = std::any_of(PendingLoads.begin(), PendingLoads.end(), [&load](const PendingLoad &pending) {
+			return pending.index == load.index;
+		});
+
+		if (reloaded) {
+			continue;
+		}
+
+		const ParsedTagsFile result = load.future.result();
+		if (result.nTagsAdded == 0 && !result.tagsIndex) {
+			it->loaded = false;
+			continue;
+		}
+
+		mergeLoadedFile(result, load.mode, load.index);
+	}
 }
 
 int matchTagRec(QList<Tag> &tags, Tag &tag) {
@@ -807,12 +1322,7 @@ TipAlignMode globAlignMode;
 int addTag(const QString &name, const QString &file, size_t lang,
 		   const QString &search, int64_t posInf, const QString &path, int index) {
 
-	QMultiHash<QString, Tag> *const table = hashTableByType(searchMode);
-
-	Tag t = {name, file, search, path, lang, posInf, index};
-
-	table->insert(name, t);
-	return 1;
+	return insertTag(hashTableByType(searchMode), name, file, lang, search, posInf, path, index);
 }
 
 /*
@@ -877,6 +1387,9 @@ bool addRelTagsFile(const QString &tagSpec, const QString &windowPath, SearchMod
 			1 // NOTE(eteran): added just so there aren't any uninitialized members
 		};
 
+		// start parsing right away, so the first lookup rarely has to wait
+		tag.loaded = startLoading(tag.filename, tag.index, searchMode);
+
 		FileList->push_front(tag);
 		added = true;
 	}
@@ -952,6 +1465,9 @@ bool addTagsFile(const QString &tagSpec, SearchMode mode) {
 			++tagFileIndex,
 			1};
 
+		// start parsing right away, so the first lookup rarely has to wait
+		tag.loaded = startLoading(tag.filename, tag.index, searchMode);
+
 		FileList->push_front(tag);
 	}
 
@@ -1039,11 +1555,14 @@ QList<Tag> lookupTagFromList(std::deque<File> *FileList, const QString &name, Se
 	** Do this only as long as name != nullptr, not for sucessive calls
 	** to find multiple tags specs.
 	**
+	** A lookup made while another one is waiting for its files to load only
+	** sees what is loaded already.
+	**
 	*/
-	if (!name.isNull()) {
-		for (File &tf : *FileList) {
+	if (!name.isNull() && !WaitingForLoad) {
+		const SearchMode loadMode = (FileList == &TipsFileList) ? SearchMode::TIP : SearchMode::TAG;
 
-			int load_status;
+		for (File &tf : *FileList) {
 
 			if (tf.loaded) {
 
@@ -1064,13 +1583,7 @@ QList<Tag> lookupTagFromList(std::deque<File> *FileList, const QString &name, Se
 			}
 
 			// If we get here we have to try to (re-) load the tags file
-			if (FileList == &TipsFileList) {
-				load_status = loadTipsFile(tf.filename, tf.index, 0);
-			} else {
-				load_status = loadTagsFile(tf.filename, tf.index, 0);
-			}
-
-			if (load_status) {
+			if (startLoading(tf.filename, tf.index, loadMode)) {
 
 				QFileInfo fileInfo(tf.filename);
 				QDateTime timestamp = fileInfo.lastModified();
@@ -1088,6 +1601,9 @@ QList<Tag> lookupTagFromList(std::deque<File> *FileList, const QString &name, Se
 				tf.loaded = false;
 			}
 		}
+
+		// only wait for the files this lookup needs
+		finishLoading(FileList);
 	}
 
 	return getTag(name, mode);
@@ -1107,42 +1623,47 @@ QList<Tag> lookupTag(const QString &name, SearchMode mode) {
 	}
 }
 
+namespace {
+
 /*
-** ctags search expressions are literal strings with a search direction flag,
-** line starting "^" and ending "$" delimiters. This routine translates them
-** into NEdit compatible regular expressions and does the search.
-** Etags search expressions are plain literals strings, which
+** Works out from a tags file search expression, and in etags mode the
+** position in <startPos>, the direction of the search for it and where it
+** starts in a text of <size> characters.
+** Returns false if the search expression can't be used.
 */
-bool fakeRegExSearch(view::string_view buffer, const QString &searchString, int64_t *startPos, int64_t *endPos) {
+bool tagSearchStart(const QString &searchString, int64_t startPos, int64_t size, Direction *dir, int64_t *searchStartPos, bool *ctagsMode) {
 
 	if (searchString.isEmpty()) {
 		return false;
 	}
 
-	int64_t searchStartPos;
-	Direction dir;
-	bool ctagsMode;
-
-	view::string_view fileString = buffer;
-
 	// determine search direction and start position
-	if (*startPos != -1) { // etags mode!
-		dir            = Direction::Forward;
-		searchStartPos = *startPos;
-		ctagsMode      = false;
+	if (startPos != -1) { // etags mode!
+		*dir            = Direction::Forward;
+		*searchStartPos = startPos;
+		*ctagsMode      = false;
 	} else if (searchString.size() > 1 && searchString[0] == QLatin1Char('/')) {
-		dir            = Direction::Forward;
-		searchStartPos = 0;
-		ctagsMode      = true;
+		*dir            = Direction::Forward;
+		*searchStartPos = 0;
+		*ctagsMode      = true;
 	} else if (searchString.size() > 1 && searchString[0] == QLatin1Char('?')) {
-		dir            = Direction::Backward;
-		searchStartPos = static_cast<int64_t>(fileString.size());
-		ctagsMode      = true;
+		*dir            = Direction::Backward;
+		*searchStartPos = size;
+		*ctagsMode      = true;
 	} else {
 		qWarning("NEdit: Error parsing tag file search string");
 		return false;
 	}
 
+	return true;
+}
+
+/*
+** Translates a tags file search expression into an NEdit compatible regular
+** expression and searches <fileString> for it.
+*/
+bool regexTagSearch(view::string_view fileString, const QString &searchString, Direction dir, int64_t searchStartPos, bool ctagsMode, int64_t *startPos, int64_t *endPos) {
+
 	// Build the search regex.
 	QString searchSubs;
 	searchSubs.reserve(3 * MAX_LINE + 3);
@@ -1229,6 +1750,52 @@ bool fakeRegExSearch(view::string_view buffer, const QString &searchString, int6
 	}
 }
 
+}
+
+/*
+** ctags search expressions are literal strings with a search direction flag,
+** line starting "^" and ending "$" delimiters. This routine translates them
+** into NEdit compatible regular expressions and does the search.
+** Etags search expressions are plain literals strings, which
+*/
+bool fakeRegExSearch(view::string_view buffer, const QString &searchString, int64_t *startPos, int64_t *endPos) {
+
+	int64_t searchStartPos;
+	Direction dir;
+	bool ctagsMode;
+
+	if (!tagSearchStart(searchString, *startPos, static_cast<int64_t>(buffer.size()), &dir, &searchStartPos, &ctagsMode)) {
+		return false;
+	}
+
+	if (ctagsMode && literalTagSearch(Segments(buffer, view::string_view()), searchString, dir, startPos, endPos)) {
+		return true;
+	}
+
+	return regexTagSearch(buffer, searchString, dir, searchStartPos, ctagsMode, startPos, endPos);
+}
+
+/*
+** Same as above, for the text of <buffer>. The text isn't made contiguous
+** (which moves the buffer's gap) unless a regular expression is needed.
+*/
+bool fakeRegExSearch(TextBuffer *buffer, const QString &searchString, int64_t *startPos, int64_t *endPos) {
+
+	int64_t searchStartPos;
+	Direction dir;
+	bool ctagsMode;
+
+	if (!tagSearchStart(searchString, *startPos, buffer->length(), &dir, &searchStartPos, &ctagsMode)) {
+		return false;
+	}
+
+	if (ctagsMode && literalTagSearch(buffer->BufGetSegments(buffer->BufStartOfBuffer(), buffer->BufEndOfBuffer()), searchString, dir, startPos, endPos)) {
+		return true;
+	}
+
+	return regexTagSearch(buffer->BufAsString(), searchString, dir, searchStartPos, ctagsMode, startPos, endPos);
+}
+
 /*
 ** Show the calltip specified by tagFiles[i], tagSearch[i], tagPosInf[i]
 ** This reads from either a source code file (if searchMode == TIP_FROM_TAG)
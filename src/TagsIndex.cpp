@@ -0,0 +1,422 @@
+
+#include "TagsIndex.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrentRun>
+#include <QtDebug>
+
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// bump the version whenever the layout changes, old indexes are then rebuilt
+constexpr char IndexMagic[8] = {'N', 'E', 'T', 'A', 'G', 'S', '0', '1'};
+
+struct IndexHeader {
+	char magic[8];
+	quint64 tagsSize;
+	qint64 tagsModified;
+	quint64 count;
+};
+
+static_assert(sizeof(IndexHeader) == 32, "the index header must not contain padding");
+
+/**
+ * @brief tagName
+ * @param line
+ * @return the name of the tag on line, that is everything up to the first
+ * tab. Empty if line isn't a tag line
+ */
+view::string_view tagName(const QByteArray &line) {
+
+	const view::string_view text(line.constData(), static_cast<size_t>(line.size()));
+
+	// "!_TAG_..." pseudo tags aren't tags
+	if (text.empty() || text[0] == '!') {
+		return view::string_view();
+	}
+
+	const size_t tab = text.find('\t');
+	if (tab == view::string_view::npos) {
+		return view::string_view();
+	}
+
+	return text.substr(0, tab);
+}
+
+/**
+ * @brief chompLine
+ * @param line
+ *
+ * Removes the line terminator from line
+ */
+void chompLine(QByteArray *line) {
+	if (line->endsWith('\n')) {
+		line->chop(1);
+	}
+
+	if (line->endsWith('\r')) {
+		line->chop(1);
+	}
+}
+
+}
+
+/**
+ * @brief TagsIndex::TagsIndex
+ * @param tagsFile the canonical path of a ctags file
+ */
+TagsIndex::TagsIndex(QString tagsFile)
+	: tagsFilename_(std::move(tagsFile)), indexFilename_(indexFilename(tagsFilename_)) {
+}
+
+/**
+ * @brief TagsIndex::~TagsIndex
+ */
+TagsIndex::~TagsIndex() {
+	cancel_ = true;
+	build_.waitForFinished();
+}
+
+/**
+ * @brief TagsIndex::tagsFilename
+ * @return the tags file this is an index of
+ */
+const QString &TagsIndex::tagsFilename() const {
+	return tagsFilename_;
+}
+
+/**
+ * @brief TagsIndex::indexFilename
+ * @param tagsFile
+ * @return where the index for tagsFile lives
+ */
+QString TagsIndex::indexFilename(const QString &tagsFile) {
+	const QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+	const QByteArray hash  = QCryptographicHash::hash(tagsFile.toUtf8(), QCryptographicHash::Sha1);
+	return QStringLiteral("%1/nedit-ng/tags/%2.idx").arg(cacheDir, QString::fromLatin1(hash.toHex()));
+}
+
+/**
+ * @brief TagsIndex::open
+ * @return true if the tags file can be read. Lookups are served from the
+ * index if it is up to date, otherwise it is rebuilt in the background
+ *
+ * Doesn't read more than the header of the index, but may still block on the
+ * file system for a while, so it is meant to be called on a worker thread.
+ * The index must not be used by any other thread until it returns.
+ */
+bool TagsIndex::open() {
+
+	const QFileInfo info(tagsFilename_);
+	size_     = info.size();
+	modified_ = info.lastModified().toMSecsSinceEpoch();
+
+	if (size_ == 0) {
+		return false;
+	}
+
+	tagsFile_.setFileName(tagsFilename_);
+	if (!tagsFile_.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	if (mapIndex()) {
+		return true;
+	}
+
+	QDir().mkpath(QFileInfo(indexFilename_).absolutePath());
+
+	const QString tagsFile  = tagsFilename_;
+	const QString indexFile = indexFilename_;
+	const qint64 size       = size_;
+	const qint64 modified   = modified_;
+
+	build_ = QtConcurrent::run([tagsFile, size, modified, indexFile, this]() {
+		return buildIndex(tagsFile, size, modified, indexFile, cancel_);
+	});
+
+	building_ = true;
+
+	return true;
+}
+
+/**
+ * @brief TagsIndex::current
+ * @return true if the tags file still has the size and modification time it
+ * had when it was opened
+ */
+bool TagsIndex::current() const {
+	const QFileInfo info(tagsFilename_);
+	return info.size() == size_ && info.lastModified().toMSecsSinceEpoch() == modified_;
+}
+
+/**
+ * @brief TagsIndex::mapIndex
+ * @return true if the index file exists and matches the tags file. Only its
+ * header is checked here, the offsets are checked as they are used
+ */
+bool TagsIndex::mapIndex() {
+
+	unmapIndex();
+
+	indexFile_.setFileName(indexFilename_);
+	if (!indexFile_.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	IndexHeader header;
+	if (indexFile_.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)) {
+		indexFile_.close();
+		return false;
+	}
+
+	if (std::memcmp(header.magic, IndexMagic, sizeof(IndexMagic)) != 0 ||
+		header.tagsSize != static_cast<quint64>(size_) ||
+		header.tagsModified != modified_ ||
+		header.count > static_cast<quint64>(size_) ||
+		static_cast<quint64>(indexFile_.size()) != sizeof(header) + header.count * sizeof(quint64)) {
+		indexFile_.close();
+		return false;
+	}
+
+	const uchar *map = indexFile_.map(0, indexFile_.size());
+	if (!map) {
+		indexFile_.close();
+		return false;
+	}
+
+	offsets_ = reinterpret_cast<const quint64 *>(map + sizeof(header));
+	count_   = header.count;
+	indexed_ = true;
+	return true;
+}
+
+/**
+ * @brief TagsIndex::unmapIndex
+ */
+void TagsIndex::unmapIndex() {
+	// closing the file unmaps it
+	indexFile_.close();
+	offsets_ = nullptr;
+	count_   = 0;
+	indexed_ = false;
+}
+
+/**
+ * @brief TagsIndex::lineAt
+ * @param offset
+ * @param line
+ * @return true if a line of the tags file starts at offset, in which case
+ * it is read into line (without its line terminator)
+ */
+bool TagsIndex::lineAt(quint64 offset, QByteArray *line) {
+
+	if (offset >= static_cast<quint64>(size_)) {
+		return false;
+	}
+
+	if (offset != 0) {
+		char prev;
+		if (!tagsFile_.seek(static_cast<qint64>(offset - 1)) || !tagsFile_.getChar(&prev) || prev != '\n') {
+			return false;
+		}
+	} else if (!tagsFile_.seek(0)) {
+		return false;
+	}
+
+	*line = tagsFile_.readLine();
+	chompLine(line);
+	return true;
+}
+
+/**
+ * @brief TagsIndex::buildIndex
+ * @param tagsFile the tags file
+ * @param size the size of the tags file when it was opened
+ * @param modified the modification time of the tags file when it was opened
+ * @param indexFile where to write the index
+ * @param cancel set when the index is no longer wanted
+ * @return true if the index was written
+ *
+ * Runs on a worker thread, so it must not touch any TagsIndex members. The
+ * tags file is read a line at a time, only the names of the tags are kept
+ */
+bool TagsIndex::buildIndex(const QString &tagsFile, qint64 size, qint64 modified, const QString &indexFile, const std::atomic<bool> &cancel) {
+
+	QFile file(tagsFile);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	struct Entry {
+		quint64 offset;
+		size_t name; // into names
+		size_t length;
+	};
+
+	std::string names;
+	std::vector<Entry> entries;
+
+	quint64 offset = 0;
+	while (!file.atEnd()) {
+
+		if (cancel) {
+			return false;
+		}
+
+		const QByteArray line = file.readLine();
+		if (line.isEmpty()) {
+			return false;
+		}
+
+		const view::string_view name = tagName(line);
+		if (!name.empty()) {
+			entries.push_back({offset, names.size(), name.size()});
+			names.append(name.data(), name.size());
+		}
+
+		offset += static_cast<quint64>(line.size());
+	}
+
+	// the tags file changed while it was read, it is indexed again when it
+	// is reloaded
+	if (offset != static_cast<quint64>(size) || QFileInfo(tagsFile).lastModified().toMSecsSinceEpoch() != modified) {
+		return false;
+	}
+
+	const view::string_view allNames = names;
+
+	// stable, so that duplicate tags keep the order they have in the file
+	std::stable_sort(entries.begin(), entries.end(), [allNames](const Entry &lhs, const Entry &rhs) {
+		return allNames.substr(lhs.name, lhs.length) < allNames.substr(rhs.name, rhs.length);
+	});
+
+	if (cancel) {
+		return false;
+	}
+
+	QSaveFile index(indexFile);
+	if (!index.open(QIODevice::WriteOnly)) {
+		qWarning("NEdit: Could not create tags index %s", qPrintable(indexFile));
+		return false;
+	}
+
+	IndexHeader header;
+	std::memcpy(header.magic, IndexMagic, sizeof(IndexMagic));
+	header.tagsSize     = static_cast<quint64>(size);
+	header.tagsModified = modified;
+	header.count        = entries.size();
+
+	index.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+	std::vector<quint64> offsets;
+	offsets.reserve(entries.size());
+	for (const Entry &entry : entries) {
+		offsets.push_back(entry.offset);
+	}
+
+	index.write(reinterpret_cast<const char *>(offsets.data()), static_cast<qint64>(offsets.size() * sizeof(quint64)));
+
+	return index.commit();
+}
+
+/**
+ * @brief TagsIndex::lookup
+ * @param name
+ * @return the lines of the tags file defining name, in the order they appear
+ * in the file. Nothing if the tags file changed since it was opened, it has
+ * to be opened again then
+ */
+std::vector<QByteArray> TagsIndex::lookup(const QByteArray &name) {
+
+	// pick up an index which finished building since the last lookup
+	if (building_ && build_.isFinished()) {
+		building_ = false;
+		if (build_.result()) {
+			mapIndex();
+		}
+	}
+
+	if (!current()) {
+		return {};
+	}
+
+	const view::string_view key(name.constData(), static_cast<size_t>(name.size()));
+
+	if (!indexed_) {
+		return scanTags(key);
+	}
+
+	bool valid = true;
+	QByteArray line;
+
+	auto first = std::lower_bound(offsets_, offsets_ + count_, key, [this, &valid, &line](quint64 offset, view::string_view value) {
+		if (!valid || !lineAt(offset, &line)) {
+			valid = false;
+			return false;
+		}
+
+		return tagName(line) < value;
+	});
+
+	std::vector<QByteArray> lines;
+
+	for (auto it = first; valid && it != offsets_ + count_; ++it) {
+		if (!lineAt(*it, &line)) {
+			valid = false;
+			break;
+		}
+
+		if (tagName(line) != key) {
+			break;
+		}
+
+		lines.push_back(line);
+	}
+
+	// the index doesn't fit the tags file after all, it is rebuilt the next
+	// time the tags file is loaded
+	if (!valid) {
+		unmapIndex();
+		QFile::remove(indexFilename_);
+		return scanTags(key);
+	}
+
+	return lines;
+}
+
+/**
+ * @brief TagsIndex::scanTags
+ * @param name
+ * @return the lines of the tags file defining name, found by reading through
+ * the whole file. Used while the index is still being built
+ */
+std::vector<QByteArray> TagsIndex::scanTags(view::string_view name) {
+
+	std::vector<QByteArray> lines;
+
+	if (!tagsFile_.seek(0)) {
+		return lines;
+	}
+
+	while (!tagsFile_.atEnd()) {
+		QByteArray line = tagsFile_.readLine();
+		if (line.isEmpty()) {
+			break;
+		}
+
+		chompLine(&line);
+		if (tagName(line) == name) {
+			lines.push_back(line);
+		}
+	}
+
+	return lines;
+}
@@ -0,0 +1,68 @@
+
+#ifndef TAGS_INDEX_H_
+#define TAGS_INDEX_H_
+
+#include "Util/string_view.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QFuture>
+#include <QString>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief A persistent index over a ctags file.
+ *
+ * The index is a file in the user's cache directory holding the offsets of
+ * all tag lines of the tags file, sorted by tag name. The index is mapped, a
+ * lookup is a binary search over the mapped offsets which reads only the tag
+ * lines it compares against from the tags file. The tags file itself is
+ * never mapped or read whole: ctags rewrites tags files in place, and a
+ * mapping of a file which shrinks faults when it is touched. The index is
+ * only ever replaced as a whole (by renaming a new one over it), so a
+ * mapping of it stays valid.
+ *
+ * The index is tied to the size and modification time of the tags file,
+ * which are checked again before every lookup. When the index is missing or
+ * stale it is rebuilt on a worker thread; lookups made in the meantime scan
+ * the tags file.
+ */
+class TagsIndex {
+public:
+	explicit TagsIndex(QString tagsFile);
+	TagsIndex(const TagsIndex &) = delete;
+	TagsIndex &operator=(const TagsIndex &) = delete;
+	~TagsIndex();
+
+public:
+	bool open();
+	std::vector<QByteArray> lookup(const QByteArray &name);
+	const QString &tagsFilename() const;
+
+private:
+	static bool buildIndex(const QString &tagsFile, qint64 size, qint64 modified, const QString &indexFile, const std::atomic<bool> &cancel);
+	static QString indexFilename(const QString &tagsFile);
+	bool current() const;
+	bool lineAt(quint64 offset, QByteArray *line);
+	bool mapIndex();
+	void unmapIndex();
+	std::vector<QByteArray> scanTags(view::string_view name);
+
+private:
+	QString tagsFilename_;
+	QString indexFilename_;
+	QFile tagsFile_;
+	QFile indexFile_;
+	const quint64 *offsets_ = nullptr;
+	size_t count_           = 0;
+	bool indexed_           = false;
+	qint64 size_            = 0;
+	qint64 modified_        = 0;
+	QFuture<bool> build_;
+	bool building_ = false;
+	std::atomic<bool> cancel_{false};
+};
+
+#endif
@@ -7,6 +7,7 @@
 #include "DragStates.h"
 #include "Font.h"
 #include "Highlight.h"
+#include "InputLatency.h"
 #include "LanguageMode.h"
 #include "LineNumberArea.h"
 #include "Preferences.h"
@@ -15,6 +16,7 @@
 #include "TextAreaMimeData.h"
 #include "TextBuffer.h"
 #include "TextEditEvent.h"
+#include "Util/Instrumentation.h"
 #include "X11Colors.h"
 
 #include <QApplication>
@@ -83,6 +85,17 @@ QString asciiToUnicode(view::string_view string) {
 	return s;
 }
 
+/**
+ * @brief segmentAt
+ * @param segments text as returned by BufGetSegments
+ * @param index
+ * @return the character at "index", counting from the start of the first
+ * segment on into the second
+ */
+char segmentAt(const std::pair<view::string_view, view::string_view> &segments, size_t index) {
+	return (index < segments.first.size()) ? segments.first[index] : segments.second[index - segments.first.size()];
+}
+
 constexpr int DefaultVMargin     = 2;
 constexpr int DefaultHMargin     = 2;
 constexpr int DefaultCursorWidth = 2;
@@ -963,7 +976,20 @@ void TextArea::verticalScrollBar_valueChanged(int value) {
  * @param value
  */
 void TextArea::horizontalScrollBar_valueChanged(int value) {
-	Q_UNUSED(value)
+
+	/* The width of very long lines is only estimated until they have been
+	 * displayed (see measureVisLine). When scrolled all the way to the right,
+	 * measure them a bit past the edge of the window, so that what follows
+	 * can be scrolled to */
+	if (value == horizontalScrollBar()->maximum() && fixedFontWidth_ > 0) {
+		const int64_t rightColumn = (value + viewport()->contentsRect().width()) / fixedFontWidth_;
+
+		for (int i = 0; i < nVisibleLines_ && lineStarts_[i] != -1; i++) {
+			buffer_->BufColumnCheckpoint(lineStarts_[i], visLineLength(i), rightColumn + DisplayColumnCache::Interval);
+		}
+
+		updateHScrollBarRange();
+	}
 
 	// NOTE(eteran): the original code seemed to do some cleverness
 	//               involving copying the parts that were "moved"
@@ -1115,6 +1141,19 @@ void TextArea::keyPressEvent(QKeyEvent *event) {
 		return;
 	}
 
+	InputLatency::keyPressed(document_);
+
+	// nothing is painted for a key which moves nothing, don't wait for it
+	const TextCursor cursorPos = cursorPos_;
+	const int topLineNum       = topLineNum_;
+	const int horizOffset      = horizontalScrollBar()->value();
+
+	auto _ = gsl::finally([this, cursorPos, topLineNum, horizOffset]() {
+		if (InputLatency::inProgress()) {
+			InputLatency::keyHandled(cursorPos_ != cursorPos || topLineNum_ != topLineNum || horizontalScrollBar()->value() != horizOffset);
+		}
+	});
+
 	auto it = std::find_if(std::begin(inputHandlers), std::end(inputHandlers), [event](const InputHandler &handler) {
 		return handler.key == event->key() && handler.modifiers == event->modifiers();
 	});
@@ -1355,6 +1394,16 @@ void TextArea::mouseReleaseEvent(QMouseEvent *event) {
  */
 void TextArea::paintEvent(QPaintEvent *event) {
 
+	INSTRUMENT_SCOPE("TextArea::paintEvent");
+
+	auto _ = gsl::finally([this]() {
+		if (InputLatency::inProgress()) {
+			InputLatency::painted(document_);
+		}
+	});
+
+	const InputLatency::StageTimer timer(InputLatency::Stage::Paint);
+
 	const QRect viewRect = viewport()->contentsRect();
 	const QRect rect     = event->rect();
 	const int top        = rect.top();
@@ -2518,6 +2567,14 @@ int TextArea::measureVisLine(int visLineNum) const {
 	const int lineLen             = visLineLength(visLineNum);
 	const TextCursor lineStartPos = lineStarts_[visLineNum];
 
+	/* Don't measure very long lines character by character after every edit,
+	 * use what is already known about them instead. The estimate can only be
+	 * short of the real width, by the tabs and control characters in the part
+	 * which hasn't been displayed yet */
+	if (lineLen >= DisplayColumnCache::Interval) {
+		return lengthToWidth(static_cast<int>(buffer_->BufEstimateLineWidth(lineStartPos, lineLen)));
+	}
+
 	for (int i = 0; i < lineLen; i++) {
 		char expandedChar[TextBuffer::MAX_EXP_CHAR_LEN];
 		const int len = buffer_->BufGetExpandedChar(lineStartPos + i, charCount, expandedChar);
@@ -2735,6 +2792,8 @@ void TextArea::redisplayLine(int visLineNum, int leftCharIndex, int rightCharInd
 */
 void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, int rightClip) {
 
+	INSTRUMENT_SCOPE("TextArea::redisplayLine");
+
 	/* Space beyond the end of the line is still counted in units of characters
 	 * of a standardized character width (this is done mostly because style
 	 * changes based on character position can still occur in this region due
@@ -2769,17 +2828,8 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 	// get buffer position of the line to display
 	const TextCursor lineStartPos = lineStarts_[visLineNum];
 
-	// get a copy of the current line (or an empty string)
-	const std::string currentLine = [&]() {
-		std::string ret;
-		if (lineStartPos != -1) {
-			const int length = visLineLength(visLineNum);
-			ret              = buffer_->BufGetRange(lineStartPos, lineStartPos + length);
-		}
-		return ret;
-	}();
-
-	const size_t lineSize = currentLine.size();
+	// get the length of the line, without copying it
+	const size_t lineSize = (lineStartPos != -1) ? static_cast<size_t>(visLineLength(visLineNum)) : 0;
 
 	/* Rectangular selections are based on "real" line starts (after a newline
 	   or start of buffer).  Calculate the difference between the last newline
@@ -2795,29 +2845,33 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 			   buffer_->highlight.rangeTouchesRectSel(rangeStart, rangeEnd);
 	};
 
-	if (continuousWrap_ && rangeTouchesRectSel(lineStartPos, lineStartPos + currentLine.size())) {
+	if (continuousWrap_ && rangeTouchesRectSel(lineStartPos, lineStartPos + lineSize)) {
 		dispIndexOffset = buffer_->BufCountDispChars(buffer_->BufStartOfLine(lineStartPos), lineStartPos);
 	}
 
-	/* Step through character positions from the beginning of the line (even if
-	 * that's off the left edge of the displayed area) to find the first
-	 * character position that's not clipped, and the x coordinate for drawing
-	 * that character */
-	const int tabDist = buffer_->BufGetTabDistance();
-	int startX        = viewRect.left() - horizontalScrollBar()->value();
-	int outIndex      = 0;
-	size_t startIndex = 0;
-	uint32_t style    = 0;
+	/* Step through character positions to find the first character position
+	 * that's not clipped, and the x coordinate for drawing that character.
+	 * On very long lines, the scan starts from the closest known column before
+	 * the left edge of the displayed area rather than from the beginning of
+	 * the line */
+	const int tabDist  = buffer_->BufGetTabDistance();
+	const int lineLeft = viewRect.left() - horizontalScrollBar()->value();
+
+	const DisplayColumnCache::Checkpoint checkpoint = buffer_->BufColumnCheckpoint(
+		lineStartPos,
+		static_cast<int64_t>(lineSize),
+		(leftClip - lineLeft + fixedFontWidth_ - 1) / fixedFontWidth_);
+
+	int startX        = lineLeft + lengthToWidth(static_cast<int>(checkpoint.column));
+	int outIndex      = static_cast<int>(checkpoint.column);
+	size_t startIndex = static_cast<size_t>(checkpoint.offset);
 
 	for (;;) {
-		int charLen   = 1;
-		char baseChar = '\0';
+		int charLen = 1;
 		if (startIndex < lineSize) {
-			baseChar = currentLine[startIndex];
-			charLen  = TextBuffer::BufCharWidth(baseChar, outIndex, tabDist);
+			charLen = TextBuffer::BufCharWidth(buffer_->BufGetCharacter(lineStartPos + startIndex), outIndex, tabDist);
 		}
 
-		style               = styleOfPos(lineStartPos, lineSize, startIndex, dispIndexOffset + outIndex, baseChar);
 		const int charWidth = (startIndex >= lineSize) ? fixedFontWidth_ : lengthToWidth(charLen);
 
 		if (startX + charWidth >= leftClip) {
@@ -2829,6 +2883,20 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 		++startIndex;
 	}
 
+	/* Only look at the part of the line which can be seen, every character is
+	 * at least one column wide. It is read in place, without moving the gap
+	 * of the buffer, since styleOfPos may have to parse more of the text */
+	const auto visibleColumns = static_cast<size_t>(std::max((rightClip - startX) / fixedFontWidth_ + 2, 0));
+	const size_t windowEnd    = std::min(lineSize, startIndex + std::min<size_t>(visibleColumns, MAX_DISP_LINE_LEN));
+
+	const std::pair<view::string_view, view::string_view> visibleText = (startIndex < windowEnd) ? buffer_->BufGetSegments(lineStartPos + startIndex, lineStartPos + windowEnd) : std::pair<view::string_view, view::string_view>();
+
+	auto charAt = [&](size_t index) {
+		return (index < windowEnd) ? segmentAt(visibleText, index - startIndex) : buffer_->BufGetCharacter(lineStartPos + index);
+	};
+
+	uint32_t style = styleOfPos(lineStartPos, lineSize, startIndex, dispIndexOffset + outIndex, (startIndex < lineSize) ? charAt(startIndex) : '\0');
+
 	/* Scan character positions from the beginning of the clipping range, and
 	 * draw parts whenever the style changes (also note if the cursor is on
 	 * this line, and where it should be drawn to take advantage of the x
@@ -2855,7 +2923,7 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 		int charLen   = 1;
 
 		if (charIndex < lineSize) {
-			baseChar = currentLine[charIndex];
+			baseChar = charAt(charIndex);
 			charLen  = TextBuffer::BufExpandCharacter(baseChar, outIndex, expandedChar, tabDist);
 		}
 
@@ -2866,7 +2934,7 @@ void TextArea::redisplayLine(QPainter *painter, int visLineNum, int leftClip, in
 			/* NOTE(eteran): this double check of the style is necessary to make
 			 * certain types of selections work correctly
 			 */
-			if (i != 0 && charIndex < lineSize && currentLine[charIndex] == '\t') {
+			if (i != 0 && baseChar == '\t') {
 				charStyle = styleOfPos(lineStartPos, lineSize, charIndex, dispIndexOffset + outIndex, '\t');
 			}
 
@@ -3694,8 +3762,8 @@ bool TextArea::positionToXY(TextCursor pos, int *x, int *y) const {
 		return true;
 	}
 
-	const int lineLen         = visLineLength(visLineNum);
-	const std::string lineStr = buffer_->BufGetRange(lineStartPos, lineStartPos + lineLen);
+	const int lineLen                                             = visLineLength(visLineNum);
+	const std::pair<view::string_view, view::string_view> lineStr = buffer_->BufGetSegments(lineStartPos, lineStartPos + lineLen);
 
 	/* Step through character positions from the beginning of the line
 	   to "pos" to calculate the x coordinate */
@@ -3705,7 +3773,7 @@ bool TextArea::positionToXY(TextCursor pos, int *x, int *y) const {
 	for (int charIndex = 0; charIndex < pos - lineStartPos; charIndex++) {
 
 		const int charLen = TextBuffer::BufCharWidth(
-			lineStr[static_cast<size_t>(charIndex)],
+			segmentAt(lineStr, static_cast<size_t>(charIndex)),
 			outIndex,
 			tabDistance);
 
@@ -4203,6 +4271,8 @@ bool TextArea::checkReadOnly() const {
 */
 void TextArea::TextInsertAtCursor(view::string_view chars, bool allowPendingDelete, bool allowWrap) {
 
+	const InputLatency::StageTimer timer(InputLatency::Stage::Insert);
+
 	const QRect viewRect = viewport()->contentsRect();
 	const int fontWidth  = fixedFontWidth_;
 
@@ -5436,8 +5506,8 @@ TextCursor TextArea::xyToPos(int x, int y, PositionType posType) const {
 	}
 
 	// Get the line text and its length
-	int64_t lineLen     = visLineLength(visLineNum);
-	std::string lineStr = buffer_->BufGetRange(lineStart, lineStart + lineLen);
+	int64_t lineLen                                               = visLineLength(visLineNum);
+	const std::pair<view::string_view, view::string_view> lineStr = buffer_->BufGetSegments(lineStart, lineStart + lineLen);
 
 	/* Step through character positions from the beginning of the line
 	   to find the character position corresponding to the x coordinate */
@@ -5446,7 +5516,7 @@ TextCursor TextArea::xyToPos(int x, int y, PositionType posType) const {
 	const int tabDistance = buffer_->BufGetTabDistance();
 	for (int64_t charIndex = 0; charIndex < lineLen; charIndex++) {
 
-		const int charLen       = TextBuffer::BufCharWidth(lineStr[charIndex], outIndex, tabDistance);
+		const int charLen       = TextBuffer::BufCharWidth(segmentAt(lineStr, static_cast<size_t>(charIndex)), outIndex, tabDistance);
 		const int64_t charWidth = lengthToWidth(charLen);
 
 		if (x < xStep + (posType == PositionType::Cursor ? charWidth / 2 : charWidth)) {
@@ -7432,11 +7502,11 @@ TextCursor TextArea::lineAndColToPosition(Location loc) const {
 		int charLen = 0;
 
 		// Count columns, expanding each character
-		const std::string lineStr = buffer_->BufGetRange(lineStart, lineEnd);
-		int outIndex              = 0;
+		const std::pair<view::string_view, view::string_view> lineStr = buffer_->BufGetSegments(lineStart, lineEnd);
+		int outIndex                                                  = 0;
 		for (TextCursor cur = lineStart; cur < lineEnd; ++cur, ++charIndex) {
 
-			charLen = TextBuffer::BufCharWidth(lineStr[charIndex], outIndex, buffer_->BufGetTabDistance());
+			charLen = TextBuffer::BufCharWidth(segmentAt(lineStr, static_cast<size_t>(charIndex)), outIndex, buffer_->BufGetTabDistance());
 
 			if (outIndex + charLen >= loc.column) {
 				break;
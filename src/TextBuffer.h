@@ -2,6 +2,7 @@
 #ifndef TEXT_BUFFER_H_
 #define TEXT_BUFFER_H_
 
+#include "DisplayColumnCache.h"
 #include "TextBufferFwd.h"
 #include "TextCursor.h"
 #include "TextRange.h"
@@ -14,6 +15,7 @@
 #include <deque>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include <boost/optional.hpp>
 
@@ -41,6 +43,12 @@ private:
 	 */
 	static constexpr int PreferredGapSize = 80;
 
+	/* Most edits remembered for BufRebase. A snapshot held on to for longer
+	 * than that can't be rebased anymore, so that a forgotten one doesn't
+	 * make the buffer log every edit for good
+	 */
+	static constexpr size_t MaxRecordedEdits = 4096;
+
 public:
 	/* Maximum length in characters of a tab or control character expansion
 	 * of a single buffer character
@@ -82,6 +90,37 @@ public:
 		int64_t rectEnd_   = 0;     // Indent of right edge of rect. selection
 	};
 
+	/* An immutable copy of the text as it was at some version of the buffer,
+	 * which worker threads can read while the buffer goes on changing. Copies
+	 * of a snapshot share the text, and so do snapshots taken at the same
+	 * version. Positions worked out from it can be carried over to the buffer
+	 * with BufRebase, for as long as the snapshot is kept. Taking one copies
+	 * the whole text, so it is meant for work which is worth handing off to
+	 * another thread, not for every edit
+	 */
+	class Snapshot {
+		template <class CharT, class Traits>
+		friend class BasicTextBuffer;
+
+	public:
+		Snapshot() = default;
+
+	private:
+		Snapshot(std::shared_ptr<const string_type> text, uint64_t version)
+			: text_(std::move(text)), version_(version) {
+		}
+
+	public:
+		bool isNull() const noexcept { return !text_; }
+		int64_t length() const noexcept { return text_ ? static_cast<int64_t>(text_->size()) : 0; }
+		uint64_t version() const noexcept { return version_; }
+		view_type text() const noexcept { return text_ ? view_type(*text_) : view_type(); }
+
+	private:
+		std::shared_ptr<const string_type> text_;
+		uint64_t version_ = 0;
+	};
+
 public:
 	BasicTextBuffer();
 	explicit BasicTextBuffer(int64_t size);
@@ -98,6 +137,12 @@ public:
 	Ch front() const noexcept;
 	Ch back() const noexcept;
 
+public:
+	boost::optional<TextCursor> BufRebase(TextCursor pos, uint64_t version) const noexcept;
+	boost::optional<TextRange> BufRebase(TextRange range, uint64_t version) const noexcept;
+	Snapshot BufSnapshot();
+	uint64_t BufVersion() const noexcept;
+
 public:
 	bool BufGetEmptySelectionPos(TextCursor *start, TextCursor *end, bool *isRect, int64_t *rectStart, int64_t *rectEnd) const noexcept;
 	bool BufGetSelectionPos(TextCursor *start, TextCursor *end, bool *isRect, int64_t *rectStart, int64_t *rectEnd) const noexcept;
@@ -106,11 +151,13 @@ public:
 	bool BufGetUseTabs() const noexcept;
 	bool BufIsEmpty() const noexcept;
 	bool BufSetSyncXSelection(bool sync);
+	DisplayColumnCache::Checkpoint BufColumnCheckpoint(TextCursor lineStartPos, int64_t lineLength, int64_t column) const noexcept;
 	boost::optional<TextCursor> searchBackward(TextCursor startPos, view_type searchChars) const noexcept;
 	boost::optional<TextCursor> searchForward(TextCursor startPos, view_type searchChars) const noexcept;
 	Ch BufGetCharacter(TextCursor pos) const noexcept;
 	int64_t BufCountDispChars(TextCursor lineStartPos, TextCursor targetPos) const noexcept;
 	int64_t BufCountLines(TextCursor startPos, TextCursor endPos) const noexcept;
+	int64_t BufEstimateLineWidth(TextCursor lineStartPos, int64_t lineLength) const noexcept;
 	int64_t length() const noexcept;
 	int compare(TextCursor pos, Ch ch) const noexcept;
 	int compare(TextCursor pos, Ch *cmpText, int64_t size) const noexcept;
@@ -120,6 +167,7 @@ public:
 	string_type BufGetAll() const;
 	string_type BufGetRange(TextCursor start, TextCursor end) const;
 	string_type BufGetRange(TextRange range) const;
+	std::pair<view_type, view_type> BufGetSegments(TextCursor start, TextCursor end) const noexcept;
 	string_type BufGetSecSelectText() const;
 	string_type BufGetSelectionText() const;
 	string_type BufGetTextInRect(TextCursor start, TextCursor end, int64_t rectStart, int64_t rectEnd) const;
@@ -132,6 +180,7 @@ public:
 	TextCursor BufEndOfBuffer() const noexcept;
 	constexpr TextCursor BufStartOfBuffer() const noexcept { return {}; }
 	view_type BufAsString() noexcept;
+	view_type BufGetRangeView(TextCursor start, TextCursor end) noexcept;
 	void BufAddHighPriorityModifyCB(modify_callback_type bufModifiedCB, void *user);
 	void BufAddModifyCB(modify_callback_type bufModifiedCB, void *user);
 	void BufAddPreDeleteCB(pre_delete_callback_type bufPreDeleteCB, void *user);
@@ -184,10 +233,10 @@ private:
 	void callModifyCBs(TextCursor pos, int64_t nDeleted, int64_t nInserted, int64_t nRestyled, view_type deletedText) const noexcept;
 	void callPreDeleteCBs(TextCursor pos, int64_t nDeleted) const noexcept;
 	void deleteRange(TextCursor start, TextCursor end) noexcept;
-	void deleteRect(TextCursor start, TextCursor end, int64_t rectStart, int64_t rectEnd, int64_t *replaceLen, TextCursor *endPos);
+	bool isLongLine(TextCursor lineStartPos) const noexcept;
+	const DisplayColumnCache::Line &measureColumns(TextCursor lineStartPos, int64_t maxOffset, int64_t maxColumn) const noexcept;
 	void findRectSelBoundariesForCopy(TextCursor lineStartPos, int64_t rectStart, int64_t rectEnd, TextCursor *selStart, TextCursor *selEnd) const noexcept;
-	void insertCol(int64_t column, TextCursor startPos, view_type insText, int64_t *nDeleted, int64_t *nInserted, TextCursor *endPos);
-	void overlayRect(TextCursor startPos, int64_t rectStart, int64_t rectEnd, view_type insText, int64_t *nDeleted, int64_t *nInserted, TextCursor *endPos);
+	void recordEdit(TextCursor pos, int64_t nDeleted, int64_t nInserted) noexcept;
 	void redisplaySelection(const Selection &oldSelection, Selection *newSelection) const noexcept;
 	void removeSelected(const Selection *sel) noexcept;
 	void replaceSelected(Selection *sel, view_type text) noexcept;
@@ -196,9 +245,11 @@ private:
 	void updatePrimarySelection() noexcept;
 
 private:
-	static string_type unexpandTabs(view_type text, int64_t startIndent, int tabDist);
-	static string_type expandTabs(view_type text, int64_t startIndent, int tabDist);
-	static string_type realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs) noexcept;
+	static void unexpandTabs(string_type *str, size_t first, int64_t startIndent, int tabDist) noexcept;
+	static void expandTabs(view_type text, int64_t startIndent, int tabDist, string_type *outStr);
+	static void realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs, string_type *outStr);
+	static string_type realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs);
+	static view_type nextLine(view_type text, size_t *pos) noexcept;
 	static void insertColInLine(view_type line, view_type insLine, int64_t column, int insWidth, int tabDist, bool useTabs, string_type *outStr, int64_t *endOffset) noexcept;
 	static void deleteRectFromLine(view_type line, int64_t rectStart, int64_t rectEnd, int tabDist, bool useTabs, string_type *outStr, int64_t *endOffset) noexcept;
 	static int textWidth(view_type text, int tabDist) noexcept;
@@ -209,8 +260,8 @@ private:
 	template <class Out>
 	static int addPadding(Out out, int64_t startIndent, int64_t toIndent, int tabDist, bool useTabs) noexcept;
 
-	template <class Ran>
-	static string_type copyLine(Ran first, Ran last);
+	template <class LineEdit>
+	void rewriteLines(TextCursor start, TextCursor end, int64_t nLines, view_type insText, LineEdit editLine, int64_t *nDeleted, int64_t *nInserted);
 
 private:
 	TextCursor cursorPosHint_ = {};              // hint for reasonable cursor position after a buffer modification operation
@@ -218,9 +269,24 @@ private:
 	bool useTabs_             = true;            // true if buffer routines are allowed to use tabs for padding in rectangular operations
 	bool syncXSelection_      = true;
 
+private:
+	mutable DisplayColumnCache columnCache_; // where the display columns of long lines are, to avoid rescanning them from the start
+
 private:
 	gap_buffer<Ch> buffer_;
 
+private:
+	struct Edit {
+		TextCursor pos;
+		int64_t nDeleted;
+		int64_t nInserted;
+	};
+
+	uint64_t version_   = 0;                                                      // incremented by every change to the text
+	uint64_t editsBase_ = 0;                                                      // the version edits_ starts from
+	std::deque<Edit> edits_;                                                      // changes since the oldest snapshot which may still be in use
+	std::deque<std::pair<uint64_t, std::weak_ptr<const string_type>>> snapshots_; // versions and texts of the snapshots handed out, oldest first
+
 private:
 	std::deque<std::pair<pre_delete_callback_type, void *>> preDeleteProcs_; // procedures to call before text is deleted from the buffer; at most one is supported.
 	std::deque<std::pair<modify_callback_type, void *>> modifyProcs_;        // procedures to call when buffer is modified to redisplay contents
@@ -2,12 +2,15 @@
 #ifndef TEXT_BUFFER_TCC_
 #define TEXT_BUFFER_TCC_
 
+#include "InputLatency.h"
 #include "TextAreaMimeData.h"
 #include "TextBuffer.h"
+#include "Util/Instrumentation.h"
 #include "Util/algorithm.h"
 
 #include <algorithm>
 #include <cassert>
+#include <limits>
 
 #include <QApplication>
 #include <QClipboard>
@@ -61,6 +64,86 @@ auto BasicTextBuffer<Ch, Tr>::BufAsString() noexcept -> view_type {
 	return buffer_.to_view();
 }
 
+/*
+** Get an immutable copy of the current contents of the buffer, for reading
+** on other threads. Snapshots of the same version share their text.
+*/
+template <class Ch, class Tr>
+auto BasicTextBuffer<Ch, Tr>::BufSnapshot() -> Snapshot {
+
+	if (!snapshots_.empty() && snapshots_.back().first == version_) {
+		if (std::shared_ptr<const string_type> text = snapshots_.back().second.lock()) {
+			return Snapshot(std::move(text), version_);
+		}
+
+		snapshots_.pop_back();
+	}
+
+	auto text = std::make_shared<const string_type>(buffer_.to_string());
+	snapshots_.emplace_back(version_, text);
+	return Snapshot(std::move(text), version_);
+}
+
+/*
+** Return the version of the buffer's contents, which changes with every
+** modification of the text (but not of selections or tab settings)
+*/
+template <class Ch, class Tr>
+uint64_t BasicTextBuffer<Ch, Tr>::BufVersion() const noexcept {
+	return version_;
+}
+
+/*
+** Carry position "pos" in the text as of "version" (that of a snapshot) over
+** to the current text. A position in text which was deleted since then ends
+** up where the deletion was. Returns boost::none if the edits since "version"
+** are no longer known, which is only the case if no snapshot of that version
+** is around anymore.
+*/
+template <class Ch, class Tr>
+boost::optional<TextCursor> BasicTextBuffer<Ch, Tr>::BufRebase(TextCursor pos, uint64_t version) const noexcept {
+
+	if (version < editsBase_ || version > version_) {
+		return boost::none;
+	}
+
+	for (auto it = edits_.begin() + static_cast<int64_t>(version - editsBase_); it != edits_.end(); ++it) {
+		if (pos >= it->pos + it->nDeleted) {
+			pos += it->nInserted - it->nDeleted;
+		} else if (pos > it->pos) {
+			pos = it->pos;
+		}
+	}
+
+	return pos;
+}
+
+/*
+** Carry "range" in the text as of "version" over to the current text.
+** Returns boost::none if there was an edit inside the range since then (even
+** one which was undone later), so a range which is returned holds exactly the
+** same text as it did in the snapshot, or if the edits since "version" are no
+** longer known.
+*/
+template <class Ch, class Tr>
+boost::optional<TextRange> BasicTextBuffer<Ch, Tr>::BufRebase(TextRange range, uint64_t version) const noexcept {
+
+	if (version < editsBase_ || version > version_) {
+		return boost::none;
+	}
+
+	for (auto it = edits_.begin() + static_cast<int64_t>(version - editsBase_); it != edits_.end(); ++it) {
+		if (it->pos + it->nDeleted <= range.start) {
+			range.start += it->nInserted - it->nDeleted;
+			range.end += it->nInserted - it->nDeleted;
+		} else if (it->pos < range.end) {
+			return boost::none;
+		}
+	}
+
+	return range;
+}
+
 /*
 ** Replace the entire contents of the text buffer
 */
@@ -76,6 +159,7 @@ void BasicTextBuffer<Ch, Tr>::BufSetAll(view_type text) {
 	const auto deleteLength       = static_cast<int64_t>(deletedText.size());
 
 	buffer_.assign(text);
+	recordEdit(BufStartOfBuffer(), deleteLength, insertLength);
 
 	// Zero all of the existing selections
 	updateSelections(BufStartOfBuffer(), deleteLength, 0);
@@ -100,6 +184,35 @@ auto BasicTextBuffer<Ch, Tr>::BufGetRange(TextCursor start, TextCursor end) cons
 	return buffer_.to_string(to_integer(start), to_integer(end));
 }
 
+/*
+** Get the text between "start" and "end" without copying it, as the (at most)
+** two pieces it is stored in, those before and after the buffer gap.  Where
+** the range doesn't span the gap, the first or second piece is empty.  The
+** views are good until the buffer is changed, or made contiguous by
+** BufAsString or BufGetRangeView
+*/
+template <class Ch, class Tr>
+auto BasicTextBuffer<Ch, Tr>::BufGetSegments(TextCursor start, TextCursor end) const noexcept -> std::pair<view_type, view_type> {
+
+	sanitizeRange(start, end);
+	return buffer_.segments(to_integer(start), to_integer(end));
+}
+
+/*
+** Get the text between "start" and "end" as a read-only view of contiguous
+** characters, for instance to match regular expressions against it.  If the
+** range spans the buffer gap, the gap is moved out of it first, which moves
+** less text than making the whole buffer contiguous and doesn't allocate
+** anything.  The view is good until the buffer is changed, so this must not
+** be used while other views of the buffer are still in use
+*/
+template <class Ch, class Tr>
+auto BasicTextBuffer<Ch, Tr>::BufGetRangeView(TextCursor start, TextCursor end) noexcept -> view_type {
+
+	sanitizeRange(start, end);
+	return buffer_.to_view(to_integer(start), to_integer(end));
+}
+
 /**
  *
  */
@@ -233,6 +346,7 @@ void BasicTextBuffer<Ch, Tr>::BufCopyFromBuf(BasicTextBuffer<Ch, Tr> *fromBuf, T
 	const int64_t length = (fromEnd - fromStart);
 
 	buffer_.insert(to_integer(toPos), fromBuf->buffer_.to_view(to_integer(fromStart), to_integer(fromEnd)));
+	recordEdit(toPos, 0, length);
 
 	updateSelections(toPos, 0, length);
 }
@@ -248,22 +362,24 @@ void BasicTextBuffer<Ch, Tr>::BufCopyFromBuf(BasicTextBuffer<Ch, Tr> *fromBuf, T
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufInsertCol(int64_t column, TextCursor startPos, view_type text, int64_t *charsInserted, int64_t *charsDeleted) noexcept {
 
-	const int64_t nLines          = countLines(text);
-	const TextCursor lineStartPos = BufStartOfLine(startPos);
-	const int64_t nDeleted        = BufEndOfLine(BufCountForwardNLines(startPos, nLines)) - lineStartPos;
+	column = std::max<int64_t>(column, 0);
 
-	callPreDeleteCBs(lineStartPos, nDeleted);
-	const string_type deletedText = BufGetRange(lineStartPos, lineStartPos + nDeleted);
+	const int64_t nLines          = countLines(text) + 1;
+	const TextCursor lineStartPos = BufStartOfLine(startPos);
+	const TextCursor lineEndPos   = BufEndOfLine(BufCountForwardNLines(lineStartPos, nLines - 1));
+	const int insWidth            = textWidth(text, tabDist_);
+	const int tabDist             = tabDist_;
+	const bool useTabs            = useTabs_;
 
-	int64_t insertDeleted;
+	int64_t nDeleted;
 	int64_t nInserted;
-	insertCol(column, lineStartPos, text, &insertDeleted, &nInserted, &cursorPosHint_);
+	auto insertLine = [column, insWidth, tabDist, useTabs](view_type line, view_type insLine, string_type *outStr) {
+		int64_t endOffset;
+		insertColInLine(line, insLine, column, insWidth, tabDist, useTabs, outStr, &endOffset);
+		return endOffset;
+	};
 
-	if (nDeleted != insertDeleted) {
-		qCritical("NEdit: internal consistency check ins1 failed");
-	}
-
-	callModifyCBs(lineStartPos, nDeleted, nInserted, 0, deletedText);
+	rewriteLines(lineStartPos, lineEndPos, nLines, text, insertLine, &nDeleted, &nInserted);
 
 	if (charsInserted) {
 		*charsInserted = nInserted;
@@ -274,83 +390,6 @@ void BasicTextBuffer<Ch, Tr>::BufInsertCol(int64_t column, TextCursor startPos,
 	}
 }
 
-/*
-** Overlay a rectangular area of text without calling the modify callbacks.
-** "nDeleted" and "nInserted" return the number of characters deleted and
-** inserted beginning at the start of the line containing "startPos".
-** "endPos" returns buffer position of the lower left edge of the inserted
-** column (as a hint for routines which need to set a cursor position).
-*/
-template <class Ch, class Tr>
-void BasicTextBuffer<Ch, Tr>::overlayRect(TextCursor startPos, int64_t rectStart, int64_t rectEnd, view_type insText, int64_t *nDeleted, int64_t *nInserted, TextCursor *endPos) {
-	int64_t len;
-	int64_t endOffset;
-
-	/* Allocate a buffer for the replacement string large enough to hold
-	   possibly expanded tabs in the inserted text, as well as per line: 1)
-	   an additional 2*MAX_EXP_CHAR_LEN characters for padding where tabs
-	   and control characters cross the column of the selection, 2) up to
-	   "column" additional spaces per line for padding out to the position
-	   of "column", 3) padding up to the width of the inserted text if that
-	   must be padded to align the text beyond the inserted column.  (Space
-	   for additional newlines if the inserted text extends beyond the end
-	   of the buffer is counted with the length of insText) */
-	const TextCursor start = BufStartOfLine(startPos);
-	const int64_t nLines   = countLines(insText) + 1;
-	const TextCursor end   = BufEndOfLine(BufCountForwardNLines(start, nLines - 1));
-
-	const string_type expIns = expandTabs(insText, 0, tabDist_);
-
-	string_type outStr;
-	outStr.reserve(static_cast<size_t>(end - start) + expIns.size() + static_cast<size_t>(nLines * (rectEnd + MAX_EXP_CHAR_LEN)));
-
-	/* Loop over all lines in the buffer between start and end overlaying the
-	   text between rectStart and rectEnd and padding appropriately.  Trim
-	   trailing space from line (whitespace at the ends of lines otherwise
-	   tends to multiply, since additional padding is added to maintain it */
-	auto outPtr          = std::back_inserter(outStr);
-	TextCursor lineStart = start;
-	auto insPtr          = insText.begin();
-
-	while (true) {
-		const TextCursor lineEnd  = BufEndOfLine(lineStart);
-		const string_type line    = BufGetRange(lineStart, lineEnd);
-		const string_type insLine = copyLine(insPtr, insText.end());
-		insPtr += insLine.size();
-
-		string_type temp;
-		overlayRectInLine(line, insLine, rectStart, rectEnd, tabDist_, useTabs_, &temp, &endOffset);
-		len = static_cast<int64_t>(temp.size());
-
-		for (auto it = outStr.rbegin(); it != outStr.rend() && (*it == Ch(' ') || *it == Ch('\t')); ++it) {
-			--len;
-		}
-
-		std::copy_n(temp.begin(), len, outPtr);
-
-		*outPtr++ = Ch('\n');
-		lineStart = (lineEnd < BufEndOfBuffer()) ? lineEnd + 1 : BufEndOfBuffer();
-
-		if (insPtr == insText.end()) {
-			break;
-		}
-		insPtr++;
-	}
-
-	// trim back off extra newline
-	if (!outStr.empty()) {
-		outStr.pop_back();
-	}
-
-	// replace the text between start and end with the new stuff
-	deleteRange(start, end);
-	insert(start, outStr);
-
-	*nInserted = static_cast<int64_t>(outStr.size());
-	*nDeleted  = end - start;
-	*endPos    = start + static_cast<int64_t>(outStr.size()) - len + endOffset;
-}
-
 /*
 ** Overlay "text" between displayed character positions "rectStart" and
 ** "rectEnd" on the line beginning at "startPos".  If charsInserted and
@@ -361,26 +400,25 @@ void BasicTextBuffer<Ch, Tr>::overlayRect(TextCursor startPos, int64_t rectStart
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufOverlayRect(TextCursor startPos, int64_t rectStart, int64_t rectEnd, view_type text, int64_t *charsInserted, int64_t *charsDeleted) noexcept {
 
-	int64_t insertDeleted;
-	int64_t nInserted;
-	int64_t nLines          = countLines(text);
-	TextCursor lineStartPos = BufStartOfLine(startPos);
-
 	if (rectEnd == -1) {
 		rectEnd = rectStart + textWidth(text, tabDist_);
 	}
 
-	const int64_t nDeleted = BufEndOfLine(BufCountForwardNLines(startPos, nLines)) - lineStartPos;
-	callPreDeleteCBs(lineStartPos, nDeleted);
-
-	const string_type deletedText = BufGetRange(lineStartPos, lineStartPos + nDeleted);
-	overlayRect(lineStartPos, rectStart, rectEnd, text, &insertDeleted, &nInserted, &cursorPosHint_);
+	const int64_t nLines          = countLines(text) + 1;
+	const TextCursor lineStartPos = BufStartOfLine(startPos);
+	const TextCursor lineEndPos   = BufEndOfLine(BufCountForwardNLines(lineStartPos, nLines - 1));
+	const int tabDist             = tabDist_;
+	const bool useTabs            = useTabs_;
 
-	if (nDeleted != insertDeleted) {
-		qCritical("NEdit: internal consistency check ovly1 failed");
-	}
+	int64_t nDeleted;
+	int64_t nInserted;
+	auto overlayLine = [rectStart, rectEnd, tabDist, useTabs](view_type line, view_type insLine, string_type *outStr) {
+		int64_t endOffset;
+		overlayRectInLine(line, insLine, rectStart, rectEnd, tabDist, useTabs, outStr, &endOffset);
+		return endOffset;
+	};
 
-	callModifyCBs(lineStartPos, nDeleted, nInserted, 0, deletedText);
+	rewriteLines(lineStartPos, lineEndPos, nLines, text, overlayLine, &nDeleted, &nInserted);
 
 	if (charsInserted) {
 		*charsInserted = nInserted;
@@ -399,61 +437,32 @@ void BasicTextBuffer<Ch, Tr>::BufOverlayRect(TextCursor startPos, int64_t rectSt
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::BufReplaceRect(TextCursor start, TextCursor end, int64_t rectStart, int64_t rectEnd, view_type text) {
 
-	string_type insText;
-	int64_t linesPadded = 0;
-
 	/* Make sure start and end refer to complete lines, since the
 	   columnar delete and insert operations will replace whole lines */
 	start = BufStartOfLine(start);
 	end   = BufEndOfLine(end);
 
-	callPreDeleteCBs(start, end - start);
-
-	/* If more lines will be deleted than inserted, pad the inserted text
-	   with newlines to make it as long as the number of deleted lines.  This
-	   will indent all of the text to the right of the rectangle to the same
-	   column.  If more lines will be inserted than deleted, insert extra
-	   lines in the buffer at the end of the rectangle to make room for the
-	   additional lines in "text" */
-	const int64_t nInsertedLines = countLines(text);
-	const int64_t nDeletedLines  = BufCountLines(start, end);
-
-	if (nInsertedLines < nDeletedLines) {
-
-		insText.reserve(text.size() + static_cast<size_t>(nDeletedLines - nInsertedLines));
-		insText.assign(text.begin(), text.end());
-		insText.append(static_cast<size_t>(nDeletedLines - nInsertedLines), Ch('\n'));
-
-		// NOTE(eteran): use insText instead of the passed in buffer
-		text = insText;
-
-	} else if (nDeletedLines < nInsertedLines) {
-		linesPadded = nInsertedLines - nDeletedLines;
-		for (int i = 0; i < linesPadded; i++) {
-			insert(end, Ch('\n'));
-		}
-
-	} else /* nDeletedLines == nInsertedLines */ {
-	}
-
-	// Save a copy of the text which will be modified for the modify CBs
-	const string_type deletedText = BufGetRange(start, end);
-
-	// Delete then insert
-	TextCursor hint;
-	int64_t deleteInserted;
-	deleteRect(start, end, rectStart, rectEnd, &deleteInserted, &hint);
-
-	int64_t insertDeleted;
-	int64_t insertInserted;
-	insertCol(rectStart, start, text, &insertDeleted, &insertInserted, &cursorPosHint_);
-
-	// Figure out how many chars were inserted and call modify callbacks
-	if (insertDeleted != deleteInserted + linesPadded) {
-		qCritical("NEdit: internal consistency check repl1 failed");
-	}
-
-	callModifyCBs(start, end - start, insertInserted, 0, deletedText);
+	/* If more lines will be deleted than inserted, the lines missing from
+	   the text are taken as empty, which indents all of the text to the right
+	   of the rectangle to the same column.  If more lines will be inserted
+	   than deleted, the extra lines are added at the end of the rectangle */
+	const int64_t nLines   = std::max(countLines(text), BufCountLines(start, end)) + 1;
+	const int insWidth     = textWidth(text, tabDist_);
+	const int tabDist      = tabDist_;
+	const bool useTabs     = useTabs_;
+	const int64_t position = std::max<int64_t>(rectStart, 0);
+
+	// delete then insert, one line at a time, reusing the space for the line in between
+	string_type deleted;
+	auto replaceLine = [&deleted, rectStart, rectEnd, position, insWidth, tabDist, useTabs](view_type line, view_type insLine, string_type *outStr) {
+		int64_t endOffset;
+		deleted.clear();
+		deleteRectFromLine(line, rectStart, rectEnd, tabDist, useTabs, &deleted, &endOffset);
+		insertColInLine(deleted, insLine, position, insWidth, tabDist, useTabs, outStr, &endOffset);
+		return endOffset;
+	};
+
+	rewriteLines(start, end, nLines, text, replaceLine, nullptr, nullptr);
 }
 
 /*
@@ -466,14 +475,17 @@ void BasicTextBuffer<Ch, Tr>::BufRemoveRect(TextCursor start, TextCursor end, in
 	start = BufStartOfLine(start);
 	end   = BufEndOfLine(end);
 
-	callPreDeleteCBs(start, end - start);
+	const int64_t nLines = BufCountLines(start, end) + 1;
+	const int tabDist    = tabDist_;
+	const bool useTabs   = useTabs_;
 
-	const string_type deletedText = BufGetRange(start, end);
+	auto removeLine = [rectStart, rectEnd, tabDist, useTabs](view_type line, view_type, string_type *outStr) {
+		int64_t endOffset;
+		deleteRectFromLine(line, rectStart, rectEnd, tabDist, useTabs, outStr, &endOffset);
+		return endOffset;
+	};
 
-	int64_t nInserted;
-	deleteRect(start, end, rectStart, rectEnd, &nInserted, &cursorPosHint_);
-
-	callModifyCBs(start, end - start, nInserted, 0, deletedText);
+	rewriteLines(start, end, nLines, view_type(), removeLine, nullptr, nullptr);
 }
 
 /*
@@ -502,7 +514,6 @@ auto BasicTextBuffer<Ch, Tr>::BufGetTextInRect(TextCursor start, TextCursor end,
 	textOut.reserve(static_cast<size_t>(end - start));
 
 	TextCursor lineStart = start;
-	auto outPtr          = std::back_inserter(textOut);
 
 	while (lineStart <= end) {
 
@@ -510,12 +521,12 @@ auto BasicTextBuffer<Ch, Tr>::BufGetTextInRect(TextCursor start, TextCursor end,
 		TextCursor selRight;
 
 		findRectSelBoundariesForCopy(lineStart, rectStart, rectEnd, &selLeft, &selRight);
-		const string_type textIn = BufGetRange(selLeft, selRight);
-		const int64_t len        = selRight - selLeft;
+		const std::pair<view_type, view_type> textIn = BufGetSegments(selLeft, selRight);
 
-		std::copy_n(textIn.begin(), len, outPtr);
+		textOut.append(textIn.first.data(), textIn.first.size());
+		textOut.append(textIn.second.data(), textIn.second.size());
 		lineStart = BufEndOfLine(selRight) + 1;
-		*outPtr++ = Ch('\n');
+		textOut.push_back(Ch('\n'));
 	}
 
 	// don't leave trailing newline
@@ -898,11 +909,20 @@ template <class Ch, class Tr>
 int64_t BasicTextBuffer<Ch, Tr>::BufCountDispChars(TextCursor lineStartPos, TextCursor targetPos) const noexcept {
 
 	int64_t charCount = 0;
-	Ch expandedChar[MAX_EXP_CHAR_LEN];
+	TextCursor pos    = lineStartPos;
 
-	TextCursor pos = lineStartPos;
-	while (pos < targetPos && pos < BufEndOfBuffer()) {
-		charCount += BufGetExpandedChar(pos, charCount, expandedChar);
+	// on long lines, start from the closest known column before the target
+	if (targetPos - lineStartPos >= DisplayColumnCache::Interval) {
+		const DisplayColumnCache::Line &line            = measureColumns(lineStartPos, targetPos - lineStartPos, std::numeric_limits<int64_t>::max());
+		const DisplayColumnCache::Checkpoint checkpoint = DisplayColumnCache::lastCheckpoint(line, targetPos - lineStartPos, std::numeric_limits<int64_t>::max());
+
+		pos       = lineStartPos + checkpoint.offset;
+		charCount = checkpoint.column;
+	}
+
+	const TextCursor end = BufEndOfBuffer();
+	while (pos < targetPos && pos < end) {
+		charCount += BufCharWidth(BufGetCharacter(pos), charCount, tabDist_);
 		++pos;
 	}
 
@@ -918,10 +938,19 @@ template <class Ch, class Tr>
 TextCursor BasicTextBuffer<Ch, Tr>::BufCountForwardDispChars(TextCursor lineStartPos, int64_t nChars) const noexcept {
 
 	int64_t charCount = 0;
+	TextCursor pos    = lineStartPos;
 
-	TextCursor pos = lineStartPos;
-	TextCursor end = BufEndOfBuffer();
+	/* on long lines, start from the closest known column before the target,
+	   every character is at least one column wide */
+	if (nChars >= DisplayColumnCache::Interval && isLongLine(lineStartPos)) {
+		const DisplayColumnCache::Line &line            = measureColumns(lineStartPos, std::numeric_limits<int64_t>::max(), nChars);
+		const DisplayColumnCache::Checkpoint checkpoint = DisplayColumnCache::lastCheckpoint(line, std::numeric_limits<int64_t>::max(), nChars);
+
+		pos       = lineStartPos + checkpoint.offset;
+		charCount = checkpoint.column;
+	}
 
+	const TextCursor end = BufEndOfBuffer();
 	while (charCount < nChars && pos < end) {
 		const Ch ch = BufGetCharacter(pos);
 		if (ch == Ch('\n')) {
@@ -936,28 +965,131 @@ TextCursor BasicTextBuffer<Ch, Tr>::BufCountForwardDispChars(TextCursor lineStar
 }
 
 /*
-** Count the number of newlines between startPos and endPos in buffer "buf".
-** The character at position "endPos" is not counted.
+** Return the last known display column checkpoint of the line starting at
+** "lineStartPos" which is strictly before display column "column", within
+** its first "lineLength" characters.  Checkpoints are added as needed to get
+** there.  Short lines don't have any but the start of the line
 */
 template <class Ch, class Tr>
-int64_t BasicTextBuffer<Ch, Tr>::BufCountLines(TextCursor startPos, TextCursor endPos) const noexcept {
+DisplayColumnCache::Checkpoint BasicTextBuffer<Ch, Tr>::BufColumnCheckpoint(TextCursor lineStartPos, int64_t lineLength, int64_t column) const noexcept {
 
-	int64_t lineCount = 0;
+	if (lineLength < DisplayColumnCache::Interval || column <= 0) {
+		return {0, 0};
+	}
 
-	TextCursor pos = startPos;
-	TextCursor end = BufEndOfBuffer();
+	const DisplayColumnCache::Line &line = measureColumns(lineStartPos, lineLength, column);
+	return DisplayColumnCache::lastCheckpoint(line, lineLength, column - 1);
+}
 
-	while (pos < end) {
-		if (pos == endPos) {
-			return lineCount;
+/*
+** Return a lower bound of the display width of the first "lineLength"
+** characters of the line starting at "lineStartPos".  It is exact as far as
+** the line has been measured already and assumes the rest is made of single
+** column characters, so that a single edit to a huge line doesn't require
+** measuring all of it again
+*/
+template <class Ch, class Tr>
+int64_t BasicTextBuffer<Ch, Tr>::BufEstimateLineWidth(TextCursor lineStartPos, int64_t lineLength) const noexcept {
+
+	const DisplayColumnCache::Line *line = columnCache_.find(lineStartPos);
+	if (!line || line->tabDist != tabDist_) {
+		return lineLength;
+	}
+
+	const DisplayColumnCache::Checkpoint last = DisplayColumnCache::lastCheckpoint(*line, lineLength, std::numeric_limits<int64_t>::max());
+	return last.column + (lineLength - last.offset);
+}
+
+/*
+** Return true if the line starting at "lineStartPos" is at least
+** DisplayColumnCache::Interval characters long, so that it is worth caching
+** its display columns.  Only the start of the line is scanned unless the
+** cache already knows
+*/
+template <class Ch, class Tr>
+bool BasicTextBuffer<Ch, Tr>::isLongLine(TextCursor lineStartPos) const noexcept {
+
+	const DisplayColumnCache::Line *line = columnCache_.find(lineStartPos);
+	if (line && line->tabDist == tabDist_) {
+		if (line->length != -1) {
+			return line->length >= DisplayColumnCache::Interval;
+		}
+
+		if (line->checkpoints.size() > 1) {
+			return true;
+		}
+	}
+
+	const TextCursor end = std::min(BufEndOfBuffer(), lineStartPos + DisplayColumnCache::Interval);
+	for (TextCursor pos = lineStartPos; pos < end; ++pos) {
+		if (BufGetCharacter(pos) == Ch('\n')) {
+			return false;
+		}
+	}
+
+	return end - lineStartPos == DisplayColumnCache::Interval;
+}
+
+/*
+** Add display column checkpoints to the line starting at "lineStartPos",
+** every DisplayColumnCache::Interval characters, until there is one past
+** "maxOffset" or "maxColumn" (or as close as they get to it without going
+** over "maxOffset"), or the end of the line is reached.  Returns the line
+*/
+template <class Ch, class Tr>
+const DisplayColumnCache::Line &BasicTextBuffer<Ch, Tr>::measureColumns(TextCursor lineStartPos, int64_t maxOffset, int64_t maxColumn) const noexcept {
+
+	DisplayColumnCache::Line &line = columnCache_.lookup(lineStartPos, tabDist_);
+	const TextCursor end           = BufEndOfBuffer();
+
+	while (line.length == -1 && line.checkpoints.back().column < maxColumn && line.checkpoints.back().offset + DisplayColumnCache::Interval <= maxOffset) {
+
+		DisplayColumnCache::Checkpoint next = line.checkpoints.back();
+		for (int64_t i = 0; i < DisplayColumnCache::Interval; ++i) {
+			const TextCursor pos = lineStartPos + next.offset;
+			if (pos >= end) {
+				break;
+			}
+
+			const Ch ch = BufGetCharacter(pos);
+			if (ch == Ch('\n')) {
+				break;
+			}
+
+			next.column += BufCharWidth(ch, next.column, tabDist_);
+			++next.offset;
 		}
 
-		if (buffer_[to_integer(pos++)] == Ch('\n')) {
-			++lineCount;
+		if (next.offset - line.checkpoints.back().offset < DisplayColumnCache::Interval) {
+			line.length = next.offset;
+			break;
 		}
+
+		line.checkpoints.push_back(next);
+	}
+
+	return line;
+}
+
+/*
+** Count the number of newlines between startPos and endPos in buffer "buf".
+** The character at position "endPos" is not counted.
+*/
+template <class Ch, class Tr>
+int64_t BasicTextBuffer<Ch, Tr>::BufCountLines(TextCursor startPos, TextCursor endPos) const noexcept {
+
+	// an end before the start counts up to the end of the buffer
+	if (endPos < startPos) {
+		endPos = BufEndOfBuffer();
 	}
 
-	return lineCount;
+	// counted where the text is, on both sides of the gap
+	const std::pair<view_type, view_type> segments = BufGetSegments(startPos, endPos);
+
+	const auto lineCount = std::count(segments.first.begin(), segments.first.end(), Ch('\n')) +
+						   std::count(segments.second.begin(), segments.second.end(), Ch('\n'));
+
+	return static_cast<int64_t>(lineCount);
 }
 
 /*
@@ -974,16 +1106,22 @@ TextCursor BasicTextBuffer<Ch, Tr>::BufCountForwardNLines(TextCursor startPos, i
 	}
 
 	TextCursor pos = startPos;
-	TextCursor end = BufEndOfBuffer();
 
-	while (pos < end) {
-		if (buffer_[to_integer(pos++)] == Ch('\n')) {
-			++lineCount;
-			if (lineCount >= nLines) {
-				return pos;
+	// searched where the text is, on both sides of the gap
+	const std::pair<view_type, view_type> segments = BufGetSegments(startPos, BufEndOfBuffer());
+
+	for (const view_type &segment : {segments.first, segments.second}) {
+		auto it = segment.begin();
+		while ((it = std::find(it, segment.end(), Ch('\n'))) != segment.end()) {
+			++it;
+			if (++lineCount >= nLines) {
+				return pos + (it - segment.begin());
 			}
 		}
+
+		pos += static_cast<int64_t>(segment.size());
 	}
+
 	return pos;
 }
 
@@ -1114,6 +1252,7 @@ int64_t BasicTextBuffer<Ch, Tr>::insert(TextCursor pos, view_type text) noexcept
 	const auto length = static_cast<int64_t>(text.size());
 
 	buffer_.insert(to_integer(pos), text);
+	recordEdit(pos, 0, length);
 
 	updateSelections(pos, 0, length);
 
@@ -1126,6 +1265,7 @@ int64_t BasicTextBuffer<Ch, Tr>::insert(TextCursor pos, Ch ch) noexcept {
 	const int64_t length = 1;
 
 	buffer_.insert(to_integer(pos), ch);
+	recordEdit(pos, 0, length);
 
 	updateSelections(pos, 0, length);
 
@@ -1208,11 +1348,56 @@ auto BasicTextBuffer<Ch, Tr>::getSelectionText(const Selection *sel) const -> st
 template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::callModifyCBs(TextCursor pos, int64_t nDeleted, int64_t nInserted, int64_t nRestyled, view_type deletedText) const noexcept {
 
+	INSTRUMENT_SCOPE("callModifyCBs");
+	const InputLatency::StageTimer timer(InputLatency::Stage::Modify);
+
 	for (const auto &pair : modifyProcs_) {
 		(pair.first)(pos, nInserted, nDeleted, nRestyled, deletedText, pair.second);
 	}
 }
 
+/*
+** Note a change to the text for BufRebase, as long as there are snapshots
+** which may need it, and throw away the display columns it invalidates
+*/
+template <class Ch, class Tr>
+void BasicTextBuffer<Ch, Tr>::recordEdit(TextCursor pos, int64_t nDeleted, int64_t nInserted) noexcept {
+
+	if (nDeleted == 0 && nInserted == 0) {
+		return;
+	}
+
+	columnCache_.invalidate(pos);
+
+	++version_;
+
+	// forget about the snapshots which aren't used anymore
+	while (!snapshots_.empty() && snapshots_.front().second.expired()) {
+		snapshots_.pop_front();
+	}
+
+	if (snapshots_.empty()) {
+		edits_.clear();
+		editsBase_ = version_;
+		return;
+	}
+
+	// and about the edits made before the oldest one which is
+	while (editsBase_ < snapshots_.front().first) {
+		edits_.pop_front();
+		++editsBase_;
+	}
+
+	// the snapshots which are still around are too old to be rebased
+	if (edits_.size() == MaxRecordedEdits) {
+		edits_.clear();
+		editsBase_ = version_;
+		return;
+	}
+
+	edits_.push_back({pos, nDeleted, nInserted});
+}
+
 /*
 ** Call the stored pre-delete callback procedure(s) for this buffer to update
 ** the changed area(s) on the screen and any other listeners.
@@ -1234,69 +1419,91 @@ template <class Ch, class Tr>
 void BasicTextBuffer<Ch, Tr>::deleteRange(TextCursor start, TextCursor end) noexcept {
 
 	buffer_.erase(to_integer(start), to_integer(end));
+	recordEdit(start, end - start, 0);
 
 	// fix up any selections which might be affected by the change
 	updateSelections(start, end - start, 0);
 }
 
 /*
-** Delete a rectangle of text without calling the modify callbacks.  Returns
-** the number of characters replacing those between start and end.  Note that
-** in some pathological cases, deleting can actually increase the size of
-** the buffer because of tab expansions.  "endPos" returns the buffer position
-** of the point in the last line where the text was removed (as a hint for
-** routines which need to position the cursor after a delete operation)
+** Rewrite the lines between "start" and "end", which must be the start and
+** end of a line, and the "nLines" lines of "insText" alongside them: the
+** rectangular operations are all a matter of "editLine" appending the new
+** form of each line, made from the old one and the matching line of
+** "insText", to the new text.  Lines past the end of either are empty.
+** "editLine" returns where in the new text the cursor should go if it is
+** the last line.
+**
+** The new text is built in a single pass, in one string sized up front for
+** tabs and control characters being expanded where they cross the edges of
+** the rectangle.  Only the part of the lines which actually changed is
+** replaced, reported to the callbacks, and so recorded for undo.
+** "nDeleted" and "nInserted" return the number of characters deleted and
+** inserted beginning at "start", the cursor position hint is left at the
+** end of the edit on the last line.
 */
 template <class Ch, class Tr>
-void BasicTextBuffer<Ch, Tr>::deleteRect(TextCursor start, TextCursor end, int64_t rectStart, int64_t rectEnd, int64_t *replaceLen, TextCursor *endPos) {
+template <class LineEdit>
+void BasicTextBuffer<Ch, Tr>::rewriteLines(TextCursor start, TextCursor end, int64_t nLines, view_type insText, LineEdit editLine, int64_t *nDeleted, int64_t *nInserted) {
 
+	const view_type oldText = BufGetRangeView(start, end);
+
+	string_type outStr;
+	outStr.reserve(oldText.size() + insText.size() + static_cast<size_t>(nLines * (MAX_EXP_CHAR_LEN * 2 + 1)));
+
+	size_t linePos    = 0;
+	size_t insPos     = 0;
 	int64_t endOffset = 0;
 
-	/* allocate a buffer for the replacement string large enough to hold
-	   possibly expanded tabs as well as an additional  MAX_EXP_CHAR_LEN * 2
-	   characters per line for padding where tabs and control characters cross
-	   the edges of the selection */
-	start                = BufStartOfLine(start);
-	end                  = BufEndOfLine(end);
-	const int64_t nLines = BufCountLines(start, end) + 1;
+	for (int64_t i = 0; i < nLines; ++i) {
+		if (i != 0) {
+			outStr.push_back(Ch('\n'));
+		}
+
+		const view_type line    = nextLine(oldText, &linePos);
+		const view_type insLine = nextLine(insText, &insPos);
+		endOffset               = editLine(line, insLine, &outStr);
+	}
 
-	const string_type text    = BufGetRange(start, end);
-	const string_type expText = expandTabs(text, 0, tabDist_);
-	auto len                  = static_cast<int64_t>(expText.size());
+	// leave alone what is the same at the start and the end of the lines
+	const size_t maxCommon = std::min(oldText.size(), outStr.size());
 
-	string_type outStr;
-	outStr.reserve(expText.size() + static_cast<size_t>(nLines * MAX_EXP_CHAR_LEN * 2));
+	size_t prefix = 0;
+	while (prefix < maxCommon && oldText[prefix] == outStr[prefix]) {
+		++prefix;
+	}
 
-	/* loop over all lines in the buffer between start and end removing
-	   the text between rectStart and rectEnd and padding appropriately */
-	TextCursor lineStart = start;
-	auto outPtr          = std::back_inserter(outStr);
+	size_t suffix = 0;
+	while (suffix < maxCommon - prefix && oldText[oldText.size() - suffix - 1] == outStr[outStr.size() - suffix - 1]) {
+		++suffix;
+	}
 
-	while (lineStart <= BufEndOfBuffer() && lineStart <= end) {
-		const TextCursor lineEnd = BufEndOfLine(lineStart);
-		const string_type line   = BufGetRange(lineStart, lineEnd);
+	const TextCursor changeStart = start + static_cast<int64_t>(prefix);
+	const auto changeDeleted     = static_cast<int64_t>(oldText.size() - prefix - suffix);
+	const view_type changeText   = view_type(outStr).substr(prefix, outStr.size() - prefix - suffix);
 
-		string_type temp;
-		deleteRectFromLine(line, rectStart, rectEnd, tabDist_, useTabs_, &temp, &endOffset);
-		len = static_cast<int64_t>(temp.size());
+	cursorPosHint_ = start + endOffset;
 
-		std::copy_n(temp.begin(), len, outPtr);
+	if (changeDeleted != 0 || !changeText.empty()) {
 
-		*outPtr++ = Ch('\n');
-		lineStart = lineEnd + 1;
-	}
+		// copied first, "oldText" points into the buffer
+		const string_type deletedText(oldText.substr(prefix, static_cast<size_t>(changeDeleted)));
+
+		callPreDeleteCBs(changeStart, changeDeleted);
 
-	// trim back off extra newline
-	if (!outStr.empty()) {
-		outStr.pop_back();
+		deleteRange(changeStart, changeStart + changeDeleted);
+		insert(changeStart, changeText);
+
+		callModifyCBs(changeStart, changeDeleted, static_cast<int64_t>(changeText.size()), 0, deletedText);
 	}
 
-	// replace the text between start and end with the newly created string
-	deleteRange(start, end);
-	insert(start, outStr);
+	if (nDeleted) {
+		*nDeleted = end - start;
+	}
 
-	*replaceLen = static_cast<int64_t>(outStr.size());
-	*endPos     = start + static_cast<int64_t>(outStr.size()) - len + endOffset;
+	if (nInserted) {
+		*nInserted = static_cast<int64_t>(outStr.size());
+	}
 }
 
 /*
@@ -1360,100 +1567,6 @@ void BasicTextBuffer<Ch, Tr>::findRectSelBoundariesForCopy(TextCursor lineStartP
 	*selEnd = pos;
 }
 
-/*
-** Insert a column of text without calling the modify callbacks.  Note that
-** in some pathological cases, inserting can actually decrease the size of
-** the buffer because of spaces being coalesced into tabs.  "nDeleted" and
-** "nInserted" return the number of characters deleted and inserted beginning
-** at the start of the line containing "startPos".  "endPos" returns buffer
-** position of the lower left edge of the inserted column (as a hint for
-** routines which need to set a cursor position).
-*/
-template <class Ch, class Tr>
-void BasicTextBuffer<Ch, Tr>::insertCol(int64_t column, TextCursor startPos, view_type insText, int64_t *nDeleted, int64_t *nInserted, TextCursor *endPos) {
-
-	int64_t len;
-	int64_t endOffset;
-
-	if (column < 0) {
-		column = 0;
-	}
-
-	/* Allocate a buffer for the replacement string large enough to hold
-	   possibly expanded tabs in both the inserted text and the replaced
-	   area, as well as per line: 1) an additional 2*MAX_EXP_CHAR_LEN
-	   characters for padding where tabs and control characters cross the
-	   column of the selection, 2) up to "column" additional spaces per
-	   line for padding out to the position of "column", 3) padding up
-	   to the width of the inserted text if that must be padded to align
-	   the text beyond the inserted column.  (Space for additional
-	   newlines if the inserted text extends beyond the end of the buffer
-	   is counted with the length of insText) */
-	const TextCursor start = BufStartOfLine(startPos);
-	const int64_t nLines   = countLines(insText) + 1;
-
-	const int insWidth         = textWidth(insText, tabDist_);
-	const TextCursor end       = BufEndOfLine(BufCountForwardNLines(start, nLines - 1));
-	const string_type replText = BufGetRange(start, end);
-
-	const string_type expRep = expandTabs(replText, 0, tabDist_);
-	const string_type expIns = expandTabs(insText, 0, tabDist_);
-
-	string_type outStr;
-	outStr.reserve(expRep.size() + expIns.size() + static_cast<size_t>(nLines * (column + insWidth + MAX_EXP_CHAR_LEN)));
-
-	/* Loop over all lines in the buffer between start and end inserting
-	   text at column, splitting tabs and adding padding appropriately */
-	auto outPtr          = std::back_inserter(outStr);
-	TextCursor lineStart = start;
-	auto insPtr          = insText.begin();
-
-	while (true) {
-		const TextCursor lineEnd  = BufEndOfLine(lineStart);
-		const string_type line    = BufGetRange(lineStart, lineEnd);
-		const string_type insLine = copyLine(insPtr, insText.end());
-		insPtr += insLine.size();
-
-		string_type temp;
-		insertColInLine(line, insLine, column, insWidth, tabDist_, useTabs_, &temp, &endOffset);
-		len = static_cast<int64_t>(temp.size());
-
-#if 0
-		/* Earlier comments claimed that trailing whitespace could multiply on
-		 * the ends of lines, but insertColInLine looks like it should never
-		 * add space unnecessarily, and this trimming interfered with
-		 * paragraph filling, so lets see if it works without it. MWE */
-
-		for(auto it = temp.rbegin(); it != temp.rend() && (*it == Ch(' ') || *it == Ch('\t')); ++it) {
-			--len;
-		}
-#endif
-
-		std::copy_n(temp.begin(), len, outPtr);
-
-		*outPtr++ = Ch('\n');
-		lineStart = lineEnd < BufEndOfBuffer() ? lineEnd + 1 : BufEndOfBuffer();
-		if (insPtr == insText.end()) {
-			break;
-		}
-
-		insPtr++;
-	}
-
-	// trim back off extra newline
-	if (!outStr.empty()) {
-		outStr.pop_back();
-	}
-
-	// replace the text between start and end with the new stuff
-	deleteRange(start, end);
-	insert(start, outStr);
-
-	*nInserted = static_cast<int64_t>(outStr.size());
-	*nDeleted  = end - start;
-	*endPos    = start + static_cast<int64_t>(outStr.size()) - len + endOffset;
-}
-
 /*
 ** Call the stored redisplay procedure(s) for this buffer to update the
 ** screen for a change in a selection.
@@ -1633,20 +1746,21 @@ bool BasicTextBuffer<Ch, Tr>::GetSimpleSelection(TextRange *range) const noexcep
 }
 
 /*
-** Convert sequences of spaces into tabs.  The threshold for conversion is
-** when 3 or more spaces can be converted into a single tab, this avoids
-** converting double spaces after a period withing a block of text.
+** Convert sequences of spaces into tabs, in place, in the part of "str"
+** starting at "first".  The threshold for conversion is when 3 or more spaces
+** can be converted into a single tab, this avoids converting double spaces
+** after a period withing a block of text.  The text only ever gets shorter,
+** so it can be written over as it is read.
 */
 template <class Ch, class Tr>
-auto BasicTextBuffer<Ch, Tr>::unexpandTabs(view_type text, int64_t startIndent, int tabDist) -> string_type {
+void BasicTextBuffer<Ch, Tr>::unexpandTabs(string_type *str, size_t first, int64_t startIndent, int tabDist) noexcept {
 
-	string_type outStr;
-	outStr.reserve(text.size());
+	const view_type text(str->data(), str->size());
 
-	auto outPtr    = std::back_inserter(outStr);
+	size_t out     = first;
 	int64_t indent = startIndent;
 
-	for (size_t pos = 0; pos != text.size();) {
+	for (size_t pos = first; pos != text.size();) {
 		if (text[pos] == Ch(' ')) {
 
 			Ch expandedChar[MAX_EXP_CHAR_LEN];
@@ -1656,57 +1770,35 @@ auto BasicTextBuffer<Ch, Tr>::unexpandTabs(view_type text, int64_t startIndent,
 
 			if (len >= 3 && !cmp) {
 				pos += static_cast<size_t>(len);
-				*outPtr++ = Ch('\t');
+				(*str)[out++] = Ch('\t');
 				indent += len;
 			} else {
-				*outPtr++ = text[pos++];
+				(*str)[out++] = text[pos++];
 				indent++;
 			}
 		} else if (text[pos] == Ch('\n')) {
-			indent    = startIndent;
-			*outPtr++ = text[pos++];
+			indent        = startIndent;
+			(*str)[out++] = text[pos++];
 		} else {
-			*outPtr++ = text[pos++];
+			(*str)[out++] = text[pos++];
 			indent++;
 		}
 	}
 
-	return outStr;
+	str->resize(out);
 }
 
 /*
-** Expand tabs to spaces for a block of text.  The additional parameter
-** "startIndent" if nonzero, indicates that the text is a rectangular selection
-** beginning at column "startIndent"
+** Expand tabs to spaces for a block of text, appending the result to
+** "outStr".  The additional parameter "startIndent" if nonzero, indicates
+** that the text is a rectangular selection beginning at column "startIndent"
 */
 template <class Ch, class Tr>
-auto BasicTextBuffer<Ch, Tr>::expandTabs(view_type text, int64_t startIndent, int tabDist) -> string_type {
+void BasicTextBuffer<Ch, Tr>::expandTabs(view_type text, int64_t startIndent, int tabDist, string_type *outStr) {
 
-	size_t outLen = 0;
+	auto outPtr = std::back_inserter(*outStr);
 
-	// rehearse the expansion to figure out length for output string
 	int64_t indent = startIndent;
-	for (Ch ch : text) {
-		if (ch == Ch('\t')) {
-			const int len = BufCharWidth(ch, indent, tabDist);
-			outLen += static_cast<size_t>(len);
-			indent += len;
-		} else if (ch == Ch('\n')) {
-			indent = startIndent;
-			outLen++;
-		} else {
-			indent += BufCharWidth(ch, indent, tabDist);
-			outLen++;
-		}
-	}
-
-	// do the expansion
-	string_type outStr;
-	outStr.reserve(outLen);
-
-	auto outPtr = std::back_inserter(outStr);
-
-	indent = startIndent;
 	for (Ch ch : text) {
 		if (ch == Ch('\t')) {
 
@@ -1723,32 +1815,44 @@ auto BasicTextBuffer<Ch, Tr>::expandTabs(view_type text, int64_t startIndent, in
 			*outPtr++ = ch;
 		}
 	}
-
-	return outStr;
 }
 
 /*
 ** Adjust the space and tab characters from string "text" so that non-white
 ** characters remain stationary when the text is shifted from starting at
-** "origIndent" to starting at "newIndent".
+** "origIndent" to starting at "newIndent", and append the result to "outStr".
 */
 template <class Ch, class Tr>
-auto BasicTextBuffer<Ch, Tr>::realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs) noexcept -> string_type {
+void BasicTextBuffer<Ch, Tr>::realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs, string_type *outStr) {
 
 	// If the tabs settings are the same, retain original tabs
 	if (origIndent % tabDist == newIndent % tabDist) {
-		return string_type(text);
+		outStr->append(text.data(), text.size());
+		return;
 	}
 
 	/* If the tab settings are not the same, brutally convert tabs to
 	   spaces, then back to tabs in the new position */
-	string_type expStr = expandTabs(text, origIndent, tabDist);
+	const size_t first = outStr->size();
+	expandTabs(text, origIndent, tabDist, outStr);
 
-	if (!useTabs) {
-		return expStr;
+	if (useTabs) {
+		unexpandTabs(outStr, first, newIndent, tabDist);
 	}
+}
 
-	return unexpandTabs(expStr, newIndent, tabDist);
+/*
+** Adjust the space and tab characters from string "text" so that non-white
+** characters remain stationary when the text is shifted from starting at
+** "origIndent" to starting at "newIndent".
+*/
+template <class Ch, class Tr>
+auto BasicTextBuffer<Ch, Tr>::realignTabs(view_type text, int64_t origIndent, int64_t newIndent, int tabDist, bool useTabs) -> string_type {
+
+	string_type outStr;
+	outStr.reserve(text.size());
+	realignTabs(text, origIndent, newIndent, tabDist, useTabs, &outStr);
+	return outStr;
 }
 
 template <class Ch, class Tr>
@@ -1841,13 +1945,11 @@ void BasicTextBuffer<Ch, Tr>::insertColInLine(view_type line, view_type insLine,
 	/* Copy the text from "insLine" (if any), recalculating the tabs as if
 	   the inserted string began at column 0 to its new column destination */
 	if (!insLine.empty()) {
-		string_type retabbedStr = realignTabs(insLine, 0, indent, tabDist, useTabs);
-		len                     = static_cast<int64_t>(retabbedStr.size());
+		const size_t first = outStr->size();
+		realignTabs(insLine, 0, indent, tabDist, useTabs, outStr);
 
-		for (Ch ch : retabbedStr) {
-			*outPtr++ = ch;
-			len       = BufCharWidth(ch, indent, tabDist);
-			indent += len;
+		for (size_t i = first; i != outStr->size(); ++i) {
+			indent += BufCharWidth((*outStr)[i], indent, tabDist);
 		}
 	}
 
@@ -1864,11 +1966,9 @@ void BasicTextBuffer<Ch, Tr>::insertColInLine(view_type line, view_type insLine,
 	indent           = toIndent;
 
 	// realign tabs for text beyond "column" and write it out
-	string_type retabbedStr = realignTabs(substr(linePtr, line.end()), postColIndent, indent, tabDist, useTabs);
-
 	*endOffset = static_cast<int64_t>(outStr->size());
 
-	std::copy(retabbedStr.begin(), retabbedStr.end(), outPtr);
+	realignTabs(substr(linePtr, line.end()), postColIndent, indent, tabDist, useTabs, outStr);
 }
 
 /*
@@ -1924,22 +2024,31 @@ void BasicTextBuffer<Ch, Tr>::deleteRectFromLine(view_type line, int64_t rectSta
 	/* Copy the rest of the line.  If the indentation has changed, preserve
 	   the position of non-whitespace characters by converting tabs to
 	   spaces, then back to tabs with the correct offset */
-	string_type retabbedStr = realignTabs(substr(c, line.end()), postRectIndent, indent, tabDist, useTabs);
-
 	*endOffset = static_cast<int64_t>(outStr->size());
 
-	std::copy(retabbedStr.begin(), retabbedStr.end(), outPtr);
+	realignTabs(substr(c, line.end()), postRectIndent, indent, tabDist, useTabs, outStr);
 }
 
 /*
-** Copy from "text" to end up to but not including newline (or end of "text")
-** and return the copy
+** Return the line of "text" starting at "*pos", up to but not including the
+** newline (or end of "text"), and move "*pos" to the start of the next one.
+** Past the end of "text", the lines are empty
 */
 template <class Ch, class Tr>
-template <class Ran>
-auto BasicTextBuffer<Ch, Tr>::copyLine(Ran first, Ran last) -> string_type {
-	auto it = std::find(first, last, Ch('\n'));
-	return string_type(first, it);
+auto BasicTextBuffer<Ch, Tr>::nextLine(view_type text, size_t *pos) noexcept -> view_type {
+
+	if (*pos >= text.size()) {
+		return view_type();
+	}
+
+	const size_t start = *pos;
+	size_t end         = text.find(Ch('\n'), start);
+	if (end == view_type::npos) {
+		end = text.size();
+	}
+
+	*pos = end + 1;
+	return text.substr(start, end - start);
 }
 
 /*
@@ -2047,13 +2156,11 @@ void BasicTextBuffer<Ch, Tr>::overlayRectInLine(view_type line, view_type insLin
 	/* Copy the text from "insLine" (if any), recalculating the tabs as if
 	   the inserted string began at column 0 to its new column destination */
 	if (!insLine.empty()) {
-		string_type retabbedStr = realignTabs(insLine, 0, rectStart, tabDist, useTabs);
-		len                     = static_cast<int64_t>(retabbedStr.size());
+		const size_t first = outStr->size();
+		realignTabs(insLine, 0, rectStart, tabDist, useTabs, outStr);
 
-		for (Ch c : retabbedStr) {
-			*outPtr++ = c;
-			len       = BufCharWidth(c, outIndent, tabDist);
-			outIndent += len;
+		for (size_t i = first; i != outStr->size(); ++i) {
+			outIndent += BufCharWidth((*outStr)[i], outIndent, tabDist);
 		}
 	}
 
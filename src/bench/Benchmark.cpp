@@ -0,0 +1,170 @@
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+
+namespace Benchmark {
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+std::vector<Case> Cases;
+
+// results of the benchmarks end up here, so that they have to be computed
+volatile int64_t Sink;
+
+// every call of the global operator new, from any thread
+std::atomic<int64_t> Allocations{0};
+
+/**
+ * @brief countAllocation
+ *
+ * Called by the replacements of the global operator new below
+ */
+void countAllocation() {
+	Allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief timeRun
+ * @param benchmark
+ * @param allocations set to the number of allocations the run made
+ * @return how long it took to run the benchmark once, in nanoseconds
+ */
+int64_t timeRun(const Case &benchmark, int64_t *allocations) {
+
+	if (benchmark.setup) {
+		benchmark.setup();
+	}
+
+	const int64_t allocated       = Allocations.load(std::memory_order_relaxed);
+	const Clock::time_point start = Clock::now();
+	benchmark.run();
+	const Clock::time_point end = Clock::now();
+
+	*allocations = Allocations.load(std::memory_order_relaxed) - allocated;
+
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+}
+
+}
+
+/**
+ * @brief add
+ * @param name
+ * @param run
+ * @param setup
+ *
+ * Registers a benchmark. "setup" is called before every run of "run", but
+ * isn't part of the time measured
+ */
+void add(std::string name, Function run, Function setup) {
+	Cases.push_back(Case{std::move(name), std::move(run), std::move(setup)});
+}
+
+/**
+ * @brief cases
+ * @return all of the benchmarks, in the order they were registered
+ */
+const std::vector<Case> &cases() {
+	return Cases;
+}
+
+/**
+ * @brief keep
+ * @param value
+ *
+ * Makes sure that the computation of "value" isn't optimized away
+ */
+void keep(int64_t value) {
+	Sink = value;
+}
+
+/**
+ * @brief measure
+ * @param benchmark
+ * @param samples
+ * @return the times of "samples" runs of the benchmark. One more run is done
+ * first and thrown away, so that caches are warm and any lazy initialization
+ * is out of the way
+ */
+Result measure(const Case &benchmark, int samples) {
+
+	Result result;
+	result.name = benchmark.name;
+
+	timeRun(benchmark, &result.allocations);
+
+	for (int i = 0; i < samples; ++i) {
+		result.samples.push_back(timeRun(benchmark, &result.allocations));
+	}
+
+	if (!result.samples.empty()) {
+		std::vector<int64_t> sorted = result.samples;
+		std::sort(sorted.begin(), sorted.end());
+
+		const size_t count = sorted.size();
+
+		result.min    = sorted.front();
+		result.median = (count % 2) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+		result.mean   = std::accumulate(sorted.begin(), sorted.end(), int64_t{0}) / static_cast<int64_t>(count);
+	}
+
+	return result;
+}
+
+}
+
+/* The allocations of the benchmarks are counted by replacing the global
+ * operator new. The allocation functions without an alignment are all
+ * replaced, so that memory never goes to a delete it doesn't belong to */
+void *operator new(std::size_t size) {
+	Benchmark::countAllocation();
+	if (void *p = std::malloc(size ? size : 1)) {
+		return p;
+	}
+
+	throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+	return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+	Benchmark::countAllocation();
+	return std::malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+	std::free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	std::free(p);
+}
@@ -0,0 +1,59 @@
+
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class DocumentWidget;
+
+/*
+ * A small harness for the nedit-bench program.
+ *
+ * A benchmark is a named piece of work which is run a fixed number of times
+ * after a warm up run, and of which every run is timed on its own. The heap
+ * allocations made by a run (on any thread) are counted as well. Anything
+ * random is drawn from generators with a fixed seed, and all of the text
+ * worked on comes from the corpus (or is made up from a fixed seed), so two
+ * runs of the same build do exactly the same work.
+ */
+namespace Benchmark {
+
+using Function = std::function<void()>;
+
+struct Case {
+	std::string name;
+	Function run;   // the work that is timed
+	Function setup; // brings things back to where "run" expects them, not timed
+};
+
+struct Result {
+	std::string name;
+	std::vector<int64_t> samples; // in nanoseconds
+	int64_t min         = 0;
+	int64_t median      = 0;
+	int64_t mean        = 0;
+	int64_t allocations = 0; // made by the last run
+};
+
+struct Corpus {
+	std::vector<std::string> files;
+	std::string text; // the contents of all of the files, one after the other
+	std::string keys; // what is typed by the typing benchmarks, one key per character
+};
+
+void add(std::string name, Function run, Function setup = Function());
+const std::vector<Case> &cases();
+Result measure(const Case &benchmark, int samples);
+
+void keep(int64_t value);
+
+void addBufferBenchmarks(const Corpus &corpus);
+void addSearchBenchmarks(const Corpus &corpus);
+void addEditorBenchmarks(const Corpus &corpus, DocumentWidget *document);
+
+}
+
+#endif
@@ -0,0 +1,252 @@
+
+#include "Benchmark.h"
+#include "TextBuffer.h"
+#include "gap_buffer.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+
+namespace {
+
+constexpr std::mt19937::result_type Seed = 20201019;
+constexpr int RectLines                  = 5000;
+constexpr int WideLineLength             = 200000;
+
+/**
+ * @brief makeLines
+ * @param count
+ * @return "count" lines of text of varying length and indentation, the same
+ * every time
+ */
+std::string makeLines(int count) {
+
+	std::mt19937 random(Seed);
+	std::string text;
+
+	for (int i = 0; i < count; ++i) {
+		text.append(random() % 3, '\t');
+		text.append(10 + random() % 70, static_cast<char>('a' + random() % 26));
+		text.push_back('\n');
+	}
+
+	return text;
+}
+
+/**
+ * @brief makeBlock
+ * @param count
+ * @param line
+ * @return "count" lines which all read "line", to be used as a rectangle
+ */
+std::string makeBlock(int count, const std::string &line) {
+
+	std::string text;
+	for (int i = 0; i < count; ++i) {
+		text.append(line);
+		text.push_back('\n');
+	}
+
+	return text;
+}
+
+}
+
+/**
+ * @brief Benchmark::addBufferBenchmarks
+ * @param corpus
+ */
+void Benchmark::addBufferBenchmarks(const Corpus &corpus) {
+
+	auto text  = std::make_shared<const std::string>(corpus.text);
+	auto lines = std::make_shared<const std::string>(makeLines(RectLines));
+	auto block = std::make_shared<const std::string>(makeBlock(RectLines, "XYZ"));
+
+	// gap_buffer
+	auto gap = std::make_shared<gap_buffer<char>>();
+
+	auto resetGap = [gap, text]() {
+		gap->assign(*text);
+	};
+
+	auto typing = [gap]() {
+		int64_t pos = gap->size() / 2;
+		for (int i = 0; i < 65536; ++i) {
+			gap->insert(pos++, (i % 64 == 63) ? '\n' : 'x');
+		}
+	};
+
+	auto backspace = [gap]() {
+		int64_t pos = gap->size() / 2;
+		for (int i = 0; i < 65536 && pos > 0; ++i, --pos) {
+			gap->erase(pos - 1, pos);
+		}
+	};
+
+	auto randomEdits = [gap]() {
+		std::mt19937 random(Seed);
+		for (int i = 0; i < 10000; ++i) {
+			const auto pos = static_cast<int64_t>(random() % static_cast<uint64_t>(gap->size() - 8));
+			if (i % 2) {
+				gap->erase(pos, pos + 5);
+			} else {
+				gap->insert(pos, "word ");
+			}
+		}
+	};
+
+	// the gap is in the middle, so the text has to be moved to make it contiguous
+	auto splitGap = [gap, text]() {
+		gap->assign(*text);
+		gap->insert(gap->size() / 2, 'x');
+	};
+
+	auto toView = [gap]() {
+		keep(static_cast<int64_t>(gap->to_view().size()));
+	};
+
+	add("gap_buffer/typing", typing, resetGap);
+	add("gap_buffer/backspace", backspace, resetGap);
+	add("gap_buffer/random_edits", randomEdits, resetGap);
+	// reading every line of the text the way drawing does, the gap is left alone
+	auto segments = [gap]() {
+		int64_t count = 0;
+		for (int64_t pos = 0; pos < gap->size(); pos += 80) {
+			const auto lineSegments = gap->segments(pos, std::min(pos + 80, gap->size()));
+			count += static_cast<int64_t>(lineSegments.first.size() + lineSegments.second.size());
+		}
+		keep(count);
+	};
+
+	add("gap_buffer/to_view", toView, splitGap);
+	add("gap_buffer/segments", segments, splitGap);
+
+	// TextBuffer, reading
+	auto buffer = std::make_shared<TextBuffer>();
+	buffer->BufSetAll(*text);
+
+	auto countLines = [buffer]() {
+		int64_t count = 0;
+		for (int i = 0; i < 10; ++i) {
+			count += buffer->BufCountLines(buffer->BufStartOfBuffer(), buffer->BufEndOfBuffer());
+		}
+		keep(count);
+	};
+
+	auto countForwardLines = [buffer]() {
+		TextCursor pos = buffer->BufStartOfBuffer();
+		while (pos != buffer->BufEndOfBuffer()) {
+			pos = buffer->BufCountForwardNLines(pos, 100);
+		}
+		keep(to_integer(pos));
+	};
+
+	auto countBackwardLines = [buffer]() {
+		TextCursor pos = buffer->BufEndOfBuffer();
+		while (pos != buffer->BufStartOfBuffer()) {
+			pos = buffer->BufCountBackwardNLines(pos, 100);
+		}
+		keep(to_integer(pos));
+	};
+
+	auto countDispChars = [buffer]() {
+		int64_t count  = 0;
+		TextCursor pos = buffer->BufStartOfBuffer();
+		while (pos != buffer->BufEndOfBuffer()) {
+			const TextCursor end = buffer->BufEndOfLine(pos);
+			count += buffer->BufCountDispChars(pos, end);
+			pos = std::min(end + 1, buffer->BufEndOfBuffer());
+		}
+		keep(count);
+	};
+
+	add("text_buffer/count_lines", countLines);
+	add("text_buffer/count_forward_lines", countForwardLines);
+	add("text_buffer/count_backward_lines", countBackwardLines);
+	add("text_buffer/count_disp_chars", countDispChars);
+
+	// TextBuffer, display columns on a very wide line, as when moving the
+	// cursor up and down at its end and typing there now and then
+	auto wideBuffer = std::make_shared<TextBuffer>();
+
+	auto resetWide = [wideBuffer]() {
+		std::string line;
+		for (int i = 0; i < WideLineLength; ++i) {
+			line.push_back((i % 8 == 0) ? '\t' : 'x');
+		}
+
+		line.push_back('\n');
+		wideBuffer->BufSetAll(line + line);
+	};
+
+	auto wideLineColumns = [wideBuffer]() {
+		const TextCursor firstLine = wideBuffer->BufStartOfBuffer();
+		TextCursor secondLine      = wideBuffer->BufCountForwardNLines(firstLine, 1);
+		TextCursor lineStart       = firstLine;
+		TextCursor pos             = secondLine - 1;
+
+		for (int i = 0; i < 1000; ++i) {
+			const int64_t column = wideBuffer->BufCountDispChars(lineStart, pos);
+			lineStart            = (lineStart == firstLine) ? secondLine : firstLine;
+			pos                  = wideBuffer->BufCountForwardDispChars(lineStart, column);
+
+			if (i % 100 == 0) {
+				wideBuffer->BufInsert(pos, 'y');
+				if (pos < secondLine) {
+					++secondLine;
+				}
+			}
+		}
+
+		keep(to_integer(pos));
+	};
+
+	add("text_buffer/wide_line_columns", wideLineColumns, resetWide);
+
+	// TextBuffer, rectangular editing
+	auto rectBuffer = std::make_shared<TextBuffer>();
+
+	auto resetRect = [rectBuffer, lines]() {
+		rectBuffer->BufSetAll(*lines);
+	};
+
+	auto insertCol = [rectBuffer, block]() {
+		int64_t inserted;
+		int64_t deleted;
+		rectBuffer->BufInsertCol(20, rectBuffer->BufStartOfBuffer(), *block, &inserted, &deleted);
+		keep(inserted);
+	};
+
+	auto overlayRect = [rectBuffer, block]() {
+		int64_t inserted;
+		int64_t deleted;
+		rectBuffer->BufOverlayRect(rectBuffer->BufStartOfBuffer(), 20, 23, *block, &inserted, &deleted);
+		keep(inserted);
+	};
+
+	auto removeRect = [rectBuffer]() {
+		rectBuffer->BufRemoveRect(rectBuffer->BufStartOfBuffer(), rectBuffer->BufEndOfBuffer(), 10, 30);
+		keep(rectBuffer->length());
+	};
+
+	auto replaceRect = [rectBuffer, block]() {
+		rectBuffer->BufReplaceRect(rectBuffer->BufStartOfBuffer(), rectBuffer->BufEndOfBuffer(), 10, 30, *block);
+		keep(rectBuffer->length());
+	};
+
+	// the gap is in the middle of the rectangle, as it is after typing in it
+	auto resetRectWithGap = [rectBuffer, lines]() {
+		rectBuffer->BufSetAll(*lines);
+		rectBuffer->BufInsert(TextCursor(rectBuffer->length() / 2), "x");
+	};
+
+	auto textInRect = [rectBuffer]() {
+		keep(static_cast<int64_t>(rectBuffer->BufGetTextInRect(rectBuffer->BufStartOfBuffer(), rectBuffer->BufEndOfBuffer(), 10, 30).size()));
+	};
+
+	add("text_buffer/text_in_rect", textInRect, resetRectWithGap);
+	add("text_buffer/insert_col", insertCol, resetRect);
+	add("text_buffer/overlay_rect", overlayRect, resetRect);
+	add("text_buffer/remove_rect", removeRect, resetRect);
+	add("text_buffer/replace_rect", replaceRect, resetRect);
+}
@@ -0,0 +1,294 @@
+
+#include "Benchmark.h"
+#include "CompiledPatternSet.h"
+#include "DocumentWidget.h"
+#include "Highlight.h"
+#include "HighlightData.h"
+#include "PatternSet.h"
+#include "TextArea.h"
+#include "TextBuffer.h"
+#include "Verbosity.h"
+#include "WindowHighlightData.h"
+
+#include <QCoreApplication>
+#include <QImage>
+#include <QKeyEvent>
+#include <QScrollBar>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+/**
+ * @brief parse
+ * @param patterns
+ * @param text
+ * @param delimiters
+ * @return the number of characters which got a style, parsing all of "text"
+ * with the given patterns the way highlighting a whole document does
+ */
+int64_t parse(const HighlightData *patterns, view::string_view text, const QString &delimiters) {
+
+	std::string styles(text.size(), UNFINISHED_STYLE);
+	char *stylePtr = &styles[0];
+
+	int prev_char = -1;
+	Highlight::ParseContext ctx;
+	ctx.prev_char         = &prev_char;
+	ctx.delimiters        = delimiters;
+	ctx.text              = text;
+	const char *stringPtr = &ctx.text[0];
+
+	Highlight::parseString(
+		patterns,
+		stringPtr,
+		stylePtr,
+		static_cast<int64_t>(text.size()),
+		&ctx,
+		nullptr,
+		nullptr);
+
+	return static_cast<int64_t>(std::count_if(styles.begin(), styles.end(), [](char style) {
+		return static_cast<uint8_t>(style) != UNFINISHED_STYLE;
+	}));
+}
+
+/**
+ * @brief runMacro
+ * @param document
+ * @param macro
+ *
+ * Runs a macro to completion, the same way the Macro menu does
+ */
+void runMacro(DocumentWidget *document, const QString &macro) {
+
+	document->doMacro(macro, QLatin1String("benchmark macro"));
+
+	// long running macros are preempted to keep the user interface responsive
+	while (document->macroCmdData_) {
+		QCoreApplication::processEvents();
+	}
+}
+
+/**
+ * @brief typeKey
+ * @param area
+ * @param ch
+ *
+ * Sends "area" the key press which types "ch", the way the window system
+ * would
+ */
+void typeKey(TextArea *area, char ch) {
+
+	int key;
+	switch (ch) {
+	case '\n':
+		key = Qt::Key_Return;
+		break;
+	case '\t':
+		key = Qt::Key_Tab;
+		break;
+	case '\b':
+		key = Qt::Key_Backspace;
+		break;
+	default:
+		key = Qt::Key_unknown;
+		break;
+	}
+
+	QKeyEvent event(QEvent::KeyPress, key, Qt::NoModifier, (key == Qt::Key_unknown) ? QString(QLatin1Char(ch)) : QString());
+	QCoreApplication::sendEvent(area, &event);
+}
+
+const auto ArithmeticMacro = QLatin1String(
+	"total = 0\n"
+	"for (i = 0; i < 200000; i++) {\n"
+	"	total = total + (i * 3) % 7 - i / 5\n"
+	"}\n");
+
+const auto StringMacro = QLatin1String(
+	"s = \"\"\n"
+	"for (i = 0; i < 20000; i++) {\n"
+	"	s = s \"x\" i\n"
+	"}\n"
+	"n = 0\n"
+	"pos = search_string(s, \"99\", 0)\n"
+	"while (pos != -1) {\n"
+	"	n++\n"
+	"	pos = search_string(s, \"99\", pos + 1)\n"
+	"}\n");
+
+const auto ArrayMacro = QLatin1String(
+	"a = $empty_array\n"
+	"for (i = 0; i < 20000; i++) {\n"
+	"	a[\"key\" i] = i * 2\n"
+	"}\n"
+	"total = 0\n"
+	"for (k in a) {\n"
+	"	total = total + a[k]\n"
+	"}\n");
+
+// the kind of table split() and counting loops make, indexed by number
+const auto IndexedArrayMacro = QLatin1String(
+	"a = $empty_array\n"
+	"for (i = 0; i < 100000; i++) {\n"
+	"	a[i] = i\n"
+	"}\n"
+	"total = 0\n"
+	"for (i = 0; i < 100000; i++) {\n"
+	"	total = total + a[i]\n"
+	"}\n"
+	"for (k in a) {\n"
+	"	total = total - a[k]\n"
+	"}\n");
+
+// a word count, 100000 lookups in a table of 50000 string keys
+const auto WordCountMacro = QLatin1String(
+	"counts = $empty_array\n"
+	"for (i = 0; i < 100000; i++) {\n"
+	"	w = \"w\" ((i * 7919) % 50000)\n"
+	"	if (w in counts) {\n"
+	"		counts[w] = counts[w] + 1\n"
+	"	} else {\n"
+	"		counts[w] = 1\n"
+	"	}\n"
+	"}\n");
+
+const auto EditMacro = QLatin1String(
+	"set_cursor_pos(0)\n"
+	"for (i = 0; i < 2000; i++) {\n"
+	"	insert_string(\"line \" i \"\\n\")\n"
+	"}\n"
+	"for (i = 0; i < 500; i++) {\n"
+	"	replace_range(i * 20, i * 20 + 4, \"LINE\")\n"
+	"}\n");
+
+}
+
+/**
+ * @brief Benchmark::addEditorBenchmarks
+ * @param corpus
+ * @param document a document in the C++ language mode, shown in a window of
+ * a fixed size
+ */
+void Benchmark::addEditorBenchmarks(const Corpus &corpus, DocumentWidget *document) {
+
+	auto text = std::make_shared<const std::string>(corpus.text);
+
+	auto resetText = [document, text]() {
+		if (document->buffer()->BufAsString() != view::string_view(*text)) {
+			document->buffer()->BufSetAll(*text);
+		}
+	};
+
+	resetText();
+
+	// highlighting
+	std::shared_ptr<WindowHighlightData> highlightData = document->createHighlightData(Highlight::FindPatternSet(QLatin1String("C++")));
+	const QString delimiters                           = document->documentDelimiters();
+
+	std::shared_ptr<const CompiledPatternSet> patterns = highlightData ? highlightData->compiledPatterns : nullptr;
+
+	if (patterns && patterns->pass1Patterns) {
+		add("highlight/pass1", [patterns, text, delimiters]() {
+			keep(parse(&patterns->pass1Patterns[0], *text, delimiters));
+		});
+	}
+
+	if (patterns && patterns->pass2Patterns) {
+		add("highlight/pass2", [patterns, text, delimiters]() {
+			keep(parse(&patterns->pass2Patterns[0], *text, delimiters));
+		});
+	}
+
+	// every bundled language mode, most of which have long lists of keywords,
+	// on a part of the corpus so that it doesn't take too long
+	auto sample       = std::make_shared<const std::string>(corpus.text.substr(0, 64 * 1024));
+	auto languageSets = std::make_shared<std::vector<std::shared_ptr<const CompiledPatternSet>>>();
+
+	for (PatternSet &patternSet : Highlight::PatternSets) {
+		std::shared_ptr<WindowHighlightData> data = document->createHighlightData(&patternSet);
+		if (data && data->compiledPatterns->pass1Patterns) {
+			languageSets->push_back(data->compiledPatterns);
+		}
+	}
+
+	add("highlight/language_modes", [languageSets, sample, delimiters]() {
+		int64_t count = 0;
+		for (const std::shared_ptr<const CompiledPatternSet> &compiled : *languageSets) {
+			count += parse(&compiled->pass1Patterns[0], *sample, delimiters);
+			if (compiled->pass2Patterns) {
+				count += parse(&compiled->pass2Patterns[0], *sample, delimiters);
+			}
+		}
+		keep(count);
+	});
+
+	// compiling the patterns and highlighting the document in one go
+	auto startHighlighting = [document]() {
+		document->startHighlighting(Verbosity::Silent);
+	};
+
+	auto stopHighlighting = [document, resetText]() {
+		resetText();
+		document->stopHighlighting();
+	};
+
+	add("highlight/start", startHighlighting, stopHighlighting);
+
+	// drawing
+	TextArea *area = document->firstPane();
+	auto image     = std::make_shared<QImage>(area->viewport()->size(), QImage::Format_ARGB32_Premultiplied);
+
+	auto toTop = [area, resetText]() {
+		resetText();
+		area->verticalScrollBar()->setValue(area->verticalScrollBar()->minimum());
+	};
+
+	auto paint = [area, image]() {
+		area->viewport()->render(image.get());
+	};
+
+	auto scrollAndPaint = [area, image]() {
+		QScrollBar *scrollBar = area->verticalScrollBar();
+		const int steps       = 20;
+		for (int i = 0; i < steps; ++i) {
+			scrollBar->setValue(scrollBar->minimum() + (scrollBar->maximum() - scrollBar->minimum()) * i / (steps - 1));
+			area->viewport()->render(image.get());
+		}
+	};
+
+	add("text_area/paint", paint, toTop);
+	add("text_area/scroll_and_paint", scrollAndPaint, toTop);
+
+	// typing, painting after every key like the event loop would. With
+	// input latency tracking on, this also gives its numbers
+	auto keys = std::make_shared<const std::string>(corpus.keys);
+
+	auto typeAndPaint = [area, image, keys]() {
+		for (char ch : *keys) {
+			typeKey(area, ch);
+			area->viewport()->render(image.get());
+		}
+	};
+
+	auto startTyping = [document, area, toTop](IndentStyle indentStyle) {
+		toTop();
+		document->setAutoIndent(indentStyle);
+		area->TextSetCursorPos(document->buffer()->BufStartOfBuffer());
+	};
+
+	add("text_area/typing", typeAndPaint, [startTyping]() { startTyping(IndentStyle::Auto); });
+	add("text_area/typing_smart_indent", typeAndPaint, [startTyping]() { startTyping(IndentStyle::Smart); });
+
+	// macros
+	add("macro/arithmetic", [document]() { runMacro(document, ArithmeticMacro); });
+	add("macro/strings", [document]() { runMacro(document, StringMacro); });
+	add("macro/arrays", [document]() { runMacro(document, ArrayMacro); });
+	add("macro/indexed_arrays", [document]() { runMacro(document, IndexedArrayMacro); });
+	add("macro/word_count", [document]() { runMacro(document, WordCountMacro); });
+	add("macro/edits", [document]() { runMacro(document, EditMacro); }, resetText);
+}
@@ -0,0 +1,147 @@
+
+#include "Benchmark.h"
+#include "Highlight.h"
+#include "HighlightPattern.h"
+#include "PatternSet.h"
+#include "Preferences.h"
+#include "Regex.h"
+#include "RegexError.h"
+#include "Search.h"
+
+#include <memory>
+
+namespace {
+
+/**
+ * @brief patternCorpus
+ * @return the regular expressions of all of the highlight patterns, which is
+ * a good sample of the expressions the editor has to deal with
+ */
+std::vector<std::string> patternCorpus() {
+
+	std::vector<std::string> expressions;
+
+	auto addExpression = [&expressions](const QString &re) {
+		if (re.isEmpty()) {
+			return;
+		}
+
+		// some only compile as part of the pattern set they belong to
+		try {
+			std::string expression = re.toStdString();
+			Regex compiled(expression, REDFLT_STANDARD);
+			expressions.push_back(std::move(expression));
+		} catch (const RegexError &) {
+		}
+	};
+
+	for (const PatternSet &patternSet : Highlight::PatternSets) {
+		for (const HighlightPattern &pattern : patternSet.patterns) {
+			if (pattern.flags & COLOR_ONLY) {
+				continue;
+			}
+
+			addExpression(pattern.startRE);
+			addExpression(pattern.endRE);
+			addExpression(pattern.errorRE);
+		}
+	}
+
+	return expressions;
+}
+
+/**
+ * @brief languagePatterns
+ * @param languageMode
+ * @return the compiled start expressions of the highlight patterns of a
+ * language mode
+ */
+std::vector<std::shared_ptr<Regex>> languagePatterns(const QString &languageMode) {
+
+	std::vector<std::shared_ptr<Regex>> expressions;
+
+	PatternSet *patternSet = Highlight::FindPatternSet(languageMode);
+	if (!patternSet) {
+		return expressions;
+	}
+
+	for (const HighlightPattern &pattern : patternSet->patterns) {
+		if ((pattern.flags & COLOR_ONLY) || pattern.startRE.isEmpty()) {
+			continue;
+		}
+
+		try {
+			expressions.push_back(std::make_shared<Regex>(pattern.startRE.toStdString(), REDFLT_STANDARD));
+		} catch (const RegexError &) {
+		}
+	}
+
+	return expressions;
+}
+
+}
+
+/**
+ * @brief Benchmark::addSearchBenchmarks
+ * @param corpus
+ */
+void Benchmark::addSearchBenchmarks(const Corpus &corpus) {
+
+	auto text        = std::make_shared<const std::string>(corpus.text);
+	auto expressions = std::make_shared<const std::vector<std::string>>(patternCorpus());
+	auto patterns    = std::make_shared<const std::vector<std::shared_ptr<Regex>>>(languagePatterns(QLatin1String("C++")));
+
+	const QString delimiters = Preferences::GetPrefDelimiters();
+
+	// Regex
+	auto compile = [expressions]() {
+		int64_t size = 0;
+		for (const std::string &expression : *expressions) {
+			Regex compiled(expression, REDFLT_STANDARD);
+			size += static_cast<int64_t>(compiled.startp.size());
+		}
+		keep(size);
+	};
+
+	auto execute = [text, patterns]() {
+		int64_t count = 0;
+		for (const std::shared_ptr<Regex> &re : *patterns) {
+			size_t offset = 0;
+			while (offset < text->size() && re->execute(*text, offset, nullptr)) {
+				const size_t start = static_cast<size_t>(re->startp[0] - text->data());
+				const size_t end   = static_cast<size_t>(re->endp[0] - text->data());
+
+				offset = (end > start) ? end : start + 1;
+				++count;
+			}
+		}
+		keep(count);
+	};
+
+	add("regex/compile", compile);
+	add("regex/execute", execute);
+
+	// Search
+	auto findAll = [text, delimiters](const QString &searchString, SearchType searchType) {
+		int64_t count = 0;
+		int64_t pos   = 0;
+		while (boost::optional<Search::Result> result = Search::SearchString(*text, searchString, Direction::Forward, searchType, WrapMode::NoWrap, pos, delimiters)) {
+			pos = (result->end > result->start) ? result->end : result->start + 1;
+			++count;
+		}
+		keep(count);
+	};
+
+	auto replaceAll = [text, delimiters](const QString &searchString, const QString &replaceString, SearchType searchType) {
+		int64_t copyStart;
+		int64_t copyEnd;
+		boost::optional<std::string> replaced = Search::ReplaceAllInString(*text, searchString, replaceString, searchType, &copyStart, &copyEnd, delimiters);
+		keep(replaced ? static_cast<int64_t>(replaced->size()) : 0);
+	};
+
+	add("search/find_literal", [findAll]() { findAll(QLatin1String("return"), SearchType::CaseSense); });
+	add("search/find_case_insensitive", [findAll]() { findAll(QLatin1String("TEXTCURSOR"), SearchType::Literal); });
+	add("search/find_regex", [findAll]() { findAll(QLatin1String("<[A-Z][a-z]+[A-Z]\\w*>"), SearchType::Regex); });
+	add("search/replace_all_literal", [replaceAll]() { replaceAll(QLatin1String("return"), QLatin1String("yield"), SearchType::CaseSense); });
+	add("search/replace_all_regex", [replaceAll]() { replaceAll(QLatin1String("<([a-z]+)_([a-z]+)>"), QLatin1String("\\2_\\1"), SearchType::Regex); });
+}
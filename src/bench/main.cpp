@@ -0,0 +1,405 @@
+
+#include "Benchmark.h"
+#include "DocumentWidget.h"
+#include "FileSignature.h"
+#include "InputLatency.h"
+#include "MainWindow.h"
+#include "Preferences.h"
+#include "Regex.h"
+#include "Util/version.h"
+#include "interpret.h"
+#include "macro.h"
+#include "nedit.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+
+#include <boost/optional.hpp>
+
+#include <algorithm>
+#include <cstdio>
+
+bool IsServer = false;
+
+namespace {
+
+constexpr int DefaultSamples      = 10;
+constexpr double DefaultThreshold = 5.0;
+
+/* Relative to NEDIT_SOURCE_DIR. These change along with the rest of the tree,
+   so to compare commits which touch them, keep copies and pass those with
+   -corpus. The results record a hash of the corpus, and -compare warns if
+   it differs */
+const char *const DefaultCorpus[] = {
+	"src/TextArea.cpp",
+	"src/DocumentWidget.cpp",
+	"Regex/Execute.cpp",
+};
+
+/* Typed, one key per character, by the typing benchmarks unless -keys is
+   given. A newline is Return, a tab is Tab, and a backspace (\b) is
+   Backspace */
+const char DefaultKeys[] =
+	"int sum(const std::vector<int> &values) {\n"
+	"int total = 0;\n"
+	"for (int value : values) {\n"
+	"if (value < 0) {\n"
+	"continue;\n"
+	"}\n"
+	"total += valeu\b\bue;\n"
+	"}\n"
+	"return total;\n"
+	"}\n";
+
+/**
+ * @brief usage
+ */
+void usage() {
+	fputs("Usage: nedit-bench [-samples n] [-filter text] [-output file] [-corpus file]... [-keys file]\n"
+		  "       nedit-bench -compare baseline.json current.json [-threshold percent]\n"
+		  "\n"
+		  "  -samples n          time every benchmark n times (default 10)\n"
+		  "  -filter text        only run the benchmarks with text in their name\n"
+		  "  -output file        write the results to file instead of stdout\n"
+		  "  -corpus file        benchmark with file instead of the default corpus,\n"
+		  "                      may be given more than once\n"
+		  "  -keys file          type the contents of file in the typing benchmarks,\n"
+		  "                      one key per character\n"
+		  "  -compare a b        compare the results of two runs, and fail if any\n"
+		  "                      benchmark got slower by more than the threshold\n"
+		  "  -threshold percent  the threshold for -compare (default 5)\n",
+		  stderr);
+}
+
+/**
+ * @brief loadCorpus
+ * @param files
+ * @return the corpus made of "files", or boost::none if any of them can't be
+ * read
+ */
+boost::optional<Benchmark::Corpus> loadCorpus(const QStringList &files) {
+
+	Benchmark::Corpus corpus;
+
+	for (const QString &name : files) {
+
+		const QString path = QDir::isAbsolutePath(name) ? name : QStringLiteral("%1/%2").arg(QLatin1String(NEDIT_SOURCE_DIR), name);
+
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) {
+			fprintf(stderr, "nedit-bench: can't read %s\n", qPrintable(path));
+			return boost::none;
+		}
+
+		const QByteArray contents = file.readAll();
+		corpus.files.push_back(name.toStdString());
+		corpus.text.append(contents.data(), static_cast<size_t>(contents.size()));
+	}
+
+	return corpus;
+}
+
+/**
+ * @brief readResults
+ * @param filename
+ * @return the JSON object written by an earlier run
+ */
+boost::optional<QJsonObject> readResults(const QString &filename) {
+
+	QFile file(filename);
+	if (!file.open(QIODevice::ReadOnly)) {
+		fprintf(stderr, "nedit-bench: can't read %s\n", qPrintable(filename));
+		return boost::none;
+	}
+
+	QJsonParseError error;
+	const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+	if (!document.isObject()) {
+		fprintf(stderr, "nedit-bench: %s: %s\n", qPrintable(filename), qPrintable(error.errorString()));
+		return boost::none;
+	}
+
+	return document.object();
+}
+
+/**
+ * @brief compareResults
+ * @param baselineFile
+ * @param currentFile
+ * @param threshold
+ * @return EXIT_SUCCESS if no benchmark got slower by more than "threshold"
+ * percent (comparing the medians)
+ */
+int compareResults(const QString &baselineFile, const QString &currentFile, double threshold) {
+
+	const boost::optional<QJsonObject> baseline = readResults(baselineFile);
+	const boost::optional<QJsonObject> current  = readResults(currentFile);
+
+	if (!baseline || !current) {
+		return EXIT_FAILURE;
+	}
+
+	if ((*baseline)[QLatin1String("corpus")] != (*current)[QLatin1String("corpus")]) {
+		fputs("nedit-bench: warning, the runs used different corpora\n", stderr);
+	}
+
+	QHash<QString, double> baselineTimes;
+	for (const QJsonValue &value : (*baseline)[QLatin1String("benchmarks")].toArray()) {
+		const QJsonObject benchmark = value.toObject();
+		baselineTimes.insert(benchmark[QLatin1String("name")].toString(), benchmark[QLatin1String("median_ns")].toDouble());
+	}
+
+	int regressions = 0;
+
+	printf("%-36s %14s %14s %9s\n", "benchmark", "baseline (us)", "current (us)", "change");
+
+	for (const QJsonValue &value : (*current)[QLatin1String("benchmarks")].toArray()) {
+		const QJsonObject benchmark = value.toObject();
+		const QString name          = benchmark[QLatin1String("name")].toString();
+		const double time           = benchmark[QLatin1String("median_ns")].toDouble();
+
+		auto it = baselineTimes.find(name);
+		if (it == baselineTimes.end() || *it <= 0) {
+			printf("%-36s %14s %14.1f %9s\n", qPrintable(name), "-", time / 1000.0, "new");
+			continue;
+		}
+
+		const double change = (time - *it) * 100.0 / *it;
+		const bool slower   = change > threshold;
+
+		printf("%-36s %14.1f %14.1f %+8.1f%%%s\n", qPrintable(name), *it / 1000.0, time / 1000.0, change, slower ? "  SLOWER" : "");
+
+		if (slower) {
+			++regressions;
+		}
+	}
+
+	if (regressions != 0) {
+		printf("\n%d benchmark(s) got slower by more than %.1f%%\n", regressions, threshold);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/**
+ * @brief toJson
+ * @param result
+ * @return
+ */
+QJsonObject toJson(const Benchmark::Result &result) {
+
+	QJsonArray samples;
+	for (int64_t sample : result.samples) {
+		samples.append(static_cast<double>(sample));
+	}
+
+	QJsonObject object;
+	object[QLatin1String("name")]      = QString::fromStdString(result.name);
+	object[QLatin1String("min_ns")]    = static_cast<double>(result.min);
+	object[QLatin1String("median_ns")] = static_cast<double>(result.median);
+	object[QLatin1String("mean_ns")]     = static_cast<double>(result.mean);
+	object[QLatin1String("allocations")] = static_cast<double>(result.allocations);
+	object[QLatin1String("samples")]     = samples;
+	return object;
+}
+
+/**
+ * @brief toJson
+ * @param corpus
+ * @return a description of the corpus, which tells whether two runs worked
+ * on the same text
+ */
+QJsonObject toJson(const Benchmark::Corpus &corpus) {
+
+	QJsonArray files;
+	for (const std::string &file : corpus.files) {
+		files.append(QString::fromStdString(file));
+	}
+
+	const FileSignature signature = FileSignature::of(corpus.text);
+
+	QJsonObject object;
+	object[QLatin1String("files")] = files;
+	object[QLatin1String("size")]  = static_cast<double>(signature.size);
+	object[QLatin1String("hash")]  = QString::number(signature.hash, 16);
+	object[QLatin1String("keys")]  = QString::number(FileSignature::of(corpus.keys).hash, 16);
+	return object;
+}
+
+/**
+ * @brief toJson
+ * @param summary
+ * @return
+ */
+QJsonObject toJson(const InputLatency::Summary &summary) {
+
+	QJsonObject object;
+	object[QLatin1String("stage")]  = QLatin1String(InputLatency::stageName(summary.stage));
+	object[QLatin1String("keys")]   = static_cast<double>(summary.count);
+	object[QLatin1String("p50_us")] = static_cast<double>(summary.p50);
+	object[QLatin1String("p99_us")] = static_cast<double>(summary.p99);
+	object[QLatin1String("max_us")] = static_cast<double>(summary.max);
+	return object;
+}
+
+}
+
+/**
+ * @brief main
+ * @param argc
+ * @param argv
+ * @return
+ *
+ * Runs the benchmarks and writes their results as JSON, or compares the
+ * results of two runs. Every benchmark is timed on its own, several times,
+ * and the median is what -compare looks at.
+ */
+int main(int argc, char *argv[]) {
+
+	// draw without a display, so that the results don't depend on one
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
+	QApplication app(argc, argv);
+
+	int samples      = DefaultSamples;
+	double threshold = DefaultThreshold;
+	QString filter;
+	QString output;
+	QStringList corpusFiles;
+	QStringList compare;
+	QString keysFile;
+
+	const QStringList args = app.arguments();
+	for (int i = 1; i < args.size(); ++i) {
+
+		const QString arg = args[i];
+		const bool hasArg = i + 1 < args.size();
+
+		if (arg == QLatin1String("-samples") && hasArg) {
+			samples = std::max(1, args[++i].toInt());
+		} else if (arg == QLatin1String("-filter") && hasArg) {
+			filter = args[++i];
+		} else if (arg == QLatin1String("-output") && hasArg) {
+			output = args[++i];
+		} else if (arg == QLatin1String("-corpus") && hasArg) {
+			corpusFiles.append(args[++i]);
+		} else if (arg == QLatin1String("-keys") && hasArg) {
+			keysFile = args[++i];
+		} else if (arg == QLatin1String("-threshold") && hasArg) {
+			threshold = args[++i].toDouble();
+		} else if (arg == QLatin1String("-compare") && i + 2 < args.size()) {
+			compare.append(args[++i]);
+			compare.append(args[++i]);
+		} else {
+			usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!compare.isEmpty()) {
+		return compareResults(compare[0], compare[1], threshold);
+	}
+
+	if (corpusFiles.isEmpty()) {
+		for (const char *file : DefaultCorpus) {
+			corpusFiles.append(QLatin1String(file));
+		}
+	}
+
+	boost::optional<Benchmark::Corpus> corpus = loadCorpus(corpusFiles);
+	if (!corpus) {
+		return EXIT_FAILURE;
+	}
+
+	if (keysFile.isEmpty()) {
+		corpus->keys = DefaultKeys;
+	} else {
+		QFile file(keysFile);
+		if (!file.open(QIODevice::ReadOnly)) {
+			fprintf(stderr, "nedit-bench: can't read %s\n", qPrintable(keysFile));
+			return EXIT_FAILURE;
+		}
+
+		corpus->keys = file.readAll().toStdString();
+	}
+
+	// run with the default preferences, not those of whoever runs the benchmarks
+	QTemporaryDir home;
+	qputenv("NEDIT_NG_HOME", home.path().toLocal8Bit());
+
+	InitMacroGlobals();
+	RegisterMacroSubroutines();
+	Preferences::RestoreNEditPrefs();
+	Regex::SetDefaultWordDelimiters(Preferences::GetPrefDelimiters().toStdString());
+
+	// the window gets the default size, so the amount of text drawn only
+	// depends on the font
+	DocumentWidget *document = MainWindow::editNewFile(nullptr, QString(), false, QLatin1String("C++"));
+	QCoreApplication::processEvents();
+
+	Benchmark::addBufferBenchmarks(*corpus);
+	Benchmark::addSearchBenchmarks(*corpus);
+	Benchmark::addEditorBenchmarks(*corpus, document);
+
+	// the typing benchmarks go through the same paths as a user typing
+	InputLatency::setEnabled(true);
+
+	QJsonArray benchmarks;
+	for (const Benchmark::Case &benchmark : Benchmark::cases()) {
+		if (!filter.isEmpty() && !QString::fromStdString(benchmark.name).contains(filter)) {
+			continue;
+		}
+
+		const Benchmark::Result result = Benchmark::measure(benchmark, samples);
+		fprintf(stderr, "%-36s %12.1f us %10lld allocations\n", result.name.c_str(), static_cast<double>(result.median) / 1000.0, static_cast<long long>(result.allocations));
+
+		benchmarks.append(toJson(result));
+	}
+
+	QJsonArray latency;
+	for (const InputLatency::Summary &summary : InputLatency::summaries()) {
+		fprintf(stderr, "latency/%-28s p50 %9.1f us  p99 %9.1f us  max %9.1f us\n",
+				InputLatency::stageName(summary.stage),
+				static_cast<double>(summary.p50),
+				static_cast<double>(summary.p99),
+				static_cast<double>(summary.max));
+
+		latency.append(toJson(summary));
+	}
+
+	QJsonObject results;
+	results[QLatin1String("format")]     = 1;
+	results[QLatin1String("version")]    = NEDIT_VERSION;
+#ifdef NEDIT_COMMIT_GIT
+	results[QLatin1String("commit")]     = QLatin1String(NEDIT_COMMIT_GIT);
+#endif
+	results[QLatin1String("qt")]         = QLatin1String(qVersion());
+	results[QLatin1String("samples")]    = samples;
+	results[QLatin1String("corpus")]     = toJson(*corpus);
+	results[QLatin1String("benchmarks")] = benchmarks;
+	results[QLatin1String("latency")]    = latency;
+
+	const QByteArray json = QJsonDocument(results).toJson();
+
+	if (output.isEmpty()) {
+		fwrite(json.data(), 1, static_cast<size_t>(json.size()), stdout);
+	} else {
+		QFile file(output);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+			fprintf(stderr, "nedit-bench: can't write %s\n", qPrintable(output));
+			return EXIT_FAILURE;
+		}
+	}
+
+	CleanupMacroGlobals();
+	return EXIT_SUCCESS;
+}
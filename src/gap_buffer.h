@@ -10,6 +10,7 @@
 #include <cassert>
 #include <memory>
 #include <string>
+#include <utility>
 
 template <class Ch, class Tr>
 class gap_buffer {
@@ -78,6 +79,7 @@ public:
 	string_type to_string(size_type start, size_type end) const;
 	view_type to_view() noexcept;
 	view_type to_view(size_type start, size_type end) noexcept;
+	std::pair<view_type, view_type> segments(size_type start, size_type end) const noexcept;
 
 public:
 	void append(view_type str);
@@ -309,20 +311,39 @@ auto gap_buffer<Ch, Tr>::to_view(size_type start, size_type end) noexcept -> vie
 	assert(end <= size() && end >= 0);
 	assert(start <= end);
 
-	const size_type bufLen   = size();
-	size_type leftLen        = gap_start_;
-	const size_type rightLen = bufLen - leftLen;
+	// move the gap out of the range, to whichever end of it is closer
+	if (start < gap_start_ && gap_start_ < end) {
+		move_gap((gap_start_ - start < end - gap_start_) ? start : end);
+	}
 
-	// find where best to put the gap to minimise memory movement
-	if (leftLen != 0 && rightLen != 0) {
-		leftLen = (leftLen < rightLen) ? 0 : bufLen;
-		move_gap(leftLen);
+	if (end <= gap_start_) {
+		return view_type(&buf_[start], static_cast<size_t>(end - start));
 	}
 
-	// get the start position of the actual data
-	Ch *const text = &buf_[(leftLen == 0) ? gap_end_ : 0];
+	return view_type(&buf_[start + gap_size()], static_cast<size_t>(end - start));
+}
+
+/**
+ * the text between start and end the way it is stored, the part before the
+ * gap and the part after it, without copying or moving anything. One of them
+ * is empty unless the range spans the gap
+ */
+template <class Ch, class Tr>
+auto gap_buffer<Ch, Tr>::segments(size_type start, size_type end) const noexcept -> std::pair<view_type, view_type> {
+
+	assert(start <= size() && start >= 0);
+	assert(end <= size() && end >= 0);
+	assert(start <= end);
+
+	if (end <= gap_start_) {
+		return {view_type(&buf_[start], static_cast<size_t>(end - start)), view_type()};
+	}
+
+	if (start >= gap_start_) {
+		return {view_type(), view_type(&buf_[start + gap_size()], static_cast<size_t>(end - start))};
+	}
 
-	return view_type(text + start, static_cast<size_t>(end - start));
+	return {view_type(&buf_[start], static_cast<size_t>(gap_start_ - start)), view_type(&buf_[gap_end_], static_cast<size_t>(end - gap_start_))};
 }
 
 /**
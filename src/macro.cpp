@@ -10,6 +10,7 @@
 #include "HighlightPattern.h"
 #include "MainWindow.h"
 #include "Preferences.h"
+#include "Profiler.h"
 #include "RangesetTable.h"
 #include "Search.h"
 #include "SearchType.h"
@@ -2031,6 +2032,52 @@ std::error_code clipboardToStringMS(DocumentWidget *document, Arguments argument
 	return MacroErrorCode::Success;
 }
 
+/*
+** Built-in macro subroutines for profiling macros. Starting throws away any
+** earlier profile, and the report is available until the next start
+*/
+std::error_code macroProfileStartMS(DocumentWidget *document, Arguments arguments, DataValue *result) {
+
+	Q_UNUSED(document)
+
+	if (!arguments.empty()) {
+		return MacroErrorCode::WrongNumberOfArguments;
+	}
+
+	Profiler::start();
+	MainWindow::updateMenuItems();
+
+	*result = make_value();
+	return MacroErrorCode::Success;
+}
+
+std::error_code macroProfileStopMS(DocumentWidget *document, Arguments arguments, DataValue *result) {
+
+	Q_UNUSED(document)
+
+	if (!arguments.empty()) {
+		return MacroErrorCode::WrongNumberOfArguments;
+	}
+
+	Profiler::stop();
+	MainWindow::updateMenuItems();
+
+	*result = make_value();
+	return MacroErrorCode::Success;
+}
+
+std::error_code macroProfileReportMS(DocumentWidget *document, Arguments arguments, DataValue *result) {
+
+	Q_UNUSED(document)
+
+	if (!arguments.empty()) {
+		return MacroErrorCode::WrongNumberOfArguments;
+	}
+
+	*result = make_value(Profiler::report());
+	return MacroErrorCode::Success;
+}
+
 /*
 ** Built-in macro subroutine for reading the contents of a text file into
 ** a string.  On success, returns 1 in $readStatus, and the contents of the
@@ -5041,6 +5088,9 @@ const SubRoutine MacroSubrs[] = {
 	{"shell_command", shellCmdMS},
 	{"string_to_clipboard", stringToClipboardMS},
 	{"clipboard_to_string", clipboardToStringMS},
+	{"macro_profile_start", macroProfileStartMS},
+	{"macro_profile_stop", macroProfileStopMS},
+	{"macro_profile_report", macroProfileReportMS},
 	{"toupper", toupperMS},
 	{"tolower", tolowerMS},
 	{"list_dialog", listDialogMS},
@@ -5306,7 +5356,7 @@ bool readCheckMacroString(QWidget *dialogParent, const QString &string, Document
 			if (runDocument) {
 
 				if (!runDocument->macroCmdData_) {
-					runDocument->runMacro(prog);
+					runDocument->runMacro(std::shared_ptr<Program>(prog), errIn);
 				} else {
 					/*  If we come here this means that the string was parsed
 						from within another macro via load_macro_file(). In
@@ -5331,11 +5381,9 @@ bool readCheckMacroString(QWidget *dialogParent, const QString &string, Document
 		Program *const prog = progStack.top();
 		progStack.pop();
 
-		RunMacroAsSubrCall(prog);
-
-		// TODO(eteran): OK, I'm pretty sure this is a memory leak. We CAN'T delete prog quite yet,
-		// because despite the name, "RunMacroAsSubrCall" doesn't run anything, it just sets up the
-		// code for execution... but no one is tracking this pointer anymore :-/.
+		/* Despite the name, "RunMacroAsSubrCall" doesn't run anything, it just
+		   sets up the code for execution, so the running macro keeps it */
+		runDocument->runMacro(std::shared_ptr<Program>(prog), errIn);
 	}
 
 	return true;
@@ -4,6 +4,7 @@
 
 #include <QTimer>
 #include <memory>
+#include <vector>
 
 class DocumentWidget;
 class MainWindow;
@@ -32,7 +33,8 @@ struct MacroCommandData {
 	bool bannerIsUp        = false;
 	bool closeOnCompletion = false;
 	std::shared_ptr<MacroContext> context;
-	std::unique_ptr<Program> program;
+	std::shared_ptr<Program> program;
+	std::vector<std::shared_ptr<Program>> subroutines; // programs started while this one runs, kept until it is done
 };
 
 #endif
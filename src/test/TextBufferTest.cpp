@@ -0,0 +1,283 @@
+
+#include "TextBuffer.h"
+#include "TextRange.h"
+
+#include <QApplication>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+
+namespace {
+
+enum class Operation {
+	InsertCol,
+	OverlayRect,
+	RemoveRect,
+	ReplaceRect,
+};
+
+struct RectTest {
+	const char *name;
+	view::string_view text;
+	int tabDist;
+	bool useTabs;
+	int64_t gap; // where the gap of the buffer is left before the edit, -1 for the end
+	Operation operation;
+	int64_t start;
+	int64_t end; // -1 for the end of the buffer
+	int64_t rectStart;
+	int64_t rectEnd;
+	view::string_view insert;
+	view::string_view expected;
+	int64_t charsInserted;
+	int64_t charsDeleted;
+};
+
+// tabs before, in and after the rectangle, and lines which end before it
+const view::string_view Tabs       = "one\ttwo\tthree\nfour\nfive\tsix\tseven\n\tindented\nx\n";
+const view::string_view ShortLines = "abcdefghij\nab\n\nabcdefghijklmnop\n";
+
+/* Every change is replayed on a copy of the text from what the modify
+   callbacks are told, so that a change which is reported wrongly (which the
+   undo list and the highlighting would then get wrong) fails as well */
+struct Shadow {
+	TextBuffer *buffer;
+	std::string text;
+	bool valid = true;
+};
+
+void shadowModified(TextCursor pos, int64_t nInserted, int64_t nDeleted, int64_t nRestyled, view::string_view deletedText, void *user) {
+
+	Q_UNUSED(nRestyled)
+
+	auto shadow = static_cast<Shadow *>(user);
+
+	const auto offset = static_cast<size_t>(to_integer(pos));
+	if (shadow->text.compare(offset, static_cast<size_t>(nDeleted), deletedText.data(), deletedText.size()) != 0) {
+		shadow->valid = false;
+		return;
+	}
+
+	shadow->text.replace(offset, static_cast<size_t>(nDeleted), shadow->buffer->BufGetRange(pos, pos + nInserted));
+}
+
+int test_rect(const RectTest &test) {
+
+	TextBuffer buffer;
+	buffer.BufSetTabDistance(test.tabDist, false);
+	buffer.BufSetUseTabs(test.useTabs);
+	buffer.BufSetAll(test.text);
+
+	// an insert moves the gap to where it is made
+	const TextCursor gap = (test.gap == -1) ? buffer.BufEndOfBuffer() : TextCursor(test.gap);
+	buffer.BufInsert(gap, "#");
+	buffer.BufRemove(gap, gap + 1);
+
+	Shadow shadow{&buffer, buffer.BufGetAll()};
+	buffer.BufAddModifyCB(shadowModified, &shadow);
+
+	const TextCursor start = TextCursor(test.start);
+	const TextCursor end   = (test.end == -1) ? buffer.BufEndOfBuffer() : TextCursor(test.end);
+
+	int64_t charsInserted = 0;
+	int64_t charsDeleted  = 0;
+
+	switch (test.operation) {
+	case Operation::InsertCol:
+		buffer.BufInsertCol(test.rectStart, start, test.insert, &charsInserted, &charsDeleted);
+		break;
+	case Operation::OverlayRect:
+		buffer.BufOverlayRect(start, test.rectStart, test.rectEnd, test.insert, &charsInserted, &charsDeleted);
+		break;
+	case Operation::RemoveRect:
+		buffer.BufRemoveRect(start, end, test.rectStart, test.rectEnd);
+		break;
+	case Operation::ReplaceRect:
+		buffer.BufReplaceRect(start, end, test.rectStart, test.rectEnd, test.insert);
+		break;
+	}
+
+	buffer.BufRemoveModifyCB(shadowModified, &shadow);
+
+	const std::string result = buffer.BufGetAll();
+
+	if (result != test.expected || charsInserted != test.charsInserted || charsDeleted != test.charsDeleted) {
+		std::cerr << "Rectangle Test Failed: " << test.name << std::endl;
+		return -1;
+	}
+
+	if (!shadow.valid || shadow.text != result) {
+		std::cerr << "Rectangle Test Reported The Wrong Change: " << test.name << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+struct RebaseTest {
+	const char *name;
+	int64_t start;
+	int64_t end;                // start == end for an insertion
+	view::string_view insert;
+	bool rangeKept;             // whether [RangeStart, RangeEnd) can be carried over the edit
+	int64_t expectedRangeStart; // and where it is then
+	int64_t expectedCursor;     // where CursorPos is carried to
+};
+
+// the range and the position which the edits are made around
+constexpr int64_t RangeStart = 3;
+constexpr int64_t RangeEnd   = 6;
+constexpr int64_t CursorPos  = 4;
+
+int test_rebase(const RebaseTest &test) {
+
+	TextBuffer buffer;
+	buffer.BufSetAll("0123456789");
+
+	boost::optional<TextRange> range;
+	boost::optional<TextCursor> cursor;
+	uint64_t version;
+
+	{
+		const TextBuffer::Snapshot snapshot = buffer.BufSnapshot();
+		version                             = snapshot.version();
+
+		if (test.start == test.end) {
+			buffer.BufInsert(TextCursor(test.start), test.insert);
+		} else {
+			buffer.BufRemove(TextCursor(test.start), TextCursor(test.end));
+		}
+
+		range  = buffer.BufRebase(TextRange{TextCursor(RangeStart), TextCursor(RangeEnd)}, version);
+		cursor = buffer.BufRebase(TextCursor(CursorPos), version);
+	}
+
+	const bool rangeRight = test.rangeKept
+								? (range && range->start == TextCursor(test.expectedRangeStart) && range->end - range->start == RangeEnd - RangeStart)
+								: !range;
+
+	if (!rangeRight || !cursor || *cursor != TextCursor(test.expectedCursor)) {
+		std::cerr << "Rebase Test Failed: " << test.name << std::endl;
+		return -1;
+	}
+
+	// without a snapshot of the version, the edits since then are forgotten
+	buffer.BufInsert(buffer.BufStartOfBuffer(), "x");
+	if (buffer.BufRebase(TextCursor(CursorPos), version)) {
+		std::cerr << "Rebase Test Kept Its Edits: " << test.name << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Lines are counted on both sides of the buffer's gap, so every range is
+   counted with the gap at every position, against counting the plain text */
+int test_count_lines() {
+
+	const std::string text = "ab\ncd\n\nef\ng";
+	const auto length      = static_cast<int64_t>(text.size());
+
+	for (int64_t gap = 0; gap <= length; ++gap) {
+		TextBuffer buffer;
+		buffer.BufSetAll(text);
+		buffer.BufInsert(TextCursor(gap), "#");
+		buffer.BufRemove(TextCursor(gap), TextCursor(gap + 1));
+
+		for (int64_t start = 0; start <= length; ++start) {
+			for (int64_t end = start; end <= length; ++end) {
+				const auto expected = std::count(text.begin() + start, text.begin() + end, '\n');
+				if (buffer.BufCountLines(TextCursor(start), TextCursor(end)) != expected) {
+					std::cerr << "Count Lines Test Failed: gap " << gap << ", " << start << " to " << end << std::endl;
+					return -1;
+				}
+			}
+
+			for (int64_t nLines = 0; nLines <= 5; ++nLines) {
+				int64_t expected = start;
+				for (int64_t n = 0; n < nLines && expected < length; ++n) {
+					const size_t newline = text.find('\n', static_cast<size_t>(expected));
+					expected             = (newline == std::string::npos) ? length : static_cast<int64_t>(newline) + 1;
+				}
+
+				if (buffer.BufCountForwardNLines(TextCursor(start), nLines) != TextCursor(expected)) {
+					std::cerr << "Count Forward Lines Test Failed: gap " << gap << ", " << nLines << " from " << start << std::endl;
+					return -1;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+
+	// the buffer may talk to the clipboard, which needs an application, but not a display
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+	}
+
+	QApplication app(argc, argv);
+
+	// with the gap before, inside and after the rectangle
+	static const RectTest tests[] = {
+		{"insert_col/tabs", Tabs, 8, true, 0, Operation::InsertCol, 0, 0, 6, 0, "AB\nCD\nEF\nGH\nIJ\n", "one   AB  two\t  three\nfour  CD\nfive  EF  six\t  seven\n      GH  indented\nx     IJ\n", 81, 46},
+		{"insert_col/tabs_no_use_tabs", Tabs, 4, false, 0, Operation::InsertCol, 0, 0, 6, 0, "AB\nCD\nEF\nGH\nIJ\n", "one\ttwABo three\nfour  CD\nfive  EF  six seven\n\tinGHdented\nx     IJ\n", 66, 46},
+		{"insert_col/past_short_lines", ShortLines, 8, true, 0, Operation::InsertCol, 0, 0, 12, 0, "1\n2\n3\n4\n", "abcdefghij  1\nab\t    2\n\t    3\nabcdefghijkl4mnop\n", 48, 32},
+		{"insert_col/more_lines_than_buffer", ShortLines, 8, true, 0, Operation::InsertCol, 11, 0, 1, 0, "1\n2\n3\n4\n5\n6\n", "abcdefghij\na1b\n 2\na3bcdefghijklmnop\n 4\n 5\n 6\n", 34, 21},
+		{"insert_col/gap_in_rect", Tabs, 8, true, 20, Operation::InsertCol, 0, 0, 6, 0, "AB\nCD\nEF\nGH\nIJ\n", "one   AB  two\t  three\nfour  CD\nfive  EF  six\t  seven\n      GH  indented\nx     IJ\n", 81, 46},
+		{"insert_col/gap_at_end", ShortLines, 8, true, -1, Operation::InsertCol, 0, 0, 3, 0, "xx\nyy\nzz\n", "abcxxdefghij\nab yy\n   zz\nabc  defghijklmnop\n", 43, 31},
+		{"overlay/tabs", Tabs, 8, true, 0, Operation::OverlayRect, 0, 0, 2, 7, "AB\nCD\nEF\nGH\nIJ\n", "onAB\ttwo\tthree\nfoCD\nfiEF\tsix\tseven\n  GH\tindented\nx IJ\n", 54, 46},
+		{"overlay/open_right", Tabs, 4, true, 0, Operation::OverlayRect, 0, 0, 5, -1, "AB\nCD\nEF\nGH\nIJ\n", "one\ttAB\tthree\nfour CD\nfive EF six\tseven\n\tiGHented\nx\t IJ\n", 56, 46},
+		{"overlay/short_lines", ShortLines, 8, true, 0, Operation::OverlayRect, 0, 0, 4, 8, "1\n2\n3\n4\n", "abcd1\tij\nab  2\n    3\nabcd4\tijklmnop\n", 36, 32},
+		{"overlay/gap_at_rect_start", ShortLines, 8, true, 15, Operation::OverlayRect, 11, 0, 1, 3, "x\ny\n", "abcdefghij\nax\n y\na  defghijklmnop\n", 22, 20},
+		{"remove/tabs", Tabs, 8, true, 0, Operation::RemoveRect, 0, -1, 3, 9, "", "onewo\t  three\nfou\nfivix\t  seven\n   ndented\nx\n", 0, 0},
+		{"remove/no_use_tabs", Tabs, 4, false, 0, Operation::RemoveRect, 0, -1, 3, 9, "", "onehree\nfou\nfivix seven\n   ted\nx\n", 0, 0},
+		{"remove/short_lines", ShortLines, 8, true, 0, Operation::RemoveRect, 0, -1, 2, 12, "", "ab\nab\n\nabmnop\n", 0, 0},
+		{"remove/gap_in_rect", ShortLines, 8, true, 5, Operation::RemoveRect, 0, -1, 2, 12, "", "ab\nab\n\nabmnop\n", 0, 0},
+		{"remove/gap_at_end", Tabs, 8, true, -1, Operation::RemoveRect, 4, 30, 0, 5, "", "   two     three\n\n   six     seven\n\tindented\nx\n", 0, 0},
+		{"replace/tabs", Tabs, 8, true, 0, Operation::ReplaceRect, 0, -1, 3, 9, "AB\nCD\nEF\nGH\nIJ\n", "oneABwo     three\nfouCD\nfivEFix     seven\n   GHndented\nx  IJ\n", 0, 0},
+		{"replace/fewer_lines", Tabs, 8, true, 0, Operation::ReplaceRect, 0, -1, 3, 9, "AB\nCD\n", "oneABwo     three\nfouCD\nfiv  ix     seven\n     ndented\nx\n", 0, 0},
+		{"replace/more_lines", ShortLines, 8, true, 0, Operation::ReplaceRect, 0, -1, 1, 4, "1\n2\n3\n4\n5\n6\n", "a1efghij\na2\n 3\na4efghijklmnop\n 5\n 6\n", 0, 0},
+		{"replace/short_lines", ShortLines, 4, false, 0, Operation::ReplaceRect, 0, -1, 5, 20, "abc\n\tx\n", "abcdeabc\nab       x\n\nabcde\n", 0, 0},
+		{"replace/gap_in_rect", Tabs, 8, true, 25, Operation::ReplaceRect, 0, -1, 3, 9, "AB\nCD\nEF\nGH\nIJ\n", "oneABwo     three\nfouCD\nfivEFix     seven\n   GHndented\nx  IJ\n", 0, 0},
+	};
+
+	// inserting and deleting before, inside and after the range
+	static const RebaseTest rebaseTests[] = {
+		{"insert/before", 1, 1, "ab", true, 5, 6},
+		{"insert/at_start", 3, 3, "ab", true, 5, 6},
+		{"insert/inside", 4, 4, "ab", false, 0, 6},
+		{"insert/at_end", 6, 6, "ab", true, 3, 4},
+		{"insert/after", 8, 8, "ab", true, 3, 4},
+		{"remove/before", 0, 2, "", true, 1, 2},
+		{"remove/up_to_start", 1, 3, "", true, 1, 2},
+		{"remove/over_start", 2, 4, "", false, 0, 2},
+		{"remove/inside", 4, 5, "", false, 0, 4},
+		{"remove/over_end", 5, 8, "", false, 0, 4},
+		{"remove/after", 7, 9, "", true, 3, 4},
+	};
+
+	int result = 0;
+	for (const RectTest &test : tests) {
+		if (test_rect(test) != 0) {
+			result = -1;
+		}
+	}
+
+	for (const RebaseTest &test : rebaseTests) {
+		if (test_rebase(test) != 0) {
+			result = -1;
+		}
+	}
+
+	if (test_count_lines() != 0) {
+		result = -1;
+	}
+
+	return result;
+}
@@ -440,7 +440,7 @@ void loadMacroMenuYaml(std::vector<MenuData> &menuItems) {
 			});
 
 			if (it2 == menuItems.end()) {
-				menuItems.push_back({menuItem, nullptr});
+				menuItems.push_back({menuItem, nullptr, nullptr});
 			} else {
 				it2->item = menuItem;
 			}
@@ -524,7 +524,7 @@ void loadShellMenuYaml(std::vector<MenuData> &menuItems) {
 			});
 
 			if (it2 == menuItems.end()) {
-				menuItems.push_back({menuItem, nullptr});
+				menuItems.push_back({menuItem, nullptr, nullptr});
 			} else {
 				it2->item = menuItem;
 			}
@@ -578,7 +578,7 @@ void loadContextMenuYaml(std::vector<MenuData> &menuItems) {
 			});
 
 			if (it2 == menuItems.end()) {
-				menuItems.push_back({menuItem, nullptr});
+				menuItems.push_back({menuItem, nullptr, nullptr});
 			} else {
 				it2->item = menuItem;
 			}
@@ -628,7 +628,7 @@ void loadMenuItemString(const QString &inString, std::vector<MenuData> &menuItem
 			});
 
 			if (it == menuItems.end()) {
-				menuItems.push_back({*f, nullptr});
+				menuItems.push_back({*f, nullptr, nullptr});
 			} else {
 				it->item = *f;
 			}
@@ -842,7 +842,8 @@ void parse_menu_item_list(std::vector<MenuData> &itemList) {
 	/* 1st pass: setup user menu info: extract language modes, menu name &
 	   default indication; build user menu ID */
 	for (MenuData &data : itemList) {
-		data.info = parseMenuItemRec(data.item);
+		data.info    = parseMenuItemRec(data.item);
+		data.program = nullptr;
 	}
 
 	// 2nd pass: solve "default" dependencies